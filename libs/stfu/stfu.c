@@ -48,25 +48,23 @@
 
 static int stfu_log_level = 7;
 
-struct stfu_queue {
-	struct stfu_frame *array;
-	struct stfu_frame int_frame;
-	uint32_t real_array_size;
-	uint32_t array_size;
-	uint32_t array_len;	
-	uint32_t wr_len;
-    uint32_t last_index;
-    int32_t last_jitter;
+/* one slot per slot_ts samples, counted from ref_ts so the index runs on across the 32 bit ts wrap */
+struct stfu_slot {
+    struct stfu_frame frame;
+    uint32_t gen;
 };
-typedef struct stfu_queue stfu_queue_t;
+typedef struct stfu_slot stfu_slot_t;
 
 struct stfu_instance {
-	struct stfu_queue a_queue;
-	struct stfu_queue b_queue;
-	struct stfu_queue c_queue;
-	struct stfu_queue *in_queue;
-	struct stfu_queue *out_queue;
-	struct stfu_queue *old_queue;
+    struct stfu_slot *ring;
+    uint32_t ring_size;
+    uint32_t gen;
+    uint32_t in_count;
+    uint32_t slot_ts;
+    uint32_t ref_ts;
+    int32_t oldest_pos;
+    uint8_t ref_set;
+    struct stfu_frame int_frame;
     struct stfu_frame *last_frame;
 	uint32_t cur_ts;
 	uint32_t last_wr_ts;
@@ -118,6 +116,13 @@ struct stfu_instance {
     uint32_t plc_pt;
     uint32_t diff;
     uint32_t diff_total;
+
+    /* interarrival jitter as in rfc3550, in samples scaled by 16 */
+    uint32_t jitter;
+    uint32_t jitter_timer_ts;
+    uint32_t jitter_ts;
+    uint8_t jitter_ref;
+
     uint8_t ready;
     uint8_t debug;
 
@@ -162,36 +167,123 @@ void stfu_global_set_default_logger(int level)
 }
 
 
+/* a stream stepping its ts by less than this is not worth a finer ring, its frames just overwrite each other */
+#define STFU_MAX_SLOTS_PER_PACKET 8
+
+/* room for the queue plus as many packets again arriving early or out of order */
+static uint32_t stfu_n_ring_size(stfu_instance_t *i, uint32_t qlen)
+{
+    uint32_t size = 8, per = 1;
+
+    if (i->slot_ts && i->samples_per_packet > i->slot_ts) {
+        per = (i->samples_per_packet + i->slot_ts - 1) / i->slot_ts;
+    }
+
+    while (size < (qlen * 2 + 2) * per) {
+        size <<= 1;
+    }
+
+    return size;
+}
+
+/* slots since ref_ts, rounded down on both sides of it so a frame never changes slot while the reference stays put */
+static int32_t stfu_n_pos(stfu_instance_t *i, uint32_t ts)
+{
+    uint32_t d = ts - i->ref_ts;
+
+    if ((int32_t) d >= 0) {
+        return (int32_t) (d / i->slot_ts);
+    }
+
+    return -(int32_t) ((0 - d + i->slot_ts - 1) / i->slot_ts);
+}
+
+#define stfu_n_pos_slot(_i, _p) (&(_i)->ring[(uint32_t) (_p) & ((_i)->ring_size - 1)])
+
+static stfu_slot_t *stfu_n_slot(stfu_instance_t *i, uint32_t ts)
+{
+    return stfu_n_pos_slot(i, stfu_n_pos(i, ts));
+}
 
-static stfu_status_t stfu_n_resize_aqueue(stfu_queue_t *queue, uint32_t qlen)
+/* the slot holds a frame added since the last reset that nobody has read yet */
+#define stfu_n_slot_live(_i, _s) ((_s)->gen == (_i)->gen && !(_s)->frame.was_read)
+
+/* count the live frames and find the oldest one the slow way, only after the ring was rebuilt or lapped */
+static void stfu_n_recount(stfu_instance_t *i)
 {
-    unsigned char *m;
+    uint32_t x;
+    int32_t pos;
+
+    i->in_count = 0;
 
-    if (qlen <= queue->real_array_size) {
-        queue->array_size = qlen;
-        if (queue->array_len > qlen) {
-            queue->array_len = qlen;
+    for (x = 0; x < i->ring_size; x++) {
+        if (stfu_n_slot_live(i, &i->ring[x])) {
+            pos = stfu_n_pos(i, i->ring[x].frame.ts);
+            if (!i->in_count++ || pos < i->oldest_pos) {
+                i->oldest_pos = pos;
+            }
         }
-    } else {
-        m = realloc(queue->array, qlen * sizeof(struct stfu_frame));
-        assert(m);
-        memset(m + queue->array_size * sizeof(struct stfu_frame), 0, (qlen * sizeof(struct stfu_frame)) - (queue->array_size * sizeof(struct stfu_frame)));
-        queue->array = (struct stfu_frame *) m;
-        queue->real_array_size = queue->array_size = qlen;
     }
+}
 
-	return STFU_IT_WORKED;
+/* the oldest frame was taken, the next one is normally in the very next slot */
+static void stfu_n_next_oldest(stfu_instance_t *i)
+{
+    stfu_slot_t *slot;
+    int32_t pos;
+
+    if (!i->in_count) {
+        return;
+    }
+
+    for (pos = i->oldest_pos + 1; pos - i->oldest_pos < (int32_t) i->ring_size; pos++) {
+        slot = stfu_n_pos_slot(i, pos);
+        if (stfu_n_slot_live(i, slot) && stfu_n_pos(i, slot->frame.ts) == pos) {
+            i->oldest_pos = pos;
+            return;
+        }
+    }
+
+    /* what is left is more than a ring ahead of the frame we took */
+    stfu_n_recount(i);
 }
 
-static void stfu_n_init_aqueue(stfu_queue_t *queue, uint32_t qlen)
+/* move the live frames into a ring of size slots, the slot width or the reference may have changed since they were stored */
+static void stfu_n_rehash(stfu_instance_t *i, stfu_slot_t *old, uint32_t old_size, uint32_t size)
 {
+    uint32_t x;
 
-	queue->array = calloc(qlen, sizeof(struct stfu_frame));
-	assert(queue->array != NULL);
-	memset(queue->array, 0, sizeof(struct stfu_frame) * qlen);	
-	queue->real_array_size = queue->array_size = qlen;
-	queue->int_frame.plc = 1;
-    memset(queue->int_frame.data, 255, sizeof(queue->int_frame.data));
+    i->ring = calloc(size, sizeof(stfu_slot_t));
+    assert(i->ring);
+    i->ring_size = size;
+    i->last_frame = NULL;
+
+    if (!old) {
+        return;
+    }
+
+    /* generation 0 is never live, a fresh ring starts out empty */
+    if (i->slot_ts) {
+        for (x = 0; x < old_size; x++) {
+            if (stfu_n_slot_live(i, &old[x])) {
+                *stfu_n_slot(i, old[x].frame.ts) = old[x];
+            }
+        }
+        stfu_n_recount(i);
+    }
+
+    free(old);
+}
+
+static void stfu_n_resize_ring(stfu_instance_t *i, uint32_t qlen)
+{
+    uint32_t size = stfu_n_ring_size(i, qlen);
+
+    if (i->ring && size <= i->ring_size) {
+        return;
+    }
+
+    stfu_n_rehash(i, i->ring, i->ring_size, size);
 }
 
 
@@ -209,9 +301,7 @@ void stfu_n_destroy(stfu_instance_t **i)
 		ii = *i;
 		*i = NULL;
         if (ii->name) free(ii->name);
-		free(ii->a_queue.array);
-		free(ii->b_queue.array);
-		free(ii->c_queue.array);
+		free(ii->ring);
 		free(ii);
 	}
 }
@@ -237,13 +327,12 @@ void stfu_n_report(stfu_instance_t *i, stfu_report_t *r)
 	r->clean_count = i->period_clean_count;
 	r->consecutive_good_count = i->consecutive_good_count;
 	r->consecutive_bad_count = i->consecutive_bad_count;
+	r->jitter = i->jitter >> 4;
 }
 
 stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen) 
 {
-    stfu_status_t s;
-
-    if (i->qlen == i->max_qlen) {
+    if (qlen > i->qlen && i->qlen == i->max_qlen) {
         return STFU_IT_FAILED;
     }
     
@@ -255,20 +344,17 @@ stfu_status_t stfu_n_resize(stfu_instance_t *i, uint32_t qlen)
         }
     }
 
-    if ((s = stfu_n_resize_aqueue(&i->a_queue, qlen)) == STFU_IT_WORKED) {
-        s = stfu_n_resize_aqueue(&i->b_queue, qlen);
-        s = stfu_n_resize_aqueue(&i->c_queue, qlen);
-
-        if (qlen > i->most_qlen) {
-            i->most_qlen = qlen;
-        }
+    stfu_n_resize_ring(i, qlen);
 
-        i->qlen = qlen;
-        i->max_plc = 5;
-        i->last_frame = NULL;
+    if (qlen > i->most_qlen) {
+        i->most_qlen = qlen;
     }
+
+    i->qlen = qlen;
+    i->max_plc = 5;
+    i->last_frame = NULL;
     
-    return s;
+    return STFU_IT_WORKED;
 }
 
 stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_per_packet, uint32_t samples_per_second, uint32_t max_drift_ms)
@@ -286,9 +372,10 @@ stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_
     i->orig_qlen = qlen;
     i->samples_per_packet = samples_per_packet;
 
-	stfu_n_init_aqueue(&i->a_queue, qlen);
-	stfu_n_init_aqueue(&i->b_queue, qlen);
-	stfu_n_init_aqueue(&i->c_queue, qlen);
+    i->gen = 1;
+    stfu_n_resize_ring(i, qlen);
+	i->int_frame.plc = 1;
+    memset(i->int_frame.data, 255, sizeof(i->int_frame.data));
 
     i->max_drift = (int32_t)(max_drift_ms * (samples_per_second / 1000) * -1);
 
@@ -296,17 +383,14 @@ stfu_instance_t *stfu_n_init(uint32_t qlen, uint32_t max_qlen, uint32_t samples_
         i->drift_max_dropped = (samples_per_second * 2) / samples_per_packet;
     }
 
-	i->in_queue = &i->a_queue;
-	i->out_queue = &i->b_queue;
-	i->old_queue = &i->c_queue;
     i->name = strdup("none");
     
     i->max_plc = i->qlen / 2;
 
     i->samples_per_second = samples_per_second ? samples_per_second : 8000;
     
-    i->period_time = ((i->samples_per_second * 20) / i->samples_per_packet);
-    i->decrement_time = ((i->samples_per_second * 15) / i->samples_per_packet);
+    i->period_time = ((i->samples_per_second * 20) / least1(i->samples_per_packet));
+    i->decrement_time = ((i->samples_per_second * 15) / least1(i->samples_per_packet));
 
 	return i;
 }
@@ -345,17 +429,16 @@ void stfu_n_reset(stfu_instance_t *i)
     }
 
     i->ready = 0;
-	i->in_queue = &i->a_queue;
-	i->out_queue = &i->b_queue;
-	i->old_queue = &i->c_queue;
 
-	i->in_queue->array_len = 0;
-	i->out_queue->array_len = 0;
-	i->out_queue->wr_len = 0;
+    /* every slot of an older generation reads as empty */
+    if (!++i->gen) {
+        memset(i->ring, 0, i->ring_size * sizeof(stfu_slot_t));
+        i->gen = 1;
+    }
+    i->in_count = 0;
+    i->ref_set = 0;
 	i->last_frame = NULL;
-    i->in_queue->last_jitter = 0;
-    i->out_queue->last_jitter = 0;
-
+    i->jitter_ref = 0;
 
     stfu_n_reset_counters(i);
     stfu_n_sync(i, 1);
@@ -382,32 +465,41 @@ stfu_status_t stfu_n_sync(stfu_instance_t *i, uint32_t packets)
     return STFU_IT_WORKED;
 }
 
+/* packets needed to ride out twice the mean deviation of arrival time plus the one being played */
+static uint32_t stfu_n_jitter_qlen(stfu_instance_t *i)
+{
+    return ((i->jitter >> 4) * 2 + i->samples_per_packet - 1) / i->samples_per_packet + 1;
+}
 
-static void stfu_n_swap(stfu_instance_t *i)
+static void stfu_n_measure_jitter(stfu_instance_t *i, uint32_t ts, uint32_t timer_ts)
 {
-    stfu_queue_t *last_in = i->in_queue, *last_out = i->out_queue, *last_old = i->old_queue;
-    
-    i->ready = 1;
-    
-    i->in_queue = last_old;
-    i->out_queue = last_in;
-    i->old_queue = last_out;
+    int32_t d;
 
-    i->in_queue->array_len = 0;
-    i->out_queue->wr_len = 0;
-    i->last_frame = NULL;
-    i->miss_count = 0;
-    i->in_queue->last_index = 0;
-    i->out_queue->last_index = 0;
-    i->out_queue->last_jitter = 0;
+    if (i->jitter_ref) {
+        d = (int32_t) (timer_ts - i->jitter_timer_ts) - (int32_t) (ts - i->jitter_ts);
+
+        if (d < 0) {
+            d = -d;
+        }
+
+        /* a jump of more than a second is a new stream, not jitter */
+        if ((uint32_t) d < i->samples_per_second) {
+            i->jitter += d - ((i->jitter + 8) >> 4);
+        }
+    }
+
+    i->jitter_timer_ts = timer_ts;
+    i->jitter_ts = ts;
+    i->jitter_ref = 1;
 }
 
 stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void *data, size_t datalen, uint32_t timer_ts, int last)
 {
-	uint32_t index = 0;
+	stfu_slot_t *slot;
 	stfu_frame_t *frame;
 	size_t cplen = 0;
     int good_ts = 0;
+    uint32_t want = 0;
 
     if (!i->samples_per_packet && ts && i->last_rd_ts) {
         i->ts_diff = ts - i->last_rd_ts;
@@ -418,6 +510,8 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
                 if (i->max_drift && i->samples_per_packet) {
                     i->drift_max_dropped = (i->samples_per_second * 2) / i->samples_per_packet;
                 }
+                i->period_time = ((i->samples_per_second * 20) / i->samples_per_packet);
+                i->decrement_time = ((i->samples_per_second * 15) / i->samples_per_packet);
             }
         } else {
             i->same_ts = 0;
@@ -430,6 +524,15 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
             return STFU_IT_FAILED;
         }
     }
+
+    if (!i->samples_per_packet) {
+        i->last_rd_ts = ts;
+        return STFU_IT_FAILED;
+    }
+
+    if (!i->slot_ts) {
+        i->slot_ts = i->samples_per_packet;
+    }
  
     if (timer_ts) {
         if (ts && !i->ts_offset) {
@@ -443,6 +546,7 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
             i->ts_drift = ts + (i->ts_offset - timer_ts);
         }
 
+        stfu_n_measure_jitter(i, ts, timer_ts);
 
         if (i->max_drift) {
             if (i->ts_drift < i->max_drift) {
@@ -466,13 +570,11 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
         }
 
         if (i->last_wr_ts) {
-            if ((ts <= i->last_wr_ts && (i->last_wr_ts != UINT_MAX || ts == i->last_wr_ts))) {
+            /* signed so a ts that just wrapped past zero is still ahead of the last one played */
+            if ((int32_t) (ts - i->last_wr_ts) <= 0) {
                 if (stfu_log != null_logger && i->debug) {
                     stfu_log(STFU_LOG_EMERG, "%s TOO LATE !!! %u \n\n\n", i->name, ts);
                 }
-                if (i->in_queue->array_len < i->in_queue->array_size) {
-                    i->in_queue->array_len++;
-                }
                 return STFU_ITS_TOO_LATE;
             }
         }
@@ -488,14 +590,19 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
 
     i->period_need_range_avg = i->period_need_range / least1(i->period_missing_count);
 
-    if (i->period_missing_count > i->qlen * 2) {
+    /* with arrival times to go by the depth follows the measured jitter, otherwise it grows on losses */
+    if (i->jitter_ref) {
+        want = stfu_n_jitter_qlen(i);
+    }
+
+    if (i->period_missing_count > i->qlen * 2 || (want > i->qlen && i->qlen < i->max_qlen)) {
         if (stfu_log != null_logger && i->debug) {
             stfu_log(STFU_LOG_EMERG, "%s resize %u %u\n", i->name, i->qlen, i->qlen + 1);
         }
         stfu_n_resize(i, i->qlen + 1);
         stfu_n_reset_counters(i);
     } else {
-        if (i->qlen > i->orig_qlen && (i->consecutive_good_count > i->decrement_time || i->period_clean_count > i->decrement_time)) {
+        if (i->qlen > i->orig_qlen && i->qlen > want && (i->consecutive_good_count > i->decrement_time || i->period_clean_count > i->decrement_time)) {
             stfu_n_resize(i, i->qlen - 1);
             stfu_n_reset_counters(i);
             stfu_n_sync(i, i->qlen);
@@ -522,7 +629,7 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
 
         i->period_packet_in_count = 0;
 
-        if (i->period_missing_count == 0 && i->qlen > i->orig_qlen) {
+        if (i->period_missing_count == 0 && i->qlen > i->orig_qlen && i->qlen > want) {
             stfu_n_resize(i, i->qlen - 1);
             stfu_n_sync(i, i->qlen);
         }
@@ -534,28 +641,66 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
     
 
     if (stfu_log != null_logger && i->debug) {
-        stfu_log(STFU_LOG_EMERG, "I: %s %u/%u i=%u/%u - g:%u/%u c:%u/%u b:%u - %u:%u - %u %d %u %u %d %d %d/%d\n", i->name,
+        stfu_log(STFU_LOG_EMERG, "I: %s %u/%u i=%u/%u - g:%u/%u c:%u/%u b:%u - %u:%u - %u %d %u %u %d %d %d/%d j:%u\n", i->name,
                  i->qlen, i->max_qlen, i->period_packet_in_count, i->period_time, i->consecutive_good_count, 
                  i->decrement_time, i->period_clean_count, i->decrement_time, i->consecutive_bad_count,
                  ts, ts / i->samples_per_packet, 
                  i->period_missing_count, i->period_need_range_avg,
-                 i->last_wr_ts, ts, i->diff, i->diff_total / least1(i->period_packet_in_count), i->ts_drift, i->max_drift);
-    }
-
-	if (last || i->in_queue->array_len == i->in_queue->array_size) {
-        stfu_n_swap(i);
+                 i->last_wr_ts, ts, i->diff, i->diff_total / least1(i->period_packet_in_count), i->ts_drift, i->max_drift, i->jitter >> 4);
     }
 
 	if (last) {
+        i->ready = 1;
 		return STFU_IM_DONE;
 	}
 
-    index = i->in_queue->array_len++;
-    assert(index < i->in_queue->array_size);
-	frame = &i->in_queue->array[index];
+    if (!i->ref_set) {
+        i->ref_ts = ts;
+        i->ref_set = 1;
+    } else if ((uint32_t) abs((int32_t) (ts - i->ref_ts)) > 0x40000000) {
+        /* re-anchor long before the distance to the reference could overflow */
+        i->ref_ts = ts;
+        stfu_n_rehash(i, i->ring, i->ring_size, i->ring_size);
+    }
+
+    slot = stfu_n_slot(i, ts);
+	frame = &slot->frame;
+
+    if (stfu_n_slot_live(i, slot) && frame->ts != ts) {
+        uint32_t gap = (uint32_t) abs((int32_t) (ts - frame->ts));
 
-	if (i->in_queue->array_len == i->in_queue->array_size) {
-        stfu_n_swap(i);
+        if (gap < i->slot_ts && gap >= i->samples_per_packet / STFU_MAX_SLOTS_PER_PACKET) {
+            /* the stream steps by less than a packet, give every ts a slot of its own */
+            if (stfu_log != null_logger && i->debug) {
+                stfu_log(STFU_LOG_EMERG, "%s SLOT %u -> %u\n", i->name, i->slot_ts, gap);
+            }
+            i->slot_ts = gap;
+            stfu_n_rehash(i, i->ring, i->ring_size, stfu_n_ring_size(i, i->qlen));
+            slot = stfu_n_slot(i, ts);
+            frame = &slot->frame;
+        } else if (stfu_n_pos(i, frame->ts) == i->oldest_pos) {
+            /* a frame still sitting in the slot is older than the whole ring and will never be played */
+            frame->was_read = 1;
+            i->in_count--;
+            stfu_n_recount(i);
+        } else {
+            frame->was_read = 1;
+            i->in_count--;
+        }
+    }
+
+    if (!stfu_n_slot_live(i, slot)) {
+        int32_t pos = stfu_n_pos(i, ts);
+
+        if (!i->in_count++ || pos < i->oldest_pos) {
+            i->oldest_pos = pos;
+        }
+    }
+
+    slot->gen = i->gen;
+
+    if (i->in_count >= i->qlen) {
+        i->ready = 1;
     }
 
 	if ((cplen = datalen) > sizeof(frame->data)) {
@@ -575,50 +720,72 @@ stfu_status_t stfu_n_add_data(stfu_instance_t *i, uint32_t ts, uint32_t pt, void
 	return STFU_IT_WORKED;
 }
 
-static int stfu_n_find_any_frame(stfu_instance_t *in, stfu_queue_t *queue, stfu_frame_t **r_frame)
+static void stfu_n_take_frame(stfu_instance_t *in, stfu_frame_t *frame, stfu_frame_t **r_frame)
+{
+    *r_frame = frame;
+    frame->was_read = 1;
+    in->in_count--;
+    in->period_packet_out_count++;
+    in->session_packet_out_count++;
+
+    if (stfu_n_pos(in, frame->ts) == in->oldest_pos) {
+        stfu_n_next_oldest(in);
+    }
+}
+
+/* the unread frame furthest behind the newest arrival, kept up to date as frames come and go */
+static stfu_slot_t *stfu_n_oldest_slot(stfu_instance_t *in)
+{
+    if (!in->in_count) {
+        return NULL;
+    }
+
+    return stfu_n_pos_slot(in, in->oldest_pos);
+}
+
+static int stfu_n_find_any_frame(stfu_instance_t *in, stfu_frame_t **r_frame)
 {
-    uint32_t i = 0;
-    stfu_frame_t *frame = NULL;
+    stfu_slot_t *slot;
 
     stfu_assert(r_frame);
     
     *r_frame = NULL;
 
-    for(i = 0; i < queue->real_array_size; i++) {
-        frame = &queue->array[i];
-        if (!frame->was_read) {
-            *r_frame = frame;
-            queue->last_index = i;
-            frame->was_read = 1;
-            in->period_packet_out_count++;
-            in->session_packet_out_count++;
-            return 1;
-        }
+    if ((slot = stfu_n_oldest_slot(in))) {
+        stfu_n_take_frame(in, &slot->frame, r_frame);
+        return 1;
     }
 
     return 0;    
 }
 
 
-static int stfu_n_find_frame(stfu_instance_t *in, stfu_queue_t *queue, uint32_t min_ts, uint32_t max_ts, stfu_frame_t **r_frame)
+/* the frame stamped max_ts or, failing that, one stamped between min_ts and max_ts; it can only live in the slots of the last packet interval */
+static int stfu_n_find_frame(stfu_instance_t *in, uint32_t min_ts, uint32_t max_ts, stfu_frame_t **r_frame)
 {
-    uint32_t i = 0;
-    stfu_frame_t *frame = NULL;
+    stfu_slot_t *slot;
+    int32_t pos, last;
 
     if (r_frame) {
         *r_frame = NULL;
     }
 
-    for(i = 0; i < queue->array_size; i++) {
-        frame = &queue->array[i];
-        
-        if (frame->ts == max_ts || (frame->ts > min_ts && frame->ts < max_ts)) {
+    if (!in->in_count) {
+        return 0;
+    }
+
+    last = stfu_n_pos(in, max_ts - in->samples_per_packet);
+
+    for (pos = stfu_n_pos(in, max_ts); pos >= last; pos--) {
+        stfu_frame_t *frame;
+
+        slot = stfu_n_pos_slot(in, pos);
+        frame = &slot->frame;
+
+        /* signed distances, the window may straddle the ts wrap */
+        if (stfu_n_slot_live(in, slot) && (frame->ts == max_ts || ((int32_t) (frame->ts - min_ts) > 0 && (int32_t) (max_ts - frame->ts) > 0))) {
             if (r_frame) {
-                *r_frame = frame;
-                queue->last_index = i;
-                frame->was_read = 1;
-                in->period_packet_out_count++;
-                in->session_packet_out_count++;
+                stfu_n_take_frame(in, frame, r_frame);
             }
             return 1;
         }
@@ -632,7 +799,7 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 	stfu_frame_t *rframe = NULL;
     int found = 0;
 
-	if (!i->samples_per_packet) {
+	if (!i->samples_per_packet || !i->slot_ts) {
         return NULL;
     }
     
@@ -645,36 +812,28 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
 
     if (i->cur_ts == 0 && i->last_wr_ts < 1000) {
-        uint32_t x = 0;
-        for (x = 0; x < i->out_queue->array_len; x++) {
-            if (!i->out_queue->array[x].was_read) {
-                i->cur_ts = i->out_queue->array[x].ts;
-                break;
-            }
-            if (i->cur_ts == 0) {
-                if (stfu_log != null_logger && i->debug) {
-                    stfu_log(STFU_LOG_EMERG, "%s JITTERBUFFER ERROR: PUNTING\n", i->name);
-                    return NULL;
-                }
-            }
-        }
-    } else {
-        i->cur_ts = i->cur_ts + i->samples_per_packet;
-    }
-    
-    found = stfu_n_find_frame(i, i->out_queue, i->last_wr_ts, i->cur_ts, &rframe);
+        stfu_slot_t *slot = stfu_n_oldest_slot(i);
 
-    if (found) {
-        if (i->out_queue->array_len) {
-            i->out_queue->array_len--;
+        if (slot) {
+            i->cur_ts = slot->frame.ts;
+        } else if (stfu_log != null_logger && i->debug) {
+            stfu_log(STFU_LOG_EMERG, "%s JITTERBUFFER ERROR: PUNTING\n", i->name);
+            return NULL;
         }
     } else {
-        found = stfu_n_find_frame(i, i->in_queue, i->last_wr_ts, i->cur_ts, &rframe);
+        i->cur_ts = i->cur_ts + i->samples_per_packet;
 
-        if (!found) {
-            found = stfu_n_find_frame(i, i->old_queue, i->last_wr_ts, i->cur_ts, &rframe);
+        /* fell too far behind the newest packet, skip ahead to the queue length */
+        if ((int32_t) (i->last_rd_ts - i->cur_ts) > (int32_t) ((i->qlen + i->qlen / 2 + 1) * i->samples_per_packet)) {
+            if (stfu_log != null_logger && i->debug) {
+                stfu_log(STFU_LOG_EMERG, "%s SKIP %u -> %u\n", i->name, i->cur_ts, i->last_rd_ts - i->qlen * i->samples_per_packet);
+            }
+            i->cur_ts = i->last_rd_ts - i->qlen * i->samples_per_packet;
+            i->last_wr_ts = i->cur_ts - i->samples_per_packet;
         }
     }
+    
+    found = stfu_n_find_frame(i, i->last_wr_ts, i->cur_ts, &rframe);
 
     if (found) {
         i->cur_ts = rframe->ts;
@@ -682,7 +841,7 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
     if (i->sync_out) {
         if (!found) {
-            if ((found = stfu_n_find_any_frame(i, i->out_queue, &rframe))) {
+            if ((found = stfu_n_find_any_frame(i, &rframe))) {
                 i->cur_ts = rframe->ts;
             }
             
@@ -725,18 +884,14 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
         if (stfu_log != null_logger && i->debug) {        
             stfu_log(STFU_LOG_EMERG, "%s ", i->name);
-            for(y = 0; y < i->out_queue->array_size; y++) {
-                if ((y % 5) == 0) stfu_log(STFU_LOG_EMERG, "\n%s ", i->name);
-                frame = &i->out_queue->array[y];
-                stfu_log(STFU_LOG_EMERG, "%u:%u\t", frame->ts, frame->ts / i->samples_per_packet);
-            }
-            stfu_log(STFU_LOG_EMERG, "\n%s ", i->name);
-
-
-            for(y = 0; y < i->in_queue->array_size; y++) {
+            for(y = 0; y < i->ring_size; y++) {
                 if ((y % 5) == 0) stfu_log(STFU_LOG_EMERG, "\n%s ", i->name);
-                frame = &i->in_queue->array[y];
-                stfu_log(STFU_LOG_EMERG, "%u:%u\t", frame->ts, frame->ts / i->samples_per_packet);
+                frame = &i->ring[y].frame;
+                if (stfu_n_slot_live(i, &i->ring[y])) {
+                    stfu_log(STFU_LOG_EMERG, "%u:%u\t", frame->ts, frame->ts / i->samples_per_packet);
+                } else {
+                    stfu_log(STFU_LOG_EMERG, "-\t");
+                }
             }
             stfu_log(STFU_LOG_EMERG, "\n%s\n\n\n", i->name);
 
@@ -766,7 +921,6 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
     if (found) {
         i->last_frame = rframe;
-        i->out_queue->wr_len++;
         i->last_wr_ts = rframe->ts;
 
         i->miss_count = 0;
@@ -778,7 +932,7 @@ stfu_frame_t *stfu_n_read_a_frame(stfu_instance_t *i)
 
     } else {
         i->last_wr_ts = i->cur_ts;
-        rframe = &i->out_queue->int_frame;
+        rframe = &i->int_frame;
         rframe->dlen = i->plc_len;
         rframe->pt = i->plc_pt;
         rframe->ts = i->cur_ts;
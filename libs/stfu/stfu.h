@@ -180,6 +180,7 @@ typedef struct {
 	uint32_t clean_count;
 	uint32_t consecutive_good_count;
 	uint32_t consecutive_bad_count;
+	uint32_t jitter;
 } stfu_report_t;
 
 typedef void (*stfu_n_call_me_t)(stfu_instance_t *i, void *);
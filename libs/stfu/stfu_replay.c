@@ -0,0 +1,432 @@
+/*
+ * STFU (S)ort (T)ransportable (F)ramed (U)tterances
+ * Copyright (c) 2007 Anthony Minessale II <anthm@freeswitch.org>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * THOSE WHO DISAGREE MAY CERTAINLY STFU
+ *
+ * stfu_replay.c -- replay an RTP arrival trace through the jitter buffer
+ *
+ * The trace is either a pcap capture (one RTP stream is picked out of it, by udp port or by the first ssrc seen),
+ * a text file with one "arrival_us ts [pt [len]]" line per packet, or a synthetic stream described as
+ * gen:<packets>:<jitter ms>[:<loss %>[:<reorder %>]].  Packets are handed to stfu_n_eat() when they arrive and a frame
+ * is read on every ptime tick, the way switch_rtp drives it.
+ */
+#include "stfu.h"
+#include <sys/time.h>
+
+#define MAX_PAYLOAD 1500
+
+typedef struct {
+    uint64_t arrival;           /* us */
+    uint32_t ts;
+    uint32_t pt;
+    uint32_t len;
+} trace_packet_t;
+
+typedef struct {
+    trace_packet_t *packets;
+    uint32_t count;
+    uint32_t size;
+} trace_t;
+
+typedef struct {
+    uint32_t in;
+    uint32_t late;
+    uint32_t reads;
+    uint32_t good;
+    uint32_t plc;
+    uint32_t empty;
+    uint32_t out_of_order;
+    uint64_t delay_total;       /* us, good frames only */
+    uint64_t delay_max;
+    uint32_t final_qlen;
+    uint32_t most_qlen;
+    uint32_t jitter;
+    uint64_t ns;
+} replay_stats_t;
+
+static void trace_add(trace_t *trace, uint64_t arrival, uint32_t ts, uint32_t pt, uint32_t len)
+{
+    trace_packet_t *p;
+
+    if (trace->count == trace->size) {
+        trace->size = trace->size ? trace->size * 2 : 1024;
+        trace->packets = realloc(trace->packets, trace->size * sizeof(*trace->packets));
+        assert(trace->packets);
+    }
+
+    p = &trace->packets[trace->count++];
+    p->arrival = arrival;
+    p->ts = ts;
+    p->pt = pt;
+    p->len = len < 4 ? 4 : (len > MAX_PAYLOAD ? MAX_PAYLOAD : len);
+}
+
+static uint32_t get32(const uint8_t *p, int swap)
+{
+    return swap ? (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3] : (uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 | (uint32_t) p[1] << 8 | p[0];
+}
+
+static uint16_t get16be(const uint8_t *p)
+{
+    return (uint16_t) (p[0] << 8 | p[1]);
+}
+
+/* classic libpcap files only, ethernet (with or without one vlan tag), linux cooked, raw ip and bsd loopback */
+static int load_pcap(FILE *f, trace_t *trace, int port)
+{
+    uint8_t hdr[24], rec[16], *pkt = NULL;
+    uint32_t magic, linktype, ssrc = 0, plen;
+    int swap, nsec, have_ssrc = 0;
+
+    if (fread(hdr, 1, sizeof(hdr), f) != sizeof(hdr)) {
+        return -1;
+    }
+
+    magic = get32(hdr, 0);
+    if (magic == 0xa1b2c3d4 || magic == 0xa1b23c4d) {
+        swap = 0;
+    } else if (magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1) {
+        swap = 1;
+    } else {
+        return -1;
+    }
+
+    nsec = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+    linktype = get32(hdr + 20, swap);
+
+    while (fread(rec, 1, sizeof(rec), f) == sizeof(rec)) {
+        uint64_t arrival = (uint64_t) get32(rec, swap) * 1000000 + (nsec ? get32(rec + 4, swap) / 1000 : get32(rec + 4, swap));
+        uint8_t *p;
+        uint32_t left, l3, caplen = get32(rec + 8, swap);
+        int proto;
+
+        if (!(pkt = realloc(pkt, caplen ? caplen : 1)) || fread(pkt, 1, caplen, f) != caplen) {
+            break;
+        }
+
+        p = pkt;
+        left = caplen;
+
+        if (linktype == 1) {
+            if (left < 14) continue;
+            l3 = get16be(p + 12);
+            p += 14, left -= 14;
+            if (l3 == 0x8100 && left >= 4) {
+                l3 = get16be(p + 2);
+                p += 4, left -= 4;
+            }
+        } else if (linktype == 113) {
+            if (left < 16) continue;
+            l3 = get16be(p + 14);
+            p += 16, left -= 16;
+        } else if (linktype == 0) {
+            if (left < 4) continue;
+            l3 = (p[4] >> 4) == 6 ? 0x86dd : 0x0800;
+            p += 4, left -= 4;
+        } else if (linktype == 101 || linktype == 12) {
+            l3 = left && (p[0] >> 4) == 6 ? 0x86dd : 0x0800;
+        } else {
+            fprintf(stderr, "unsupported pcap link type %u\n", linktype);
+            break;
+        }
+
+        if (l3 == 0x0800) {
+            uint32_t ihl;
+
+            if (left < 20 || (ihl = (p[0] & 0x0f) * 4) > left || (get16be(p + 6) & 0x3fff)) continue;
+            proto = p[9];
+            p += ihl, left -= ihl;
+        } else if (l3 == 0x86dd) {
+            if (left < 40) continue;
+            proto = p[6];
+            p += 40, left -= 40;
+        } else {
+            continue;
+        }
+
+        if (proto != 17 || left < 8 + 12) {
+            continue;
+        }
+
+        if (port && get16be(p + 2) != port) {
+            continue;
+        }
+
+        p += 8, left -= 8;
+
+        /* rtp version 2, skipping rtcp */
+        if ((p[0] >> 6) != 2 || (p[1] >= 200 && p[1] <= 204)) {
+            continue;
+        }
+
+        if (!have_ssrc) {
+            ssrc = get32(p + 8, 1);
+            have_ssrc = 1;
+        } else if (get32(p + 8, 1) != ssrc) {
+            continue;
+        }
+
+        plen = left - 12 - (p[0] & 0x0f) * 4;
+        trace_add(trace, arrival, get32(p + 4, 1), p[1] & 0x7f, plen);
+    }
+
+    free(pkt);
+
+    return trace->count ? 0 : -1;
+}
+
+static int load_text(FILE *f, trace_t *trace)
+{
+    char line[256];
+    unsigned long long arrival;
+    unsigned int ts, pt, len;
+    int n;
+
+    while (fgets(line, sizeof(line), f)) {
+        pt = 0;
+        len = 160;
+
+        if (*line == '#' || (n = sscanf(line, "%llu %u %u %u", &arrival, &ts, &pt, &len)) < 2) {
+            continue;
+        }
+
+        trace_add(trace, arrival, ts, pt, len);
+    }
+
+    return trace->count ? 0 : -1;
+}
+
+/* a steady stream with uniformly distributed extra network delay, random loss and the odd swapped pair */
+static void generate(trace_t *trace, uint32_t packets, uint32_t jitter_ms, uint32_t loss, uint32_t reorder, uint32_t spp, uint32_t rate)
+{
+    uint64_t period = (uint64_t) spp * 1000000 / rate;
+    uint32_t x, start = trace->count;
+
+    srand(1);
+
+    for (x = 0; x < packets; x++) {
+        uint64_t arrival = x * period + (jitter_ms ? (uint64_t) (rand() % (jitter_ms * 1000)) : 0);
+
+        if (loss && (uint32_t) (rand() % 100) < loss) {
+            continue;
+        }
+
+        trace_add(trace, arrival, 1000 + x * spp, 0, spp);
+    }
+
+    /* the trace is replayed in file order, so sort by arrival and then disturb */
+    for (x = start + 1; x < trace->count; x++) {
+        trace_packet_t p = trace->packets[x];
+        uint32_t y = x;
+
+        while (y > start && trace->packets[y - 1].arrival > p.arrival) {
+            trace->packets[y] = trace->packets[y - 1];
+            y--;
+        }
+        trace->packets[y] = p;
+    }
+
+    for (x = start + 1; reorder && x < trace->count; x++) {
+        if ((uint32_t) (rand() % 100) < reorder) {
+            uint32_t ts = trace->packets[x].ts;
+
+            trace->packets[x].ts = trace->packets[x - 1].ts;
+            trace->packets[x - 1].ts = ts;
+        }
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void replay(trace_t *trace, uint32_t qlen, uint32_t max_qlen, uint32_t spp, uint32_t rate, uint32_t max_drift, replay_stats_t *stats)
+{
+    stfu_instance_t *jb = stfu_n_init(qlen, max_qlen, spp, rate, max_drift);
+    uint64_t period = (uint64_t) spp * 1000000 / rate, start = trace->packets[0].arrival, tick_time, ns = 0, t;
+    uint32_t x = 0, tick = 1, last_out = 0, have_out = 0;
+    uint8_t payload[MAX_PAYLOAD] = { 0 };
+    stfu_report_t r = { 0 };
+
+    memset(stats, 0, sizeof(*stats));
+
+    while (x < trace->count) {
+        stfu_frame_t *frame;
+
+        tick_time = start + tick * period;
+
+        t = now_ns();
+
+        /* everything that has arrived by this tick, stamped with the timer sample count like switch_rtp does */
+        for (; x < trace->count && trace->packets[x].arrival <= tick_time; x++) {
+            trace_packet_t *p = &trace->packets[x];
+
+            memcpy(payload, &x, sizeof(x));
+            stats->in++;
+
+            if (stfu_n_eat(jb, p->ts, p->pt, payload, p->len, tick * spp) == STFU_ITS_TOO_LATE) {
+                stats->late++;
+            }
+        }
+
+        frame = stfu_n_read_a_frame(jb);
+
+        ns += now_ns() - t;
+
+        stats->reads++;
+
+        if (!frame) {
+            stats->empty++;
+        } else if (frame->plc) {
+            stats->plc++;
+        } else {
+            uint32_t idx;
+            uint64_t delay;
+
+            memcpy(&idx, frame->data, sizeof(idx));
+            stats->good++;
+
+            if (have_out && (int32_t) (frame->ts - last_out) <= 0) {
+                stats->out_of_order++;
+            }
+
+            last_out = frame->ts;
+            have_out = 1;
+
+            if (idx < trace->count && trace->packets[idx].arrival <= tick_time) {
+                delay = tick_time - trace->packets[idx].arrival;
+                stats->delay_total += delay;
+                if (delay > stats->delay_max) {
+                    stats->delay_max = delay;
+                }
+            }
+        }
+
+        tick++;
+    }
+
+    stfu_n_report(jb, &r);
+    stats->final_qlen = r.qlen;
+    stats->most_qlen = stfu_n_get_most_qlen(jb);
+    stats->jitter = r.jitter;
+    stats->ns = ns;
+
+    stfu_n_destroy(&jb);
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-q qlen] [-m max_qlen] [-s samples_per_packet] [-r rate] [-d max_drift_ms] [-p udp_port] [-n loops]\n"
+            "          <capture.pcap | trace.txt | gen:<packets>:<jitter ms>[:<loss %%>[:<reorder %%>]]>\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t qlen = 5, max_qlen = 50, spp = 160, rate = 8000, max_drift = 0, loops = 1, x;
+    int port = 0, opt;
+    trace_t trace = { 0 };
+    replay_stats_t stats;
+    uint64_t ns = 0;
+    const char *src;
+
+    while ((opt = getopt(argc, argv, "q:m:s:r:d:p:n:h")) != -1) {
+        switch (opt) {
+        case 'q': qlen = atoi(optarg); break;
+        case 'm': max_qlen = atoi(optarg); break;
+        case 's': spp = atoi(optarg); break;
+        case 'r': rate = atoi(optarg); break;
+        case 'd': max_drift = atoi(optarg); break;
+        case 'p': port = atoi(optarg); break;
+        case 'n': loops = atoi(optarg); break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+
+    if (optind >= argc || !qlen || !spp || !rate || !loops) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    src = argv[optind];
+
+    if (!strncmp(src, "gen:", 4)) {
+        unsigned int packets = 0, jitter = 0, loss = 0, reorder = 0;
+
+        if (sscanf(src + 4, "%u:%u:%u:%u", &packets, &jitter, &loss, &reorder) < 2 || !packets) {
+            usage(argv[0]);
+            return 1;
+        }
+        generate(&trace, packets, jitter, loss, reorder, spp, rate);
+    } else {
+        FILE *f = fopen(src, "rb");
+
+        if (!f) {
+            perror(src);
+            return 1;
+        }
+
+        if (load_pcap(f, &trace, port)) {
+            rewind(f);
+            load_text(f, &trace);
+        }
+        fclose(f);
+    }
+
+    if (!trace.count) {
+        fprintf(stderr, "%s: no packets\n", src);
+        return 1;
+    }
+
+    for (x = 0; x < loops; x++) {
+        replay(&trace, qlen, max_qlen, spp, rate, max_drift, &stats);
+        ns += stats.ns;
+    }
+
+    printf("packets,late,reads,good,plc,empty,out_of_order,avg_delay_ms,max_delay_ms,final_qlen,most_qlen,jitter,ns_per_tick\n");
+    printf("%u,%u,%u,%u,%u,%u,%u,%.1f,%.1f,%u,%u,%u,%.0f\n",
+           stats.in, stats.late, stats.reads, stats.good, stats.plc, stats.empty, stats.out_of_order,
+           stats.good ? (double) stats.delay_total / stats.good / 1000 : 0.0, (double) stats.delay_max / 1000,
+           stats.final_qlen, stats.most_qlen, stats.jitter, (double) ns / loops / stats.reads);
+
+    free(trace.packets);
+
+    return 0;
+}
+
+/* For Emacs:
+ * Local Variables:
+ * mode:c
+ * indent-tabs-mode:nil
+ * tab-width:4
+ * c-basic-offset:4
+ * End:
+ * For VIM:
+ * vim:set softtabstop=4 shiftwidth=4 tabstop=4:
+ */
@@ -85,7 +85,6 @@
 #define SWITCH_EVENT_QUEUE_LEN 256
 #define SWITCH_MESSAGE_QUEUE_LEN 256
 
-#define SWITCH_BUFFER_BLOCK_FRAMES 25
 #define SWITCH_BUFFER_START_FRAMES 50
 
 typedef enum {
@@ -251,8 +250,11 @@ struct switch_runtime {
 	switch_profile_timer_t *profile_timer;
 	double profile_time;
 	double min_idle_time;
-	int sql_buffer_len;
 	int max_sql_buffer_len;
+	uint32_t sql_writers;
+	uint32_t sql_batch_ms;
+	switch_bool_t channel_registry;
+	uint32_t sql_snapshot_sec;
 	switch_dbtype_t odbc_dbtype;
 	char hostname[256];
 	char *switchname;
@@ -266,9 +268,17 @@ struct switch_runtime {
 extern struct switch_runtime runtime;
 
 
+#define SWITCH_SESSION_TABLE_SHARDS 64
+
+/* one stripe of the session table, picked by a hash of the uuid */
+struct switch_session_shard {
+	switch_thread_rwlock_t *rwlock;
+	switch_hash_t *table;
+};
+
 struct switch_session_manager {
 	switch_memory_pool_t *memory_pool;
-	switch_hash_t *session_table;
+	struct switch_session_shard shards[SWITCH_SESSION_TABLE_SHARDS];
 	uint32_t session_count;
 	uint32_t session_limit;
 	switch_size_t session_id;
@@ -282,6 +292,14 @@ switch_status_t switch_core_sqldb_start(switch_memory_pool_t *pool, switch_bool_
 void switch_core_sqldb_stop(void);
 void switch_core_session_init(switch_memory_pool_t *pool);
 void switch_core_session_uninit(void);
+void switch_core_session_thread_pool_start(void);
+void switch_core_session_thread_pool_stop(void);
+void switch_regex_cache_init(switch_memory_pool_t *pool);
+void switch_regex_cache_shutdown(void);
+void switch_core_file_cache_init(switch_memory_pool_t *pool);
+void switch_core_file_cache_shutdown(void);
+void switch_core_file_writer_init(switch_memory_pool_t *pool);
+void switch_core_file_writer_shutdown(void);
 void switch_core_state_machine_init(switch_memory_pool_t *pool);
 switch_memory_pool_t *switch_core_memory_init(void);
 void switch_core_memory_stop(void);
@@ -451,6 +451,21 @@ SWITCH_DECLARE(uint32_t) switch_atomic_read(volatile switch_atomic_t *mem);
  */
 SWITCH_DECLARE(void) switch_atomic_set(volatile switch_atomic_t *mem, uint32_t val);
 
+/**
+ * Read the uint32 value at mem with acquire semantics, memory written before
+ * the matching switch_atomic_set_release() is visible after the call.
+ * @param mem The location of memory which stores the value to read.
+ */
+SWITCH_DECLARE(uint32_t) switch_atomic_read_acquire(volatile switch_atomic_t *mem);
+
+/**
+ * Set the uint32 value at mem with release semantics, memory written before
+ * the call is visible to a switch_atomic_read_acquire() that sees val.
+ * @param mem The location of memory to set.
+ * @param val The uint32 value to set at the memory location.
+ */
+SWITCH_DECLARE(void) switch_atomic_set_release(volatile switch_atomic_t *mem, uint32_t val);
+
 /**
  * Uses an atomic operation to add the uint32 value to the value at the
  * specified location of memory.
@@ -473,6 +488,26 @@ SWITCH_DECLARE(void) switch_atomic_inc(volatile switch_atomic_t *mem);
  */
 SWITCH_DECLARE(int)  switch_atomic_dec(volatile switch_atomic_t *mem);
 
+/**
+ * Compare the uint32 value at the specified location with cmp and, if they
+ * are equal, replace it with with.  Implies a full memory barrier.
+ * @param mem The location of the value.
+ * @param with The value to store if the comparison succeeds.
+ * @param cmp The value to compare against.
+ * @return The value that was at mem before the call.
+ */
+SWITCH_DECLARE(uint32_t) switch_atomic_cas(volatile switch_atomic_t *mem, uint32_t with, uint32_t cmp);
+
+/**
+ * Compare the pointer at the specified location with cmp and, if they
+ * are equal, replace it with with.  Implies a full memory barrier.
+ * @param mem The location of the pointer.
+ * @param with The pointer to store if the comparison succeeds.
+ * @param cmp The pointer to compare against.
+ * @return The pointer that was at mem before the call.
+ */
+SWITCH_DECLARE(void *) switch_atomic_casptr(volatile void **mem, void *with, const void *cmp);
+
 /** @} */
 
 /**
@@ -919,6 +954,21 @@ SWITCH_DECLARE(switch_status_t) switch_file_read(switch_file_t *thefile, void *b
  * be returned.  APR_EINTR is never returned.
  */
 SWITCH_DECLARE(switch_status_t) switch_file_write(switch_file_t *thefile, const void *buf, switch_size_t *nbytes);
+
+struct iovec;
+
+/**
+ * Write data from iovec array to the specified file.
+ * @param thefile The file descriptor to write to.
+ * @param vec The array from which to get the data to write to the file.
+ * @param nvec The number of elements in the struct iovec array. This must
+ *             be smaller than APR_MAX_IOVEC_SIZE.  If it isn't, the function
+ *             will fail with APR_EINVAL.
+ * @param nbytes The number of bytes written.
+ *
+ * @remark Like switch_file_write, it may write less than asked for.
+ */
+SWITCH_DECLARE(switch_status_t) switch_file_writev(switch_file_t *thefile, const struct iovec *vec, switch_size_t nvec, switch_size_t *nbytes);
 SWITCH_DECLARE(int) switch_file_printf(switch_file_t *thefile, const char *format, ...);
 
 SWITCH_DECLARE(switch_status_t) switch_file_mktemp(switch_file_t ** thefile, char *templ, int32_t flags, switch_memory_pool_t *pool);
@@ -1218,6 +1268,29 @@ SWITCH_DECLARE(switch_status_t) switch_socket_send_nonblock(switch_socket_t *soc
  */
 SWITCH_DECLARE(switch_status_t) switch_socket_recvfrom(switch_sockaddr_t *from, switch_socket_t *sock, int32_t flags, char *buf, size_t *len);
 
+/**
+ * Get the os level descriptor behind a socket, for handing it to an os event api
+ * @param sock The socket
+ * @return the descriptor or -1
+ */
+SWITCH_DECLARE(int) switch_socket_fd_get(switch_socket_t *sock);
+
+/**
+ * Get the os level address held by a sockaddr
+ * @param sa The sockaddr
+ * @param len returned length of the address
+ * @return pointer to the struct sockaddr inside sa
+ */
+SWITCH_DECLARE(const void *) switch_sockaddr_get_raw(switch_sockaddr_t *sa, int *len);
+
+/**
+ * Fill a sockaddr from an os level address, such as one returned by recvmmsg
+ * @param sa The sockaddr to fill in
+ * @param raw pointer to a struct sockaddr_in or sockaddr_in6
+ * @param len length of the address
+ */
+SWITCH_DECLARE(switch_status_t) switch_sockaddr_set_raw(switch_sockaddr_t *sa, const void *raw, int len);
+
 SWITCH_DECLARE(switch_status_t) switch_socket_atmark(switch_socket_t *sock, int *atmark);
 
 /**
@@ -1476,6 +1549,12 @@ SWITCH_DECLARE(switch_status_t) switch_file_pipe_timeout_set(switch_file_t *thep
  */
 SWITCH_DECLARE(switch_status_t) switch_thread_exit(switch_thread_t *thd, switch_status_t retval);
 
+/**
+ * detach a thread so its resources are released when it exits instead of by a join
+ * @param thd The thread to detach
+ */
+SWITCH_DECLARE(switch_status_t) switch_thread_detach(switch_thread_t *thd);
+
 /**
  * block until the desired thread stops executing.
  * @param retval The return value from the dead thread.
@@ -70,6 +70,34 @@ SWITCH_DECLARE(switch_status_t) switch_buffer_create(_In_ switch_memory_pool_t *
 SWITCH_DECLARE(switch_status_t) switch_buffer_create_dynamic(_Out_ switch_buffer_t **buffer, _In_ switch_size_t blocksize, _In_ switch_size_t start_len,
 															 _In_ switch_size_t max_len);
 
+/*! \brief Allocate a new circular switch_buffer
+ * \param pool Pool to allocate the buffer from
+ * \param buffer returned pointer to the new buffer
+ * \param len length required by the buffer, rounded up to a power of two
+ * \return status
+ * \note data wraps around instead of being moved back to the start of the buffer, the api is otherwise unchanged
+ */
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_ring(_In_ switch_memory_pool_t *pool, _Out_ switch_buffer_t **buffer, _In_ switch_size_t len);
+
+/*! \brief Allocate a new dynamic circular switch_buffer
+ * \param buffer returned pointer to the new buffer
+ * \param start_len ammount of memory to reserve initially, rounded up to a power of two
+ * \param max_len length the buffer is allowed to grow to (0 for no limit)
+ * \return status
+ * \note the buffer doubles when it fills up instead of growing by a fixed block
+ */
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_ring_dynamic(_Out_ switch_buffer_t **buffer, _In_ switch_size_t start_len, _In_ switch_size_t max_len);
+
+/*! \brief Allocate a new lock free single producer / single consumer circular switch_buffer
+ * \param pool Pool to allocate the buffer from
+ * \param buffer returned pointer to the new buffer
+ * \param len length required by the buffer, rounded up to a power of two
+ * \return status
+ * \note one thread may write/reserve/commit while another reads/peeks/tosses without a mutex,
+ *       switch_buffer_zero and switch_buffer_read_loop still need both sides quiet.
+ */
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_spsc(_In_ switch_memory_pool_t *pool, _Out_ switch_buffer_t **buffer, _In_ switch_size_t len);
+
 SWITCH_DECLARE(void) switch_buffer_add_mutex(_In_ switch_buffer_t *buffer, _In_ switch_mutex_t *mutex);
 SWITCH_DECLARE(void) switch_buffer_lock(_In_ switch_buffer_t *buffer);
 SWITCH_DECLARE(switch_status_t) switch_buffer_trylock(_In_ switch_buffer_t *buffer);
@@ -109,8 +137,51 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_read(_In_ switch_buffer_t *buffer, _
  */
 SWITCH_DECLARE(switch_size_t) switch_buffer_peek(_In_ switch_buffer_t *buffer, _In_ void *data, _In_ switch_size_t datalen);
 
+/*! \brief Get a pointer to the buffered data without copying it
+ * \param buffer any buffer of type switch_buffer_t
+ * \param ptr returned pointer to the data
+ * \return int ammount of data at ptr
+ * \note on a circular buffer this is only the part up to the wrap, see switch_buffer_peek_segments
+ */
 SWITCH_DECLARE(switch_size_t) switch_buffer_peek_zerocopy(_In_ switch_buffer_t *buffer, _Out_ const void **ptr);
 
+/*! \brief Get pointers to all the buffered data without copying it
+ * \param buffer any buffer of type switch_buffer_t
+ * \param ptr1 returned pointer to the oldest data
+ * \param len1 returned length of the data at ptr1
+ * \param ptr2 returned pointer to the data that wrapped around, if any
+ * \param len2 returned length of the data at ptr2
+ * \return int total ammount of data, release it with switch_buffer_read_commit
+ */
+SWITCH_DECLARE(switch_size_t) switch_buffer_peek_segments(_In_ switch_buffer_t *buffer, _Out_ const void **ptr1, _Out_ switch_size_t *len1,
+														  _Out_ const void **ptr2, _Out_ switch_size_t *len2);
+
+/*! \brief Remove data seen with switch_buffer_peek_segments from the buffer
+ * \param buffer any buffer of type switch_buffer_t
+ * \param datalen amount of data consumed
+ * \return int ammount of data actually removed
+ */
+SWITCH_DECLARE(switch_size_t) switch_buffer_read_commit(_In_ switch_buffer_t *buffer, _In_ switch_size_t datalen);
+
+/*! \brief Get pointers to free space so data can be produced directly into the buffer
+ * \param buffer any buffer of type switch_buffer_t
+ * \param datalen amount of space needed, dynamic buffers grow to fit it
+ * \param ptr1 returned pointer to the first free segment
+ * \param len1 returned length of the first free segment
+ * \param ptr2 returned pointer to the free segment at the start of a circular buffer, if any
+ * \param len2 returned length of the second free segment
+ * \return int total free space, or 0 if datalen does not fit
+ */
+SWITCH_DECLARE(switch_size_t) switch_buffer_reserve_segments(_In_ switch_buffer_t *buffer, _In_ switch_size_t datalen, _Out_ void **ptr1,
+															 _Out_ switch_size_t *len1, _Out_ void **ptr2, _Out_ switch_size_t *len2);
+
+/*! \brief Publish data written into space returned by switch_buffer_reserve_segments
+ * \param buffer any buffer of type switch_buffer_t
+ * \param datalen amount of data written
+ * \return int amount of buffer used after the commit
+ */
+SWITCH_DECLARE(switch_size_t) switch_buffer_write_commit(_In_ switch_buffer_t *buffer, _In_ switch_size_t datalen);
+
 /*! \brief Read data endlessly from a switch_buffer_t 
  * \param buffer any buffer of type switch_buffer_t
  * \param data pointer to the read data to be returned
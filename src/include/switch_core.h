@@ -679,6 +679,29 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_request_by_name(_In_
 */
 SWITCH_DECLARE(switch_status_t) switch_core_session_thread_launch(_In_ switch_core_session_t *session);
 
+/*!
+  \brief Size the pool of worker threads that session and helper threads are run on
+  \param min threads spawned up front and kept warm, 0 to start a new thread for every session
+  \param max most threads the pool grows to before launches fall back to threads of their own, 0 for twice the session limit
+  \param affinity pin each worker to a cpu in turn
+  \note only takes effect when the pool starts
+*/
+SWITCH_DECLARE(void) switch_core_session_thread_pool_set(uint32_t min, uint32_t max, switch_bool_t affinity);
+
+/*!
+  \brief Choose whether new session threads are taken from the pool, starting it if needed
+  \param enable SWITCH_TRUE to use the pool, SWITCH_FALSE for one new thread per launch
+  \return whether the pool was in use before
+*/
+SWITCH_DECLARE(switch_bool_t) switch_core_session_thread_pool_use(switch_bool_t enable);
+
+/*!
+  \brief Write session thread pool occupancy and queue wait to a stream
+  \param stream the stream to write to
+  \param reset clear the counters after reporting them
+*/
+SWITCH_DECLARE(void) switch_core_session_thread_pool_stats(switch_stream_handle_t *stream, switch_bool_t reset);
+
 /*! 
   \brief Retrieve a pointer to the channel object associated with a given session
   \param session the session to retrieve from
@@ -1334,6 +1357,14 @@ SWITCH_DECLARE(switch_hash_index_t *) switch_hash_next(_In_ switch_hash_index_t
 SWITCH_DECLARE(void) switch_hash_this(_In_ switch_hash_index_t *hi, _Out_opt_ptrdiff_cap_(klen)
 									  const void **key, _Out_opt_ switch_ssize_t *klen, _Out_ void **val);
 
+/*!
+ \brief Time insert, find, miss, iterate and delete against the old sqlite table and write the results to a stream
+ \param stream the stream to write to
+ \param keys the number of keys to use
+ \param case_sensitive compare keys as switch_core_hash_init does (SWITCH_TRUE) or as switch_core_hash_init_nocase does
+*/
+SWITCH_DECLARE(void) switch_core_hash_bench(switch_stream_handle_t *stream, uint32_t keys, switch_bool_t case_sensitive);
+
 ///\}
 
 ///\defgroup timer Timer Functions
@@ -1676,6 +1707,75 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(_In_ switch_file_handle_t
 
 SWITCH_DECLARE(switch_status_t) switch_core_file_truncate(switch_file_handle_t *fh, int64_t offset);
 
+/*!
+  \brief Set the byte budget of the shared cache of decoded prompts
+  \param max_bytes total decoded audio to keep, 0 turns the cache off
+  \param max_file_bytes largest single decoded file to keep, 0 leaves it unchanged
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_set_limits(switch_size_t max_bytes, switch_size_t max_file_bytes);
+
+/*!
+  \brief Drop every idle prompt from the cache, prompts still playing go when their last handle closes
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_flush(void);
+
+/*!
+  \brief Write prompt cache occupancy, hit rate and bytes served to a stream
+  \param stream the stream to write to
+  \param reset clear the counters after reporting them
+*/
+SWITCH_DECLARE(void) switch_core_file_cache_stats(switch_stream_handle_t *stream, switch_bool_t reset);
+
+/*! \brief Write queue metrics of one async file handle */
+typedef struct {
+	/*! audio queued and not yet written */
+	uint32_t lag_ms;
+	/*! most audio ever queued at once */
+	uint32_t max_lag_ms;
+	/*! size of the queue */
+	uint32_t buffer_ms;
+	/*! samples thrown away because the queue was full */
+	switch_size_t dropped_samples;
+	/*! number of times the queue was found full */
+	switch_size_t drop_events;
+	/*! writes done by the writer threads */
+	switch_size_t writes;
+	switch_time_t last_write_usec;
+	switch_time_t max_write_usec;
+} switch_file_async_stats_t;
+
+/*!
+  \brief Hand the writes of an open file handle to the pool of writer threads
+  \param fh the file handle, open for writing with 16 bit samples
+  \param owner the name shown in the writer stats, usually the session uuid
+  \param buffer_ms how much audio to queue before dropping, 0 for the default
+  \param max_block_ms how long a write may wait for room before it drops the audio
+  \return SWITCH_STATUS_SUCCESS if writes are now queued, the handle is left synchronous otherwise
+  \note switch_core_file_write never touches the file afterwards, it returns SWITCH_STATUS_FALSE once a
+		queued write failed.  Seeking, truncating and closing wait for the queue to drain first.
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_file_set_async(switch_file_handle_t *fh, const char *owner, uint32_t buffer_ms, uint32_t max_block_ms);
+
+/*!
+  \brief Get the queue metrics of an async file handle
+  \param fh the file handle
+  \param stats the metrics to fill in
+  \return SWITCH_STATUS_FALSE if the handle is not async
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_file_get_async_stats(switch_file_handle_t *fh, switch_file_async_stats_t *stats);
+
+/*!
+  \brief Set the number of writer threads serving async file handles, 0 keeps new handles synchronous
+  \param threads the number of threads, started on first use
+*/
+SWITCH_DECLARE(void) switch_core_file_writer_set_threads(uint32_t threads);
+
+/*!
+  \brief Write writer pool totals and the lag of every async file handle to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_core_file_writer_stats(switch_stream_handle_t *stream);
+
 
 ///\}
 
@@ -2121,6 +2221,18 @@ SWITCH_DECLARE(void) switch_time_set_timerfd(switch_bool_t enable);
 SWITCH_DECLARE(void) switch_time_set_nanosleep(switch_bool_t enable);
 SWITCH_DECLARE(void) switch_time_set_matrix(switch_bool_t enable);
 SWITCH_DECLARE(void) switch_time_set_cond_yield(switch_bool_t enable);
+/*!
+ \brief Set how many per-core tick threads the soft timer spreads its timers over
+ \param shards number of shards, -1 for one per cpu, 0 to keep the single timer matrix
+ \note only takes effect when the soft timer starts
+*/
+SWITCH_DECLARE(void) switch_time_set_timer_shards(int shards);
+/*!
+ \brief Write per-shard timer counts and tick jitter to a stream
+ \param stream the stream to write to
+ \param reset clear the jitter counters after reporting them
+*/
+SWITCH_DECLARE(void) switch_time_timer_shard_stats(switch_stream_handle_t *stream, switch_bool_t reset);
 SWITCH_DECLARE(uint32_t) switch_core_min_dtmf_duration(uint32_t duration);
 SWITCH_DECLARE(uint32_t) switch_core_max_dtmf_duration(uint32_t duration);
 SWITCH_DECLARE(double) switch_core_min_idle_cpu(double new_limit);
@@ -2148,7 +2260,8 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_preprocess_session(switch_core_sessio
 #define CACHE_DB_LEN 256
 typedef enum {
 	CDF_INUSE = (1 << 0),
-	CDF_PRUNE = (1 << 1)
+	CDF_PRUNE = (1 << 1),
+	CDF_REGISTRY = (1 << 2)
 } cache_db_flag_t;
 
 typedef enum {
@@ -2266,6 +2379,13 @@ SWITCH_DECLARE(int) switch_cache_db_affected_rows(switch_cache_db_handle_t *dbh)
  \param [in] stream stream for status
 */
 SWITCH_DECLARE(void) switch_cache_db_status(switch_stream_handle_t *stream);
+
+/*! 
+ \brief Wait for the core db writers to commit everything queued before the call
+ \param [in] timeout_ms how long to wait
+ \return SWITCH_STATUS_SUCCESS once the queued statements are written, SWITCH_STATUS_TIMEOUT otherwise
+*/
+SWITCH_DECLARE(switch_status_t) switch_core_sqldb_sync(uint32_t timeout_ms);
 SWITCH_DECLARE(switch_status_t) _switch_core_db_handle(switch_cache_db_handle_t ** dbh, const char *file, const char *func, int line);
 #define switch_core_db_handle(_a) _switch_core_db_handle(_a, __FILE__, __SWITCH_FUNC__, __LINE__)
 
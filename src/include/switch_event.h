@@ -100,12 +100,29 @@ struct switch_event {
 	unsigned long key;
 	struct switch_event *next;
 	int flags;
+	/*! number of headers in the event */
+	uint32_t header_count;
+	/*! open addressing lookup table of headers by name, built once the event grows large */
+	switch_event_header_t **index;
+	/*! number of slots in the lookup table (power of 2) */
+	uint32_t index_size;
+	/*! references to the event, it is freed when the last one is destroyed */
+	volatile switch_atomic_t refs;
+	/*! the fired event this one is a read-only view of, copied on first write */
+	struct switch_event *parent;
+	/*! blocks holding the header names and values */
+	void *arena;
+	/*! bytes deleted or replaced since the event was created */
+	switch_size_t arena_waste;
+	/*! some header strings were adopted from the heap (SWITCH_STACK_NODUP) and are freed on their own */
+	switch_bool_t heap_strings;
 };
 
 typedef enum {
 	EF_UNIQ_HEADERS = (1 << 0),
 	EF_NO_CHAT_EXEC = (1 << 1),
-	EF_DEFAULT_ALLOW = (1 << 2)
+	EF_DEFAULT_ALLOW = (1 << 2),
+	EF_NO_INDEX = (1 << 3)
 } switch_event_flag_t;
 
 
@@ -210,6 +227,13 @@ SWITCH_DECLARE(void) switch_event_destroy(switch_event_t **event);
   \return SWITCH_STATUS_SUCCESS if the event was duplicated
 */
 SWITCH_DECLARE(switch_status_t) switch_event_dup(switch_event_t **event, switch_event_t *todup);
+
+/*!
+  \brief Count the heap allocations holding an event and its headers
+  \param event the event
+  \return the number of allocations, 1 for a small event whose headers fit in the event itself
+*/
+SWITCH_DECLARE(uint32_t) switch_event_allocations(switch_event_t *event);
 SWITCH_DECLARE(void) switch_event_merge(switch_event_t *event, switch_event_t *tomerge);
 SWITCH_DECLARE(switch_status_t) switch_event_dup_reply(switch_event_t **event, switch_event_t *todup);
 
@@ -383,6 +407,12 @@ static inline switch_status_t switch_event_create_plain(switch_event_t **event,
 */
 SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event);
 
+/*!
+  \brief Write the per-subscriber dispatch queue depth, drop and latency counters to a stream
+  \param stream the stream to write to
+*/
+SWITCH_DECLARE(void) switch_event_dispatch_status(switch_stream_handle_t *stream);
+
 /*!
   \brief Fire an event filling in most of the arguements with obvious values
   \param event the event to send (will be nulled on success)
@@ -383,6 +383,26 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_tone_detect_session(switch_core_sessi
 SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *session, switch_file_handle_t *fh, const char *file,
 													 switch_input_args_t *args);
 
+/*!
+  \brief build the name of the pre-encoded sibling of a file for a codec implementation
+  \param pool the pool to allocate the name from
+  \param file the path to the original file
+  \param impl the codec implementation the sibling is encoded with
+  \return the sibling path or NULL if the codec can't be played natively
+*/
+SWITCH_DECLARE(char *) switch_ivr_native_file_path(switch_memory_pool_t *pool, const char *file, const switch_codec_implementation_t *impl);
+
+/*!
+  \brief encode a file into the native sibling switch_ivr_play_file picks for legs using that codec
+  \param pool the pool to use
+  \param file the path to the original file
+  \param impl the codec implementation to encode with
+  \param native_file optional pointer to the path that was written
+  \return SWITCH_STATUS_SUCCESS if the sibling was written
+*/
+SWITCH_DECLARE(switch_status_t) switch_ivr_native_file_encode(switch_memory_pool_t *pool, const char *file, const switch_codec_implementation_t *impl,
+															  char **native_file);
+
 SWITCH_DECLARE(switch_status_t) switch_ivr_wait_for_silence(switch_core_session_t *session, uint32_t thresh, uint32_t silence_hits,
 															uint32_t listen_hits, uint32_t timeout_ms, const char *file);
 
@@ -125,6 +125,23 @@ SWITCH_DECLARE(void) switch_log_vprintf(_In_ switch_text_channel_t channel, _In_
 SWITCH_DECLARE(switch_status_t) switch_log_bind_logger(_In_ switch_log_function_t function, _In_ switch_log_level_t level, _In_ switch_bool_t is_console);
 SWITCH_DECLARE(switch_status_t) switch_log_unbind_logger(_In_ switch_log_function_t function);
 
+/*! 
+  \brief Change the highest level a bound logger wants to see
+  \param function the logger function
+  \param level the new level
+  \return SWITCH_STATUS_SUCCESS if the logger is bound
+  \note lines above the level of every logger are dropped before they are formatted
+*/
+SWITCH_DECLARE(switch_status_t) switch_log_set_logger_level(_In_ switch_log_function_t function, _In_ switch_log_level_t level);
+
+/*! 
+  \brief Compare formatting log lines in the calling thread with deferring it to the logger thread
+  \param stream the stream to write the results to
+  \param lines the number of lines each thread logs
+  \param threads the number of threads logging at once
+*/
+SWITCH_DECLARE(void) switch_log_bench(_In_ switch_stream_handle_t *stream, _In_ uint32_t lines, _In_ uint32_t threads);
+
 /*! 
   \brief Return the name of the specified log level
   \param level the level
@@ -343,6 +343,10 @@ struct switch_file_handle {
 	char *file_path;
 	char *spool_path;
 	const char *prefix;
+	/*! decoded audio shared from the prompt cache, read in place of the file when set */
+	struct switch_prompt_cache_entry *prompt_cache;
+	/*! queue drained by the writer threads, writes go here instead of the file when set */
+	struct switch_file_writer *async_writer;
 };
 
 /*! \brief Abstract interface to an asr module */
@@ -76,6 +76,24 @@ SWITCH_DECLARE(void) switch_capture_regex(switch_regex_t *re, int match_count, c
 SWITCH_DECLARE_NONSTD(void) switch_regex_set_var_callback(const char *var, const char *val, void *user_data);
 SWITCH_DECLARE_NONSTD(void) switch_regex_set_event_header_callback(const char *var, const char *val, void *user_data);
 
+/*!
+ \brief Set how many compiled patterns switch_regex_perform and switch_regex_match keep for reuse
+ \param size most patterns cached, 0 to compile every expression each time it is used
+*/
+SWITCH_DECLARE(void) switch_regex_cache_set_size(uint32_t size);
+
+/*!
+ \brief Drop every compiled pattern from the cache
+*/
+SWITCH_DECLARE(void) switch_regex_cache_flush(void);
+
+/*!
+ \brief Write compiled pattern cache occupancy and hit rate to a stream
+ \param stream the stream to write to
+ \param reset clear the counters after reporting them
+*/
+SWITCH_DECLARE(void) switch_regex_cache_stats(switch_stream_handle_t *stream, switch_bool_t reset);
+
 #define switch_regex_safe_free(re)	if (re) {\
 				switch_regex_free(re);\
 				re = NULL;\
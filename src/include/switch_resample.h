@@ -167,6 +167,37 @@ SWITCH_DECLARE(void) switch_change_sln_volume(int16_t *data, uint32_t samples, i
   \param vol the volume factor -12 -> 12
  */
 SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t samples, int32_t vol);
+
+/*!
+  \brief Add a signed linear audio frame into a 32 bit mix
+  \param mix the mix to add to
+  \param data the audio data
+  \param samples the number of 2 byte samples
+ */
+SWITCH_DECLARE(void) switch_accumulate_sln(int32_t *mix, const int16_t *data, uint32_t samples);
+
+/*!
+  \brief Render a 32 bit mix to signed linear, taking out one participant's own audio
+  \param out the audio data buffer
+  \param mix the mix made with switch_accumulate_sln
+  \param self the audio to remove from the mix (NULL for none)
+  \param self_samples the number of samples in self
+  \param samples the number of 2 byte samples to render
+  \note samples outside the 16 bit range are saturated like switch_normalize_to_16bit
+ */
+SWITCH_DECLARE(void) switch_unmix_sln(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t self_samples, uint32_t samples);
+
+/*!
+  \brief Select the implementation used by the mixing and volume routines
+  \param name scalar, sse2, avx2 or auto for the best one this cpu supports
+  \return SWITCH_STATUS_FALSE if the cpu or the build does not support it
+ */
+SWITCH_DECLARE(switch_status_t) switch_sln_kernel_set(const char *name);
+
+/*!
+  \brief Get the name of the implementation used by the mixing and volume routines
+ */
+SWITCH_DECLARE(const char *) switch_sln_kernel_name(void);
 ///\}
 
 SWITCH_DECLARE(uint32_t) switch_merge_sln(int16_t *data, uint32_t samples, int16_t *other_data, uint32_t other_samples);
@@ -90,6 +90,33 @@ SWITCH_DECLARE(void) switch_rtp_get_random(void *buf, uint32_t len);
 SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool);
 SWITCH_DECLARE(void) switch_rtp_shutdown(void);
 
+/*!
+  \brief Set how many media reactor threads drain and feed the RTP sockets
+  \param threads number of threads, -1 for one per cpu, 0 to let every leg use its own socket
+  \note only takes effect when the RTP system starts
+*/
+SWITCH_DECLARE(void) switch_rtp_set_reactor_threads(int threads);
+
+/*!
+  \brief Write per-reactor packet and syscall counts to a stream
+  \param stream the stream to write to
+  \param reset clear the counters after reporting them
+*/
+SWITCH_DECLARE(void) switch_rtp_reactor_stats(switch_stream_handle_t *stream, switch_bool_t reset);
+
+/*!
+  \brief Share one RTP port between every leg on a local address
+  \param port the shared port, 0 to give every leg a port of its own
+  \note needs the media reactor, which is started for it if rtp-reactor-threads is 0
+*/
+SWITCH_DECLARE(void) switch_rtp_set_mux_port(switch_port_t port);
+
+/*!
+  \brief Get the shared RTP port
+  \return the port switch_rtp_request_port hands out to every leg, 0 when ports are not shared
+*/
+SWITCH_DECLARE(switch_port_t) switch_rtp_get_mux_port(void);
+
 /*!
   \brief Set/Get RTP start port
   \param port new value (if > 0)
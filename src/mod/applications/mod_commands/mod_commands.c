@@ -41,6 +41,9 @@
 #include <switch.h>
 #include <switch_stun.h>
 #include <switch_version.h>
+#ifndef WIN32
+#include <sys/resource.h>
+#endif
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_commands_shutdown);
@@ -320,6 +323,17 @@ SWITCH_STANDARD_API(db_cache_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_STANDARD_API(event_dispatch_function)
+{
+	if (!zstr(cmd) && switch_stristr("status", cmd)) {
+		switch_event_dispatch_status(stream);
+	} else {
+		stream->write_function(stream, "%s", "parameter missing\n");
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(host_lookup_function)
 {
 	char host[256] = "";
@@ -573,6 +587,924 @@ SWITCH_STANDARD_API(timer_test_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
+#define MIX_TEST_SYNTAX "<members> [<rate>] [<frames>] [scalar|sse2|avx2|all]"
+
+static double mix_test_run(int16_t **frames, int16_t **outs, int members, uint32_t samples, int loops)
+{
+	int32_t *mix;
+	switch_time_t start;
+	int i, m;
+
+	switch_zmalloc(mix, samples * sizeof(*mix));
+
+	start = switch_time_ref();
+
+	/* one conference tick: sum everyone, give each member the mix minus itself, then apply each member's output volume */
+	for (i = 0; i < loops; i++) {
+		memset(mix, 0, samples * sizeof(*mix));
+
+		for (m = 0; m < members; m++) {
+			switch_accumulate_sln(mix, frames[m], samples);
+		}
+
+		for (m = 0; m < members; m++) {
+			switch_unmix_sln(outs[m], mix, frames[m], samples, samples);
+		}
+
+		for (m = 0; m < members; m++) {
+			switch_change_sln_volume(outs[m], samples, (m % 3) - 1);
+		}
+	}
+
+	free(mix);
+
+	return (double) (switch_time_ref() - start);
+}
+
+SWITCH_STANDARD_API(mix_test_function)
+{
+	char *mycmd = NULL, *argv[4] = { 0 };
+	const char *kernels[] = { "scalar", "sse2", "avx2", NULL };
+	const char *active;
+	int argc, members, loops = 5000, m, k;
+	uint32_t rate = 16000, samples, x;
+	int16_t **frames, **outs;
+	double usec;
+
+	if (zstr(cmd) || !(mycmd = strdup(cmd)) || (argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])))) < 1 ||
+		(members = atoi(argv[0])) < 1) {
+		stream->write_function(stream, "-USAGE: %s\n", MIX_TEST_SYNTAX);
+		goto end;
+	}
+
+	if (argc > 1 && atoi(argv[1]) >= 8000) {
+		rate = atoi(argv[1]);
+	}
+
+	if (argc > 2 && atoi(argv[2]) > 0) {
+		loops = atoi(argv[2]);
+	}
+
+	samples = rate / 50;
+	switch_zmalloc(frames, members * sizeof(*frames));
+	switch_zmalloc(outs, members * sizeof(*outs));
+
+	for (m = 0; m < members; m++) {
+		switch_zmalloc(frames[m], samples * sizeof(int16_t));
+		switch_zmalloc(outs[m], samples * sizeof(int16_t));
+		for (x = 0; x < samples; x++) {
+			frames[m][x] = (int16_t) ((rand() % 16384) - 8192);
+		}
+	}
+
+	active = switch_sln_kernel_name();
+
+	for (k = 0; kernels[k]; k++) {
+		if (argc > 3 && strcasecmp(argv[3], "all") && strcasecmp(argv[3], kernels[k])) {
+			continue;
+		}
+
+		if (argc < 4 && strcasecmp(kernels[k], "scalar") && strcasecmp(kernels[k], active)) {
+			continue;
+		}
+
+		if (switch_sln_kernel_set(kernels[k]) != SWITCH_STATUS_SUCCESS) {
+			stream->write_function(stream, "%-8s not supported\n", kernels[k]);
+			continue;
+		}
+
+		usec = mix_test_run(frames, outs, members, samples, loops);
+		stream->write_function(stream, "%-8s %d members @%uhz: %.0f frames/sec (%.1fx realtime)\n",
+							   kernels[k], members, rate, loops * 1000000.0 / usec, loops * 20000.0 / usec);
+	}
+
+	switch_sln_kernel_set(active);
+
+	for (m = 0; m < members; m++) {
+		free(frames[m]);
+		free(outs[m]);
+	}
+	free(frames);
+	free(outs);
+
+  end:
+	switch_safe_free(mycmd);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define TIMER_SHARDS_SYNTAX "[reset]"
+
+SWITCH_STANDARD_API(timer_shards_function)
+{
+	switch_time_timer_shard_stats(stream, (!zstr(cmd) && !strcasecmp(cmd, "reset")) ? SWITCH_TRUE : SWITCH_FALSE);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define RTP_REACTOR_SYNTAX "[reset]"
+
+SWITCH_STANDARD_API(rtp_reactor_function)
+{
+	switch_rtp_reactor_stats(stream, (!zstr(cmd) && !strcasecmp(cmd, "reset")) ? SWITCH_TRUE : SWITCH_FALSE);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define RTP_MUX_BENCH_SYNTAX "<legs> [<seconds>] [<base port>]"
+
+/* open fds and resident kb of this process, -1 where the platform can't say */
+static void rtp_mux_bench_usage(switch_memory_pool_t *pool, long *fds, long *rss_kb)
+{
+	*fds = -1;
+	*rss_kb = -1;
+#ifdef __linux__
+	{
+		switch_dir_t *dir;
+		FILE *f;
+		long pages = 0, rss = 0;
+		char name[256];
+
+		if (switch_dir_open(&dir, "/proc/self/fd", pool) == SWITCH_STATUS_SUCCESS) {
+			*fds = 0;
+			while (switch_dir_next_file(dir, name, sizeof(name))) {
+				(*fds)++;
+			}
+			switch_dir_close(dir);
+		}
+
+		if ((f = fopen("/proc/self/statm", "r"))) {
+			if (fscanf(f, "%ld %ld", &pages, &rss) == 2) {
+				*rss_kb = rss * (sysconf(_SC_PAGESIZE) / 1024);
+			}
+			fclose(f);
+		}
+	}
+#endif
+}
+
+static double rtp_mux_bench_cpu(void)
+{
+#ifndef WIN32
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000.0 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#else
+	return 0;
+#endif
+}
+
+static int rtp_mux_bench_drain(switch_rtp_t *rtp_session, switch_bool_t echo)
+{
+	switch_frame_t frame = { 0 };
+	int got = 0;
+
+	while (switch_rtp_zerocopy_read_frame(rtp_session, &frame, SWITCH_IO_FLAG_NOBLOCK) == SWITCH_STATUS_SUCCESS &&
+		   frame.datalen && !switch_test_flag((&frame), SFF_CNG)) {
+		got++;
+
+		if (echo) {
+			switch_frame_flag_t flags = 0;
+			switch_rtp_write_manual(rtp_session, frame.data, frame.datalen, 0, 0, 160, &flags);
+		}
+	}
+
+	return got;
+}
+
+/* far ends on ports of their own talk to the legs under test, which echo everything back */
+static void rtp_mux_bench_run(switch_stream_handle_t *stream, switch_port_t mux_port, int legs, int seconds, switch_port_t base)
+{
+	switch_memory_pool_t *pool = NULL;
+	switch_rtp_t **far, **near;
+	const char *err = NULL;
+	long fds0, rss0, fds1, rss1;
+	uint64_t near_rx = 0, far_rx = 0;
+	int i, t, ticks = seconds * 50, ok = 0;
+	double cpu;
+	char buf[160];
+
+	switch_core_new_memory_pool(&pool);
+	far = switch_core_alloc(pool, legs * sizeof(*far));
+	near = switch_core_alloc(pool, legs * sizeof(*near));
+	memset(buf, 0x55, sizeof(buf));
+
+	for (i = 0; i < legs; i++) {
+		switch_port_t nport = mux_port ? mux_port : (switch_port_t) (base + 2 * legs + 2 * i);
+
+		if (!(far[i] = switch_rtp_new("127.0.0.1", (switch_port_t) (base + 2 * i), "127.0.0.1", nport, 0, 160, 20000, 0, NULL, &err, pool))) {
+			stream->write_function(stream, "-ERR far end %d: %s\n", i, err);
+			goto end;
+		}
+	}
+
+	rtp_mux_bench_usage(pool, &fds0, &rss0);
+
+	for (i = 0; i < legs; i++) {
+		switch_port_t nport = mux_port ? mux_port : (switch_port_t) (base + 2 * legs + 2 * i);
+
+		if (!(near[i] = switch_rtp_new("127.0.0.1", nport, "127.0.0.1", (switch_port_t) (base + 2 * i), 0, 160, 20000, 0, NULL, &err, pool))) {
+			stream->write_function(stream, "-ERR leg %d: %s\n", i, err);
+			goto end;
+		}
+	}
+
+	rtp_mux_bench_usage(pool, &fds1, &rss1);
+
+	cpu = rtp_mux_bench_cpu();
+
+	for (t = 0; t < ticks; t++) {
+		for (i = 0; i < legs; i++) {
+			switch_frame_flag_t flags = 0;
+			switch_rtp_write_manual(far[i], buf, sizeof(buf), 0, 0, 160, &flags);
+		}
+
+		for (i = 0; i < legs; i++) {
+			near_rx += rtp_mux_bench_drain(near[i], SWITCH_TRUE);
+		}
+
+		for (i = 0; i < legs; i++) {
+			far_rx += rtp_mux_bench_drain(far[i], SWITCH_FALSE);
+		}
+
+		switch_yield(20000);
+	}
+
+	for (i = 0; i < legs; i++) {
+		near_rx += rtp_mux_bench_drain(near[i], SWITCH_TRUE);
+	}
+
+	switch_yield(20000);
+
+	for (i = 0; i < legs; i++) {
+		far_rx += rtp_mux_bench_drain(far[i], SWITCH_FALSE);
+	}
+
+	cpu = rtp_mux_bench_cpu() - cpu;
+	ok = 1;
+
+	stream->write_function(stream, "%-5s %6d %8.2f %8.1f %10.1f %8.1f%% %8.1f%%\n", mux_port ? "mux" : "port", legs,
+						   fds0 < 0 ? -1.0 : (double) (fds1 - fds0) / legs, rss0 < 0 ? -1.0 : (double) (rss1 - rss0) / legs,
+						   cpu / legs / seconds, near_rx * 100.0 / ((double) legs * ticks), far_rx * 100.0 / ((double) legs * ticks));
+
+  end:
+
+	if (!ok) {
+		stream->write_function(stream, "%-5s did not run\n", mux_port ? "mux" : "port");
+	}
+
+	for (i = 0; i < legs; i++) {
+		if (near[i]) {
+			switch_rtp_destroy(&near[i]);
+		}
+		if (far[i]) {
+			switch_rtp_destroy(&far[i]);
+		}
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+}
+
+SWITCH_STANDARD_API(rtp_mux_bench_function)
+{
+	char *mycmd = NULL, *argv[3] = { 0 };
+	int argc, legs, seconds = 5;
+	switch_port_t base = 40000, mux_port = switch_rtp_get_mux_port();
+
+	if (zstr(cmd) || !(mycmd = strdup(cmd)) || (argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])))) < 1 ||
+		(legs = atoi(argv[0])) < 1) {
+		stream->write_function(stream, "-USAGE: %s\n", RTP_MUX_BENCH_SYNTAX);
+		goto end;
+	}
+
+	if (argc > 1 && atoi(argv[1]) > 0) {
+		seconds = atoi(argv[1]);
+	}
+
+	if (argc > 2 && atoi(argv[2]) > 1024) {
+		base = (switch_port_t) atoi(argv[2]);
+	}
+
+	if (base + 4 * legs > 65535) {
+		stream->write_function(stream, "-ERR not enough ports above %d for %d legs\n", base, legs);
+		goto end;
+	}
+
+	stream->write_function(stream, "%-5s %6s %8s %8s %10s %9s %9s\n", "mode", "legs", "fds/leg", "kb/leg", "cpu_us/s", "rx", "echo");
+
+	rtp_mux_bench_run(stream, 0, legs, seconds, base);
+
+	if (mux_port) {
+		rtp_mux_bench_run(stream, mux_port, legs, seconds, base);
+	} else {
+		stream->write_function(stream, "mux   not configured, set rtp-mux-port in switch.conf\n");
+	}
+
+  end:
+	switch_safe_free(mycmd);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define REGEX_CACHE_SYNTAX "[reset|flush]"
+
+SWITCH_STANDARD_API(regex_cache_function)
+{
+	if (!zstr(cmd) && !strcasecmp(cmd, "flush")) {
+		switch_regex_cache_flush();
+		stream->write_function(stream, "+OK\n");
+	} else {
+		switch_regex_cache_stats(stream, (!zstr(cmd) && !strcasecmp(cmd, "reset")) ? SWITCH_TRUE : SWITCH_FALSE);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define PROMPT_CACHE_SYNTAX "[reset|flush]"
+
+SWITCH_STANDARD_API(prompt_cache_function)
+{
+	if (!zstr(cmd) && !strcasecmp(cmd, "flush")) {
+		switch_core_file_cache_flush();
+		stream->write_function(stream, "+OK\n");
+	} else {
+		switch_core_file_cache_stats(stream, (!zstr(cmd) && !strcasecmp(cmd, "reset")) ? SWITCH_TRUE : SWITCH_FALSE);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define NATIVE_ENCODE_SYNTAX "<file|dir> <codec>[@<rate>h][@<ptime>i][,<codec>...]"
+
+static int native_encode_file(switch_stream_handle_t *stream, const char *file, const switch_codec_implementation_t **impls, int count)
+{
+	switch_memory_pool_t *pool = NULL;
+	const char *ext;
+	char *native_file;
+	switch_codec_interface_t *codec_interface;
+	switch_file_interface_t *file_interface;
+	switch_status_t status;
+	int i, written = 0;
+
+	/* leave earlier output and half written files alone */
+	if (!(ext = strrchr(file, '.')) || !strcasecmp(ext, ".tmp")) {
+		return 0;
+	}
+
+	if ((codec_interface = switch_loadable_module_get_codec_interface(ext + 1))) {
+		UNPROTECT_INTERFACE(codec_interface);
+		return 0;
+	}
+
+	/* nothing can read it, so it is not a prompt: skip it quietly, a directory holds all sorts */
+	if (!(file_interface = switch_loadable_module_get_file_interface(ext + 1))) {
+		return 0;
+	}
+	UNPROTECT_INTERFACE(file_interface);
+
+	switch_core_new_memory_pool(&pool);
+
+	for (i = 0; i < count; i++) {
+		if ((status = switch_ivr_native_file_encode(pool, file, impls[i], &native_file)) == SWITCH_STATUS_SUCCESS) {
+			stream->write_function(stream, "+OK %s\n", native_file);
+			written++;
+		} else if (status == SWITCH_STATUS_NOTIMPL) {
+			stream->write_function(stream, "-ERR %s can't be played natively\n", impls[i]->iananame);
+		} else {
+			stream->write_function(stream, "-ERR %s %s@%uh@%ui\n", file, impls[i]->iananame,
+								   impls[i]->actual_samples_per_second, impls[i]->microseconds_per_packet / 1000);
+		}
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+
+	return written;
+}
+
+SWITCH_STANDARD_API(native_encode_function)
+{
+	char *mydata = NULL, *argv[2] = { 0 }, *prefs[32] = { 0 };
+	const switch_codec_implementation_t *impls[32] = { 0 };
+	switch_memory_pool_t *pool = NULL;
+	switch_dir_t *dir = NULL;
+	const char *fname;
+	char buf[1024];
+	int argc, nprefs, count, written = 0;
+
+	if (zstr(cmd) || !(mydata = strdup(cmd)) || (argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])))) < 2) {
+		stream->write_function(stream, "-USAGE: %s\n", NATIVE_ENCODE_SYNTAX);
+		goto done;
+	}
+
+	nprefs = switch_separate_string(argv[1], ',', prefs, (sizeof(prefs) / sizeof(prefs[0])));
+
+	if (!(count = switch_loadable_module_get_codecs_sorted(impls, sizeof(impls) / sizeof(impls[0]), prefs, nprefs))) {
+		stream->write_function(stream, "-ERR no such codec %s\n", argv[1]);
+		goto done;
+	}
+
+	switch_core_new_memory_pool(&pool);
+
+	if (switch_dir_open(&dir, argv[0], pool) == SWITCH_STATUS_SUCCESS) {
+		while ((fname = switch_dir_next_file(dir, buf, sizeof(buf)))) {
+			char *path = switch_mprintf("%s%s%s", argv[0], SWITCH_PATH_SEPARATOR, fname);
+
+			written += native_encode_file(stream, path, impls, count);
+			free(path);
+		}
+		switch_dir_close(dir);
+	} else {
+		written = native_encode_file(stream, argv[0], impls, count);
+	}
+
+	stream->write_function(stream, "+OK %d native file%s written\n", written, written == 1 ? "" : "s");
+
+  done:
+
+	if (pool) {
+		switch_core_destroy_memory_pool(&pool);
+	}
+
+	switch_safe_free(mydata);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_STANDARD_API(record_writers_function)
+{
+	switch_core_file_writer_stats(stream);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define SESSION_POOL_SYNTAX "[reset]"
+
+SWITCH_STANDARD_API(session_pool_function)
+{
+	switch_core_session_thread_pool_stats(stream, (!zstr(cmd) && !strcasecmp(cmd, "reset")) ? SWITCH_TRUE : SWITCH_FALSE);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define SESSION_POOL_BENCH_SYNTAX "<calls> [<concurrency>] [<dial string>]"
+
+typedef struct {
+	const char *dial;
+	int calls;
+	int failed;
+	switch_time_t originate_total;
+} session_pool_bench_t;
+
+static void *SWITCH_THREAD_FUNC session_pool_bench_thread(switch_thread_t *thread, void *obj)
+{
+	session_pool_bench_t *b = (session_pool_bench_t *) obj;
+	int i;
+
+	for (i = 0; i < b->calls; i++) {
+		switch_core_session_t *session = NULL;
+		switch_call_cause_t cause = SWITCH_CAUSE_NONE;
+		switch_time_t start = switch_micro_time_now();
+
+		if (switch_ivr_originate(NULL, &session, &cause, b->dial, 10, NULL, NULL, NULL, NULL, NULL, SOF_NONE, NULL) != SWITCH_STATUS_SUCCESS) {
+			b->failed++;
+			continue;
+		}
+
+		b->originate_total += switch_micro_time_now() - start;
+		switch_channel_hangup(switch_core_session_get_channel(session), SWITCH_CAUSE_NORMAL_CLEARING);
+		switch_core_session_rwunlock(session);
+	}
+
+	return NULL;
+}
+
+/* originate and hang up calls from a few threads at once, timed until every leg has gone away */
+static void session_pool_bench_run(switch_stream_handle_t *stream, switch_bool_t use_pool, int calls, int concurrency, const char *dial)
+{
+	switch_memory_pool_t *pool = NULL;
+	switch_thread_t **threads;
+	session_pool_bench_t *b;
+	switch_threadattr_t *thd_attr = NULL;
+	switch_time_t start, elapsed, originate_total = 0;
+	uint32_t base = switch_core_session_count(), left;
+	int i, done = 0, failed = 0, loops;
+	double secs;
+
+	switch_core_session_thread_pool_use(use_pool);
+
+	switch_core_new_memory_pool(&pool);
+	threads = switch_core_alloc(pool, concurrency * sizeof(*threads));
+	b = switch_core_alloc(pool, concurrency * sizeof(*b));
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	start = switch_micro_time_now();
+
+	for (i = 0; i < concurrency; i++) {
+		b[i].dial = dial;
+		b[i].calls = calls / concurrency + (i < calls % concurrency ? 1 : 0);
+		switch_thread_create(&threads[i], thd_attr, session_pool_bench_thread, &b[i], pool);
+	}
+
+	for (i = 0; i < concurrency; i++) {
+		switch_status_t st;
+
+		if (threads[i]) {
+			switch_thread_join(&st, threads[i]);
+		}
+		done += b[i].calls - b[i].failed;
+		failed += b[i].failed;
+		originate_total += b[i].originate_total;
+	}
+
+	/* legs that outlive their hangup by this long are reported rather than waited for */
+	for (loops = 0; switch_core_session_count() > base && loops < 5000; loops++) {
+		switch_yield(1000);
+	}
+
+	elapsed = switch_micro_time_now() - start;
+	secs = elapsed / 1000000.0;
+
+	left = switch_core_session_count();
+
+	stream->write_function(stream, "%-7s %6d %6d %6u %8.3f %8.1f %12.2f\n", use_pool ? "pool" : "thread", done, failed, left > base ? left - base : 0,
+						   secs, secs > 0 ? done / secs : 0, done ? originate_total / 1000.0 / done : 0);
+
+	switch_core_destroy_memory_pool(&pool);
+}
+
+SWITCH_STANDARD_API(session_pool_bench_function)
+{
+	char *mycmd = NULL, *argv[3] = { 0 };
+	int argc, calls, concurrency = 4;
+	const char *dial = "loopback/echo/default/inline";
+	switch_bool_t was;
+
+	if (zstr(cmd) || !(mycmd = strdup(cmd)) || (argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])))) < 1 ||
+		(calls = atoi(argv[0])) < 1) {
+		stream->write_function(stream, "-USAGE: %s\n", SESSION_POOL_BENCH_SYNTAX);
+		goto end;
+	}
+
+	if (argc > 1 && atoi(argv[1]) > 0) {
+		concurrency = atoi(argv[1]);
+	}
+
+	if (argc > 2 && !zstr(argv[2])) {
+		dial = argv[2];
+	}
+
+	if (concurrency > calls) {
+		concurrency = calls;
+	}
+
+	stream->write_function(stream, "%-7s %6s %6s %6s %8s %8s %12s\n", "mode", "calls", "failed", "left", "seconds", "cps", "originate_ms");
+
+	was = switch_core_session_thread_pool_use(SWITCH_FALSE);
+	session_pool_bench_run(stream, SWITCH_FALSE, calls, concurrency, dial);
+	session_pool_bench_run(stream, SWITCH_TRUE, calls, concurrency, dial);
+	switch_core_session_thread_pool_use(was);
+
+  end:
+	switch_safe_free(mycmd);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define LOG_BENCH_SYNTAX "[<lines>] [<threads>]"
+
+SWITCH_STANDARD_API(log_bench_function)
+{
+	char *mycmd = NULL, *argv[2] = { 0 };
+	int argc = 0;
+	uint32_t lines = 100000, threads = 1;
+
+	if (!zstr(cmd) && (mycmd = strdup(cmd))) {
+		argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	if ((argc > 0 && atoi(argv[0]) <= 0) || (argc > 1 && (atoi(argv[1]) <= 0 || atoi(argv[1]) > 64))) {
+		stream->write_function(stream, "-USAGE: %s\n", LOG_BENCH_SYNTAX);
+		goto end;
+	}
+
+	if (argc > 0) {
+		lines = (uint32_t) atoi(argv[0]);
+	}
+
+	if (argc > 1) {
+		threads = (uint32_t) atoi(argv[1]);
+	}
+
+	switch_log_bench(stream, lines, threads);
+
+  end:
+	switch_safe_free(mycmd);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define HASH_BENCH_SYNTAX "[<keys>] [nocase]"
+
+SWITCH_STANDARD_API(hash_bench_function)
+{
+	char *mycmd = NULL, *argv[2] = { 0 };
+	int argc = 0, i;
+	uint32_t keys = 0, sizes[] = { 1000, 10000, 100000, 1000000 };
+	switch_bool_t case_sensitive = SWITCH_TRUE;
+
+	if (!zstr(cmd) && (mycmd = strdup(cmd))) {
+		argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	for (i = 0; i < argc; i++) {
+		if (!strcasecmp(argv[i], "nocase")) {
+			case_sensitive = SWITCH_FALSE;
+		} else if (atoi(argv[i]) > 0) {
+			keys = (uint32_t) atoi(argv[i]);
+		} else {
+			stream->write_function(stream, "-USAGE: %s\n", HASH_BENCH_SYNTAX);
+			goto end;
+		}
+	}
+
+	if (keys) {
+		switch_core_hash_bench(stream, keys, case_sensitive);
+	} else {
+		for (i = 0; i < (int) (sizeof(sizes) / sizeof(sizes[0])); i++) {
+			switch_core_hash_bench(stream, sizes[i], case_sensitive);
+		}
+	}
+
+  end:
+	switch_safe_free(mycmd);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define EVENT_TEST_SYNTAX "get_header|build|dup|fire [<headers>] [<loops>]"
+
+static const char *event_test_channel_headers[] = {
+	"Channel-State", "Channel-Call-State", "Channel-State-Number", "Channel-Name", "Unique-ID", "Call-Direction",
+	"Presence-Call-Direction", "Channel-HIT-Dialplan", "Channel-Presence-ID", "Channel-Call-UUID", "Answer-State",
+	"Hangup-Cause", "Channel-Read-Codec-Name", "Channel-Read-Codec-Rate", "Channel-Read-Codec-Bit-Rate",
+	"Channel-Write-Codec-Name", "Channel-Write-Codec-Rate", "Channel-Write-Codec-Bit-Rate", "Caller-Direction",
+	"Caller-Username", "Caller-Dialplan", "Caller-Caller-ID-Name", "Caller-Caller-ID-Number", "Caller-Orig-Caller-ID-Name",
+	"Caller-Orig-Caller-ID-Number", "Caller-Callee-ID-Name", "Caller-Callee-ID-Number", "Caller-Network-Addr", "Caller-ANI",
+	"Caller-Destination-Number", "Caller-Unique-ID", "Caller-Source", "Caller-Context", "Caller-Channel-Name",
+	"Caller-Profile-Index", "Caller-Profile-Created-Time", "Caller-Channel-Created-Time", "Caller-Channel-Answered-Time",
+	"Caller-Channel-Progress-Time", "Caller-Channel-Progress-Media-Time", "Caller-Channel-Hangup-Time",
+	"Caller-Channel-Transfer-Time", "Caller-Screen-Bit", "Caller-Privacy-Hide-Name", "Caller-Privacy-Hide-Number",
+	"variable_direction", "variable_uuid", "variable_session_id", "variable_sip_from_user", "variable_sip_from_uri",
+	"variable_sip_from_host", "variable_sip_local_network_addr", "variable_sip_network_ip", "variable_sip_network_port",
+	"variable_sip_received_ip", "variable_sip_received_port", "variable_sip_via_protocol", "variable_sip_from_user_stripped",
+	"variable_sip_req_user", "variable_sip_req_uri", "variable_sip_req_host", "variable_sip_to_user", "variable_sip_to_uri",
+	"variable_sip_to_host", "variable_sip_contact_user", "variable_sip_contact_uri", "variable_sip_contact_host",
+	"variable_sip_call_id", "variable_sip_user_agent", "variable_sip_via_host", "variable_sip_via_port",
+	"variable_sip_via_rport", "variable_switch_r_sdp", "variable_rtp_use_codec_name", "variable_rtp_use_codec_rate",
+	"variable_rtp_use_codec_ptime", "variable_read_codec", "variable_read_rate", "variable_write_codec",
+	"variable_write_rate", "variable_local_media_ip", "variable_local_media_port", "variable_remote_media_ip",
+	"variable_remote_media_port", "variable_endpoint_disposition", "variable_current_application",
+	"variable_hangup_cause", "variable_hangup_cause_q850", "variable_start_stamp", "variable_profile_start_stamp",
+	"variable_answer_stamp", "variable_end_stamp", "variable_start_epoch", "variable_start_uepoch",
+	"variable_answer_epoch", "variable_answer_uepoch", "variable_end_epoch", "variable_end_uepoch",
+	"variable_duration", "variable_billsec", "variable_progresssec", "variable_answersec", "variable_waitsec",
+	"variable_mduration", "variable_billmsec", "variable_uduration", "variable_billusec", "variable_rtp_audio_in_raw_bytes",
+	"variable_rtp_audio_in_media_bytes", "variable_rtp_audio_in_packet_count", "variable_rtp_audio_out_raw_bytes",
+	"variable_rtp_audio_out_media_bytes", "variable_rtp_audio_out_packet_count", NULL
+};
+
+/* what CDR and ESL consumers typically look for, including misses */
+static const char *event_test_lookups[] = {
+	"Unique-ID", "Event-Name", "Caller-Caller-ID-Number", "Caller-Destination-Number", "Hangup-Cause",
+	"variable_sip_call_id", "variable_billsec", "variable_duration", "variable_start_epoch", "variable_end_epoch",
+	"variable_rtp_audio_in_packet_count", "variable_accountcode", "variable_user_context", "variable_not_set", NULL
+};
+
+static switch_event_t *event_test_build(const char *subclass, int headers)
+{
+	switch_event_t *event = NULL;
+	int x;
+
+	if (subclass) {
+		switch_event_create_subclass(&event, SWITCH_EVENT_CUSTOM, subclass);
+	} else {
+		switch_event_create(&event, SWITCH_EVENT_CHANNEL_HANGUP_COMPLETE);
+	}
+
+	for (x = 0; event_test_channel_headers[x] && event->header_count < (uint32_t) headers; x++) {
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, event_test_channel_headers[x], "value-%d", x);
+	}
+
+	for (x = 0; event->header_count < (uint32_t) headers; x++) {
+		char name[80];
+		switch_snprintf(name, sizeof(name), "variable_custom_var_%d", x);
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, name, "value-%d", x);
+	}
+
+	return event;
+}
+
+#define EVENT_TEST_SUBSCRIBERS 4
+
+/* the arena starts at 4KB and grows by blocks of 32KB and up, doubling each time, so even
+   at a generous 256 bytes a header the allocations must stay logarithmic in the header count */
+static uint32_t event_test_max_allocations(uint32_t headers)
+{
+	switch_size_t need = (switch_size_t) headers * 256, have = 4096, grow = 32768;
+	uint32_t count = 1;
+
+	while (have < need) {
+		have += grow;
+		grow *= 2;
+		count++;
+	}
+
+	return count;
+}
+
+static void event_test_allocations(switch_stream_handle_t *stream, switch_event_t *event)
+{
+	uint32_t count = switch_event_allocations(event), max = event_test_max_allocations(event->header_count);
+
+	stream->write_function(stream, "allocs:  %u/event (at most %u)%s\n", count, max, count > max ? " (MISMATCH)" : "");
+}
+
+static void event_test_callback(switch_event_t *event)
+{
+	switch_atomic_inc((volatile switch_atomic_t *) event->bind_user_data);
+}
+
+static void event_test_report(switch_stream_handle_t *stream, const char *what, int loops, switch_time_t elapsed)
+{
+	stream->write_function(stream, "%-8s %0.2fus/event %0.0f events/sec\n", what, (double) elapsed / loops,
+						   elapsed ? (double) loops * 1000000 / elapsed : 0);
+}
+
+SWITCH_STANDARD_API(event_test_function)
+{
+	char *mydata = NULL, *argv[3] = { 0 };
+	int argc = 0;
+	int headers = 250, loops = 10000;
+
+	if (!zstr(cmd)) {
+		mydata = strdup(cmd);
+		switch_assert(mydata);
+		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+	}
+
+	if (argc < 1 || (strcasecmp(argv[0], "get_header") && strcasecmp(argv[0], "build") &&
+					 strcasecmp(argv[0], "dup") && strcasecmp(argv[0], "fire"))) {
+		stream->write_function(stream, "-USAGE: %s\n", EVENT_TEST_SYNTAX);
+		goto end;
+	}
+
+	if (argc > 1 && atoi(argv[1]) > 0) {
+		headers = atoi(argv[1]);
+	}
+
+	if (argc > 2 && atoi(argv[2]) > 0) {
+		loops = atoi(argv[2]);
+	}
+
+	if (!strcasecmp(argv[0], "get_header")) {
+		switch_event_t *event;
+		switch_time_t start, linear, indexed;
+		int i, x, lookups = 0, found = 0;
+
+		for (x = 0; event_test_lookups[x]; x++) {
+			lookups++;
+		}
+
+		event = event_test_build(NULL, headers);
+		switch_set_flag(event, EF_NO_INDEX);
+
+		start = switch_time_ref();
+		for (i = 0; i < loops; i++) {
+			for (x = 0; event_test_lookups[x]; x++) {
+				if (switch_event_get_header(event, event_test_lookups[x])) {
+					found++;
+				}
+			}
+		}
+		linear = switch_time_ref() - start;
+
+		switch_clear_flag(event, EF_NO_INDEX);
+		switch_event_get_header(event, "Unique-ID");
+
+		start = switch_time_ref();
+		for (i = 0; i < loops; i++) {
+			for (x = 0; event_test_lookups[x]; x++) {
+				if (switch_event_get_header(event, event_test_lookups[x])) {
+					found--;
+				}
+			}
+		}
+		indexed = switch_time_ref() - start;
+
+		stream->write_function(stream, "%u headers, %d lookups x %d loops%s\n", event->header_count, lookups, loops,
+							   found ? " (MISMATCH)" : "");
+		stream->write_function(stream, "linear:  %0.1fns/lookup\n", (double) linear * 1000 / ((double) lookups * loops));
+		stream->write_function(stream, "indexed: %0.1fns/lookup (%u slots)\n", (double) indexed * 1000 / ((double) lookups * loops),
+							   event->index_size);
+
+		switch_event_destroy(&event);
+	} else if (!strcasecmp(argv[0], "build")) {
+		switch_event_t *event;
+		switch_time_t start;
+		char *adopted;
+		int i;
+
+		start = switch_time_ref();
+		for (i = 0; i < loops; i++) {
+			event = event_test_build(NULL, headers);
+			switch_event_destroy(&event);
+		}
+
+		stream->write_function(stream, "%d headers, %d loops\n", headers, loops);
+		event_test_report(stream, "build:", loops, switch_time_ref() - start);
+
+		event = event_test_build(NULL, headers);
+		event_test_allocations(stream, event);
+
+		/* a NODUP value is the caller's buffer, not a copy of it */
+		adopted = strdup("adopted");
+		switch_assert(adopted);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM | SWITCH_STACK_NODUP, "variable_event_test_nodup", adopted);
+		stream->write_function(stream, "nodup:   %s\n",
+							   switch_event_get_header(event, "variable_event_test_nodup") == adopted ? "adopted" : "copied (MISMATCH)");
+		switch_event_destroy(&event);
+	} else if (!strcasecmp(argv[0], "dup")) {
+		switch_event_t *event, *clone = NULL;
+		switch_time_t start;
+		int i;
+
+		event = event_test_build(NULL, headers);
+
+		start = switch_time_ref();
+		for (i = 0; i < loops; i++) {
+			switch_event_dup(&clone, event);
+			switch_event_destroy(&clone);
+		}
+
+		stream->write_function(stream, "%u headers, %d loops\n", event->header_count, loops);
+		event_test_report(stream, "dup:", loops, switch_time_ref() - start);
+
+		switch_event_dup(&clone, event);
+		event_test_allocations(stream, clone);
+		switch_event_destroy(&clone);
+		switch_event_destroy(&event);
+	} else if (!strcasecmp(argv[0], "fire")) {
+		switch_event_node_t *nodes[EVENT_TEST_SUBSCRIBERS] = { 0 };
+		volatile switch_atomic_t delivered = 0;
+		switch_event_t *event;
+		switch_time_t start, fired, done;
+		uint32_t expected = (uint32_t) loops * EVENT_TEST_SUBSCRIBERS;
+		int i;
+
+		for (i = 0; i < EVENT_TEST_SUBSCRIBERS; i++) {
+			if (switch_event_bind_removable("event_test", SWITCH_EVENT_CUSTOM, "event_test::fire", event_test_callback,
+											(void *) &delivered, &nodes[i]) != SWITCH_STATUS_SUCCESS) {
+				stream->write_function(stream, "-ERR cannot bind subscriber\n");
+				goto unbind;
+			}
+		}
+
+		start = switch_time_ref();
+		for (i = 0; i < loops; i++) {
+			event = event_test_build("event_test::fire", headers);
+			switch_event_fire(&event);
+		}
+		fired = switch_time_ref() - start;
+
+		/* wait for the dispatch threads to drain */
+		for (i = 0; i < 10000 && switch_atomic_read(&delivered) < expected; i++) {
+			switch_yield(1000);
+		}
+		done = switch_time_ref() - start;
+
+		stream->write_function(stream, "%d headers, %d loops, %d subscribers, %u/%u delivered\n", headers, loops,
+							   EVENT_TEST_SUBSCRIBERS, switch_atomic_read(&delivered), expected);
+		event_test_report(stream, "fire:", loops, fired);
+		event_test_report(stream, "deliver:", loops, done);
+
+	  unbind:
+		for (i = 0; i < EVENT_TEST_SUBSCRIBERS; i++) {
+			if (nodes[i]) {
+				switch_event_unbind(&nodes[i]);
+			}
+		}
+	}
+
+  end:
+
+	switch_safe_free(mydata);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_STANDARD_API(group_call_function)
 {
 	char *domain, *dup_domain = NULL;
@@ -4000,7 +4932,7 @@ SWITCH_STANDARD_API(alias_function)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-#define SHOW_SYNTAX "codec|endpoint|application|api|dialplan|file|timer|calls [count]|channels [count|like <match string>]|calls|detailed_calls|bridged_calls|detailed_bridged_calls|aliases|complete|chat|management|modules|nat_map|say|interfaces|interface_types|tasks|limits"
+#define SHOW_SYNTAX "codec|endpoint|application|api|dialplan|file|timer|calls [count]|channels [count|like <match string>]|calls|detailed_calls|bridged_calls|detailed_bridged_calls|aliases|complete|chat|management|modules|nat_map|say|interfaces|interface_types|tasks|limits [sync]"
 SWITCH_STANDARD_API(show_function)
 {
 	char sql[1024];
@@ -4013,6 +4945,7 @@ SWITCH_STANDARD_API(show_function)
 	switch_core_flag_t cflags = switch_core_flags();
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
     const char *hostname = switch_core_get_switchname();
+	int sync = 0, argc;
 
 	if (!(cflags & SCF_USE_SQL)) {
 		stream->write_function(stream, "-ERR SQL DISABLED NO DATA AVAILABLE!\n");
@@ -4027,8 +4960,13 @@ SWITCH_STANDARD_API(show_function)
 	holder.justcount = 0;
 
 	if (cmd && (mydata = strdup(cmd))) {
-		switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
+		argc = switch_separate_string(mydata, ' ', argv, (sizeof(argv) / sizeof(argv[0])));
 		command = argv[0];
+		/* a trailing "sync" waits for the core db writers, plain show reads what is committed */
+		if (argc > 1 && !strcasecmp(argv[argc - 1], "sync")) {
+			argv[--argc] = NULL;
+			sync = 1;
+		}
 		if (argv[2] && !strcasecmp(argv[1], "as")) {
 			as = argv[2];
 		}
@@ -4051,6 +4989,10 @@ SWITCH_STANDARD_API(show_function)
 
 	holder.print_title = 1;
 
+	if (sync) {
+		switch_core_sqldb_sync(1000);
+	}
+
 	/* If you change the field qty or order of any of these select */
 	/* statements, you must also change show_callback and friends to match! */
 	if (!command) {
@@ -5357,7 +6299,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	SWITCH_ADD_API(commands_api_interface, "db_cache", "db cache management", db_cache_function, "status");
 	SWITCH_ADD_API(commands_api_interface, "domain_exists", "check if a domain exists", domain_exists_function, "<domain>");
 	SWITCH_ADD_API(commands_api_interface, "echo", "echo", echo_function, "<data>");
+	SWITCH_ADD_API(commands_api_interface, "event_dispatch", "event dispatch queue management", event_dispatch_function, "status");
 	SWITCH_ADD_API(commands_api_interface, "escape", "escape a string", escape_function, "<data>");
+	SWITCH_ADD_API(commands_api_interface, "event_test", "event_test", event_test_function, EVENT_TEST_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "eval", "eval (noop)", eval_function, "[uuid:<uuid> ]<expression>");
 	SWITCH_ADD_API(commands_api_interface, "expand", "expand vars and execute", expand_function, "[uuid:<uuid> ]<cmd> <args>");
 	SWITCH_ADD_API(commands_api_interface, "find_user_xml", "find a user", find_user_function, "<key> <user> <domain>");
@@ -5408,6 +6352,18 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	SWITCH_ADD_API(commands_api_interface, "system", "Execute a system command", system_function, SYSTEM_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "time_test", "time_test", time_test_function, "<mss> [count]");
 	SWITCH_ADD_API(commands_api_interface, "timer_test", "timer_test", timer_test_function, TIMER_TEST_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "mix_test", "Benchmark the conference mixing kernels", mix_test_function, MIX_TEST_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "timer_shards", "Show soft timer shard jitter", timer_shards_function, TIMER_SHARDS_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "rtp_reactor", "Show media reactor batching", rtp_reactor_function, RTP_REACTOR_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "rtp_mux_bench", "Compare per-leg RTP ports with the shared port", rtp_mux_bench_function, RTP_MUX_BENCH_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "regex_cache", "Show or flush the compiled regex cache", regex_cache_function, REGEX_CACHE_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "prompt_cache", "Show or flush the shared decoded prompt cache", prompt_cache_function, PROMPT_CACHE_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "native_encode", "Pre-encode files for native playback", native_encode_function, NATIVE_ENCODE_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "record_writers", "Show the async recording writers and their lag", record_writers_function, "");
+	SWITCH_ADD_API(commands_api_interface, "session_pool", "Show session thread pool usage", session_pool_function, SESSION_POOL_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "hash_bench", "Compare the core hash with the old sqlite hash", hash_bench_function, HASH_BENCH_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "log_bench", "Compare formatting log lines on the spot with deferring it to the logger", log_bench_function, LOG_BENCH_SYNTAX);
+	SWITCH_ADD_API(commands_api_interface, "session_pool_bench", "Compare call setup on the session thread pool with a thread per call", session_pool_bench_function, SESSION_POOL_BENCH_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "tone_detect", "Start Tone Detection on a channel", tone_detect_session_function, TONE_DETECT_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "unload", "Unload Module", unload_function, UNLOAD_SYNTAX);
 	SWITCH_ADD_API(commands_api_interface, "unsched_api", "Unschedule an api command", unsched_api_function, UNSCHED_SYNTAX);
@@ -5466,6 +6422,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_commands_load)
 	switch_console_set_complete("add complete add");
 	switch_console_set_complete("add complete del");
 	switch_console_set_complete("add db_cache status");
+	switch_console_set_complete("add event_dispatch status");
 	switch_console_set_complete("add fsctl debug_level");
 	switch_console_set_complete("add fsctl debug_sql");
 	switch_console_set_complete("add fsctl last_sps");
@@ -74,6 +74,11 @@ static int EC = 0;
 #define CONF_DBUFFER_MAX 0
 #define CONF_CHAT_PROTO "conf"
 
+/* most worker threads the shared mixing pool will start */
+#define CONF_MIX_MAX_THREADS 32
+/* default member count at which a conference starts mixing on the pool */
+#define CONF_MIX_PARALLEL_MEMBERS 64
+
 #ifndef MIN
 #define MIN(a, b) ((a)<(b)?(a):(b))
 #endif
@@ -108,6 +113,9 @@ static struct {
 	int32_t running;
 	uint32_t threads;
 	switch_event_node_t *node;
+	switch_queue_t *mix_queue;
+	switch_thread_t *mix_threads[CONF_MIX_MAX_THREADS];
+	uint32_t mix_thread_count;
 } globals;
 
 /* forward declaration for conference_obj and caller_control */
@@ -318,6 +326,7 @@ typedef struct conference_obj {
 	int endconf_grace_time;
 
 	uint32_t relationship_total;
+	uint32_t mix_parallel_members;
 	uint32_t score;
 	int mux_loop_count;
 	int member_loop_count;
@@ -1312,6 +1321,366 @@ static void *SWITCH_THREAD_FUNC conference_video_thread_run(switch_thread_t *thr
 	return NULL;
 }
 
+/* Parallel mixing: big conferences hand the per-member read and mix-minus-self stages to a shared worker pool
+   while the conference thread keeps the timer, the file playback and everything else that is not per member. */
+
+typedef enum {
+	MIX_STAGE_READ,
+	MIX_STAGE_WRITE
+} conference_mix_stage_t;
+
+typedef struct conference_mix_job_s conference_mix_job_t;
+
+typedef struct conference_mix_slice_s {
+	conference_mix_job_t *job;
+	uint32_t start;
+	uint32_t end;
+	uint32_t ready;
+	switch_status_t status;
+	int32_t mix[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	int16_t write_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+} conference_mix_slice_t;
+
+struct conference_mix_job_s {
+	conference_obj_t *conference;
+	conference_mix_stage_t stage;
+	conference_member_t **members;
+	uint32_t member_count;
+	uint32_t member_alloc;
+	int32_t *main_frame;
+	uint32_t bytes;
+	conference_mix_slice_t *slices;
+	uint32_t slice_count;
+	uint32_t slice_max;
+	uint32_t used;
+	uint32_t ready;
+	uint32_t pending;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+};
+
+static uint32_t conference_member_read_frame(conference_member_t *member, uint32_t bytes)
+{
+	uint32_t buf_read = 0;
+
+	member->read = 0;
+	switch_clear_flag_locked(member, MFLAG_HAS_AUDIO);
+	switch_mutex_lock(member->audio_in_mutex);
+
+	if (switch_buffer_inuse(member->audio_buffer) >= bytes
+		&& (buf_read = (uint32_t) switch_buffer_read(member->audio_buffer, member->frame, bytes))) {
+		member->read = buf_read;
+		switch_set_flag_locked(member, MFLAG_HAS_AUDIO);
+	}
+	switch_mutex_unlock(member->audio_in_mutex);
+
+	return buf_read ? 1 : 0;
+}
+
+/* Create the write frame for a member who is not deaf: for each sample in the main frame check if our audio is involved
+   and if so, subtract it from the sample so we don't hear ourselves.
+   Since main frame was 32 bit int, we did not lose any detail, now that we have to convert to 16 bit we can
+   cut it off at the min and max range if need be and write the frame to the output buffer.
+ */
+static switch_status_t conference_member_mix_out(conference_obj_t *conference, conference_member_t *omember,
+												 int32_t *main_frame, int16_t *write_frame, uint32_t bytes)
+{
+	conference_member_t *imember;
+	int16_t *bptr;
+	uint32_t x;
+	int32_t z;
+	switch_size_t ok = 1;
+
+	if (!switch_test_flag(omember, MFLAG_RUNNING)) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!switch_test_flag(omember, MFLAG_CAN_HEAR)) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	bptr = (int16_t *) omember->frame;
+
+	if (!conference->relationship_total) {
+		/* subtract our own contribution and convert to 16 bit in one pass */
+		switch_unmix_sln(write_frame, main_frame, switch_test_flag(omember, MFLAG_HAS_AUDIO) ? bptr : NULL, omember->read / 2, bytes / 2);
+	} else {
+		for (x = 0; x < bytes / 2; x++) {
+			z = main_frame[x];
+			/* bptr[x] represents my own contribution to this audio sample */
+			if (switch_test_flag(omember, MFLAG_HAS_AUDIO) && x < omember->read / 2) {
+				z -= (int32_t) bptr[x];
+			}
+
+			/* when there are relationships, we have to do more work by scouring all the members to see if there are any 
+			   reasons why we should not be hearing a paticular member, and if not, delete their samples as well.
+			 */
+			for (imember = conference->members; imember; imember = imember->next) {
+				if (imember != omember && switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
+					conference_relationship_t *rel;
+					switch_size_t found = 0;
+					int16_t *rptr = (int16_t *) imember->frame;
+					for (rel = imember->relationships; rel; rel = rel->next) {
+						if ((rel->id == omember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_SPEAK)) {
+							z -= (int32_t) rptr[x];
+							found = 1;
+							break;
+						}
+					}
+					if (!found) {
+						for (rel = omember->relationships; rel; rel = rel->next) {
+							if ((rel->id == imember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_HEAR)) {
+								z -= (int32_t) rptr[x];
+								break;
+							}
+						}
+					}
+
+				}
+			}
+
+			/* Now we can convert to 16 bit. */
+			switch_normalize_to_16bit(z);
+			write_frame[x] = (int16_t) z;
+		}
+	}
+
+	switch_mutex_lock(omember->audio_out_mutex);
+	ok = switch_buffer_write(omember->mux_buffer, write_frame, bytes);
+	switch_mutex_unlock(omember->audio_out_mutex);
+
+	return ok ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
+static void conference_mix_slice_exec(conference_mix_slice_t *slice)
+{
+	conference_mix_job_t *job = slice->job;
+	conference_member_t *member;
+	uint32_t i;
+
+	if (job->stage == MIX_STAGE_READ) {
+		slice->ready = 0;
+		memset(slice->mix, 0, job->bytes * 2);
+
+		for (i = slice->start; i < slice->end; i++) {
+			member = job->members[i];
+
+			if (conference_member_read_frame(member, job->bytes)) {
+				slice->ready++;
+
+				if (switch_test_flag(member, MFLAG_RUNNING)) {
+					switch_accumulate_sln(slice->mix, (int16_t *) member->frame, member->read / 2);
+				}
+			}
+		}
+	} else {
+		slice->status = SWITCH_STATUS_SUCCESS;
+
+		for (i = slice->start; i < slice->end; i++) {
+			if (conference_member_mix_out(job->conference, job->members[i], job->main_frame, slice->write_frame, job->bytes) != SWITCH_STATUS_SUCCESS) {
+				slice->status = SWITCH_STATUS_FALSE;
+			}
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC conference_mix_worker_run(switch_thread_t *thread, void *obj)
+{
+	void *pop;
+
+	while (switch_queue_pop(globals.mix_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		conference_mix_slice_t *slice = (conference_mix_slice_t *) pop;
+		conference_mix_job_t *job = slice->job;
+
+		conference_mix_slice_exec(slice);
+
+		switch_mutex_lock(job->mutex);
+		if (!--job->pending) {
+			switch_thread_cond_signal(job->cond);
+		}
+		switch_mutex_unlock(job->mutex);
+	}
+
+	return NULL;
+}
+
+static void conference_mix_pool_start(void)
+{
+	switch_xml_t cxml, cfg, settings, param;
+	switch_threadattr_t *thd_attr = NULL;
+	int threads = -1;
+	uint32_t i;
+
+	if ((cxml = switch_xml_open_cfg(global_cf_name, &cfg, NULL))) {
+		if ((settings = switch_xml_child(cfg, "settings"))) {
+			for (param = switch_xml_child(settings, "param"); param; param = param->next) {
+				char *var = (char *) switch_xml_attr_soft(param, "name");
+				char *val = (char *) switch_xml_attr_soft(param, "value");
+
+				if (!strcasecmp(var, "mix-threads") && !zstr(val)) {
+					threads = strcasecmp(val, "auto") ? atoi(val) : -1;
+				}
+			}
+		}
+		switch_xml_free(cxml);
+	}
+
+	if (threads < 0) {
+		/* the conference thread mixes its own share, so leave it a core */
+		threads = (int) switch_core_cpu_count() - 1;
+	}
+
+	if (threads > CONF_MIX_MAX_THREADS) {
+		threads = CONF_MIX_MAX_THREADS;
+	}
+
+	if (threads <= 0) {
+		return;
+	}
+
+	switch_queue_create(&globals.mix_queue, CONF_MIX_MAX_THREADS * 64, globals.conference_pool);
+	switch_threadattr_create(&thd_attr, globals.conference_pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_threadattr_priority_increase(thd_attr);
+
+	for (i = 0; i < (uint32_t) threads; i++) {
+		if (switch_thread_create(&globals.mix_threads[i], thd_attr, conference_mix_worker_run, NULL, globals.conference_pool) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+		globals.mix_thread_count++;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Started %u conference mix threads\n", globals.mix_thread_count);
+}
+
+static void conference_mix_pool_stop(void)
+{
+	switch_status_t st;
+	uint32_t i;
+
+	for (i = 0; i < globals.mix_thread_count; i++) {
+		switch_queue_push(globals.mix_queue, NULL);
+	}
+
+	for (i = 0; i < globals.mix_thread_count; i++) {
+		switch_thread_join(&st, globals.mix_threads[i]);
+	}
+
+	globals.mix_thread_count = 0;
+}
+
+static conference_mix_job_t *conference_mix_job_alloc(conference_obj_t *conference, uint32_t slices, switch_memory_pool_t *pool)
+{
+	conference_mix_job_t *job;
+	uint32_t i;
+
+	job = switch_core_alloc(pool, sizeof(*job));
+	job->conference = conference;
+	job->slice_max = job->slice_count = slices;
+	job->slices = switch_core_alloc(pool, sizeof(conference_mix_slice_t) * job->slice_max);
+
+	for (i = 0; i < job->slice_max; i++) {
+		job->slices[i].job = job;
+	}
+
+	switch_mutex_init(&job->mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_thread_cond_create(&job->cond, pool);
+
+	return job;
+}
+
+static conference_mix_job_t *conference_mix_job_create(conference_obj_t *conference, switch_memory_pool_t *pool)
+{
+	if (!globals.mix_thread_count) {
+		return NULL;
+	}
+
+	return conference_mix_job_alloc(conference, globals.mix_thread_count + 1, pool);
+}
+
+static switch_status_t conference_mix_job_add(conference_mix_job_t *job, conference_member_t *member)
+{
+	if (job->member_count == job->member_alloc) {
+		uint32_t alloc = job->member_alloc ? job->member_alloc * 2 : 64;
+		conference_member_t **members;
+
+		if (!(members = realloc(job->members, sizeof(conference_member_t *) * alloc))) {
+			return SWITCH_STATUS_MEMERR;
+		}
+
+		job->members = members;
+		job->member_alloc = alloc;
+	}
+
+	job->members[job->member_count++] = member;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* Split the member snapshot into slices, run the first one here and the rest on the pool, and wait for all of them. */
+static switch_status_t conference_mix_run(conference_mix_job_t *job, conference_mix_stage_t stage)
+{
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	uint32_t i, n = job->slice_count, per;
+
+	if (n > job->member_count) {
+		n = job->member_count ? job->member_count : 1;
+	}
+
+	per = (job->member_count + n - 1) / n;
+	job->stage = stage;
+
+	for (i = 0; i < n; i++) {
+		job->slices[i].start = MIN(i * per, job->member_count);
+		job->slices[i].end = MIN(job->slices[i].start + per, job->member_count);
+	}
+
+	job->pending = n - 1;
+
+	for (i = 1; i < n; i++) {
+		if (switch_queue_trypush(globals.mix_queue, &job->slices[i]) != SWITCH_STATUS_SUCCESS) {
+			/* the pool is swamped, do it ourselves */
+			conference_mix_slice_exec(&job->slices[i]);
+			switch_mutex_lock(job->mutex);
+			job->pending--;
+			switch_mutex_unlock(job->mutex);
+		}
+	}
+
+	conference_mix_slice_exec(&job->slices[0]);
+
+	switch_mutex_lock(job->mutex);
+	while (job->pending) {
+		switch_thread_cond_wait(job->cond, job->mutex);
+	}
+	switch_mutex_unlock(job->mutex);
+
+	job->used = n;
+	job->ready = 0;
+
+	for (i = 0; i < n; i++) {
+		if (stage == MIX_STAGE_READ) {
+			job->ready += job->slices[i].ready;
+		} else if (job->slices[i].status != SWITCH_STATUS_SUCCESS) {
+			status = SWITCH_STATUS_FALSE;
+		}
+	}
+
+	return status;
+}
+
+/* Fold the partial sums from the read stage into the main frame. */
+static void conference_mix_merge(conference_mix_job_t *job, int32_t *main_frame)
+{
+	uint32_t i, x;
+
+	for (i = 0; i < job->used; i++) {
+		for (x = 0; x < job->bytes / 2; x++) {
+			main_frame[x] += job->slices[i].mix[x];
+		}
+	}
+}
+
 /* Main monitor thread (1 per distinct conference room) */
 static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, void *obj)
 {
@@ -1319,7 +1688,7 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	conference_member_t *imember, *omember;
 	uint32_t samples = switch_samples_per_packet(conference->rate, conference->interval);
 	uint32_t bytes = samples * 2;
-	uint8_t ready = 0, total = 0;
+	uint32_t ready = 0, total = 0;
 	switch_timer_t timer = { 0 };
 	switch_event_t *event;
 	uint8_t *file_frame;
@@ -1329,6 +1698,8 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	int32_t z = 0;
 	int member_score_sum = 0;
 	int divisor = 0;
+	conference_mix_job_t *mix_job = NULL;
+	int parallel = 0;
 	
 	if (!(divisor = conference->rate / 8000)) {
 		divisor = 1;
@@ -1369,12 +1740,24 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 		has_file_data = ready = total = 0;
 
 		floor_holder = conference->floor_holder;
+
+		parallel = 0;
+		if (conference->mix_parallel_members && conference->count >= conference->mix_parallel_members) {
+			/* the slices are only worth their memory once the conference is big enough to split, allocate them the first time it is */
+			if (!mix_job) {
+				mix_job = conference_mix_job_create(conference, conference->pool);
+			}
+			parallel = mix_job != NULL;
+		}
+
+		if (parallel) {
+			mix_job->member_count = 0;
+			mix_job->bytes = bytes;
+		}
 		
 		/* Read one frame of audio from each member channel and save it for redistribution */
 		for (imember = conference->members; imember; imember = imember->next) {
-			uint32_t buf_read = 0;
 			total++;
-			imember->read = 0;
 
 			if (switch_test_flag(imember, MFLAG_RUNNING) && imember->session) {
 				switch_channel_t *channel = switch_core_session_get_channel(imember->session);
@@ -1401,16 +1784,29 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 				}
 			}
 
-			switch_clear_flag_locked(imember, MFLAG_HAS_AUDIO);
-			switch_mutex_lock(imember->audio_in_mutex);
+			if (parallel && conference_mix_job_add(mix_job, imember) != SWITCH_STATUS_SUCCESS) {
+				uint32_t j;
+
+				/* out of memory, read whoever made it into the job and finish this round serially */
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error, mixing conference %s serially\n", conference->name);
+
+				for (j = 0; j < mix_job->member_count; j++) {
+					if (conference_member_read_frame(mix_job->members[j], bytes)) {
+						ready++;
+					}
+				}
 
-			if (switch_buffer_inuse(imember->audio_buffer) >= bytes
-				&& (buf_read = (uint32_t) switch_buffer_read(imember->audio_buffer, imember->frame, bytes))) {
-				imember->read = buf_read;
-				switch_set_flag_locked(imember, MFLAG_HAS_AUDIO);
+				parallel = 0;
+			}
+
+			if (!parallel && conference_member_read_frame(imember, bytes)) {
 				ready++;
 			}
-			switch_mutex_unlock(imember->audio_in_mutex);
+		}
+
+		if (parallel) {
+			conference_mix_run(mix_job, MIX_STAGE_READ);
+			ready = mix_job->ready;
 		}
 		
 
@@ -1606,7 +2002,7 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 
 		if (ready || has_file_data) {
 			/* Use more bits in the main_frame to preserve the exact sum of the audio samples. */
-			int main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
+			int32_t main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
 			int16_t write_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2] = { 0 };
 
 
@@ -1642,12 +2038,15 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 					}
 				}
 				
-				bptr = (int16_t *) omember->frame;
-				for (x = 0; x < omember->read / 2; x++) {
-					main_frame[x] += (int32_t) bptr[x];
+				if (!parallel) {
+					switch_accumulate_sln(main_frame, (int16_t *) omember->frame, omember->read / 2);
 				}
 			}
 
+			if (parallel) {
+				conference_mix_merge(mix_job, main_frame);
+			}
+
 			if (conference->agc_level && conference->member_loop_count) {
 				conf_energy = 0;
 			
@@ -1664,72 +2063,21 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 				if (!conference->avg_itt) conference->avg_tally = conference->score;
 			}
 			
-			/* Create write frame once per member who is not deaf for each sample in the main frame
-			   check if our audio is involved and if so, subtract it from the sample so we don't hear ourselves.
-			   Since main frame was 32 bit int, we did not lose any detail, now that we have to convert to 16 bit we can
-			   cut it off at the min and max range if need be and write the frame to the output buffer.
-			 */
-			for (omember = conference->members; omember; omember = omember->next) {
-				switch_size_t ok = 1;
-
-				if (!switch_test_flag(omember, MFLAG_RUNNING)) {
-					continue;
-				}
-
-				if (!switch_test_flag(omember, MFLAG_CAN_HEAR)) {
-					continue;
-				}
-
-				bptr = (int16_t *) omember->frame;
-				for (x = 0; x < bytes / 2; x++) {
-					z = main_frame[x];
-					/* bptr[x] represents my own contribution to this audio sample */
-					if (switch_test_flag(omember, MFLAG_HAS_AUDIO) && x <= omember->read / 2) {
-						z -= (int32_t) bptr[x];
-					}
-
-					/* when there are relationships, we have to do more work by scouring all the members to see if there are any 
-					   reasons why we should not be hearing a paticular member, and if not, delete their samples as well.
-					 */
-					if (conference->relationship_total) {
-						for (imember = conference->members; imember; imember = imember->next) {
-							if (imember != omember && switch_test_flag(imember, MFLAG_HAS_AUDIO)) {
-								conference_relationship_t *rel;
-								switch_size_t found = 0;
-								int16_t *rptr = (int16_t *) imember->frame;
-								for (rel = imember->relationships; rel; rel = rel->next) {
-									if ((rel->id == omember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_SPEAK)) {
-										z -= (int32_t) rptr[x];
-										found = 1;
-										break;
-									}
-								}
-								if (!found) {
-									for (rel = omember->relationships; rel; rel = rel->next) {
-										if ((rel->id == imember->id || rel->id == 0) && !switch_test_flag(rel, RFLAG_CAN_HEAR)) {
-											z -= (int32_t) rptr[x];
-											break;
-										}
-									}
-								}
-
-							}
-						}
-					}
+			/* Hand each member who is not deaf the mix minus their own audio */
+			if (parallel) {
+				mix_job->main_frame = main_frame;
 
-					/* Now we can convert to 16 bit. */
-					switch_normalize_to_16bit(z);
-					write_frame[x] = (int16_t) z;
-				}
-				
-				switch_mutex_lock(omember->audio_out_mutex);
-				ok = switch_buffer_write(omember->mux_buffer, write_frame, bytes);
-				switch_mutex_unlock(omember->audio_out_mutex);
-
-				if (!ok) {
+				if (conference_mix_run(mix_job, MIX_STAGE_WRITE) != SWITCH_STATUS_SUCCESS) {
 					switch_mutex_unlock(conference->mutex);
 					goto end;
 				}
+			} else {
+				for (omember = conference->members; omember; omember = omember->next) {
+					if (conference_member_mix_out(conference, omember, main_frame, write_frame, bytes) != SWITCH_STATUS_SUCCESS) {
+						switch_mutex_unlock(conference->mutex);
+						goto end;
+					}
+				}
 			}
 		}
 
@@ -1877,6 +2225,10 @@ static void *SWITCH_THREAD_FUNC conference_thread_run(switch_thread_t *thread, v
 	conference->end_time = switch_epoch_time_now(NULL);
 	conference_cdr_render(conference);
 
+	if (mix_job) {
+		switch_safe_free(mix_job->members);
+	}
+
 	if (conference->pool) {
 		switch_memory_pool_t *pool = conference->pool;
 		switch_core_destroy_memory_pool(&pool);
@@ -3235,13 +3587,13 @@ static void *SWITCH_THREAD_FUNC conference_record_thread_run(switch_thread_t *th
 	switch_thread_rwlock_create(&member->rwlock, rec->pool);
 
 	/* Setup an audio buffer for the incoming audio */
-	if (switch_buffer_create_dynamic(&member->audio_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring_dynamic(&member->audio_buffer, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
 		goto end;
 	}
 
 	/* Setup an audio buffer for the outgoing audio */
-	if (switch_buffer_create_dynamic(&member->mux_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring_dynamic(&member->mux_buffer, CONF_DBUFFER_SIZE, 0) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
 		goto end;
 	}
@@ -5325,6 +5677,132 @@ static switch_status_t conf_api_sub_set(conference_obj_t *conference,
 	return ret_status;
 }
 
+#define CONF_MIX_BENCH_SYNTAX "mix_bench <members> [<rate>] [<frames>]"
+
+/* Push synthetic members through the same read, merge and mix-minus-self stages the conference thread uses,
+   once per slice count from 1 (all on the calling thread) up to every mix thread plus the caller. */
+static switch_status_t conf_api_sub_mix_bench(conference_obj_t *conference, switch_stream_handle_t *stream, int argc, char **argv)
+{
+	switch_memory_pool_t *pool = NULL;
+	conference_obj_t *bconf;
+	conference_member_t *members;
+	conference_mix_job_t *job;
+	int16_t *src;
+	int32_t main_frame[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+	int nmembers = 0, rate = 8000, frames = 500, i, f;
+	uint32_t samples, bytes, slices, slice_max;
+	double base = 0;
+	int64_t check = 0;
+
+	if (argc < 2 || (nmembers = atoi(argv[1])) <= 0) {
+		stream->write_function(stream, "-USAGE: %s\n", CONF_MIX_BENCH_SYNTAX);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (argc > 2 && atoi(argv[2]) > 0) {
+		rate = atoi(argv[2]);
+	}
+
+	if (argc > 3 && atoi(argv[3]) > 0) {
+		frames = atoi(argv[3]);
+	}
+
+	samples = switch_samples_per_packet(rate, 20);
+	bytes = samples * 2;
+
+	if (bytes > SWITCH_RECOMMENDED_BUFFER_SIZE) {
+		stream->write_function(stream, "-ERR rate %d is too high\n", rate);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_core_new_memory_pool(&pool);
+
+	bconf = switch_core_alloc(pool, sizeof(*bconf));
+	members = switch_core_alloc(pool, sizeof(*members) * nmembers);
+	src = switch_core_alloc(pool, bytes * nmembers);
+	slice_max = globals.mix_thread_count + 1;
+	job = conference_mix_job_alloc(bconf, slice_max, pool);
+	job->bytes = bytes;
+
+	for (i = 0; i < nmembers; i++) {
+		conference_member_t *member = &members[i];
+		uint32_t x;
+
+		member->id = i + 1;
+		member->conference = bconf;
+		member->flags = MFLAG_RUNNING | MFLAG_CAN_SPEAK | MFLAG_CAN_HEAR;
+		member->frame = switch_core_alloc(pool, bytes);
+		switch_mutex_init(&member->flag_mutex, SWITCH_MUTEX_NESTED, pool);
+		switch_mutex_init(&member->audio_in_mutex, SWITCH_MUTEX_NESTED, pool);
+		switch_mutex_init(&member->audio_out_mutex, SWITCH_MUTEX_NESTED, pool);
+		switch_buffer_create_ring(pool, &member->audio_buffer, bytes * 2);
+		switch_buffer_create_ring(pool, &member->mux_buffer, bytes * 2);
+		member->next = i + 1 < nmembers ? &members[i + 1] : NULL;
+
+		for (x = 0; x < samples; x++) {
+			src[i * samples + x] = (int16_t) ((rand() % 8192) - 4096);
+		}
+	}
+
+	bconf->members = members;
+
+	for (slices = 1; slices <= slice_max; slices++) {
+		switch_time_t elapsed = 0, start;
+		int64_t sum = 0;
+		double fps;
+
+		job->slice_count = slices;
+
+		for (f = 0; f < frames; f++) {
+			int16_t out[SWITCH_RECOMMENDED_BUFFER_SIZE / 2];
+
+			for (i = 0; i < nmembers; i++) {
+				switch_buffer_write(members[i].audio_buffer, src + i * samples, bytes);
+			}
+
+			start = switch_time_now();
+
+			job->member_count = 0;
+			for (i = 0; i < nmembers; i++) {
+				if (conference_mix_job_add(job, &members[i]) != SWITCH_STATUS_SUCCESS) {
+					stream->write_function(stream, "-ERR Memory Error\n");
+					goto end;
+				}
+			}
+
+			conference_mix_run(job, MIX_STAGE_READ);
+			memset(main_frame, 0, sizeof(main_frame));
+			conference_mix_merge(job, main_frame);
+			job->main_frame = main_frame;
+			conference_mix_run(job, MIX_STAGE_WRITE);
+
+			elapsed += switch_time_now() - start;
+
+			for (i = 0; i < nmembers; i++) {
+				switch_buffer_read(members[i].mux_buffer, out, bytes);
+				sum += out[(f + i) % samples];
+			}
+		}
+
+		fps = elapsed ? (double) frames * 1000000 / elapsed : 0;
+
+		if (slices == 1) {
+			base = fps;
+			check = sum;
+		}
+
+		stream->write_function(stream, "%2u thread%s %d members @%dhz: %.0f frames/sec (%.1fx realtime, %.2fx serial)%s\n",
+							   slices, slices == 1 ? " " : "s", nmembers, rate, fps, fps / 50, base ? fps / base : 0,
+							   sum == check ? "" : " MISMATCH");
+	}
+
+  end:
+	switch_safe_free(job->members);
+	switch_core_destroy_memory_pool(&pool);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 typedef enum {
 	CONF_API_COMMAND_LIST = 0,
 	CONF_API_COMMAND_ENERGY,
@@ -5560,6 +6038,8 @@ SWITCH_STANDARD_API(conf_api_main)
 				conf_api_sub_list(NULL, stream, argc, argv);
 			} else if (strcasecmp(argv[0], "xml_list") == 0) {
 				conf_api_sub_xml_list(NULL, stream, argc, argv);
+			} else if (strcasecmp(argv[0], "mix_bench") == 0) {
+				conf_api_sub_mix_bench(NULL, stream, argc, argv);
 			} else if (strcasecmp(argv[0], "help") == 0 || strcasecmp(argv[0], "commands") == 0) {
 				stream->write_function(stream, "%s\n", api_syntax);
 			} else if (argv[1] && strcasecmp(argv[1], "dial") == 0) {
@@ -6156,13 +6636,13 @@ static int setup_media(conference_member_t *member, conference_obj_t *conference
 	}
 
 	/* Setup an audio buffer for the incoming audio */
-	if (switch_buffer_create_dynamic(&member->audio_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring_dynamic(&member->audio_buffer, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
 		goto codec_done1;
 	}
 
 	/* Setup an audio buffer for the outgoing audio */
-	if (switch_buffer_create_dynamic(&member->mux_buffer, CONF_DBLOCK_SIZE, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
+	if (switch_buffer_create_ring_dynamic(&member->mux_buffer, CONF_DBUFFER_SIZE, CONF_DBUFFER_MAX) != SWITCH_STATUS_SUCCESS) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(member->session), SWITCH_LOG_CRIT, "Memory Error Creating Audio Buffer!\n");
 		goto codec_done1;
 	}
@@ -6961,6 +7441,7 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 	char *conference_log_dir = NULL;
 	char *terminate_on_silence = NULL;
 	char *endconf_grace_time = NULL;
+	char *mix_parallel_members = NULL;
 	char uuid_str[SWITCH_UUID_FORMATTED_LENGTH+1];
 	switch_uuid_t uuid;
 	switch_codec_implementation_t read_impl = { 0 };
@@ -7172,6 +7653,8 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 				terminate_on_silence = val;
 			} else if (!strcasecmp(var, "endconf-grace-time") && !zstr(val)) {
 				endconf_grace_time = val;
+			} else if (!strcasecmp(var, "mix-parallel-members") && !zstr(val)) {
+				mix_parallel_members = val;
 			}
 		}
 
@@ -7407,6 +7890,11 @@ static conference_obj_t *conference_new(char *name, conf_xml_cfg_t cfg, switch_c
 		conference->endconf_grace_time = atoi(endconf_grace_time);
 	}
 
+	conference->mix_parallel_members = CONF_MIX_PARALLEL_MEMBERS;
+	if (!zstr(mix_parallel_members)) {
+		conference->mix_parallel_members = atoi(mix_parallel_members) > 0 ? atoi(mix_parallel_members) : 0;
+	}
+
 	if (!zstr(verbose_events) && switch_true(verbose_events)) {
 		conference->verbose_events = 1;
 	}
@@ -7772,6 +8260,13 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_conference_load)
 		}
 
 	}
+
+	nl = strlen(CONF_MIX_BENCH_SYNTAX) + 4;
+	if ((tmp = realloc(p, strlen(p) + nl))) {
+		p = tmp;
+		strcat(p, "\n\t\t");
+		strcat(p, CONF_MIX_BENCH_SYNTAX);
+	}
 	api_syntax = p;
 
 	/* create/register custom event message type */
@@ -7790,6 +8285,8 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_conference_load)
 	switch_mutex_init(&globals.hash_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
 	switch_mutex_init(&globals.setup_mutex, SWITCH_MUTEX_NESTED, globals.conference_pool);
 
+	conference_mix_pool_start();
+
 	/* Subscribe to presence request events */
 	if (switch_event_bind_removable(modname, SWITCH_EVENT_PRESENCE_PROBE, SWITCH_EVENT_SUBCLASS_ANY, pres_event_handler, NULL, &globals.node) !=
 		SWITCH_STATUS_SUCCESS) {
@@ -7825,6 +8322,8 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_conference_shutdown)
 			switch_yield(100000);
 		}
 
+		conference_mix_pool_stop();
+
 		switch_event_unbind(&globals.node);
 		switch_event_free_subclass(CONF_EVENT_MAINT);
 
@@ -35,7 +35,8 @@
 #include <fcntl.h>
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_dialplan_xml_load);
-SWITCH_MODULE_DEFINITION(mod_dialplan_xml, mod_dialplan_xml_load, NULL, NULL);
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_dialplan_xml_shutdown);
+SWITCH_MODULE_DEFINITION(mod_dialplan_xml, mod_dialplan_xml_load, mod_dialplan_xml_shutdown, NULL);
 
 typedef enum {
 	BREAK_ON_TRUE,
@@ -446,6 +447,421 @@ static int parse_exten(switch_core_session_t *session, switch_caller_profile_t *
 	return proceed;
 }
 
+/* Context index: when the dialplan comes from the main XML root, each context is compiled once per
+   root into a trie keyed on the literal text its extensions' destination_number expressions must
+   start with.  A hunt then only parses extensions whose prefix the number starts with plus those
+   that could not be indexed, in their original order.  An extension is only ever left out when
+   parse_exten is certain to fail it without side effects: its first condition tests
+   destination_number against an anchored, variable-free expression, has no time, regex or break
+   modifiers and no anti-actions. */
+
+#define DP_PREFIX_MAX 64
+
+typedef struct dp_trie_node_s {
+	char c;
+	struct dp_trie_node_s *child;
+	struct dp_trie_node_s *sibling;
+	uint32_t *extens;
+	uint32_t count;
+	uint32_t alloc;
+} dp_trie_node_t;
+
+typedef struct dp_index_s {
+	switch_memory_pool_t *pool;
+	switch_xml_t root;
+	switch_xml_t xcontext;
+	switch_xml_t *extens;
+	uint32_t count;
+	uint32_t indexed;
+	dp_trie_node_t trie;
+	int refs;
+	int stale;
+	switch_time_t build_time;
+} dp_index_t;
+
+typedef struct {
+	const uint32_t *extens[DP_PREFIX_MAX + 1];
+	uint32_t left[DP_PREFIX_MAX + 1];
+	int lists;
+} dp_cursor_t;
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_hash_t *indexes;
+	switch_event_node_t *reload_node;
+	uint64_t hunts;
+	uint64_t parsed;
+	uint64_t skipped;
+	uint64_t builds;
+} globals;
+
+/* a group starting at p that always matches exactly once and has no alternative of its own */
+static int dp_group_transparent(const char *p)
+{
+	int depth = 0, in_class = 0;
+
+	if (p[1] == '?') {
+		return 0;
+	}
+
+	for (; *p; p++) {
+		if (*p == '\\') {
+			if (!*++p) {
+				break;
+			}
+		} else if (in_class) {
+			if (*p == ']') {
+				in_class = 0;
+			}
+		} else if (*p == '[') {
+			in_class = 1;
+			if (p[1] == ']' || (p[1] == '^' && p[2] == ']')) {
+				p += p[1] == '^' ? 2 : 1;
+			}
+		} else if (*p == '(') {
+			depth++;
+		} else if (*p == ')') {
+			if (!--depth) {
+				return p[1] != '?' && p[1] != '*' && p[1] != '{';
+			}
+		} else if (*p == '|' && depth == 1) {
+			return 0;
+		}
+	}
+
+	return 0;
+}
+
+/* literal text every match of the expression has to begin with, copied to buf ("" when there is none) */
+static void dp_literal_prefix(const char *expr, char *buf, switch_size_t len)
+{
+	const char *p;
+	int depth = 0, in_class = 0;
+	switch_size_t n = 0;
+
+	*buf = '\0';
+
+	if (*expr != '^') {
+		return;
+	}
+
+	/* an alternative at the top level can match anything, so there is no common prefix */
+	for (p = expr; *p; p++) {
+		if (*p == '\\') {
+			if (!*++p) {
+				break;
+			}
+		} else if (in_class) {
+			if (*p == ']') {
+				in_class = 0;
+			}
+		} else if (*p == '[') {
+			in_class = 1;
+			if (p[1] == ']' || (p[1] == '^' && p[2] == ']')) {
+				p += p[1] == '^' ? 2 : 1;
+			}
+		} else if (*p == '(') {
+			depth++;
+		} else if (*p == ')') {
+			depth--;
+		} else if (*p == '|' && !depth) {
+			return;
+		}
+	}
+
+	for (p = expr + 1; *p && n < len - 1;) {
+		const char *q;
+		char lit;
+
+		if (*p == '(') {
+			if (!dp_group_transparent(p)) {
+				break;
+			}
+			p++;
+			continue;
+		}
+
+		if (*p == '\\') {
+			if (!p[1] || isalnum((unsigned char) p[1])) {
+				break;
+			}
+			lit = p[1];
+			q = p + 2;
+		} else if (isalnum((unsigned char) *p) || strchr("#@-_,:;=%&~!<>/'\"", *p)) {
+			lit = *p;
+			q = p + 1;
+		} else {
+			break;
+		}
+
+		if (*q == '?' || *q == '*' || *q == '{') {
+			break;
+		}
+
+		buf[n++] = lit;
+
+		if (*q == '+') {
+			break;
+		}
+
+		p = q;
+	}
+
+	buf[n] = '\0';
+}
+
+/* the expression of an extension that fails quietly unless destination_number starts with its prefix */
+static const char *dp_indexable_expression(switch_xml_t xexten)
+{
+	switch_xml_t xcond, xexpression;
+	const char *field, *expression, *brk;
+
+	if (!(xcond = switch_xml_child(xexten, "condition"))) {
+		return NULL;
+	}
+
+	if (!(field = switch_xml_attr(xcond, "field")) || strcasecmp(field, "destination_number")) {
+		return NULL;
+	}
+
+	if (switch_xml_attr(xcond, "regex") || switch_xml_child(xcond, "condition") || switch_xml_child(xcond, "anti-action") ||
+		switch_xml_std_datetime_check(xcond, NULL) != -1) {
+		return NULL;
+	}
+
+	if ((brk = switch_xml_attr(xcond, "break")) && strcasecmp(brk, "on-false")) {
+		return NULL;
+	}
+
+	if ((xexpression = switch_xml_child(xcond, "expression"))) {
+		expression = switch_str_nil(xexpression->txt);
+	} else {
+		expression = switch_xml_attr_soft(xcond, "expression");
+	}
+
+	/* expand_variables would rewrite it per call */
+	if (switch_string_var_check_const(expression) || switch_string_has_escaped_data(expression)) {
+		return NULL;
+	}
+
+	return expression;
+}
+
+static void dp_trie_add(dp_index_t *idx, dp_trie_node_t *node, uint32_t ordinal)
+{
+	if (node->count == node->alloc) {
+		uint32_t *extens;
+
+		node->alloc = node->alloc ? node->alloc * 2 : 4;
+		extens = switch_core_alloc(idx->pool, node->alloc * sizeof(*extens));
+		if (node->count) {
+			memcpy(extens, node->extens, node->count * sizeof(*extens));
+		}
+		node->extens = extens;
+	}
+
+	node->extens[node->count++] = ordinal;
+}
+
+static dp_index_t *dp_index_build(switch_xml_t root, switch_xml_t xcontext)
+{
+	switch_memory_pool_t *pool;
+	switch_xml_t xexten;
+	dp_index_t *idx;
+	uint32_t i;
+	switch_time_t start = switch_time_now();
+
+	switch_core_new_memory_pool(&pool);
+	idx = switch_core_alloc(pool, sizeof(*idx));
+	idx->pool = pool;
+	idx->root = root;
+	idx->xcontext = xcontext;
+
+	for (xexten = switch_xml_child(xcontext, "extension"); xexten; xexten = xexten->next) {
+		idx->count++;
+	}
+
+	idx->extens = switch_core_alloc(pool, (idx->count + 1) * sizeof(*idx->extens));
+
+	for (i = 0, xexten = switch_xml_child(xcontext, "extension"); xexten; xexten = xexten->next, i++) {
+		dp_trie_node_t *node = &idx->trie;
+		const char *expression;
+		char prefix[DP_PREFIX_MAX + 1] = "", *p;
+
+		idx->extens[i] = xexten;
+
+		if ((expression = dp_indexable_expression(xexten))) {
+			dp_literal_prefix(expression, prefix, sizeof(prefix));
+		}
+
+		for (p = prefix; *p; p++) {
+			dp_trie_node_t *child;
+
+			for (child = node->child; child && child->c != *p; child = child->sibling);
+
+			if (!child) {
+				child = switch_core_alloc(pool, sizeof(*child));
+				child->c = *p;
+				child->sibling = node->child;
+				node->child = child;
+			}
+
+			node = child;
+		}
+
+		if (*prefix) {
+			idx->indexed++;
+		}
+
+		dp_trie_add(idx, node, i);
+	}
+
+	idx->build_time = switch_time_now() - start;
+
+	return idx;
+}
+
+static void dp_index_destroy(dp_index_t *idx)
+{
+	switch_memory_pool_t *pool = idx->pool;
+
+	if (idx->root) {
+		switch_xml_free(idx->root);
+	}
+
+	switch_core_destroy_memory_pool(&pool);
+}
+
+/* the index for this context of the main root, taking over the caller's reference on the root */
+static dp_index_t *dp_index_get(switch_xml_t root, switch_xml_t xcontext)
+{
+	const char *name = switch_xml_attr_soft(xcontext, "name");
+	dp_index_t *idx;
+
+	switch_mutex_lock(globals.mutex);
+
+	if ((idx = switch_core_hash_find(globals.indexes, name)) && idx->root == root && idx->xcontext == xcontext) {
+		switch_xml_free(root);
+	} else {
+		if (idx) {
+			switch_core_hash_delete(globals.indexes, name);
+			idx->stale = 1;
+			if (!idx->refs) {
+				dp_index_destroy(idx);
+			}
+		}
+
+		idx = dp_index_build(root, xcontext);
+		switch_core_hash_insert(globals.indexes, name, idx);
+		globals.builds++;
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Indexed dialplan context %s: %u of %u extensions by prefix in %" SWITCH_TIME_T_FMT "us\n",
+						  name, idx->indexed, idx->count, idx->build_time);
+	}
+
+	idx->refs++;
+	switch_mutex_unlock(globals.mutex);
+
+	return idx;
+}
+
+static void dp_index_release(dp_index_t *idx, uint64_t parsed, uint64_t skipped)
+{
+	switch_mutex_lock(globals.mutex);
+	globals.hunts++;
+	globals.parsed += parsed;
+	globals.skipped += skipped;
+	if (!--idx->refs && idx->stale) {
+		dp_index_destroy(idx);
+	}
+	switch_mutex_unlock(globals.mutex);
+}
+
+static void dp_index_flush(void)
+{
+	switch_hash_index_t *hi;
+	void *val;
+	dp_index_t *idx;
+
+	switch_mutex_lock(globals.mutex);
+	while ((hi = switch_hash_first(NULL, globals.indexes))) {
+		const void *key;
+
+		switch_hash_this(hi, &key, NULL, &val);
+		idx = (dp_index_t *) val;
+		switch_core_hash_delete(globals.indexes, (const char *) key);
+		idx->stale = 1;
+		if (!idx->refs) {
+			dp_index_destroy(idx);
+		}
+	}
+	switch_mutex_unlock(globals.mutex);
+}
+
+static void dp_reload_event_handler(switch_event_t *event)
+{
+	/* drop the indexes so they release the old root, the next hunt in each context rebuilds */
+	dp_index_flush();
+}
+
+/* the extensions a number could reach from ordinal "from" on, merged back into document order */
+static void dp_cursor_init(dp_index_t *idx, const char *dest, uint32_t from, dp_cursor_t *cur)
+{
+	dp_trie_node_t *node = &idx->trie;
+	const char *p = dest;
+	int i;
+
+	cur->lists = 0;
+
+	for (;;) {
+		if (node->count) {
+			cur->extens[cur->lists] = node->extens;
+			cur->left[cur->lists] = node->count;
+			cur->lists++;
+		}
+
+		if (!*p || cur->lists > DP_PREFIX_MAX) {
+			break;
+		}
+
+		for (node = node->child; node && node->c != *p; node = node->sibling);
+
+		if (!node) {
+			break;
+		}
+
+		p++;
+	}
+
+	for (i = 0; i < cur->lists; i++) {
+		while (cur->left[i] && *cur->extens[i] < from) {
+			cur->extens[i]++;
+			cur->left[i]--;
+		}
+	}
+}
+
+static int dp_cursor_next(dp_cursor_t *cur, uint32_t *ordinal)
+{
+	int i, best = -1;
+
+	for (i = 0; i < cur->lists; i++) {
+		if (cur->left[i] && (best < 0 || *cur->extens[i] < *cur->extens[best])) {
+			best = i;
+		}
+	}
+
+	if (best < 0) {
+		return 0;
+	}
+
+	*ordinal = *cur->extens[best]++;
+	cur->left[best]--;
+
+	return 1;
+}
+
 static switch_status_t dialplan_xml_locate(switch_core_session_t *session, switch_caller_profile_t *caller_profile, switch_xml_t *root,
 										   switch_xml_t *node)
 {
@@ -470,6 +886,7 @@ SWITCH_STANDARD_DIALPLAN(dialplan_hunt)
 	switch_xml_t alt_root = NULL, cfg, xml = NULL, xcontext, xexten = NULL;
 	char *alt_path = (char *) arg;
 	const char *hunt = NULL;
+	dp_index_t *idx = NULL;
 
 	if (!caller_profile) {
 		if (!(caller_profile = switch_channel_get_caller_profile(channel))) {
@@ -521,7 +938,65 @@ SWITCH_STANDARD_DIALPLAN(dialplan_hunt)
 		xexten = switch_xml_find_child(xcontext, "extension", "name", caller_profile->destination_number);
 	}
 
-	if (!xexten) {
+	if (!xexten && !alt_root) {
+		switch_xml_t main_root = switch_xml_root();
+
+		if (main_root == xml) {
+			idx = dp_index_get(main_root, xcontext);
+		} else {
+			switch_xml_free(main_root);
+		}
+	}
+
+	if (idx) {
+		dp_cursor_t cur;
+		const char *dest = switch_str_nil(caller_profile->destination_number);
+		uint32_t ordinal, next = 0;
+		uint64_t parsed = 0, skipped = 0;
+
+		dp_cursor_init(idx, dest, 0, &cur);
+
+		for (;;) {
+			int proceed = 0;
+			const char *cont, *exten_name;
+
+			if (!dp_cursor_next(&cur, &ordinal)) {
+				skipped += idx->count - next;
+				break;
+			}
+
+			skipped += ordinal - next;
+			next = ordinal + 1;
+			parsed++;
+
+			xexten = idx->extens[ordinal];
+			cont = switch_xml_attr(xexten, "continue");
+			exten_name = switch_xml_attr(xexten, "name");
+
+			if (!exten_name) {
+				exten_name = "UNKNOWN";
+			}
+
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG_CLEAN(session), SWITCH_LOG_DEBUG,
+							  "Dialplan: %s parsing [%s->%s] continue=%s\n",
+							  switch_channel_get_name(channel), caller_profile->context, exten_name, cont ? cont : "false");
+
+			proceed = parse_exten(session, caller_profile, xexten, &extension);
+
+			if (proceed && !switch_true(cont)) {
+				break;
+			}
+
+			/* an inline action may have rewritten the number, pick up the candidates for the new one */
+			if (strcmp(dest, switch_str_nil(caller_profile->destination_number))) {
+				dest = switch_str_nil(caller_profile->destination_number);
+				dp_cursor_init(idx, dest, next, &cur);
+			}
+		}
+
+		dp_index_release(idx, parsed, skipped);
+		xexten = NULL;
+	} else if (!xexten) {
 		xexten = switch_xml_child(xcontext, "extension");
 	}
 
@@ -555,18 +1030,191 @@ SWITCH_STANDARD_DIALPLAN(dialplan_hunt)
 	return extension;
 }
 
+#define DIALPLAN_INDEX_SYNTAX "[flush]"
+
+SWITCH_STANDARD_API(dialplan_index_function)
+{
+	switch_hash_index_t *hi;
+	const void *key;
+	void *val;
+
+	if (!zstr(cmd) && !strcasecmp(cmd, "flush")) {
+		dp_index_flush();
+		stream->write_function(stream, "+OK\n");
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	switch_mutex_lock(globals.mutex);
+	stream->write_function(stream, "context,extensions,indexed,build_us\n");
+	for (hi = switch_hash_first(NULL, globals.indexes); hi; hi = switch_hash_next(hi)) {
+		dp_index_t *idx;
+
+		switch_hash_this(hi, &key, NULL, &val);
+		idx = (dp_index_t *) val;
+		stream->write_function(stream, "%s,%u,%u,%" SWITCH_TIME_T_FMT "\n", (const char *) key, idx->count, idx->indexed, idx->build_time);
+	}
+	stream->write_function(stream, "\nbuilds,hunts,parsed,skipped,parsed_per_hunt\n");
+	stream->write_function(stream, "%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%.1f\n",
+						   globals.builds, globals.hunts, globals.parsed, globals.skipped, globals.hunts ? (double) globals.parsed / globals.hunts : 0.0);
+	switch_mutex_unlock(globals.mutex);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+#define DIALPLAN_BENCH_SYNTAX "<extensions> [<lookups>]"
+
+/* the first extension whose first condition matches, the way a hunt of plain number extensions ends */
+static int dp_bench_match(switch_xml_t xexten, const char *dest)
+{
+	switch_regex_t *re = NULL;
+	int ovector[30], proceed;
+	switch_xml_t xcond = switch_xml_child(xexten, "condition");
+
+	proceed = switch_regex_perform(dest, switch_xml_attr_soft(xcond, "expression"), &re, ovector, sizeof(ovector) / sizeof(ovector[0]));
+	switch_regex_safe_free(re);
+
+	return proceed;
+}
+
+SWITCH_STANDARD_API(dialplan_bench_function)
+{
+	switch_stream_handle_t xs = { 0 };
+	switch_xml_t xml = NULL, xcontext, xexten;
+	dp_index_t *idx = NULL;
+	char *mycmd = NULL, *argv[2] = { 0 };
+	int argc, extensions, lookups = 10000, i, mismatches = 0;
+	uint64_t linear_parsed = 0, indexed_parsed = 0;
+	switch_time_t start, linear_time, indexed_time;
+
+	if (zstr(cmd) || !(mycmd = strdup(cmd)) || (argc = switch_separate_string(mycmd, ' ', argv, (sizeof(argv) / sizeof(argv[0])))) < 1 ||
+		(extensions = atoi(argv[0])) < 1) {
+		stream->write_function(stream, "-USAGE: %s\n", DIALPLAN_BENCH_SYNTAX);
+		goto end;
+	}
+
+	if (argc > 1 && atoi(argv[1]) > 0) {
+		lookups = atoi(argv[1]);
+	}
+
+	/* mostly exact numbers, every 50th a short-code pattern, and a catch-all at the end */
+	SWITCH_STANDARD_STREAM(xs);
+	xs.write_function(&xs, "<context name=\"bench\">\n");
+	for (i = 0; i < extensions; i++) {
+		if (i % 50 == 49) {
+			xs.write_function(&xs, "<extension name=\"e%d\"><condition field=\"destination_number\" expression=\"^(8%02d\\d{3})$\">"
+							  "<action application=\"log\" data=\"$1\"/></condition></extension>\n", i, i % 100);
+		} else {
+			xs.write_function(&xs, "<extension name=\"e%d\"><condition field=\"destination_number\" expression=\"^%d$\">"
+							  "<action application=\"log\" data=\"%d\"/></condition></extension>\n", i, 1000000 + i, i);
+		}
+	}
+	xs.write_function(&xs, "<extension name=\"all\"><condition field=\"destination_number\" expression=\"^(\\d+)$\">"
+					  "<action application=\"log\" data=\"$1\"/></condition></extension>\n</context>\n");
+
+	if (!(xml = switch_xml_parse_str_dynamic((char *) xs.data, SWITCH_TRUE)) || !(xcontext = xml)) {
+		stream->write_function(stream, "-ERR could not build the test context\n");
+		goto end;
+	}
+
+	idx = dp_index_build(NULL, xcontext);
+
+	/* draw the same numbers for both walks: hits, short codes and misses */
+	srand(1);
+	linear_time = 0;
+	indexed_time = 0;
+
+	for (i = 0; i < lookups; i++) {
+		char dest[32];
+		int r = rand(), found_linear = -1, found_indexed = -1;
+		uint32_t ordinal;
+		dp_cursor_t cur;
+
+		if (r % 10 == 0) {
+			switch_snprintf(dest, sizeof(dest), "8%02d%03d", r % 100, r % 1000);
+		} else if (r % 10 == 1) {
+			switch_snprintf(dest, sizeof(dest), "555%04d", r % 10000);
+		} else {
+			switch_snprintf(dest, sizeof(dest), "%d", 1000000 + r % extensions);
+		}
+
+		start = switch_time_now();
+		for (ordinal = 0, xexten = switch_xml_child(xcontext, "extension"); xexten; xexten = xexten->next, ordinal++) {
+			linear_parsed++;
+			if (dp_bench_match(xexten, dest)) {
+				found_linear = ordinal;
+				break;
+			}
+		}
+		linear_time += switch_time_now() - start;
+
+		start = switch_time_now();
+		dp_cursor_init(idx, dest, 0, &cur);
+		while (dp_cursor_next(&cur, &ordinal)) {
+			indexed_parsed++;
+			if (dp_bench_match(idx->extens[ordinal], dest)) {
+				found_indexed = ordinal;
+				break;
+			}
+		}
+		indexed_time += switch_time_now() - start;
+
+		if (found_linear != found_indexed) {
+			mismatches++;
+		}
+	}
+
+	stream->write_function(stream, "extensions,indexed,build_us,lookups,mismatches\n%u,%u,%" SWITCH_TIME_T_FMT ",%d,%d\n\n",
+						   idx->count, idx->indexed, idx->build_time, lookups, mismatches);
+	stream->write_function(stream, "mode,us_per_lookup,parsed_per_lookup\n");
+	stream->write_function(stream, "linear,%.2f,%.1f\n", (double) linear_time / lookups, (double) linear_parsed / lookups);
+	stream->write_function(stream, "indexed,%.2f,%.1f\n", (double) indexed_time / lookups, (double) indexed_parsed / lookups);
+
+  end:
+
+	if (idx) {
+		dp_index_destroy(idx);
+	}
+
+	switch_xml_free(xml);
+	switch_safe_free(xs.data);
+	switch_safe_free(mycmd);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_dialplan_xml_load)
 {
 	switch_dialplan_interface_t *dp_interface;
+	switch_api_interface_t *api_interface;
+
+	memset(&globals, 0, sizeof(globals));
+	globals.pool = pool;
+	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, globals.pool);
+	switch_core_hash_init(&globals.indexes, globals.pool);
+
+	if (switch_event_bind_removable(modname, SWITCH_EVENT_RELOADXML, NULL, dp_reload_event_handler, NULL, &globals.reload_node) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind to reloadxml, contexts will be re-indexed on their next call instead\n");
+	}
 
 	/* connect my internal structure to the blank pointer passed to me */
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
 	SWITCH_ADD_DIALPLAN(dp_interface, "XML", dialplan_hunt);
+	SWITCH_ADD_API(api_interface, "xml_dialplan_index", "Show the XML dialplan context indexes", dialplan_index_function, DIALPLAN_INDEX_SYNTAX);
+	SWITCH_ADD_API(api_interface, "xml_dialplan_bench", "Compare indexed and linear dialplan matching", dialplan_bench_function, DIALPLAN_BENCH_SYNTAX);
 
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_dialplan_xml_shutdown)
+{
+	switch_event_unbind(&globals.reload_node);
+	dp_index_flush();
+	switch_core_hash_destroy(&globals.indexes);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 /* For Emacs:
  * Local Variables:
  * mode:c
@@ -102,6 +102,7 @@ typedef struct listener listener_t;
 
 static struct {
 	switch_mutex_t *listener_mutex;
+	switch_mutex_t *log_level_mutex;
 	switch_event_node_t *node;
 	int debug;
 } globals;
@@ -195,6 +196,25 @@ static switch_status_t socket_logger(const switch_log_node_t *node, switch_log_l
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* tell the core the highest level a listener is logging at, socket_logger locks listener_mutex under the core's bind lock so it is released first */
+static void socket_logger_level(void)
+{
+	switch_log_level_t level = SWITCH_LOG_CONSOLE;
+	listener_t *l;
+
+	switch_mutex_lock(globals.log_level_mutex);
+	switch_mutex_lock(globals.listener_mutex);
+	for (l = listen_list.listeners; l; l = l->next) {
+		if (switch_test_flag(l, LFLAG_LOG) && l->level > level) {
+			level = l->level;
+		}
+	}
+	switch_mutex_unlock(globals.listener_mutex);
+
+	switch_log_set_logger_level(socket_logger, level);
+	switch_mutex_unlock(globals.log_level_mutex);
+}
+
 static void flush_listener(listener_t *listener, switch_bool_t flush_log, switch_bool_t flush_events)
 {
 	void *pop;
@@ -565,6 +585,8 @@ static void add_listener(listener_t *listener)
 	listener->next = listen_list.listeners;
 	listen_list.listeners = listener;
 	switch_mutex_unlock(globals.listener_mutex);
+
+	socket_logger_level();
 }
 
 static void remove_listener(listener_t *listener)
@@ -583,6 +605,8 @@ static void remove_listener(listener_t *listener)
 		last = l;
 	}
 	switch_mutex_unlock(globals.listener_mutex);
+
+	socket_logger_level();
 }
 
 static void send_disconnect(listener_t *listener, const char *message)
@@ -776,6 +800,7 @@ SWITCH_STANDARD_API(event_sink_function)
 
 		if (switch_test_flag(listener, LFLAG_LOG)) {
 			switch_clear_flag_locked(listener, LFLAG_LOG);
+			socket_logger_level();
 			stream->write_function(stream, "<data><reply type=\"success\">Not Logging</reply></data>\n");
 		} else {
 			stream->write_function(stream, "<data><reply type=\"error\">Not Logging</reply></data>\n");
@@ -802,6 +827,7 @@ SWITCH_STANDARD_API(event_sink_function)
 			if (ltype != SWITCH_LOG_INVALID) {
 				listener->level = ltype;
 				switch_set_flag(listener, LFLAG_LOG);
+				socket_logger_level();
 				stream->write_function(stream, "<data><reply type=\"success\">Log Level %s</reply></data>\n", loglevel);
 			} else {
 				stream->write_function(stream, "<data><reply type=\"error\">Invalid Level</reply></data>\n");
@@ -1073,6 +1099,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
 	memset(&globals, 0, sizeof(globals));
 
 	switch_mutex_init(&globals.listener_mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_mutex_init(&globals.log_level_mutex, SWITCH_MUTEX_NESTED, pool);
 
 	memset(&listen_list, 0, sizeof(listen_list));
 	switch_mutex_init(&listen_list.sock_mutex, SWITCH_MUTEX_NESTED, pool);
@@ -1082,7 +1109,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_event_socket_load)
 		return SWITCH_STATUS_GENERR;
 	}
 
-	switch_log_bind_logger(socket_logger, SWITCH_LOG_DEBUG, SWITCH_FALSE);
+	switch_log_bind_logger(socket_logger, SWITCH_LOG_CONSOLE, SWITCH_FALSE);
 
 	/* connect my internal structure to the blank pointer passed to me */
 	*module_interface = switch_loadable_module_create_module_interface(pool, modname);
@@ -2272,6 +2299,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		if (ltype != SWITCH_LOG_INVALID) {
 			listener->level = ltype;
 			switch_set_flag(listener, LFLAG_LOG);
+			socket_logger_level();
 			switch_snprintf(reply, reply_len, "+OK log level %s [%d]", level_s, listener->level);
 		} else {
 			switch_snprintf(reply, reply_len, "-ERR invalid log level");
@@ -2306,6 +2334,7 @@ static switch_status_t parse_command(listener_t *listener, switch_event_t **even
 		flush_listener(listener, SWITCH_TRUE, SWITCH_FALSE);
 		if (switch_test_flag(listener, LFLAG_LOG)) {
 			switch_clear_flag_locked(listener, LFLAG_LOG);
+			socket_logger_level();
 			switch_snprintf(reply, reply_len, "+OK no longer logging");
 		} else {
 			switch_snprintf(reply, reply_len, "-ERR not loging");
@@ -36,10 +36,64 @@ SWITCH_MODULE_DEFINITION(mod_native_file, mod_native_file_load, NULL, NULL);
 
 struct native_file_context {
 	switch_file_t *fd;
+	uint32_t bytes_per_packet;
+	uint32_t samples_per_packet;
 };
 
 typedef struct native_file_context native_file_context;
 
+/* the stream is whole frames of the codec named by the extension, the rate and ptime tags in front of it pick the
+   implementation when the name alone does not (prompt.16000hz.30ms.iLBC) */
+static void native_file_frame_size(native_file_context *context, const char *path, const char *ext)
+{
+	switch_codec_interface_t *codec_interface;
+	const switch_codec_implementation_t *ip;
+	const char *base, *p, *tag;
+	uint32_t rate = 0, ptime = 0;
+
+	context->bytes_per_packet = context->samples_per_packet = 1;
+
+	if ((base = strrchr(path, '/')) || (base = strrchr(path, '\\'))) {
+		base++;
+	} else {
+		base = path;
+	}
+
+	for (p = strchr(base, '.'); p && p < ext; p = strchr(p + 1, '.')) {
+		for (tag = p + 1; *tag >= '0' && *tag <= '9'; tag++);
+
+		if (tag == p + 1) {
+			continue;
+		}
+
+		if (!strncasecmp(tag, "hz.", 3)) {
+			rate = (uint32_t) atoi(p + 1);
+		} else if (!strncasecmp(tag, "ms.", 3)) {
+			ptime = (uint32_t) atoi(p + 1);
+		}
+	}
+
+	if (!(codec_interface = switch_loadable_module_get_codec_interface(ext))) {
+		return;
+	}
+
+	for (ip = codec_interface->implementations; ip; ip = ip->next) {
+		if (strcasecmp(ip->iananame, ext) || !ip->encoded_bytes_per_packet || !ip->samples_per_packet) {
+			continue;
+		}
+
+		if ((rate && ip->actual_samples_per_second != rate) || (ptime && ip->microseconds_per_packet / 1000 != ptime)) {
+			continue;
+		}
+
+		context->bytes_per_packet = ip->encoded_bytes_per_packet;
+		context->samples_per_packet = ip->samples_per_packet;
+		break;
+	}
+
+	UNPROTECT_INTERFACE(codec_interface);
+}
+
 static switch_status_t native_file_file_open(switch_file_handle_t *handle, const char *path)
 {
 	native_file_context *context;
@@ -75,6 +129,8 @@ static switch_status_t native_file_file_open(switch_file_handle_t *handle, const
 		return SWITCH_STATUS_GENERR;
 	}
 
+	native_file_frame_size(context, path, ext);
+
 	if (switch_test_flag(handle, SWITCH_FILE_WRITE_APPEND)) {
 		int64_t samples = 0;
 		switch_file_seek(context->fd, SEEK_END, &samples);
@@ -124,14 +180,25 @@ static switch_status_t native_file_file_close(switch_file_handle_t *handle)
 static switch_status_t native_file_file_seek(switch_file_handle_t *handle, unsigned int *cur_sample, int64_t samples, int whence)
 {
 	switch_status_t status;
+	int64_t bytes;
 
 	native_file_context *context = handle->private_info;
 
-	status = switch_file_seek(context->fd, whence, &samples);
+	/* callers count samples, the file holds whole encoded frames */
+	bytes = samples / context->samples_per_packet * context->bytes_per_packet;
+
+	status = switch_file_seek(context->fd, whence, &bytes);
+
+	if (status == SWITCH_STATUS_SUCCESS && bytes % context->bytes_per_packet) {
+		bytes -= bytes % context->bytes_per_packet;
+		status = switch_file_seek(context->fd, SEEK_SET, &bytes);
+	}
+
 	if (status == SWITCH_STATUS_SUCCESS) {
-		handle->pos += samples;
+		handle->pos = bytes;
+		*cur_sample = (unsigned int) (bytes / context->bytes_per_packet * context->samples_per_packet);
 	}
-	return SWITCH_STATUS_FALSE;
+	return status;
 }
 
 static switch_status_t native_file_file_read(switch_file_handle_t *handle, void *data, size_t *len)
@@ -320,6 +320,7 @@ SWITCH_STANDARD_API(console_api_function)
 			stream->write_function(stream, "-ERR Invalid console loglevel (%s)!\n\n", argc > 1 ? argv[1] : "");
 		} else {
 			hard_log_level = level;
+			switch_log_set_logger_level(switch_console_logger, hard_log_level);
 			stream->write_function(stream, "+OK console log level set to %s\n", switch_log_level2str(hard_log_level));
 		}
 
@@ -377,6 +378,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_console_load)
 	switch_log_bind_logger(switch_console_logger, SWITCH_LOG_DEBUG, SWITCH_TRUE);
 
 	config_logger();
+	switch_log_set_logger_level(switch_console_logger, hard_log_level);
 	RUNNING = 1;
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
@@ -31,6 +31,9 @@
  */
 
 #include <switch.h>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
 
 SWITCH_MODULE_LOAD_FUNCTION(mod_logfile_load);
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_logfile_shutdown);
@@ -39,6 +42,10 @@ SWITCH_MODULE_DEFINITION(mod_logfile, mod_logfile_load, mod_logfile_shutdown, NU
 #define DEFAULT_LIMIT	 0xA00000	/* About 10 MB */
 #define WARM_FUZZY_OFFSET 256
 #define MAX_ROT 4096			/* why not */
+#define CHUNK_SIZE 65536		/* lines are copied into chunks this big and written with one writev */
+#define MAX_SPARE_CHUNKS 16
+#define MAX_PENDING 0x4000000	/* drop lines once 64 MB are waiting for the disk */
+#define MAX_IOV 64
 
 static switch_memory_pool_t *module_pool = NULL;
 static switch_hash_t *profile_hash = NULL;
@@ -47,8 +54,24 @@ static struct {
 	int rotate;
 	switch_mutex_t *mutex;
 	switch_event_node_t *node;
+	uint32_t levels;			/* every level some mapping writes */
+	uint32_t flush_interval;	/* ms the writer waits to gather lines, 0 to write as soon as it can */
+	struct logfile_profile *profiles;
+	int running;
+	int wake;
+	switch_mutex_t *cond_mutex;
+	switch_thread_cond_t *cond;
+	switch_thread_t *writer_thread;
+	switch_thread_t *compress_thread;
+	switch_queue_t *compress_queue;
 } globals;
 
+typedef struct logfile_chunk {
+	switch_size_t used;
+	struct logfile_chunk *next;
+	char data[CHUNK_SIZE];
+} logfile_chunk_t;
+
 struct logfile_profile {
 	char *name;
 	switch_size_t log_size;		/* keep the log size in check for rotation */
@@ -60,10 +83,40 @@ struct logfile_profile {
 	uint32_t all_level;
 	uint32_t suffix;			/* suffix of the highest logfile name */
 	switch_bool_t log_uuid;
+	char *compress_command;		/* run on every rotated file with the file name appended */
+	char *compress_suffix;		/* what compress_command adds to the file name */
+	switch_mutex_t *mutex;		/* protects the pending chunks */
+	logfile_chunk_t *head;
+	logfile_chunk_t *tail;
+	logfile_chunk_t *spare;
+	uint32_t spare_count;
+	switch_size_t pending_bytes;
+	uint32_t pending_lines;
+	uint64_t dropped;
+	int rotate_now;				/* set on HUP, acted on by the writer thread */
+	int reopen_now;
+	int write_failing;			/* only touched by the writer thread, so a dead disk is reported once */
+	volatile switch_atomic_t compressing;
+	/* written by the writer thread with mutex held, so the stats can read them */
+	uint64_t lines;
+	uint64_t bytes;
+	uint64_t writes;
+	uint64_t rotations;
+	switch_time_t rate_time;
+	uint64_t rate_lines_mark;
+	uint64_t rate_bytes_mark;
+	double lines_per_sec;
+	double bytes_per_sec;
+	struct logfile_profile *next;
 };
 
 typedef struct logfile_profile logfile_profile_t;
 
+typedef struct {
+	logfile_profile_t *profile;
+	char *cmd;
+} compress_job_t;
+
 static switch_status_t load_profile(switch_xml_t xml);
 
 #if 0
@@ -75,12 +128,28 @@ static void del_mapping(char *var, logfile_profile_t *profile)
 
 static void add_mapping(logfile_profile_t *profile, char *var, char *val)
 {
+	uint32_t mask = (uint32_t) switch_log_str2mask(val);
+
+	globals.levels |= mask;
+
 	if (!strcasecmp(var, "all")) {
-		profile->all_level |= (uint32_t) switch_log_str2mask(val);
+		profile->all_level |= mask;
 		return;
 	}
 
-	switch_core_hash_insert(profile->log_hash, var, (void *) (intptr_t) switch_log_str2mask(val));
+	switch_core_hash_insert(profile->log_hash, var, (void *) (intptr_t) mask);
+}
+
+/* the highest level any profile writes, so the core can drop the rest before formatting them */
+static switch_log_level_t logfile_max_level(void)
+{
+	switch_log_level_t level = SWITCH_LOG_DEBUG;
+
+	while (level > SWITCH_LOG_CONSOLE && !switch_log_check_mask(globals.levels, level)) {
+		level--;
+	}
+
+	return level;
 }
 
 static switch_status_t mod_logfile_rotate(logfile_profile_t *profile);
@@ -112,6 +181,62 @@ static switch_status_t mod_logfile_openlogfile(logfile_profile_t *profile, switc
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* move one rotated log, and its compressed copy, out of the way */
+static switch_status_t mod_logfile_shift(logfile_profile_t *profile, const char *from, const char *to, switch_memory_pool_t *pool)
+{
+	const char *suffixes[2] = { "", profile->compress_suffix };
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		char *from_filename, *to_filename;
+
+		if (i && !profile->compress_command) {
+			break;
+		}
+
+		from_filename = switch_core_sprintf(pool, "%s%s", from, suffixes[i]);
+		to_filename = switch_core_sprintf(pool, "%s%s", to, suffixes[i]);
+
+		if (switch_file_exists(to_filename, pool) == SWITCH_STATUS_SUCCESS) {
+			if (switch_file_remove(to_filename, pool) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error removing log %s\n", to_filename);
+				return SWITCH_STATUS_FALSE;
+			}
+		}
+
+		if (switch_file_exists(from_filename, pool) == SWITCH_STATUS_SUCCESS) {
+			if (switch_file_rename(from_filename, to_filename, pool) != SWITCH_STATUS_SUCCESS) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error renaming log from %s to %s\n", from_filename, to_filename);
+				return SWITCH_STATUS_FALSE;
+			}
+		}
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* hand a rotated log to the compress thread */
+static void mod_logfile_compress(logfile_profile_t *profile, const char *filename)
+{
+	compress_job_t *job;
+
+	if (!profile->compress_command || !globals.compress_queue) {
+		return;
+	}
+
+	switch_zmalloc(job, sizeof(*job));
+	job->profile = profile;
+	job->cmd = switch_mprintf("%s \"%s\"", profile->compress_command, filename);
+	switch_atomic_inc(&profile->compressing);
+
+	if (switch_queue_trypush(globals.compress_queue, job) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Not compressing %s, too many rotated logs are waiting\n", filename);
+		switch_atomic_dec(&profile->compressing);
+		switch_safe_free(job->cmd);
+		free(job);
+	}
+}
+
 /* rotate the log file */
 static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 {
@@ -153,26 +278,15 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 			sprintf((char *) to_filename, "%s.%i", profile->logfile, i);
 			sprintf((char *) from_filename, "%s.%i", profile->logfile, i-1);
 
-			if (switch_file_exists(to_filename, pool) == SWITCH_STATUS_SUCCESS) {
-				if ((status = switch_file_remove(to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error removing log %s\n",to_filename);
-					goto end;
-				}
-			}
-
-			if ((status = switch_file_rename(from_filename, to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error renaming log from %s to %s\n",from_filename, to_filename);
+			if ((status = mod_logfile_shift(profile, from_filename, to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
 				goto end;
 			}
 		}
 
 		sprintf((char *) to_filename, "%s.%i", profile->logfile, i);
 			
-		if (switch_file_exists(to_filename, pool) == SWITCH_STATUS_SUCCESS) {
-			if ((status = switch_file_remove(to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error removing log %s\n",to_filename);
-				goto end;
-			}
+		if ((status = mod_logfile_shift(profile, to_filename, to_filename, pool)) != SWITCH_STATUS_SUCCESS) {
+			goto end;
 		}
 
 		switch_file_close(profile->log_afd);
@@ -188,6 +302,10 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 			profile->suffix++;
 		}
 
+		switch_mutex_lock(profile->mutex);
+		profile->rotations++;
+		switch_mutex_unlock(profile->mutex);
+		mod_logfile_compress(profile, to_filename);
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "New log started.\n");
 
 		goto end;
@@ -206,6 +324,10 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error Rotating Log!\n");
 			goto end;
 		}
+		switch_mutex_lock(profile->mutex);
+		profile->rotations++;
+		switch_mutex_unlock(profile->mutex);
+		mod_logfile_compress(profile, filename);
 		break;
 	}
 
@@ -222,38 +344,248 @@ static switch_status_t mod_logfile_rotate(logfile_profile_t *profile)
 	return status;
 }
 
-/* write to the actual logfile */
-static switch_status_t mod_logfile_raw_write(logfile_profile_t *profile, char *log_data)
+static logfile_chunk_t *logfile_chunk_get(logfile_profile_t *profile)
 {
-	switch_size_t len;
-	switch_status_t status = SWITCH_STATUS_SUCCESS;
-	len = strlen(log_data);
+	logfile_chunk_t *chunk;
 
-	if (len <= 0 || !profile->log_afd) {
-		return SWITCH_STATUS_FALSE;
+	if ((chunk = profile->spare)) {
+		profile->spare = chunk->next;
+		profile->spare_count--;
+	} else {
+		switch_malloc(chunk, sizeof(*chunk));
 	}
 
-	switch_mutex_lock(globals.mutex);
+	chunk->used = 0;
+	chunk->next = NULL;
 
-	if (switch_file_write(profile->log_afd, log_data, &len) != SWITCH_STATUS_SUCCESS) {
-		switch_file_close(profile->log_afd);
-		if ((status = mod_logfile_openlogfile(profile, SWITCH_TRUE)) == SWITCH_STATUS_SUCCESS) {
-			len = strlen(log_data);
-			switch_file_write(profile->log_afd, log_data, &len);
+	return chunk;
+}
+
+/* copy data into the profile's pending chunks, profile->mutex must be held */
+static void logfile_append(logfile_profile_t *profile, const char *data, switch_size_t len)
+{
+	logfile_chunk_t *chunk = profile->tail;
+
+	profile->pending_bytes += len;
+
+	while (len) {
+		switch_size_t n;
+
+		if (!chunk || chunk->used == CHUNK_SIZE) {
+			chunk = logfile_chunk_get(profile);
+			if (profile->tail) {
+				profile->tail->next = chunk;
+			} else {
+				profile->head = chunk;
+			}
+			profile->tail = chunk;
 		}
+
+		n = CHUNK_SIZE - chunk->used;
+		if (n > len) {
+			n = len;
+		}
+
+		memcpy(chunk->data + chunk->used, data, n);
+		chunk->used += n;
+		data += n;
+		len -= n;
 	}
+}
 
-	switch_mutex_unlock(globals.mutex);
+static void logfile_wake(void)
+{
+	switch_mutex_lock(globals.cond_mutex);
+	globals.wake = 1;
+	switch_thread_cond_signal(globals.cond);
+	switch_mutex_unlock(globals.cond_mutex);
+}
 
-	if (status == SWITCH_STATUS_SUCCESS) {
-		profile->log_size += len;
+/* write a batch of chunks, reopening the file once if the write fails */
+static switch_status_t logfile_write_chunks(logfile_profile_t *profile, logfile_chunk_t *chunks, switch_size_t *written)
+{
+	logfile_chunk_t *chunk = chunks;
+	switch_size_t done = 0;
+	int reopened = 0;
 
-		if (profile->roll_size && profile->log_size >= profile->roll_size) {
-			mod_logfile_rotate(profile);
+	*written = 0;
+
+	while (chunk) {
+#ifdef WIN32
+		switch_size_t len = chunk->used - done;
+
+		if (switch_file_write(profile->log_afd, chunk->data + done, &len) != SWITCH_STATUS_SUCCESS || !len) {
+#else
+		struct iovec iov[MAX_IOV];
+		logfile_chunk_t *c = chunk;
+		switch_size_t n = 0, len = 0;
+
+		for (; c && n < MAX_IOV; c = c->next, n++) {
+			iov[n].iov_base = c->data + (n ? 0 : done);
+			iov[n].iov_len = c->used - (n ? 0 : done);
 		}
+
+		if (switch_file_writev(profile->log_afd, iov, n, &len) != SWITCH_STATUS_SUCCESS || !len) {
+#endif
+			if (reopened++) {
+				return SWITCH_STATUS_FALSE;
+			}
+			switch_file_close(profile->log_afd);
+			profile->log_afd = NULL;
+			if (mod_logfile_openlogfile(profile, SWITCH_FALSE) != SWITCH_STATUS_SUCCESS) {
+				return SWITCH_STATUS_FALSE;
+			}
+			continue;
+		}
+
+		switch_mutex_lock(profile->mutex);
+		profile->writes++;
+		switch_mutex_unlock(profile->mutex);
+		*written += len;
+
+		/* a short write leaves us part way into some chunk */
+		while (chunk && len >= chunk->used - done) {
+			len -= chunk->used - done;
+			done = 0;
+			chunk = chunk->next;
+		}
+		done += len;
 	}
 
-	return status;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* write everything the profile has pending, rotate it if it is due, runs on the writer thread */
+static void logfile_flush(logfile_profile_t *profile)
+{
+	logfile_chunk_t *chunks, *chunk;
+	switch_size_t written = 0;
+	switch_time_t now;
+	uint32_t lines, lost = 0;
+
+	switch_mutex_lock(profile->mutex);
+	chunks = profile->head;
+	lines = profile->pending_lines;
+	profile->head = profile->tail = NULL;
+	profile->pending_bytes = 0;
+	profile->pending_lines = 0;
+	switch_mutex_unlock(profile->mutex);
+
+	if (chunks) {
+		if (!profile->log_afd) {
+			mod_logfile_openlogfile(profile, SWITCH_FALSE);
+		}
+
+		if (!profile->log_afd || logfile_write_chunks(profile, chunks, &written) != SWITCH_STATUS_SUCCESS) {
+			/* the line comes right back to us, report the first failure only and count the rest in dropped */
+			if (!profile->write_failing++) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error writing to %s\n", profile->logfile);
+			}
+			lost = lines;
+		} else if (profile->write_failing) {
+			profile->write_failing = 0;
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Writing to %s again\n", profile->logfile);
+		}
+
+		profile->log_size += written;
+	}
+
+	if (profile->reopen_now) {
+		profile->reopen_now = 0;
+		switch_mutex_lock(globals.mutex);
+		if (profile->log_afd) {
+			switch_file_close(profile->log_afd);
+			profile->log_afd = NULL;
+		}
+		if (mod_logfile_openlogfile(profile, SWITCH_TRUE) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error Re-opening Log!\n");
+		}
+		switch_mutex_unlock(globals.mutex);
+	}
+
+	/* never rename logs out from under a compression that is still running */
+	if (profile->log_afd && (profile->rotate_now || (profile->roll_size && profile->log_size >= profile->roll_size)) &&
+		!(profile->max_rot && switch_atomic_read(&profile->compressing))) {
+		profile->rotate_now = 0;
+		mod_logfile_rotate(profile);
+	}
+
+	now = switch_micro_time_now();
+
+	switch_mutex_lock(profile->mutex);
+
+	if (chunks) {
+		profile->dropped += lost;
+		profile->lines += lines - lost;
+		profile->bytes += written;
+
+		while ((chunk = chunks)) {
+			chunks = chunk->next;
+			if (profile->spare_count < MAX_SPARE_CHUNKS) {
+				chunk->next = profile->spare;
+				profile->spare = chunk;
+				profile->spare_count++;
+			} else {
+				free(chunk);
+			}
+		}
+	}
+
+	if (!profile->rate_time) {
+		profile->rate_time = now;
+	} else if (now - profile->rate_time >= 1000000) {
+		double secs = (double) (now - profile->rate_time) / 1000000;
+
+		profile->lines_per_sec = (double) (profile->lines - profile->rate_lines_mark) / secs;
+		profile->bytes_per_sec = (double) (profile->bytes - profile->rate_bytes_mark) / secs;
+		profile->rate_lines_mark = profile->lines;
+		profile->rate_bytes_mark = profile->bytes;
+		profile->rate_time = now;
+	}
+
+	switch_mutex_unlock(profile->mutex);
+}
+
+static void *SWITCH_THREAD_FUNC logfile_writer_thread(switch_thread_t *thread, void *obj)
+{
+	logfile_profile_t *profile;
+	int running = 1;
+
+	while (running) {
+		switch_mutex_lock(globals.cond_mutex);
+		if (!globals.wake && globals.running) {
+			switch_thread_cond_timedwait(globals.cond, globals.cond_mutex, globals.flush_interval ? globals.flush_interval * 1000 : 1000000);
+		}
+		globals.wake = 0;
+		running = globals.running;
+		switch_mutex_unlock(globals.cond_mutex);
+
+		for (profile = globals.profiles; profile; profile = profile->next) {
+			logfile_flush(profile);
+		}
+	}
+
+	return NULL;
+}
+
+static void *SWITCH_THREAD_FUNC logfile_compress_thread(switch_thread_t *thread, void *obj)
+{
+	void *pop = NULL;
+
+	while (switch_queue_pop(globals.compress_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		compress_job_t *job = (compress_job_t *) pop;
+
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Compressing rotated log: %s\n", job->cmd);
+		if (switch_system(job->cmd, SWITCH_TRUE) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error running %s\n", job->cmd);
+		}
+
+		switch_atomic_dec(&job->profile->compressing);
+		switch_safe_free(job->cmd);
+		free(job);
+	}
+
+	return NULL;
 }
 
 static switch_status_t process_node(const switch_log_node_t *node, switch_log_level_t level)
@@ -283,22 +615,46 @@ static switch_status_t process_node(const switch_log_node_t *node, switch_log_le
 		}
 
 		if (ok) {
+			switch_size_t pending, need = strlen(node->data);
+			size_t ulen = 0;
+
 			if (profile->log_uuid && !zstr(node->userdata)) {
-				char buf[2048];
+				const char *p;
+
+				/* every line gets the uuid and a space, and a newline if it had none */
+				ulen = strlen(node->userdata);
+				for (p = node->data, need += ulen + 2; (p = strchr(p, '\n')) && *++p; need += ulen + 2);
+			}
+
+			switch_mutex_lock(profile->mutex);
+
+			if (profile->pending_bytes + need > MAX_PENDING) {
+				profile->dropped++;
+			} else if (ulen) {
 				char *dup = strdup(node->data);
 				char *lines[100];
 				int argc, i;
-				
+
 				argc = switch_split(dup, '\n', lines);
 				for (i = 0; i < argc; i++) {
-					switch_snprintf(buf, sizeof(buf), "%s %s\n", node->userdata, lines[i]);
-					mod_logfile_raw_write(profile, buf);	
+					logfile_append(profile, node->userdata, ulen);
+					logfile_append(profile, " ", 1);
+					logfile_append(profile, lines[i], strlen(lines[i]));
+					logfile_append(profile, "\n", 1);
 				}
-				
+				profile->pending_lines++;
+
 				free(dup);
-				
 			} else {
-				mod_logfile_raw_write(profile, node->data);
+				logfile_append(profile, node->data, strlen(node->data));
+				profile->pending_lines++;
+			}
+
+			pending = profile->pending_bytes;
+			switch_mutex_unlock(profile->mutex);
+
+			if (!globals.flush_interval || pending >= CHUNK_SIZE) {
+				logfile_wake();
 			}
 		}
 
@@ -340,10 +696,22 @@ static switch_status_t load_profile(switch_xml_t xml)
 				}
 			} else if (!strcmp(var, "uuid") && switch_true(val)) {
 				new_profile->log_uuid = SWITCH_TRUE;
+			} else if (!strcmp(var, "compress-command")) {
+				if (!zstr(val)) {
+					new_profile->compress_command = switch_core_strdup(module_pool, val);
+				}
+			} else if (!strcmp(var, "compress-suffix")) {
+				new_profile->compress_suffix = switch_core_strdup(module_pool, val);
 			}
 		}
 	}
 
+	if (!new_profile->compress_suffix) {
+		new_profile->compress_suffix = ".gz";
+	}
+
+	switch_mutex_init(&new_profile->mutex, SWITCH_MUTEX_NESTED, module_pool);
+
 	if ((settings = switch_xml_child(xml, "mappings"))) {
 		for (param = switch_xml_child(settings, "map"); param; param = param->next) {
 			char *var = (char *) switch_xml_attr_soft(param, "name");
@@ -364,6 +732,9 @@ static switch_status_t load_profile(switch_xml_t xml)
 	}
 
 	switch_core_hash_insert(profile_hash, new_profile->name, (void *) new_profile);
+	new_profile->next = globals.profiles;
+	globals.profiles = new_profile;
+
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -377,36 +748,79 @@ static void event_handler(switch_event_t *event)
 	logfile_profile_t *profile;
 
 	if (sig && !strcmp(sig, "HUP")) {
-		if (globals.rotate) {
-			for (hi = switch_hash_first(NULL, profile_hash); hi; hi = switch_hash_next(hi)) {
-				switch_hash_this(hi, &var, NULL, &val);
-				profile = val;
-				mod_logfile_rotate(profile);
-			}
-		} else {
-			switch_mutex_lock(globals.mutex);
-			for (hi = switch_hash_first(NULL, profile_hash); hi; hi = switch_hash_next(hi)) {
-				switch_hash_this(hi, &var, NULL, &val);
-				profile = val;
-				switch_file_close(profile->log_afd);
-				if (mod_logfile_openlogfile(profile, SWITCH_TRUE) != SWITCH_STATUS_SUCCESS) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error Re-opening Log!\n");
-				}
+		/* the writer thread owns the files, let it rotate or reopen them after its next write */
+		for (hi = switch_hash_first(NULL, profile_hash); hi; hi = switch_hash_next(hi)) {
+			switch_hash_this(hi, &var, NULL, &val);
+			profile = val;
+			if (globals.rotate) {
+				profile->rotate_now = 1;
+			} else {
+				profile->reopen_now = 1;
 			}
-			switch_mutex_unlock(globals.mutex);
 		}
+		logfile_wake();
 	}
 }
 
+#define LOGFILE_SYNTAX "stats"
+SWITCH_STANDARD_API(logfile_api_function)
+{
+	logfile_profile_t *profile;
+
+	if (zstr(cmd) || strcasecmp(cmd, "stats")) {
+		stream->write_function(stream, "-USAGE: %s\n", LOGFILE_SYNTAX);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	stream->write_function(stream, "flush-interval: %ums\n", globals.flush_interval);
+
+	for (profile = globals.profiles; profile; profile = profile->next) {
+		switch_size_t pending_bytes;
+		uint32_t pending_lines;
+		uint64_t dropped, lines, bytes, writes, rotations;
+		double lines_per_sec, bytes_per_sec;
+
+		switch_mutex_lock(profile->mutex);
+		pending_bytes = profile->pending_bytes;
+		pending_lines = profile->pending_lines;
+		dropped = profile->dropped;
+		lines = profile->lines;
+		bytes = profile->bytes;
+		writes = profile->writes;
+		rotations = profile->rotations;
+		lines_per_sec = profile->lines_per_sec;
+		bytes_per_sec = profile->bytes_per_sec;
+		switch_mutex_unlock(profile->mutex);
+
+		stream->write_function(stream, "\nprofile: %s\nfile: %s\n", profile->name, profile->logfile);
+		stream->write_function(stream, "lines/sec: %0.1f\nbytes/sec: %0.1f\n", lines_per_sec, bytes_per_sec);
+		stream->write_function(stream, "lines: %" SWITCH_UINT64_T_FMT "\nbytes: %" SWITCH_UINT64_T_FMT "\n", lines, bytes);
+		stream->write_function(stream, "writes: %" SWITCH_UINT64_T_FMT " (%0.1f lines per write)\n", writes,
+							   writes ? (double) lines / writes : 0.0);
+		stream->write_function(stream, "pending: %u lines, %" SWITCH_SIZE_T_FMT " bytes\n", pending_lines, pending_bytes);
+		stream->write_function(stream, "dropped: %" SWITCH_UINT64_T_FMT "\n", dropped);
+		stream->write_function(stream, "rotations: %" SWITCH_UINT64_T_FMT " (%d compressing)\n", rotations,
+							   (int) switch_atomic_read(&profile->compressing));
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_MODULE_LOAD_FUNCTION(mod_logfile_load)
 {
 	char *cf = "logfile.conf";
 	switch_xml_t cfg, xml, settings, param, profiles, xprofile;
+	switch_api_interface_t *api_interface;
+	switch_threadattr_t *thd_attr = NULL;
+	logfile_profile_t *profile;
 
 	module_pool = pool;
 
 	memset(&globals, 0, sizeof(globals));
 	switch_mutex_init(&globals.mutex, SWITCH_MUTEX_NESTED, module_pool);
+	switch_mutex_init(&globals.cond_mutex, SWITCH_MUTEX_NESTED, module_pool);
+	switch_thread_cond_create(&globals.cond, module_pool);
+	switch_queue_create(&globals.compress_queue, MAX_ROT, module_pool);
 
 	if (profile_hash) {
 		switch_core_hash_destroy(&profile_hash);
@@ -430,6 +844,8 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_logfile_load)
 				char *val = (char *) switch_xml_attr_soft(param, "value");
 				if (!strcmp(var, "rotate-on-hup")) {
 					globals.rotate = switch_true(val);
+				} else if (!strcmp(var, "flush-interval")) {
+					globals.flush_interval = switch_atoui(val);
 				}
 			}
 		}
@@ -445,27 +861,56 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_logfile_load)
 		switch_xml_free(xml);
 	}
 
-	switch_log_bind_logger(mod_logfile_logger, SWITCH_LOG_DEBUG, SWITCH_FALSE);
+	SWITCH_ADD_API(api_interface, "logfile", "File logger", logfile_api_function, LOGFILE_SYNTAX);
+
+	globals.running = 1;
+	switch_threadattr_create(&thd_attr, module_pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_thread_create(&globals.writer_thread, thd_attr, logfile_writer_thread, NULL, module_pool);
+
+	for (profile = globals.profiles; profile; profile = profile->next) {
+		if (profile->compress_command) {
+			switch_thread_create(&globals.compress_thread, thd_attr, logfile_compress_thread, NULL, module_pool);
+			break;
+		}
+	}
+
+	switch_log_bind_logger(mod_logfile_logger, logfile_max_level(), SWITCH_FALSE);
 
 	return SWITCH_STATUS_SUCCESS;
 }
 
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_logfile_shutdown)
 {
-	switch_hash_index_t *hi;
-	const void *var;
-	void *val;
+	logfile_profile_t *profile;
+	logfile_chunk_t *chunk;
+	switch_status_t st;
 
 	switch_log_unbind_logger(mod_logfile_logger);
 	switch_event_unbind(&globals.node);
 
-	for (hi = switch_hash_first(NULL, profile_hash); hi; hi = switch_hash_next(hi)) {
-		logfile_profile_t *profile;
-		switch_hash_this(hi, &var, NULL, &val);
-		if ((profile = (logfile_profile_t *) val)) {
+	/* the writer flushes whatever is still pending before it exits */
+	switch_mutex_lock(globals.cond_mutex);
+	globals.running = 0;
+	switch_mutex_unlock(globals.cond_mutex);
+	logfile_wake();
+	switch_thread_join(&st, globals.writer_thread);
+
+	if (globals.compress_thread) {
+		switch_queue_push(globals.compress_queue, NULL);
+		switch_thread_join(&st, globals.compress_thread);
+	}
+
+	for (profile = globals.profiles; profile; profile = profile->next) {
+		if (profile->log_afd) {
 			switch_file_close(profile->log_afd);
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Closing %s\n", profile->logfile);
-			switch_safe_free(profile->logfile);
+		}
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Closing %s\n", profile->logfile);
+		switch_safe_free(profile->logfile);
+
+		while ((chunk = profile->spare)) {
+			profile->spare = chunk->next;
+			free(chunk);
 		}
 	}
 
@@ -39,7 +39,36 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_curl_shutdown);
 SWITCH_MODULE_DEFINITION(mod_xml_curl, mod_xml_curl_load, mod_xml_curl_shutdown, NULL);
 
 
+typedef struct xml_curl_entry {
+	char *key;
+	char *body;
+	int negative;
+	int fetching;
+	int detached;
+	int refs;
+	switch_time_t expires;
+	struct xml_curl_entry *prev;
+	struct xml_curl_entry *next;
+} xml_curl_entry_t;
+
+/* responses of one binding, most recently used at the head */
+typedef struct xml_curl_cache {
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	switch_hash_t *hash;
+	xml_curl_entry_t *head;
+	xml_curl_entry_t *tail;
+	uint32_t count;
+	uint64_t hits;
+	uint64_t negative_hits;
+	uint64_t misses;
+	uint64_t coalesced;
+	uint64_t expired;
+	uint64_t evicted;
+} xml_curl_cache_t;
+
 struct xml_binding {
+	char *name;
 	char *method;
 	char *url;
 	char *bindings;
@@ -59,6 +88,20 @@ struct xml_binding {
 	int use_dynamic_url;
 	int auth_scheme;
 	int timeout;
+	uint32_t cache_ttl;
+	uint32_t cache_negative_ttl;
+	uint32_t cache_max;
+	int coalesce;
+	char **cache_ignore;
+	int cache_ignore_count;
+	xml_curl_cache_t cache;
+	switch_mutex_t *handle_mutex;
+	switch_CURL **handles;
+	uint32_t handle_count;
+	uint32_t handle_max;
+	uint64_t connects;
+	uint64_t reuses;
+	struct xml_binding *next;
 };
 
 static int keep_files_around = 0;
@@ -84,11 +127,313 @@ static struct {
 	switch_memory_pool_t *pool;
 	hash_node_t *hash_root;
 	hash_node_t *hash_tail;
+	struct xml_binding *bindings;
 } globals;
 
-#define XML_CURL_SYNTAX "[debug_on|debug_off]"
+/* request params that change on every lookup and never pick a different answer */
+static const char *default_cache_ignore[] = { "Event-Date-*", "Event-Calling-*", "Event-Sequence", NULL };
+
+static void cache_entry_free(xml_curl_entry_t *entry)
+{
+	switch_safe_free(entry->key);
+	switch_safe_free(entry->body);
+	free(entry);
+}
+
+/* take an entry out of the lookup path; whoever still holds a ref frees it later. call with the cache mutex held */
+static void cache_unlink(xml_curl_cache_t *cache, xml_curl_entry_t *entry)
+{
+	if (!entry->detached) {
+		switch_core_hash_delete(cache->hash, entry->key);
+
+		if (entry->prev) {
+			entry->prev->next = entry->next;
+		} else {
+			cache->head = entry->next;
+		}
+
+		if (entry->next) {
+			entry->next->prev = entry->prev;
+		} else {
+			cache->tail = entry->prev;
+		}
+
+		entry->prev = entry->next = NULL;
+		entry->detached = 1;
+		cache->count--;
+	}
+
+	if (!entry->refs) {
+		cache_entry_free(entry);
+	}
+}
+
+static void cache_push_head(xml_curl_cache_t *cache, xml_curl_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = cache->head;
+
+	if (cache->head) {
+		cache->head->prev = entry;
+	} else {
+		cache->tail = entry;
+	}
+
+	cache->head = entry;
+}
+
+static void cache_flush(xml_curl_cache_t *cache)
+{
+	switch_mutex_lock(cache->mutex);
+	while (cache->head) {
+		cache_unlink(cache, cache->head);
+	}
+	switch_mutex_unlock(cache->mutex);
+}
+
+static int cache_param_ignored(xml_binding_t *binding, const char *name, switch_size_t len)
+{
+	int x;
+
+	for (x = 0; x < binding->cache_ignore_count; x++) {
+		const char *ign = binding->cache_ignore[x];
+		switch_size_t ilen = strlen(ign);
+
+		if (ilen && ign[ilen - 1] == '*') {
+			if (len >= ilen - 1 && !strncasecmp(name, ign, ilen - 1)) {
+				return 1;
+			}
+		} else if (len == ilen && !strncasecmp(name, ign, len)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static int cache_param_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* the url plus the request params in a fixed order, minus the ones that are different on every request */
+static char *cache_key(xml_binding_t *binding, const char *url, const char *data)
+{
+	char *mydata, **pairs, *key, *p;
+	int argc, x;
+	switch_size_t len = strlen(url) + 2;
+
+	mydata = strdup(data);
+	switch_assert(mydata);
+	pairs = malloc(sizeof(char *) * (strlen(data) / 2 + 2));
+	switch_assert(pairs);
+
+	argc = switch_separate_string(mydata, '&', pairs, strlen(data) / 2 + 2);
+
+	for (x = 0; x < argc;) {
+		char *eq = strchr(pairs[x], '=');
+
+		if (zstr(pairs[x]) || cache_param_ignored(binding, pairs[x], eq ? (switch_size_t) (eq - pairs[x]) : strlen(pairs[x]))) {
+			pairs[x] = pairs[--argc];
+			continue;
+		}
+
+		len += strlen(pairs[x]) + 1;
+		x++;
+	}
+
+	qsort(pairs, argc, sizeof(char *), cache_param_cmp);
+
+	key = malloc(len);
+	switch_assert(key);
+	p = key + switch_snprintf(key, len, "%s?", url);
+	for (x = 0; x < argc; x++) {
+		p += switch_snprintf(p, len - (p - key), "%s%s", x ? "&" : "", pairs[x]);
+	}
+
+	free(pairs);
+	free(mydata);
+
+	return key;
+}
+
+/* a document that only says the server has nothing for this key */
+static int xml_not_found(switch_xml_t xml)
+{
+	switch_xml_t section, result;
+
+	return (section = switch_xml_find_child(xml, "section", "name", "result")) &&
+		(result = switch_xml_child(section, "result")) && !strcasecmp(switch_xml_attr_soft(result, "status"), "not found");
+}
+
+/*
+ * Look key up in the binding cache.  On a hit (or after waiting for an identical fetch already in
+ * flight) *body gets a copy of the stored document, NULL for a failed fetch, and SWITCH_STATUS_SUCCESS
+ * is returned.  On a miss *entry is a placeholder the caller has to fill in with cache_complete().
+ */
+static switch_status_t cache_lookup(xml_binding_t *binding, char *key, char **body, xml_curl_entry_t **entry)
+{
+	xml_curl_cache_t *cache = &binding->cache;
+	xml_curl_entry_t *e;
+	switch_time_t now = switch_micro_time_now();
+
+	*body = NULL;
+	*entry = NULL;
+
+	switch_mutex_lock(cache->mutex);
+
+	if ((e = switch_core_hash_find(cache->hash, key)) && !e->fetching && e->expires <= now) {
+		cache->expired++;
+		cache_unlink(cache, e);
+		e = NULL;
+	}
+
+	if (e) {
+		if (e->fetching) {
+			cache->coalesced++;
+			e->refs++;
+			while (e->fetching) {
+				switch_thread_cond_wait(cache->cond, cache->mutex);
+			}
+			e->refs--;
+		} else if (e->negative) {
+			cache->negative_hits++;
+		} else {
+			cache->hits++;
+		}
+
+		if (e->body) {
+			*body = strdup(e->body);
+		}
+
+		if (e->detached) {
+			if (!e->refs) {
+				cache_entry_free(e);
+			}
+		} else if (e != cache->head) {
+			e->prev->next = e->next;
+			if (e->next) {
+				e->next->prev = e->prev;
+			} else {
+				cache->tail = e->prev;
+			}
+			cache_push_head(cache, e);
+		}
+
+		switch_mutex_unlock(cache->mutex);
+		free(key);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	cache->misses++;
+
+	switch_zmalloc(e, sizeof(*e));
+	e->key = key;
+	e->fetching = 1;
+	e->refs = 1;
+	switch_core_hash_insert(cache->hash, e->key, e);
+	cache_push_head(cache, e);
+	cache->count++;
+
+	while (cache->count > binding->cache_max && cache->tail != e) {
+		xml_curl_entry_t *victim = cache->tail;
+
+		while (victim && victim->fetching) {
+			victim = victim->prev;
+		}
+
+		if (!victim || victim == e) {
+			break;
+		}
+
+		cache->evicted++;
+		cache_unlink(cache, victim);
+	}
+
+	switch_mutex_unlock(cache->mutex);
+
+	*entry = e;
+	return SWITCH_STATUS_FALSE;
+}
+
+/* publish the outcome of a fetch to the waiters and, when its ttl allows, to later lookups */
+static void cache_complete(xml_binding_t *binding, xml_curl_entry_t *entry, switch_xml_t xml)
+{
+	xml_curl_cache_t *cache = &binding->cache;
+	int negative = !xml || xml_not_found(xml);
+	uint32_t ttl = negative ? binding->cache_negative_ttl : binding->cache_ttl;
+
+	switch_mutex_lock(cache->mutex);
+
+	/* only pay for the serialization when the entry is kept or somebody is waiting on it, anyone
+	   joining while it runs still finds fetching set and waits for the body */
+	if (xml && ((ttl && !entry->detached) || entry->refs > 1)) {
+		char *body;
+
+		switch_mutex_unlock(cache->mutex);
+		body = switch_xml_toxml(xml, SWITCH_FALSE);
+		switch_mutex_lock(cache->mutex);
+		entry->body = body;
+	}
+
+	entry->negative = negative;
+	entry->expires = switch_micro_time_now() + (switch_time_t) ttl * 1000000;
+	entry->fetching = 0;
+	entry->refs--;
+
+	if (!ttl || entry->detached) {
+		cache_unlink(cache, entry);
+	}
+
+	switch_thread_cond_broadcast(cache->cond);
+	switch_mutex_unlock(cache->mutex);
+}
+
+/* an idle handle of the binding still holds its connection to the gateway, so reusing it skips the handshake */
+static switch_CURL *handle_acquire(xml_binding_t *binding)
+{
+	switch_CURL *curl_handle = NULL;
+
+	switch_mutex_lock(binding->handle_mutex);
+	if (binding->handle_count) {
+		curl_handle = binding->handles[--binding->handle_count];
+		binding->reuses++;
+	} else {
+		binding->connects++;
+	}
+	switch_mutex_unlock(binding->handle_mutex);
+
+	if (curl_handle) {
+		curl_easy_reset(curl_handle);
+	} else {
+		curl_handle = switch_curl_easy_init();
+	}
+
+	return curl_handle;
+}
+
+static void handle_release(xml_binding_t *binding, switch_CURL *curl_handle, int reusable)
+{
+	/* the cookie jar is only written out when the handle goes away */
+	if (reusable && !binding->cookie_file) {
+		switch_mutex_lock(binding->handle_mutex);
+		if (binding->handle_count < binding->handle_max) {
+			binding->handles[binding->handle_count++] = curl_handle;
+			curl_handle = NULL;
+		}
+		switch_mutex_unlock(binding->handle_mutex);
+	}
+
+	if (curl_handle) {
+		switch_curl_easy_cleanup(curl_handle);
+	}
+}
+
+#define XML_CURL_SYNTAX "[debug_on|debug_off|cache_stats [reset]|cache_flush [<binding>]]"
 SWITCH_STANDARD_API(xml_curl_function)
 {
+	xml_binding_t *binding;
+
 	if (session) {
 		return SWITCH_STATUS_FALSE;
 	}
@@ -101,6 +446,48 @@ SWITCH_STANDARD_API(xml_curl_function)
 		keep_files_around = 1;
 	} else if (!strcasecmp(cmd, "debug_off")) {
 		keep_files_around = 0;
+	} else if (!strncasecmp(cmd, "cache_stats", 11)) {
+		int reset = !strcasecmp(cmd + 11, " reset");
+
+		stream->write_function(stream, "binding,entries,hits,negative_hits,misses,coalesced,expired,evicted,hit_rate,connects,reuses\n");
+		for (binding = globals.bindings; binding; binding = binding->next) {
+			xml_curl_cache_t *cache = &binding->cache;
+			uint64_t lookups, connects, reuses;
+
+			/* the handle counters belong to handle_mutex, they are bumped in handle_acquire() */
+			switch_mutex_lock(binding->handle_mutex);
+			connects = binding->connects;
+			reuses = binding->reuses;
+			if (reset) {
+				binding->connects = binding->reuses = 0;
+			}
+			switch_mutex_unlock(binding->handle_mutex);
+
+			switch_mutex_lock(cache->mutex);
+			lookups = cache->hits + cache->negative_hits + cache->misses + cache->coalesced;
+			stream->write_function(stream, "%s,%u,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT
+								   ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%.1f%%,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT "\n",
+								   binding->name ? binding->name : binding->url, cache->count, cache->hits, cache->negative_hits, cache->misses,
+								   cache->coalesced, cache->expired, cache->evicted,
+								   lookups ? 100.0 * (cache->hits + cache->negative_hits + cache->coalesced) / lookups : 0.0, connects, reuses);
+			if (reset) {
+				cache->hits = cache->negative_hits = cache->misses = cache->coalesced = cache->expired = cache->evicted = 0;
+			}
+			switch_mutex_unlock(cache->mutex);
+		}
+		return SWITCH_STATUS_SUCCESS;
+	} else if (!strncasecmp(cmd, "cache_flush", 11)) {
+		const char *name = cmd + 11;
+
+		while (*name == ' ') {
+			name++;
+		}
+
+		for (binding = globals.bindings; binding; binding = binding->next) {
+			if (zstr(name) || (binding->name && !strcasecmp(binding->name, name))) {
+				cache_flush(&binding->cache);
+			}
+		}
 	} else {
 		goto usage;
 	}
@@ -156,6 +543,8 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 	char basic_data[512];
 	char *uri = NULL;
 	char *dynamic_url = NULL;
+	xml_curl_entry_t *entry = NULL;
+	switch_CURLcode curl_status;
 
     strncpy(hostname, switch_core_get_switchname(), sizeof(hostname));
 
@@ -202,11 +591,22 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 		sprintf(uri, "%s%c%s", dynamic_url, strchr(dynamic_url, '?') != NULL ? '&' : '?', data);
 	}
 
+	if (binding->cache_ttl || binding->cache_negative_ttl || binding->coalesce) {
+		char *body = NULL;
+
+		if (cache_lookup(binding, cache_key(binding, dynamic_url, data), &body, &entry) == SWITCH_STATUS_SUCCESS) {
+			if (body) {
+				xml = switch_xml_parse_str_dynamic(body, SWITCH_FALSE);
+			}
+			goto end;
+		}
+	}
+
 	switch_uuid_get(&uuid);
 	switch_uuid_format(uuid_str, &uuid);
 
 	switch_snprintf(filename, sizeof(filename), "%s%s%s.tmp.xml", SWITCH_GLOBAL_dirs.temp_dir, SWITCH_PATH_SEPARATOR, uuid_str);
-	curl_handle = switch_curl_easy_init();
+	curl_handle = handle_acquire(binding);
 	headers = switch_curl_slist_append(headers, "Content-Type: application/x-www-form-urlencoded");
 
 	if (!strncasecmp(binding->url, "https", 5)) {
@@ -288,14 +688,16 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 			curl_easy_setopt(curl_handle, CURLOPT_INTERFACE, binding->bind_local);
 		}
 
-		switch_curl_easy_perform(curl_handle);
+		curl_status = switch_curl_easy_perform(curl_handle);
 		switch_curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &httpRes);
-		switch_curl_easy_cleanup(curl_handle);
+		handle_release(binding, curl_handle, curl_status == CURLE_OK);
 		switch_curl_slist_free_all(headers);
 		switch_curl_slist_free_all(slist);
 		close(config_data.fd);
 	} else {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error Opening temp file!\n");
+		handle_release(binding, curl_handle, 1);
+		switch_curl_slist_free_all(headers);
 	}
 
 	if (config_data.err) {
@@ -322,6 +724,12 @@ static switch_xml_t xml_url_fetch(const char *section, const char *tag_name, con
 		}
 	}
 
+	if (entry) {
+		cache_complete(binding, entry, xml);
+	}
+
+  end:
+
 	switch_safe_free(data);
 	if (binding->use_get_style == 1)
 		switch_safe_free(uri);
@@ -336,7 +744,7 @@ static switch_status_t do_config(void)
 	char *cf = "xml_curl.conf";
 	switch_xml_t cfg, xml, bindings_tag, binding_tag, param;
 	xml_binding_t *binding = NULL;
-	int x = 0;
+	int x = 0, i;
 	int need_vars_map = 0;
 	switch_hash_t *vars_map = NULL;
 
@@ -369,6 +777,10 @@ static switch_status_t do_config(void)
 		char *cookie_file = NULL;
 		hash_node_t *hash_node;
 		int auth_scheme = CURLAUTH_BASIC;
+		uint32_t cache_ttl = 0, cache_negative_ttl = 0, cache_max = 4096, keepalive = 8;
+		int coalesce = 1;
+		char *cache_ignore[64];
+		int cache_ignore_count = 0;
 		need_vars_map = 0;
 		vars_map = NULL;
 
@@ -447,6 +859,22 @@ static switch_status_t do_config(void)
 				}
 			} else if (!strcasecmp(var, "bind-local")) {
 				bind_local = val;
+			} else if (!strcasecmp(var, "cache-ttl")) {
+				cache_ttl = atoi(val) > 0 ? atoi(val) : 0;
+			} else if (!strcasecmp(var, "cache-negative-ttl")) {
+				cache_negative_ttl = atoi(val) > 0 ? atoi(val) : 0;
+			} else if (!strcasecmp(var, "cache-max-entries")) {
+				if (atoi(val) > 0) {
+					cache_max = atoi(val);
+				}
+			} else if (!strcasecmp(var, "cache-ignore-param")) {
+				if (!zstr(val) && cache_ignore_count < (int) (sizeof(cache_ignore) / sizeof(cache_ignore[0]))) {
+					cache_ignore[cache_ignore_count++] = val;
+				}
+			} else if (!strcasecmp(var, "coalesce-requests")) {
+				coalesce = switch_true(val);
+			} else if (!strcasecmp(var, "keepalive-connections")) {
+				keepalive = atoi(val) > 0 ? atoi(val) : 0;
 			}
 		}
 
@@ -518,6 +946,33 @@ static switch_status_t do_config(void)
 
 		binding->vars_map = vars_map;
 
+		if (!zstr(bname)) {
+			binding->name = strdup(bname);
+		}
+
+		binding->cache_ttl = cache_ttl;
+		binding->cache_negative_ttl = cache_negative_ttl;
+		binding->cache_max = cache_max;
+		binding->coalesce = coalesce;
+		binding->cache_ignore = malloc(sizeof(char *) * (cache_ignore_count + sizeof(default_cache_ignore) / sizeof(default_cache_ignore[0])));
+		switch_assert(binding->cache_ignore);
+		for (i = 0; default_cache_ignore[i]; i++) {
+			binding->cache_ignore[binding->cache_ignore_count++] = strdup(default_cache_ignore[i]);
+		}
+		for (i = 0; i < cache_ignore_count; i++) {
+			binding->cache_ignore[binding->cache_ignore_count++] = strdup(cache_ignore[i]);
+		}
+		switch_mutex_init(&binding->cache.mutex, SWITCH_MUTEX_NESTED, globals.pool);
+		switch_thread_cond_create(&binding->cache.cond, globals.pool);
+		switch_core_hash_init(&binding->cache.hash, globals.pool);
+
+		binding->handle_max = keepalive;
+		if (keepalive) {
+			binding->handles = malloc(sizeof(switch_CURL *) * keepalive);
+			switch_assert(binding->handles);
+		}
+		switch_mutex_init(&binding->handle_mutex, SWITCH_MUTEX_NESTED, globals.pool);
+
 		if (vars_map) {
 			switch_zmalloc(hash_node, sizeof(hash_node_t));
 			hash_node->hash = vars_map;
@@ -538,6 +993,8 @@ static switch_status_t do_config(void)
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Binding [%s] XML Fetch Function [%s] [%s]\n",
 						  zstr(bname) ? "N/A" : bname, binding->url, binding->bindings ? binding->bindings : "all");
 		switch_xml_bind_search_function(xml_url_fetch, switch_xml_parse_section_string(binding->bindings), binding);
+		binding->next = globals.bindings;
+		globals.bindings = binding;
 		x++;
 		binding = NULL;
 	}
@@ -567,6 +1024,9 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_curl_load)
 	SWITCH_ADD_API(xml_curl_api_interface, "xml_curl", "XML Curl", xml_curl_function, XML_CURL_SYNTAX);
 	switch_console_set_complete("add xml_curl debug_on");
 	switch_console_set_complete("add xml_curl debug_off");
+	switch_console_set_complete("add xml_curl cache_stats");
+	switch_console_set_complete("add xml_curl cache_stats reset");
+	switch_console_set_complete("add xml_curl cache_flush");
 
 	/* indicate that the module should continue to be loaded */
 	return SWITCH_STATUS_SUCCESS;
@@ -575,6 +1035,7 @@ SWITCH_MODULE_LOAD_FUNCTION(mod_xml_curl_load)
 SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_curl_shutdown)
 {
 	hash_node_t *ptr = NULL;
+	xml_binding_t *binding;
 
 	while (globals.hash_root) {
 		ptr = globals.hash_root;
@@ -585,6 +1046,16 @@ SWITCH_MODULE_SHUTDOWN_FUNCTION(mod_xml_curl_shutdown)
 
 	switch_xml_unbind_search_function_ptr(xml_url_fetch);
 
+	/* lookups hold the binding lock, so nothing is fetching any more */
+	for (binding = globals.bindings; binding; binding = binding->next) {
+		cache_flush(&binding->cache);
+		switch_core_hash_destroy(&binding->cache.hash);
+
+		while (binding->handle_count) {
+			switch_curl_easy_cleanup(binding->handles[--binding->handle_count]);
+		}
+	}
+
 	return SWITCH_STATUS_SUCCESS;
 }
 
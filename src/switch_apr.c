@@ -458,6 +458,11 @@ SWITCH_DECLARE(switch_status_t) switch_file_write(switch_file_t *thefile, const
 	return apr_file_write(thefile, buf, nbytes);
 }
 
+SWITCH_DECLARE(switch_status_t) switch_file_writev(switch_file_t *thefile, const struct iovec *vec, switch_size_t nvec, switch_size_t *nbytes)
+{
+	return apr_file_writev(thefile, vec, nvec, nbytes);
+}
+
 SWITCH_DECLARE(int) switch_file_printf(switch_file_t *thefile, const char *format, ...)
 {
 	va_list ap;
@@ -872,6 +877,52 @@ SWITCH_DECLARE(switch_status_t) switch_socket_recvfrom(switch_sockaddr_t *from,
 	return r;
 }
 
+SWITCH_DECLARE(int) switch_socket_fd_get(switch_socket_t *sock)
+{
+	apr_os_sock_t fd;
+
+	if (!sock || apr_os_sock_get(&fd, sock) != APR_SUCCESS) {
+		return -1;
+	}
+
+	return (int) fd;
+}
+
+SWITCH_DECLARE(const void *) switch_sockaddr_get_raw(switch_sockaddr_t *sa, int *len)
+{
+	*len = sa->salen;
+	return &sa->sa;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_sockaddr_set_raw(switch_sockaddr_t *sa, const void *raw, int len)
+{
+	const struct sockaddr *in = (const struct sockaddr *) raw;
+
+	if (len <= 0 || len > (int) sizeof(sa->sa)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memcpy(&sa->sa, raw, len);
+	sa->salen = len;
+	sa->family = in->sa_family;
+	sa->port = ntohs(sa->sa.sin.sin_port);
+
+#if APR_HAVE_IPV6
+	if (in->sa_family == AF_INET6) {
+		sa->ipaddr_ptr = &(sa->sa.sin6.sin6_addr);
+		sa->ipaddr_len = sizeof(struct in6_addr);
+		sa->addr_str_len = 46;
+		return SWITCH_STATUS_SUCCESS;
+	}
+#endif
+
+	sa->ipaddr_ptr = &(sa->sa.sin.sin_addr);
+	sa->ipaddr_len = sizeof(struct in_addr);
+	sa->addr_str_len = 16;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
 /* poll stubs */
 
 SWITCH_DECLARE(switch_status_t) switch_pollset_create(switch_pollset_t ** pollset, uint32_t size, switch_memory_pool_t *p, uint32_t flags)
@@ -1162,6 +1213,11 @@ SWITCH_DECLARE(switch_status_t) switch_thread_exit(switch_thread_t *thd, switch_
 	return apr_thread_exit((apr_thread_t *) thd, retval);
 }
 
+SWITCH_DECLARE(switch_status_t) switch_thread_detach(switch_thread_t *thd)
+{
+	return apr_thread_detach((apr_thread_t *) thd);
+}
+
 /**
  * block until the desired thread stops executing.
  * @param retval The return value from the dead thread.
@@ -1196,6 +1252,29 @@ SWITCH_DECLARE(void) switch_atomic_set(volatile switch_atomic_t *mem, uint32_t v
 #endif
 }
 
+SWITCH_DECLARE(uint32_t) switch_atomic_read_acquire(volatile switch_atomic_t *mem)
+{
+#if defined(__ATOMIC_ACQUIRE) && !defined(apr_atomic_t)
+	return __atomic_load_n(mem, __ATOMIC_ACQUIRE);
+#else
+	/* a cas that never changes the value still brings its full barrier */
+	return switch_atomic_cas(mem, 0, 0);
+#endif
+}
+
+SWITCH_DECLARE(void) switch_atomic_set_release(volatile switch_atomic_t *mem, uint32_t val)
+{
+#if defined(__ATOMIC_RELEASE) && !defined(apr_atomic_t)
+	__atomic_store_n(mem, val, __ATOMIC_RELEASE);
+#else
+	uint32_t old;
+
+	do {
+		old = switch_atomic_read(mem);
+	} while (switch_atomic_cas(mem, val, old) != old);
+#endif
+}
+
 SWITCH_DECLARE(void) switch_atomic_add(volatile switch_atomic_t *mem, uint32_t val)
 {
 #ifdef apr_atomic_t
@@ -1223,6 +1302,20 @@ SWITCH_DECLARE(int) switch_atomic_dec(volatile switch_atomic_t *mem)
 #endif
 }
 
+SWITCH_DECLARE(uint32_t) switch_atomic_cas(volatile switch_atomic_t *mem, uint32_t with, uint32_t cmp)
+{
+#ifdef apr_atomic_t
+	return apr_atomic_cas((apr_atomic_t *)mem, with, cmp);
+#else
+	return apr_atomic_cas32((apr_uint32_t *)mem, with, cmp);
+#endif
+}
+
+SWITCH_DECLARE(void *) switch_atomic_casptr(volatile void **mem, void *with, const void *cmp)
+{
+	return apr_atomic_casptr(mem, with, cmp);
+}
+
 SWITCH_DECLARE(char *) switch_strerror(switch_status_t statcode, char *buf, switch_size_t bufsize)
 {
        return apr_strerror(statcode, buf, bufsize);
@@ -35,9 +35,14 @@
 static uint32_t buffer_id = 0;
 
 typedef enum {
-	SWITCH_BUFFER_FLAG_DYNAMIC = (1 << 0)
+	SWITCH_BUFFER_FLAG_DYNAMIC = (1 << 0),
+	SWITCH_BUFFER_FLAG_RING = (1 << 1),
+	SWITCH_BUFFER_FLAG_SPSC = (1 << 2)
 } switch_buffer_flag_t;
 
+/* largest ring we can index with the 32 bit free running positions */
+#define RING_MAX_LEN ((switch_size_t) 1 << 31)
+
 struct switch_buffer {
 	switch_byte_t *data;
 	switch_byte_t *head;
@@ -50,8 +55,195 @@ struct switch_buffer {
 	uint32_t flags;
 	uint32_t id;
 	int32_t loops;
+	/* ring mode: free running read and write positions, datalen is a power of two */
+	volatile switch_atomic_t rpos;
+	volatile switch_atomic_t wpos;
 };
 
+static switch_size_t ring_size(switch_size_t len)
+{
+	switch_size_t size = 64;
+
+	while (size < len && size < RING_MAX_LEN) {
+		size <<= 1;
+	}
+
+	return size;
+}
+
+/*
+ * Only spsc buffers pay for atomics, other rings are protected by the caller like any switch_buffer_t.
+ * A position is loaded with acquire so the bytes the other side wrote before publishing it are visible.
+ */
+static uint32_t ring_pos(switch_buffer_t *buffer, volatile switch_atomic_t *pos)
+{
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		return switch_atomic_read_acquire(pos);
+	}
+
+	return *pos;
+}
+
+static switch_size_t ring_inuse(switch_buffer_t *buffer)
+{
+	return (switch_size_t) (uint32_t) (ring_pos(buffer, &buffer->wpos) - ring_pos(buffer, &buffer->rpos));
+}
+
+static void ring_advance(switch_buffer_t *buffer, volatile switch_atomic_t *pos, switch_size_t len)
+{
+	if (!switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
+		*pos += (uint32_t) len;
+		return;
+	}
+
+	/* each position has a single writer, the release store publishes the data before the position */
+	switch_atomic_set_release(pos, *pos + (uint32_t) len);
+}
+
+/* only the last datalen bytes can be replayed by read_loop, so the count never has to go past that */
+static void ring_written(switch_buffer_t *buffer, switch_size_t len)
+{
+	if (buffer->datalen - buffer->actually_used > len) {
+		buffer->actually_used += len;
+	} else {
+		buffer->actually_used = buffer->datalen;
+	}
+}
+
+static void ring_copy_out(switch_buffer_t *buffer, uint32_t pos, void *data, switch_size_t len)
+{
+	switch_size_t off = pos & (buffer->datalen - 1);
+	switch_size_t first = buffer->datalen - off;
+
+	if (first > len) {
+		first = len;
+	}
+
+	memcpy(data, buffer->data + off, first);
+	if (len > first) {
+		memcpy((switch_byte_t *) data + first, buffer->data, len - first);
+	}
+}
+
+static void ring_copy_in(switch_buffer_t *buffer, uint32_t pos, const void *data, switch_size_t len)
+{
+	switch_size_t off = pos & (buffer->datalen - 1);
+	switch_size_t first = buffer->datalen - off;
+
+	if (first > len) {
+		first = len;
+	}
+
+	memcpy(buffer->data + off, data, first);
+	if (len > first) {
+		memcpy(buffer->data, (const switch_byte_t *) data + first, len - first);
+	}
+}
+
+/* make room for datalen more bytes, dynamic rings double instead of growing by blocksize so the copy is amortized */
+static switch_bool_t ring_reserve(switch_buffer_t *buffer, switch_size_t datalen)
+{
+	switch_size_t used = ring_inuse(buffer), new_size;
+	switch_byte_t *tmp;
+
+	if (buffer->datalen - used >= datalen) {
+		return SWITCH_TRUE;
+	}
+
+	if (!switch_test_flag(buffer, SWITCH_BUFFER_FLAG_DYNAMIC) || switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC) ||
+		(buffer->max_len && used + datalen > buffer->max_len) || used + datalen > RING_MAX_LEN) {
+		return SWITCH_FALSE;
+	}
+
+	new_size = ring_size(used + datalen);
+	if (new_size < buffer->datalen * 2) {
+		new_size = buffer->datalen * 2;
+	}
+
+	if (!(tmp = malloc(new_size))) {
+		return SWITCH_FALSE;
+	}
+
+	if (used) {
+		ring_copy_out(buffer, ring_pos(buffer, &buffer->rpos), tmp, used);
+	}
+
+	switch_safe_free(buffer->data);
+	buffer->data = buffer->head = tmp;
+	buffer->datalen = new_size;
+	switch_atomic_set(&buffer->rpos, 0);
+	switch_atomic_set(&buffer->wpos, (uint32_t) used);
+
+	return SWITCH_TRUE;
+}
+
+static switch_buffer_t *ring_create(switch_memory_pool_t *pool, switch_size_t start_len, switch_size_t max_len, uint32_t flags)
+{
+	switch_buffer_t *new_buffer;
+	switch_size_t size = ring_size(start_len);
+
+	if (pool) {
+		if (!(new_buffer = switch_core_alloc(pool, sizeof(*new_buffer))) || !(new_buffer->data = switch_core_alloc(pool, size))) {
+			return NULL;
+		}
+	} else {
+		if (!(new_buffer = malloc(sizeof(*new_buffer)))) {
+			return NULL;
+		}
+		memset(new_buffer, 0, sizeof(*new_buffer));
+
+		if (!(new_buffer->data = malloc(size))) {
+			free(new_buffer);
+			return NULL;
+		}
+		flags |= SWITCH_BUFFER_FLAG_DYNAMIC;
+	}
+
+	new_buffer->datalen = size;
+	new_buffer->max_len = max_len;
+	new_buffer->id = buffer_id++;
+	new_buffer->head = new_buffer->data;
+	new_buffer->flags = flags | SWITCH_BUFFER_FLAG_RING;
+
+	return new_buffer;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_ring(switch_memory_pool_t *pool, switch_buffer_t **buffer, switch_size_t len)
+{
+	switch_buffer_t *new_buffer;
+
+	if (len > RING_MAX_LEN || !(new_buffer = ring_create(pool, len, 0, 0))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	*buffer = new_buffer;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_ring_dynamic(switch_buffer_t **buffer, switch_size_t start_len, switch_size_t max_len)
+{
+	switch_buffer_t *new_buffer;
+
+	if (start_len > RING_MAX_LEN || !(new_buffer = ring_create(NULL, start_len, max_len, 0))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	*buffer = new_buffer;
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_buffer_create_spsc(switch_memory_pool_t *pool, switch_buffer_t **buffer, switch_size_t len)
+{
+	switch_buffer_t *new_buffer;
+
+	if (len > RING_MAX_LEN || !(new_buffer = ring_create(pool, len, 0, SWITCH_BUFFER_FLAG_SPSC))) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	*buffer = new_buffer;
+	return SWITCH_STATUS_SUCCESS;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_buffer_create(switch_memory_pool_t *pool, switch_buffer_t **buffer, switch_size_t max_len)
 {
 	switch_buffer_t *new_buffer;
@@ -130,18 +322,24 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_len(switch_buffer_t *buffer)
 
 SWITCH_DECLARE(switch_size_t) switch_buffer_freespace(switch_buffer_t *buffer)
 {
-	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_DYNAMIC)) {
+	switch_size_t used = switch_buffer_inuse(buffer);
+
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_DYNAMIC) && !switch_test_flag(buffer, SWITCH_BUFFER_FLAG_SPSC)) {
 		if (buffer->max_len) {
-			return (switch_size_t) (buffer->max_len - buffer->used);
+			return (switch_size_t) (buffer->max_len - used);
 		}
 		return 1000000;
 	}
 
-	return (switch_size_t) (buffer->datalen - buffer->used);
+	return (switch_size_t) (buffer->datalen - used);
 }
 
 SWITCH_DECLARE(switch_size_t) switch_buffer_inuse(switch_buffer_t *buffer)
 {
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		return ring_inuse(buffer);
+	}
+
 	return buffer->used;
 }
 
@@ -149,6 +347,15 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_toss(switch_buffer_t *buffer, switch
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		switch_size_t used = ring_inuse(buffer);
+
+		reading = used < datalen ? used : datalen;
+		ring_advance(buffer, &buffer->rpos, reading);
+
+		return used - reading;
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -179,8 +386,12 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_read_loop(switch_buffer_t *buffer, v
 		if (buffer->loops == 0) {
 			return 0;
 		}
-		buffer->head = buffer->data;
-		buffer->used = buffer->actually_used;
+		if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+			switch_atomic_set(&buffer->rpos, ring_pos(buffer, &buffer->wpos) - (uint32_t) buffer->actually_used);
+		} else {
+			buffer->head = buffer->data;
+			buffer->used = buffer->actually_used;
+		}
 		len = switch_buffer_read(buffer, data, datalen);
 	}
 	return len;
@@ -190,6 +401,19 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_read(switch_buffer_t *buffer, void *
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		if ((reading = ring_inuse(buffer)) > datalen) {
+			reading = datalen;
+		}
+
+		if (reading) {
+			ring_copy_out(buffer, ring_pos(buffer, &buffer->rpos), data, reading);
+			ring_advance(buffer, &buffer->rpos, reading);
+		}
+
+		return reading;
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -210,6 +434,18 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_peek(switch_buffer_t *buffer, void *
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		if ((reading = ring_inuse(buffer)) > datalen) {
+			reading = datalen;
+		}
+
+		if (reading) {
+			ring_copy_out(buffer, ring_pos(buffer, &buffer->rpos), data, reading);
+		}
+
+		return reading;
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -228,6 +464,15 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_peek_zerocopy(switch_buffer_t *buffe
 {
 	switch_size_t reading = 0;
 
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		const void *ptr2;
+		switch_size_t len2;
+
+		switch_buffer_peek_segments(buffer, ptr, &reading, &ptr2, &len2);
+
+		return reading;
+	}
+
 	if (buffer->used < 1) {
 		buffer->used = 0;
 		return 0;
@@ -240,16 +485,57 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_peek_zerocopy(switch_buffer_t *buffe
 	return reading;
 }
 
-SWITCH_DECLARE(switch_size_t) switch_buffer_write(switch_buffer_t *buffer, const void *data, switch_size_t datalen)
+SWITCH_DECLARE(switch_size_t) switch_buffer_peek_segments(switch_buffer_t *buffer, const void **ptr1, switch_size_t *len1,
+															 const void **ptr2, switch_size_t *len2)
 {
-	switch_size_t freespace, actual_freespace;
+	switch_size_t used, off;
 
-	switch_assert(buffer->data != NULL);
+	*ptr1 = *ptr2 = NULL;
+	*len1 = *len2 = 0;
 
-	if (!datalen) {
+	if (!switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		if (buffer->used) {
+			*ptr1 = buffer->head;
+			*len1 = buffer->used;
+		}
 		return buffer->used;
 	}
 
+	if (!(used = ring_inuse(buffer))) {
+		return 0;
+	}
+
+	off = ring_pos(buffer, &buffer->rpos) & (buffer->datalen - 1);
+	*ptr1 = buffer->data + off;
+	*len1 = buffer->datalen - off;
+
+	if (*len1 >= used) {
+		*len1 = used;
+	} else {
+		*ptr2 = buffer->data;
+		*len2 = used - *len1;
+	}
+
+	return used;
+}
+
+SWITCH_DECLARE(switch_size_t) switch_buffer_read_commit(switch_buffer_t *buffer, switch_size_t datalen)
+{
+	switch_size_t used = switch_buffer_inuse(buffer);
+
+	if (datalen > used) {
+		datalen = used;
+	}
+
+	switch_buffer_toss(buffer, datalen);
+
+	return datalen;
+}
+
+static switch_bool_t buffer_make_room(switch_buffer_t *buffer, switch_size_t datalen)
+{
+	switch_size_t freespace, actual_freespace;
+
 	actual_freespace = buffer->datalen - buffer->actually_used;
 
 	if (actual_freespace < datalen) {
@@ -273,7 +559,7 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_write(switch_buffer_t *buffer, const
 			}
 			buffer->head = buffer->data;
 			if (!(tmp = realloc(buffer->data, new_size))) {
-				return 0;
+				return SWITCH_FALSE;
 			}
 			buffer->data = tmp;
 			buffer->head = buffer->data;
@@ -283,7 +569,86 @@ SWITCH_DECLARE(switch_size_t) switch_buffer_write(switch_buffer_t *buffer, const
 
 	freespace = buffer->datalen - buffer->used;
 
-	if (freespace < datalen) {
+	return freespace < datalen ? SWITCH_FALSE : SWITCH_TRUE;
+}
+
+SWITCH_DECLARE(switch_size_t) switch_buffer_reserve_segments(switch_buffer_t *buffer, switch_size_t datalen, void **ptr1, switch_size_t *len1,
+																void **ptr2, switch_size_t *len2)
+{
+	switch_size_t freespace, off;
+
+	*ptr1 = *ptr2 = NULL;
+	*len1 = *len2 = 0;
+
+	if (!switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		if (!buffer_make_room(buffer, datalen)) {
+			return 0;
+		}
+		*ptr1 = buffer->head + buffer->used;
+		*len1 = buffer->datalen - buffer->actually_used;
+		return *len1;
+	}
+
+	if (!ring_reserve(buffer, datalen)) {
+		return 0;
+	}
+
+	freespace = buffer->datalen - ring_inuse(buffer);
+	off = ring_pos(buffer, &buffer->wpos) & (buffer->datalen - 1);
+	*ptr1 = buffer->data + off;
+	*len1 = buffer->datalen - off;
+
+	if (*len1 >= freespace) {
+		*len1 = freespace;
+	} else {
+		*ptr2 = buffer->data;
+		*len2 = freespace - *len1;
+	}
+
+	return freespace;
+}
+
+SWITCH_DECLARE(switch_size_t) switch_buffer_write_commit(switch_buffer_t *buffer, switch_size_t datalen)
+{
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		switch_assert(datalen <= buffer->datalen - ring_inuse(buffer));
+		ring_written(buffer, datalen);
+		ring_advance(buffer, &buffer->wpos, datalen);
+		return ring_inuse(buffer);
+	}
+
+	switch_assert(datalen <= buffer->datalen - buffer->actually_used);
+	buffer->used += datalen;
+	buffer->actually_used += datalen;
+
+	return buffer->used;
+}
+
+SWITCH_DECLARE(switch_size_t) switch_buffer_write(switch_buffer_t *buffer, const void *data, switch_size_t datalen)
+{
+	switch_assert(buffer->data != NULL);
+
+	if (switch_test_flag(buffer, SWITCH_BUFFER_FLAG_RING)) {
+		if (!datalen) {
+			return ring_inuse(buffer);
+		}
+
+		if (!ring_reserve(buffer, datalen)) {
+			return 0;
+		}
+
+		ring_copy_in(buffer, ring_pos(buffer, &buffer->wpos), data, datalen);
+		ring_written(buffer, datalen);
+		ring_advance(buffer, &buffer->wpos, datalen);
+
+		return ring_inuse(buffer);
+	}
+
+	if (!datalen) {
+		return buffer->used;
+	}
+
+	if (!buffer_make_room(buffer, datalen)) {
 		return 0;
 	}
 
@@ -300,6 +665,8 @@ SWITCH_DECLARE(void) switch_buffer_zero(switch_buffer_t *buffer)
 	buffer->used = 0;
 	buffer->actually_used = 0;
 	buffer->head = buffer->data;
+	switch_atomic_set(&buffer->rpos, 0);
+	switch_atomic_set(&buffer->wpos, 0);
 }
 
 SWITCH_DECLARE(switch_size_t) switch_buffer_zwrite(switch_buffer_t *buffer, const void *data, switch_size_t datalen)
@@ -1392,8 +1392,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	runtime.db_handle_timeout = 5000000;;
 	
 	runtime.runlevel++;
-	runtime.sql_buffer_len = 1024 * 32;
 	runtime.max_sql_buffer_len = 1024 * 1024;
+	runtime.sql_writers = 1;
+	runtime.sql_batch_ms = 100;
 	runtime.dummy_cng_frame.data = runtime.dummy_data;
 	runtime.dummy_cng_frame.datalen = sizeof(runtime.dummy_data);
 	runtime.dummy_cng_frame.buflen = sizeof(runtime.dummy_data);
@@ -1457,6 +1458,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	switch_thread_rwlock_create(&runtime.global_var_rwlock, runtime.memory_pool);
 	switch_core_set_globals();
 	switch_core_session_init(runtime.memory_pool);
+	switch_regex_cache_init(runtime.memory_pool);
+	switch_core_file_cache_init(runtime.memory_pool);
+	switch_core_file_writer_init(runtime.memory_pool);
 	switch_event_create_plain(&runtime.global_vars, SWITCH_EVENT_CHANNEL_DATA);
 	switch_core_hash_init(&runtime.mime_types, runtime.memory_pool);
 	switch_core_hash_init_case(&runtime.ptimes, runtime.memory_pool, SWITCH_FALSE);
@@ -1511,6 +1515,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_init(switch_core_flag_t flags, switc
 	switch_load_core_config("switch.conf");
 
 	switch_core_state_machine_init(runtime.memory_pool);
+	switch_core_session_thread_pool_start();
 
 	if (switch_core_sqldb_start(runtime.memory_pool, switch_test_flag((&runtime), SCF_USE_SQL) ? SWITCH_TRUE : SWITCH_FALSE) != SWITCH_STATUS_SUCCESS) {
 		*err = "Error activating database";
@@ -1629,6 +1634,10 @@ static void switch_load_core_config(const char *file)
 		}
 
 		if ((settings = switch_xml_child(cfg, "settings"))) {
+			uint32_t pool_min = 0, pool_max = 0;
+			switch_bool_t pool_affinity = SWITCH_FALSE;
+			switch_size_t prompt_cache_mb = 0, prompt_cache_file_kb = 0;
+
 			for (param = switch_xml_child(settings, "param"); param; param = param->next) {
 				const char *var = switch_xml_attr_soft(param, "name");
 				const char *val = switch_xml_attr_soft(param, "value");
@@ -1677,6 +1686,10 @@ static void switch_load_core_config(const char *file)
 				} else if (!strcasecmp(var, "multiple-registrations")) {
 					runtime.multiple_registrations = switch_true(val);
 				} else if (!strcasecmp(var, "sql-buffer-len")) {
+					/* the core db writers batch statements instead of concatenating them into one buffer */
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+									  "sql-buffer-len is deprecated and ignored, batches are bounded by max-sql-buffer-len\n");
+				} else if (!strcasecmp(var, "max-sql-buffer-len")) {
 					int tmp = atoi(val);
 
 					if (end_of(val) == 'k') {
@@ -1684,29 +1697,39 @@ static void switch_load_core_config(const char *file)
 					} else if (end_of(val) == 'm') {
 						tmp *= (1024 * 1024);
 					}
-					
+
 					if (tmp >= 32000 && tmp < 10500000) {
-						runtime.sql_buffer_len = tmp;
+						runtime.max_sql_buffer_len = tmp;
 					} else {
-						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "sql-buffer-len: Value is not within rage 32k to 10m\n");
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "max-sql-buffer-len: Value is not within rage 32k to 10m\n");
 					}
-				} else if (!strcasecmp(var, "max-sql-buffer-len")) {
+
+				} else if (!strcasecmp(var, "core-db-writers")) {
 					int tmp = atoi(val);
 
-					if (end_of(val) == 'k') {
-						tmp *= 1024;
-					} else if (end_of(val) == 'm') {
-						tmp *= (1024 * 1024);
+					if (tmp > 0 && tmp <= 16) {
+						runtime.sql_writers = tmp;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "core-db-writers: Value is not within range 1 to 16\n");
 					}
+				} else if (!strcasecmp(var, "core-db-batch-ms")) {
+					int tmp = atoi(val);
 
-					if (tmp < runtime.sql_buffer_len) {
-						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Value is not larger than sql-buffer-len\n");
-					} else if (tmp >= 32000 && tmp < 10500000) {
-						runtime.sql_buffer_len = tmp;
+					if (tmp > 0 && tmp <= 10000) {
+						runtime.sql_batch_ms = tmp;
 					} else {
-						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "max-sql-buffer-len: Value is not within rage 32k to 10m\n");
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "core-db-batch-ms: Value is not within range 1 to 10000\n");
 					}
+				} else if (!strcasecmp(var, "core-channel-registry")) {
+					runtime.channel_registry = switch_true(val);
+				} else if (!strcasecmp(var, "core-db-snapshot-sec")) {
+					int tmp = atoi(val);
 
+					if (tmp >= 0 && tmp <= 3600) {
+						runtime.sql_snapshot_sec = tmp;
+					} else {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "core-db-snapshot-sec: Value is not within range 0 to 3600\n");
+					}
 				} else if (!strcasecmp(var, "auto-create-schemas")) {
 					if (switch_true(val)) {
 						switch_set_flag((&runtime), SCF_AUTO_SCHEMAS);
@@ -1780,6 +1803,39 @@ static void switch_load_core_config(const char *file)
 					runtime.tipping_point = atoi(val);
 				} else if (!strcasecmp(var, "1ms-timer") && switch_true(val)) {
 					runtime.microseconds_per_tick = 1000;
+				} else if (!strcasecmp(var, "timer-shards") && !zstr(val)) {
+					if (!strcasecmp(val, "auto")) {
+						switch_time_set_timer_shards(-1);
+					} else {
+						switch_time_set_timer_shards(atoi(val) > 0 ? atoi(val) : 0);
+					}
+				} else if (!strcasecmp(var, "rtp-reactor-threads") && !zstr(val)) {
+					if (!strcasecmp(val, "auto")) {
+						switch_rtp_set_reactor_threads(-1);
+					} else {
+						switch_rtp_set_reactor_threads(atoi(val) > 0 ? atoi(val) : 0);
+					}
+				} else if (!strcasecmp(var, "regex-cache-size") && !zstr(val)) {
+					switch_regex_cache_set_size(atoi(val) > 0 ? (uint32_t) atoi(val) : 0);
+				} else if (!strcasecmp(var, "prompt-cache-size") && !zstr(val)) {
+					prompt_cache_mb = atoi(val) > 0 ? (switch_size_t) atoi(val) : 0;
+				} else if (!strcasecmp(var, "prompt-cache-max-file-size") && !zstr(val)) {
+					prompt_cache_file_kb = atoi(val) > 0 ? (switch_size_t) atoi(val) : 0;
+				} else if (!strcasecmp(var, "record-writer-threads") && !zstr(val)) {
+					switch_core_file_writer_set_threads(atoi(val) > 0 ? (uint32_t) atoi(val) : 0);
+				} else if (!strcasecmp(var, "session-thread-pool") && !zstr(val)) {
+					pool_min = atoi(val) > 0 ? (uint32_t) atoi(val) : 0;
+				} else if (!strcasecmp(var, "session-thread-pool-max") && !zstr(val)) {
+					pool_max = atoi(val) > 0 ? (uint32_t) atoi(val) : 0;
+				} else if (!strcasecmp(var, "session-thread-pool-affinity")) {
+					pool_affinity = switch_true(val);
+				} else if (!strcasecmp(var, "rtp-mux-port") && !zstr(val)) {
+					switch_rtp_set_mux_port((switch_port_t) atoi(val));
+				} else if (!strcasecmp(var, "sln-kernel") && !zstr(val)) {
+					if (switch_sln_kernel_set(val) != SWITCH_STATUS_SUCCESS) {
+						switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Mixing kernel %s not supported on this cpu, using %s\n",
+										  val, switch_sln_kernel_name());
+					}
 				} else if (!strcasecmp(var, "timer-affinity") && !zstr(val)) {
 					if (!strcasecmp(val, "disabled")) {
 						runtime.timer_affinity = -1;
@@ -1821,6 +1877,9 @@ static void switch_load_core_config(const char *file)
                     switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Set switchname to %s\n", runtime.switchname);
 				}
 			}
+
+			switch_core_session_thread_pool_set(pool_min, pool_max, pool_affinity);
+			switch_core_file_cache_set_limits(prompt_cache_mb * 1024 * 1024, prompt_cache_file_kb * 1024);
 		}
 
 		if ((settings = switch_xml_child(cfg, "variables"))) {
@@ -2292,6 +2351,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_destroy(void)
 		switch_core_sqldb_stop();
 	}
 	switch_scheduler_task_thread_stop();
+	switch_core_session_thread_pool_stop();
 
 	switch_rtp_shutdown();
 
@@ -2299,6 +2359,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_destroy(void)
 		switch_nat_shutdown();
 	}
 	switch_xml_destroy();
+	switch_regex_cache_shutdown();
+	switch_core_file_cache_shutdown();
+	switch_core_file_writer_shutdown();
 
 	switch_console_shutdown();
 
@@ -35,6 +35,1022 @@
 
 #include <switch.h>
 #include "private/switch_core_pvt.h"
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#define PROMPT_CACHE_DEFAULT_MAX_FILE (4 * 1024 * 1024)
+#define PROMPT_CACHE_READ_CHUNK 1024
+#define PROMPT_CACHE_INLINE_MS 2000		/* longer files are decoded by a loader thread instead of the first caller */
+
+/* decoded, mono, rate converted audio of one file, shared read only by every handle playing it */
+struct switch_prompt_cache_entry {
+	char *key;
+	int16_t *data;
+	switch_size_t samples;
+	switch_size_t bytes;
+	uint32_t rate;
+	uint32_t native_rate;
+	uint32_t refs;
+	int evicted;
+	int loading;
+	struct switch_prompt_cache_entry *prev;
+	struct switch_prompt_cache_entry *next;
+};
+
+typedef struct switch_prompt_cache_entry prompt_cache_entry_t;
+
+static struct {
+	int ready;
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	prompt_cache_entry_t *head;
+	prompt_cache_entry_t *tail;
+	uint32_t count;
+	switch_size_t bytes;
+	switch_size_t max_bytes;
+	switch_size_t max_file_bytes;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t bypassed;
+	uint64_t evictions;
+	uint64_t bytes_served;
+	uint32_t loaders;
+} PROMPT_CACHE = { 0, NULL, NULL, NULL, NULL, 0, 0, 0, PROMPT_CACHE_DEFAULT_MAX_FILE };
+
+typedef struct {
+	switch_memory_pool_t *pool;
+	prompt_cache_entry_t *loaded;
+	char *path;
+	uint32_t rate;
+	uint32_t channels;
+} prompt_cache_job_t;
+
+static int16_t *prompt_cache_map(switch_size_t bytes)
+{
+#ifdef HAVE_MMAP
+	void *mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	return mem == MAP_FAILED ? NULL : mem;
+#else
+	return malloc(bytes);
+#endif
+}
+
+/* nobody writes to a finished entry, make sure of it */
+static void prompt_cache_seal(prompt_cache_entry_t *entry)
+{
+#ifdef HAVE_MMAP
+	mprotect(entry->data, entry->bytes, PROT_READ);
+#endif
+}
+
+static void prompt_cache_entry_free(prompt_cache_entry_t *entry)
+{
+	if (entry->data) {
+#ifdef HAVE_MMAP
+		munmap(entry->data, entry->bytes);
+#else
+		free(entry->data);
+#endif
+	}
+	free(entry->key);
+	free(entry);
+}
+
+/* take an entry out of the cache, freeing it now unless a handle still reads from it */
+static void prompt_cache_unlink(prompt_cache_entry_t *entry)
+{
+	switch_core_hash_delete(PROMPT_CACHE.hash, entry->key);
+
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		PROMPT_CACHE.head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		PROMPT_CACHE.tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+	PROMPT_CACHE.count--;
+	PROMPT_CACHE.bytes -= entry->bytes;
+
+	if (entry->refs) {
+		entry->evicted = 1;
+	} else {
+		prompt_cache_entry_free(entry);
+	}
+}
+
+static void prompt_cache_push_front(prompt_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = PROMPT_CACHE.head;
+	if (PROMPT_CACHE.head) {
+		PROMPT_CACHE.head->prev = entry;
+	}
+	PROMPT_CACHE.head = entry;
+	if (!PROMPT_CACHE.tail) {
+		PROMPT_CACHE.tail = entry;
+	}
+}
+
+/* evict idle entries from the cold end until bytes more fit, the caller holds the mutex */
+static switch_bool_t prompt_cache_make_room(switch_size_t bytes)
+{
+	prompt_cache_entry_t *entry = PROMPT_CACHE.tail, *prev;
+
+	while (entry && PROMPT_CACHE.bytes + bytes > PROMPT_CACHE.max_bytes) {
+		prev = entry->prev;
+		if (!entry->refs && !entry->loading) {
+			prompt_cache_unlink(entry);
+			PROMPT_CACHE.evictions++;
+		}
+		entry = prev;
+	}
+
+	return PROMPT_CACHE.bytes + bytes <= PROMPT_CACHE.max_bytes ? SWITCH_TRUE : SWITCH_FALSE;
+}
+
+/*
+ * The key has to change whenever the audio would: the file mod_sndfile would pick for this rate
+ * (it tries <dir>/<rate>/<name>, then the other standard rates, then the path itself) with its
+ * size and mtime, plus what the module reported on open.
+ */
+static char *prompt_cache_key(switch_file_handle_t *fh, const char *path, uint32_t rate)
+{
+	uint32_t rates[5] = { rate, 48000, 32000, 16000, 8000 };
+	const char *name = strrchr(path, *SWITCH_PATH_SEPARATOR);
+	char *candidate;
+	struct stat st;
+	int i, found = 0;
+
+	for (i = 0; name && !found && i < 5; i++) {
+		candidate = switch_mprintf("%.*s%u%s%s", (int) (name + 1 - path), path, rates[i], SWITCH_PATH_SEPARATOR, name + 1);
+		found = !stat(candidate, &st);
+		free(candidate);
+	}
+
+	if (!found && stat(path, &st)) {
+		return NULL;
+	}
+
+	return switch_mprintf("%s|%u|%u|%u|%u|%" SWITCH_INT64_T_FMT "|%" SWITCH_INT64_T_FMT,
+						  path, rate, fh->native_rate, fh->channels, fh->samples, (int64_t) st.st_size, (int64_t) st.st_mtime);
+}
+
+/* decode the rest of an open handle through the normal read path; NULL when it outgrows max_samples */
+static int16_t *prompt_cache_decode(switch_file_handle_t *fh, switch_size_t max_samples, switch_size_t *samples)
+{
+	int16_t *pcm = NULL, *mem, *scratch;
+	switch_size_t have = 0, alloced = 0, len;
+
+	*samples = 0;
+
+	/* the module fills every channel before they are mixed down to mono */
+	switch_zmalloc(scratch, PROMPT_CACHE_READ_CHUNK * (fh->channels ? fh->channels : 1) * sizeof(*scratch));
+
+	for (;;) {
+		len = PROMPT_CACHE_READ_CHUNK;
+		if (switch_core_file_read(fh, scratch, &len) != SWITCH_STATUS_SUCCESS || !len) {
+			free(scratch);
+			*samples = have;
+			return pcm;
+		}
+
+		if (have + len > max_samples) {
+			break;
+		}
+
+		if (have + len > alloced) {
+			alloced = alloced ? alloced * 2 : 16 * PROMPT_CACHE_READ_CHUNK;
+			if (!(mem = realloc(pcm, alloced * sizeof(*pcm)))) {
+				break;
+			}
+			pcm = mem;
+		}
+
+		memcpy(pcm + have, scratch, len * sizeof(*pcm));
+		have += len;
+	}
+
+	free(scratch);
+	free(pcm);
+	return NULL;
+}
+
+/* decode an open handle into a placeholder and publish it, NULL if it did not fit or the cache went away */
+static prompt_cache_entry_t *prompt_cache_fill(switch_file_handle_t *fh, prompt_cache_entry_t *loaded, uint32_t rate, uint32_t refs)
+{
+	prompt_cache_entry_t *entry = NULL;
+	switch_size_t samples = 0, bytes;
+	int16_t *pcm;
+
+	if ((pcm = prompt_cache_decode(fh, PROMPT_CACHE.max_file_bytes / sizeof(int16_t), &samples)) && samples) {
+		bytes = samples * sizeof(int16_t);
+		if ((loaded->data = prompt_cache_map(bytes))) {
+			memcpy(loaded->data, pcm, bytes);
+			loaded->samples = samples;
+			loaded->bytes = bytes;
+			loaded->rate = rate;
+			loaded->native_rate = fh->native_rate;
+			prompt_cache_seal(loaded);
+		}
+	}
+	switch_safe_free(pcm);
+
+	switch_mutex_lock(PROMPT_CACHE.mutex);
+	if (loaded->data && PROMPT_CACHE.ready && prompt_cache_make_room(loaded->bytes)) {
+		loaded->loading = 0;
+		loaded->refs = refs;
+		prompt_cache_push_front(loaded);
+		PROMPT_CACHE.count++;
+		PROMPT_CACHE.bytes += loaded->bytes;
+		entry = loaded;
+	} else {
+		switch_core_hash_delete(PROMPT_CACHE.hash, loaded->key);
+		prompt_cache_entry_free(loaded);
+	}
+	switch_mutex_unlock(PROMPT_CACHE.mutex);
+
+	return entry;
+}
+
+/* decodes long files on its own handle so the media thread that missed never waits for it */
+static void *SWITCH_THREAD_FUNC prompt_cache_loader(switch_thread_t *thread, void *obj)
+{
+	prompt_cache_job_t *job = (prompt_cache_job_t *) obj;
+	switch_memory_pool_t *pool = job->pool;
+	switch_file_handle_t fh = { 0 };
+
+	/* the placeholder is already in the hash, so this open plays it the old way instead of attaching */
+	if (switch_core_file_open(&fh, job->path, job->channels, job->rate, SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, pool) == SWITCH_STATUS_SUCCESS) {
+		prompt_cache_fill(&fh, job->loaded, job->rate, 0);
+		switch_core_file_close(&fh);
+	} else {
+		switch_mutex_lock(PROMPT_CACHE.mutex);
+		switch_core_hash_delete(PROMPT_CACHE.hash, job->loaded->key);
+		prompt_cache_entry_free(job->loaded);
+		switch_mutex_unlock(PROMPT_CACHE.mutex);
+	}
+
+	switch_mutex_lock(PROMPT_CACHE.mutex);
+	PROMPT_CACHE.loaders--;
+	switch_mutex_unlock(PROMPT_CACHE.mutex);
+
+	switch_core_destroy_memory_pool(&pool);
+
+	return NULL;
+}
+
+/* hand a placeholder to a loader thread, the caller holds the mutex */
+static switch_status_t prompt_cache_launch(prompt_cache_entry_t *loaded, const char *path, uint32_t rate, uint32_t channels)
+{
+	switch_memory_pool_t *pool;
+	switch_threadattr_t *thd_attr;
+	switch_thread_t *thread;
+	prompt_cache_job_t *job;
+
+	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	job = switch_core_alloc(pool, sizeof(*job));
+	job->pool = pool;
+	job->loaded = loaded;
+	job->path = switch_core_strdup(pool, path);
+	job->rate = rate;
+	job->channels = channels;
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_detach_set(thd_attr, 1);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	PROMPT_CACHE.loaders++;
+	if (switch_thread_create(&thread, thd_attr, prompt_cache_loader, job, pool) != SWITCH_STATUS_SUCCESS) {
+		PROMPT_CACHE.loaders--;
+		switch_core_destroy_memory_pool(&pool);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* serve a just opened read handle from the cache, loading the file into it on a miss */
+static void prompt_cache_attach(switch_file_handle_t *fh, const char *path, uint32_t rate)
+{
+	prompt_cache_entry_t *entry, *loaded = NULL;
+	unsigned int pos = 0;
+	char *key;
+
+	if (!(key = prompt_cache_key(fh, path, rate))) {
+		switch_mutex_lock(PROMPT_CACHE.mutex);
+		PROMPT_CACHE.bypassed++;
+		switch_mutex_unlock(PROMPT_CACHE.mutex);
+		return;
+	}
+
+	switch_mutex_lock(PROMPT_CACHE.mutex);
+	if ((entry = switch_core_hash_find(PROMPT_CACHE.hash, key))) {
+		if (entry->loading) {
+			/* someone else is decoding it right now, play this one the old way */
+			PROMPT_CACHE.bypassed++;
+			entry = NULL;
+		} else {
+			PROMPT_CACHE.hits++;
+			entry->refs++;
+			if (entry != PROMPT_CACHE.head) {
+				entry->prev->next = entry->next;
+				if (entry->next) {
+					entry->next->prev = entry->prev;
+				} else {
+					PROMPT_CACHE.tail = entry->prev;
+				}
+				prompt_cache_push_front(entry);
+			}
+		}
+		switch_mutex_unlock(PROMPT_CACHE.mutex);
+		free(key);
+		goto end;
+	}
+
+	PROMPT_CACHE.misses++;
+	switch_zmalloc(loaded, sizeof(*loaded));
+	loaded->key = key;
+	loaded->loading = 1;
+	switch_core_hash_insert(PROMPT_CACHE.hash, loaded->key, loaded);
+
+	/* only short files are decoded on the caller's thread, this one plays the old way while a loader fills the cache */
+	if (fh->samples > (switch_size_t) fh->native_rate * PROMPT_CACHE_INLINE_MS / 1000) {
+		PROMPT_CACHE.bypassed++;
+		if (prompt_cache_launch(loaded, path, rate, fh->channels) != SWITCH_STATUS_SUCCESS) {
+			switch_core_hash_delete(PROMPT_CACHE.hash, loaded->key);
+			prompt_cache_entry_free(loaded);
+		}
+		switch_mutex_unlock(PROMPT_CACHE.mutex);
+		return;
+	}
+	switch_mutex_unlock(PROMPT_CACHE.mutex);
+
+	/* decode outside the lock, the placeholder keeps other openers from doing the same work */
+	if (!(entry = prompt_cache_fill(fh, loaded, rate, 1))) {
+		switch_mutex_lock(PROMPT_CACHE.mutex);
+		PROMPT_CACHE.bypassed++;
+		switch_mutex_unlock(PROMPT_CACHE.mutex);
+	}
+
+	if (!entry) {
+		/* too big or out of room, rewind and let the module carry on */
+		switch_core_file_seek(fh, &pos, 0, SEEK_SET);
+		switch_clear_flag(fh, SWITCH_FILE_SEEK);
+		switch_clear_flag(fh, SWITCH_FILE_DONE);
+		switch_resample_destroy(&fh->resampler);
+		fh->samples_in = 0;
+		fh->offset_pos = 0;
+	}
+
+  end:
+
+	if (entry) {
+		/* the module stays open for metadata, reads and seeks come from the shared copy */
+		fh->prompt_cache = entry;
+		fh->pos = 0;
+		fh->samples_in = 0;
+		fh->offset_pos = 0;
+		switch_clear_flag(fh, SWITCH_FILE_DONE);
+		switch_resample_destroy(&fh->resampler);
+		if (fh->buffer) {
+			switch_buffer_destroy(&fh->buffer);
+		}
+	}
+}
+
+static void prompt_cache_release(switch_file_handle_t *fh)
+{
+	prompt_cache_entry_t *entry = fh->prompt_cache;
+
+	fh->prompt_cache = NULL;
+
+	switch_mutex_lock(PROMPT_CACHE.mutex);
+	PROMPT_CACHE.bytes_served += fh->samples_in * sizeof(int16_t);
+	if (!--entry->refs && entry->evicted) {
+		prompt_cache_entry_free(entry);
+	}
+	switch_mutex_unlock(PROMPT_CACHE.mutex);
+}
+
+static switch_status_t prompt_cache_read(switch_file_handle_t *fh, void *data, switch_size_t *len)
+{
+	prompt_cache_entry_t *entry = fh->prompt_cache;
+	switch_size_t left = fh->pos < (int64_t) entry->samples ? entry->samples - (switch_size_t) fh->pos : 0;
+
+	if (*len > left) {
+		*len = left;
+	}
+
+	if (!*len) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memcpy(data, entry->data + fh->pos, *len * sizeof(int16_t));
+	fh->pos += *len;
+	fh->samples_in += *len;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* positions are in samples of the file's own rate like a module would report them, the copy is at the caller's rate */
+static switch_status_t prompt_cache_seek(switch_file_handle_t *fh, unsigned int *cur_pos, int64_t samples, int whence)
+{
+	prompt_cache_entry_t *entry = fh->prompt_cache;
+	int64_t total = (int64_t) entry->samples * entry->native_rate / entry->rate, pos = samples;
+
+	if (whence == SWITCH_SEEK_CUR) {
+		pos += fh->offset_pos;
+	} else if (whence == SWITCH_SEEK_END) {
+		pos += total;
+	}
+
+	if (pos < 0) {
+		pos = 0;
+	} else if (pos > total) {
+		pos = total;
+	}
+
+	fh->pos = pos * entry->rate / entry->native_rate;
+	*cur_pos = (unsigned int) pos;
+	fh->offset_pos = *cur_pos;
+	switch_set_flag(fh, SWITCH_FILE_SEEK);
+	switch_clear_flag(fh, SWITCH_FILE_DONE);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_core_file_cache_init(switch_memory_pool_t *pool)
+{
+	switch_mutex_init(&PROMPT_CACHE.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_core_hash_init(&PROMPT_CACHE.hash, pool);
+	PROMPT_CACHE.ready = 1;
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_flush(void)
+{
+	prompt_cache_entry_t *entry, *next;
+
+	if (!PROMPT_CACHE.ready) {
+		return;
+	}
+
+	switch_mutex_lock(PROMPT_CACHE.mutex);
+	for (entry = PROMPT_CACHE.head; entry; entry = next) {
+		next = entry->next;
+		prompt_cache_unlink(entry);
+	}
+	switch_mutex_unlock(PROMPT_CACHE.mutex);
+}
+
+void switch_core_file_cache_shutdown(void)
+{
+	int loaders;
+
+	if (!PROMPT_CACHE.ready) {
+		return;
+	}
+
+	/* let loaders that are still decoding finish and flush what they published before tearing down */
+	do {
+		switch_core_file_cache_flush();
+		switch_mutex_lock(PROMPT_CACHE.mutex);
+		if (!(loaders = PROMPT_CACHE.loaders)) {
+			PROMPT_CACHE.ready = 0;
+		}
+		switch_mutex_unlock(PROMPT_CACHE.mutex);
+		if (loaders) {
+			switch_yield(10000);
+		}
+	} while (loaders);
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_set_limits(switch_size_t max_bytes, switch_size_t max_file_bytes)
+{
+	if (max_file_bytes) {
+		PROMPT_CACHE.max_file_bytes = max_file_bytes;
+	}
+
+	PROMPT_CACHE.max_bytes = max_bytes;
+
+	if (PROMPT_CACHE.ready) {
+		switch_mutex_lock(PROMPT_CACHE.mutex);
+		prompt_cache_make_room(0);
+		switch_mutex_unlock(PROMPT_CACHE.mutex);
+	}
+}
+
+SWITCH_DECLARE(void) switch_core_file_cache_stats(switch_stream_handle_t *stream, switch_bool_t reset)
+{
+	uint64_t hits, misses, bypassed, evictions, served;
+	switch_size_t bytes, max_bytes, max_file_bytes;
+	uint32_t count;
+
+	if (!PROMPT_CACHE.ready) {
+		stream->write_function(stream, "-ERR prompt cache not running\n");
+		return;
+	}
+
+	switch_mutex_lock(PROMPT_CACHE.mutex);
+	count = PROMPT_CACHE.count;
+	bytes = PROMPT_CACHE.bytes;
+	max_bytes = PROMPT_CACHE.max_bytes;
+	max_file_bytes = PROMPT_CACHE.max_file_bytes;
+	hits = PROMPT_CACHE.hits;
+	misses = PROMPT_CACHE.misses;
+	bypassed = PROMPT_CACHE.bypassed;
+	evictions = PROMPT_CACHE.evictions;
+	served = PROMPT_CACHE.bytes_served;
+	if (reset) {
+		PROMPT_CACHE.hits = PROMPT_CACHE.misses = PROMPT_CACHE.bypassed = PROMPT_CACHE.evictions = PROMPT_CACHE.bytes_served = 0;
+	}
+	switch_mutex_unlock(PROMPT_CACHE.mutex);
+
+	stream->write_function(stream, "files,bytes,max_bytes,max_file_bytes,hits,misses,hit_rate,bypassed,evictions,bytes_served\n");
+	stream->write_function(stream, "%u,%" SWITCH_SIZE_T_FMT ",%" SWITCH_SIZE_T_FMT ",%" SWITCH_SIZE_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT
+						   ",%.1f%%,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT "\n",
+						   count, bytes, max_bytes, max_file_bytes, hits, misses, hits + misses ? hits * 100.0 / (hits + misses) : 0.0,
+						   bypassed, evictions, served);
+}
+
+
+#define FILE_WRITER_DEFAULT_THREADS 2
+#define FILE_WRITER_MAX_THREADS 64
+#define FILE_WRITER_QUEUE_LEN 65536
+#define FILE_WRITER_BATCH_MS 100
+#define FILE_WRITER_DEFAULT_BUFFER_MS 5000
+#define FILE_WRITER_MAX_RING (16 * 1024 * 1024)
+
+/* audio waiting to be written to one async handle, a single producer/single consumer byte ring */
+struct switch_file_writer {
+	switch_file_handle_t *fh;
+	char *owner;
+	uint8_t *ring;
+	uint32_t size;
+	uint32_t mask;
+	uint32_t chunk;
+	uint32_t batch;
+	uint32_t bytes_per_ms;
+	uint32_t max_block_ms;
+	volatile switch_atomic_t head;
+	volatile switch_atomic_t tail;
+	volatile switch_atomic_t scheduled;
+	volatile switch_atomic_t busy;
+	volatile switch_atomic_t closing;
+	volatile switch_atomic_t error;
+	uint32_t max_inuse;
+	switch_size_t dropped;
+	switch_size_t drop_events;
+	switch_size_t pressure;
+	switch_size_t writes;
+	switch_size_t bytes_written;
+	switch_time_t last_write_usec;
+	switch_time_t max_write_usec;
+	switch_time_t started;
+	struct switch_file_writer *next;
+};
+
+typedef struct switch_file_writer file_writer_t;
+
+static struct {
+	int ready;
+	int running;
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+	switch_queue_t *queue;
+	switch_thread_t *threads[FILE_WRITER_MAX_THREADS];
+	uint32_t thread_count;
+	uint32_t max_threads;
+	file_writer_t *list;
+	uint32_t count;
+	uint64_t opened;
+	uint64_t dropped;
+	uint64_t drop_events;
+	uint64_t writes;
+	uint64_t write_errors;
+	uint64_t pressure;
+	switch_time_t max_write_usec;
+} FILE_WRITERS = { 0, 0, NULL, NULL, NULL, { 0 }, 0, FILE_WRITER_DEFAULT_THREADS };
+
+static switch_status_t file_write_now(switch_file_handle_t *fh, void *data, switch_size_t *len);
+
+static void file_writer_schedule(file_writer_t *w)
+{
+	if (switch_atomic_cas(&w->scheduled, 1, 0) != 0) {
+		return;
+	}
+
+	if (switch_queue_trypush(FILE_WRITERS.queue, w) != SWITCH_STATUS_SUCCESS) {
+		/* the next frame will try again */
+		switch_atomic_set(&w->scheduled, 0);
+	}
+}
+
+/* write everything queued so far, runs on one writer thread at a time per handle */
+static void file_writer_drain(file_writer_t *w, uint8_t *scratch)
+{
+	uint32_t head, tail, n, off, first;
+	switch_size_t len;
+	switch_time_t start, took;
+	int frame = 2 * w->fh->channels;
+
+	tail = switch_atomic_read(&w->tail);
+
+	/* acquire pairs with the release in file_writer_push so the bytes below head are there to copy */
+	while ((head = switch_atomic_read_acquire(&w->head)) != tail) {
+		n = head - tail;
+		if (n > w->chunk) {
+			n = w->chunk;
+		}
+
+		off = tail & w->mask;
+		first = w->size - off < n ? w->size - off : n;
+		memcpy(scratch, w->ring + off, first);
+		if (first < n) {
+			memcpy(scratch + first, w->ring, n - first);
+		}
+
+		len = n / frame;
+		start = switch_time_now();
+
+		if (!switch_atomic_read(&w->error) && file_write_now(w->fh, scratch, &len) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error writing %s\n", w->fh->file_path);
+			switch_atomic_set(&w->error, 1);
+		}
+
+		took = switch_time_now() - start;
+		w->last_write_usec = took;
+		if (took > w->max_write_usec) {
+			w->max_write_usec = took;
+		}
+		w->writes++;
+		w->bytes_written += n;
+
+		tail += n;
+		switch_atomic_set_release(&w->tail, tail);
+	}
+}
+
+static void *SWITCH_THREAD_FUNC file_writer_thread(switch_thread_t *thread, void *obj)
+{
+	uint8_t *scratch;
+	void *pop;
+
+	switch_zmalloc(scratch, SWITCH_RECOMMENDED_BUFFER_SIZE * 4);
+
+	while (FILE_WRITERS.running) {
+		file_writer_t *w;
+		uint32_t inuse;
+
+		if (switch_queue_pop_timeout(FILE_WRITERS.queue, &pop, 1000000) != SWITCH_STATUS_SUCCESS || !pop) {
+			continue;
+		}
+
+		w = (file_writer_t *) pop;
+		switch_atomic_set(&w->busy, 1);
+		file_writer_drain(w, scratch);
+		switch_atomic_set(&w->scheduled, 0);
+
+		/* frames that landed while we were clearing the flag */
+		inuse = switch_atomic_read(&w->head) - switch_atomic_read(&w->tail);
+		if (inuse >= w->batch || (inuse && switch_atomic_read(&w->closing))) {
+			file_writer_schedule(w);
+		}
+
+		switch_atomic_set(&w->busy, 0);
+	}
+
+	free(scratch);
+
+	return NULL;
+}
+
+static switch_status_t file_writer_start_threads(void)
+{
+	switch_threadattr_t *thd_attr;
+
+	while (FILE_WRITERS.thread_count < FILE_WRITERS.max_threads) {
+		switch_threadattr_create(&thd_attr, FILE_WRITERS.pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		if (switch_thread_create(&FILE_WRITERS.threads[FILE_WRITERS.thread_count], thd_attr, file_writer_thread, NULL, FILE_WRITERS.pool) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+		FILE_WRITERS.thread_count++;
+	}
+
+	return FILE_WRITERS.thread_count ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
+}
+
+/* queue audio for the writer threads without ever touching the file on the caller's thread */
+static switch_status_t file_writer_push(file_writer_t *w, void *data, switch_size_t len)
+{
+	uint32_t bytes = (uint32_t) len * 2 * w->fh->channels, inuse, off, first, waited = 0;
+	uint32_t head = switch_atomic_read(&w->head);
+
+	if (switch_atomic_read(&w->error)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!bytes) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!w->chunk) {
+		w->chunk = bytes > SWITCH_RECOMMENDED_BUFFER_SIZE * 4 ? SWITCH_RECOMMENDED_BUFFER_SIZE * 4 : bytes;
+		w->chunk -= w->chunk % (2 * w->fh->channels);
+	}
+
+	while ((inuse = head - switch_atomic_read_acquire(&w->tail)) + bytes > w->size) {
+		file_writer_schedule(w);
+		if (waited++ >= w->max_block_ms || !FILE_WRITERS.running) {
+			w->dropped += len;
+			w->drop_events++;
+			if (w->drop_events == 1) {
+				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s is %ums behind, dropping audio\n",
+								  w->fh->file_path, inuse / w->bytes_per_ms);
+			}
+			return SWITCH_STATUS_SUCCESS;
+		}
+		switch_yield(1000);
+	}
+
+	off = head & w->mask;
+	first = w->size - off < bytes ? w->size - off : bytes;
+	memcpy(w->ring + off, data, first);
+	if (first < bytes) {
+		memcpy(w->ring, (uint8_t *) data + first, bytes - first);
+	}
+	switch_atomic_set_release(&w->head, head + bytes);
+
+	/* counted here on the media thread, the writer threads never touch samples_out */
+	w->fh->samples_out += len;
+
+	inuse += bytes;
+	if (inuse > w->max_inuse) {
+		w->max_inuse = inuse;
+	}
+
+	if (inuse >= w->batch) {
+		if (inuse >= w->size / 2) {
+			w->pressure++;
+		}
+		file_writer_schedule(w);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* wait for the writer threads to finish with a handle, writes what is left here if they are gone */
+static void file_writer_flush(file_writer_t *w)
+{
+	switch_atomic_set(&w->closing, 1);
+
+	for (;;) {
+		if (!switch_atomic_read(&w->busy)) {
+			uint32_t threads;
+
+			/* shutdown only zeroes the count once every writer thread is joined */
+			switch_mutex_lock(FILE_WRITERS.mutex);
+			threads = FILE_WRITERS.thread_count;
+			switch_mutex_unlock(FILE_WRITERS.mutex);
+
+			if (!threads) {
+				uint8_t scratch[SWITCH_RECOMMENDED_BUFFER_SIZE * 4];
+				file_writer_drain(w, scratch);
+				break;
+			}
+			if (!switch_atomic_read(&w->scheduled)) {
+				if (switch_atomic_read(&w->head) == switch_atomic_read(&w->tail)) {
+					break;
+				}
+				file_writer_schedule(w);
+			}
+		}
+		switch_yield(1000);
+	}
+
+	switch_atomic_set(&w->closing, 0);
+}
+
+static void file_writer_release(switch_file_handle_t *fh)
+{
+	file_writer_t *w = fh->async_writer, **wp;
+
+	file_writer_flush(w);
+
+	switch_mutex_lock(FILE_WRITERS.mutex);
+	for (wp = &FILE_WRITERS.list; *wp; wp = &(*wp)->next) {
+		if (*wp == w) {
+			*wp = w->next;
+			break;
+		}
+	}
+	FILE_WRITERS.count--;
+	FILE_WRITERS.dropped += w->dropped;
+	FILE_WRITERS.drop_events += w->drop_events;
+	FILE_WRITERS.pressure += w->pressure;
+	FILE_WRITERS.writes += w->writes;
+	FILE_WRITERS.write_errors += switch_atomic_read(&w->error);
+	if (w->max_write_usec > FILE_WRITERS.max_write_usec) {
+		FILE_WRITERS.max_write_usec = w->max_write_usec;
+	}
+	switch_mutex_unlock(FILE_WRITERS.mutex);
+
+	if (w->drop_events) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%s lost %" SWITCH_SIZE_T_FMT " samples in %" SWITCH_SIZE_T_FMT " drops, max lag %ums\n",
+						  fh->file_path, w->dropped, w->drop_events, w->max_inuse / w->bytes_per_ms);
+	}
+
+	fh->async_writer = NULL;
+	free(w->ring);
+	free(w->owner);
+	free(w);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_file_set_async(switch_file_handle_t *fh, const char *owner, uint32_t buffer_ms, uint32_t max_block_ms)
+{
+	file_writer_t *w;
+	uint32_t size = 4096, want;
+
+	switch_assert(fh != NULL);
+
+	if (!FILE_WRITERS.ready || !FILE_WRITERS.max_threads || fh->async_writer || !switch_test_flag(fh, SWITCH_FILE_OPEN) ||
+		!switch_test_flag(fh, SWITCH_FILE_FLAG_WRITE) || switch_test_flag(fh, SWITCH_FILE_NATIVE) || !fh->samplerate || !fh->channels) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	/* the pool only grows when recordings actually ask for it */
+	switch_mutex_lock(FILE_WRITERS.mutex);
+	if (!FILE_WRITERS.ready) {
+		switch_mutex_unlock(FILE_WRITERS.mutex);
+		return SWITCH_STATUS_FALSE;
+	}
+	FILE_WRITERS.running = 1;
+	if (file_writer_start_threads() != SWITCH_STATUS_SUCCESS) {
+		switch_mutex_unlock(FILE_WRITERS.mutex);
+		return SWITCH_STATUS_FALSE;
+	}
+	switch_mutex_unlock(FILE_WRITERS.mutex);
+
+	switch_zmalloc(w, sizeof(*w));
+	w->fh = fh;
+	w->owner = strdup(switch_str_nil(owner));
+	w->bytes_per_ms = fh->samplerate * fh->channels * 2 / 1000;
+	if (!w->bytes_per_ms) {
+		w->bytes_per_ms = 1;
+	}
+	w->max_block_ms = max_block_ms;
+
+	want = (buffer_ms ? buffer_ms : FILE_WRITER_DEFAULT_BUFFER_MS) * w->bytes_per_ms;
+	while (size < want && size < FILE_WRITER_MAX_RING) {
+		size <<= 1;
+	}
+	w->size = size;
+	w->mask = size - 1;
+	w->batch = FILE_WRITER_BATCH_MS * w->bytes_per_ms;
+	if (w->batch > size / 4) {
+		w->batch = size / 4;
+	}
+	switch_zmalloc(w->ring, size);
+	w->started = switch_micro_time_now();
+
+	switch_mutex_lock(FILE_WRITERS.mutex);
+	w->next = FILE_WRITERS.list;
+	FILE_WRITERS.list = w;
+	FILE_WRITERS.count++;
+	FILE_WRITERS.opened++;
+	switch_mutex_unlock(FILE_WRITERS.mutex);
+
+	fh->async_writer = w;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_core_file_get_async_stats(switch_file_handle_t *fh, switch_file_async_stats_t *stats)
+{
+	file_writer_t *w;
+
+	switch_assert(fh != NULL);
+
+	if (!(w = fh->async_writer)) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	stats->lag_ms = (switch_atomic_read(&w->head) - switch_atomic_read(&w->tail)) / w->bytes_per_ms;
+	stats->max_lag_ms = w->max_inuse / w->bytes_per_ms;
+	stats->buffer_ms = w->size / w->bytes_per_ms;
+	stats->dropped_samples = w->dropped;
+	stats->drop_events = w->drop_events;
+	stats->writes = w->writes;
+	stats->last_write_usec = w->last_write_usec;
+	stats->max_write_usec = w->max_write_usec;
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+void switch_core_file_writer_init(switch_memory_pool_t *pool)
+{
+	FILE_WRITERS.pool = pool;
+	switch_mutex_init(&FILE_WRITERS.mutex, SWITCH_MUTEX_NESTED, pool);
+	switch_queue_create(&FILE_WRITERS.queue, FILE_WRITER_QUEUE_LEN, pool);
+	FILE_WRITERS.ready = 1;
+}
+
+void switch_core_file_writer_shutdown(void)
+{
+	switch_status_t st;
+	uint32_t i;
+
+	if (!FILE_WRITERS.ready) {
+		return;
+	}
+
+	switch_mutex_lock(FILE_WRITERS.mutex);
+	FILE_WRITERS.ready = 0;
+	FILE_WRITERS.running = 0;
+	switch_mutex_unlock(FILE_WRITERS.mutex);
+
+	switch_queue_interrupt_all(FILE_WRITERS.queue);
+
+	for (i = 0; i < FILE_WRITERS.thread_count; i++) {
+		switch_thread_join(&st, FILE_WRITERS.threads[i]);
+	}
+
+	switch_mutex_lock(FILE_WRITERS.mutex);
+	FILE_WRITERS.thread_count = 0;
+	switch_mutex_unlock(FILE_WRITERS.mutex);
+}
+
+SWITCH_DECLARE(void) switch_core_file_writer_set_threads(uint32_t threads)
+{
+	if (threads > FILE_WRITER_MAX_THREADS) {
+		threads = FILE_WRITER_MAX_THREADS;
+	}
+
+	/* running threads stay until shutdown, a smaller number only stops new ones from starting */
+	FILE_WRITERS.max_threads = threads;
+}
+
+SWITCH_DECLARE(void) switch_core_file_writer_stats(switch_stream_handle_t *stream)
+{
+	file_writer_t *w;
+	switch_time_t now = switch_micro_time_now(), max_write_usec;
+	uint64_t writes, write_errors, dropped, drop_events, pressure;
+
+	if (!FILE_WRITERS.ready) {
+		stream->write_function(stream, "-ERR async file writers not running\n");
+		return;
+	}
+
+	switch_mutex_lock(FILE_WRITERS.mutex);
+	writes = FILE_WRITERS.writes;
+	write_errors = FILE_WRITERS.write_errors;
+	dropped = FILE_WRITERS.dropped;
+	drop_events = FILE_WRITERS.drop_events;
+	pressure = FILE_WRITERS.pressure;
+	max_write_usec = FILE_WRITERS.max_write_usec;
+
+	for (w = FILE_WRITERS.list; w; w = w->next) {
+		writes += w->writes;
+		write_errors += switch_atomic_read(&w->error);
+		dropped += w->dropped;
+		drop_events += w->drop_events;
+		pressure += w->pressure;
+		if (w->max_write_usec > max_write_usec) {
+			max_write_usec = w->max_write_usec;
+		}
+	}
+
+	stream->write_function(stream, "threads,max_threads,handles,opened,writes,write_errors,dropped_samples,drop_events,pressure,max_write_usec\n");
+	stream->write_function(stream, "%u,%u,%u,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT
+						   ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_TIME_T_FMT "\n",
+						   FILE_WRITERS.thread_count, FILE_WRITERS.max_threads, FILE_WRITERS.count, FILE_WRITERS.opened, writes,
+						   write_errors, dropped, drop_events, pressure, max_write_usec);
+
+	if (FILE_WRITERS.list) {
+		stream->write_function(stream, "\nowner,file,seconds,lag_ms,max_lag_ms,buffer_ms,dropped_samples,drop_events,pressure,writes,last_write_usec,max_write_usec\n");
+	}
+
+	for (w = FILE_WRITERS.list; w; w = w->next) {
+		stream->write_function(stream, "%s,%s,%u,%u,%u,%u,%" SWITCH_SIZE_T_FMT ",%" SWITCH_SIZE_T_FMT ",%" SWITCH_SIZE_T_FMT ",%" SWITCH_SIZE_T_FMT
+							   ",%" SWITCH_TIME_T_FMT ",%" SWITCH_TIME_T_FMT "\n",
+							   w->owner, switch_str_nil(w->fh->file_path), (uint32_t) ((now - w->started) / 1000000),
+							   (switch_atomic_read(&w->head) - switch_atomic_read(&w->tail)) / w->bytes_per_ms, w->max_inuse / w->bytes_per_ms,
+							   w->size / w->bytes_per_ms, w->dropped, w->drop_events, w->pressure, w->writes, w->last_write_usec, w->max_write_usec);
+	}
+
+	switch_mutex_unlock(FILE_WRITERS.mutex);
+}
 
 SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file, const char *func, int line,
 															  switch_file_handle_t *fh,
@@ -183,7 +1199,14 @@ SWITCH_DECLARE(switch_status_t) switch_core_perform_file_open(const char *file,
 		}
 	}
 
-	if (fh->pre_buffer_datalen) {
+	if (PROMPT_CACHE.max_bytes && PROMPT_CACHE.ready && (flags & SWITCH_FILE_FLAG_READ) && !(flags & SWITCH_FILE_FLAG_WRITE) && !is_stream &&
+		!switch_test_flag(fh, SWITCH_FILE_NATIVE) && rate && fh->seekable && fh->samples) {
+		switch_set_flag(fh, SWITCH_FILE_OPEN);
+		prompt_cache_attach(fh, file_path, rate);
+		switch_clear_flag(fh, SWITCH_FILE_OPEN);
+	}
+
+	if (fh->pre_buffer_datalen && !fh->prompt_cache) {
 		//switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Prebuffering %d bytes\n", (int)fh->pre_buffer_datalen);
 		switch_buffer_create_dynamic(&fh->pre_buffer, fh->pre_buffer_datalen * fh->channels, fh->pre_buffer_datalen * fh->channels / 2, 0);
 		fh->pre_buffer_data = switch_core_alloc(fh->memory_pool, fh->pre_buffer_datalen * fh->channels);
@@ -217,6 +1240,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->prompt_cache) {
+		return prompt_cache_read(fh, data, len);
+	}
+
   top:
 
 	if (fh->buffer && switch_buffer_inuse(fh->buffer) >= *len * 2) {
@@ -327,8 +1354,6 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_read(switch_file_handle_t *fh,
 
 SWITCH_DECLARE(switch_status_t) switch_core_file_write(switch_file_handle_t *fh, void *data, switch_size_t *len)
 {
-	switch_size_t orig_len = *len;
-
 	switch_assert(fh != NULL);
 	switch_assert(fh->file_interface != NULL);
 
@@ -340,6 +1365,17 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_write(switch_file_handle_t *fh,
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->async_writer) {
+		return file_writer_push(fh->async_writer, data, *len);
+	}
+
+	return file_write_now(fh, data, len);
+}
+
+static switch_status_t file_write_now(switch_file_handle_t *fh, void *data, switch_size_t *len)
+{
+	switch_size_t orig_len = *len;
+
 	if (!switch_test_flag(fh, SWITCH_FILE_NATIVE) && fh->native_rate != fh->samplerate) {
 		if (!fh->resampler) {
 			if (switch_resample_create(&fh->resampler,
@@ -395,11 +1431,13 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_write(switch_file_handle_t *fh,
 				}
 			}
 		}
-		fh->samples_out += orig_len;
+		if (!fh->async_writer) {
+			fh->samples_out += orig_len;
+		}
 		return status;
 	} else {
 		switch_status_t status;
-		if ((status = fh->file_interface->file_write(fh, data, len)) == SWITCH_STATUS_SUCCESS) {
+		if ((status = fh->file_interface->file_write(fh, data, len)) == SWITCH_STATUS_SUCCESS && !fh->async_writer) {
 			fh->samples_out += orig_len;
 		}
 		return status;
@@ -426,6 +1464,14 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_seek(switch_file_handle_t *fh,
 	if (!ok) {
 		return SWITCH_STATUS_FALSE;
 	}
+
+	if (fh->prompt_cache) {
+		return prompt_cache_seek(fh, cur_pos, samples, whence);
+	}
+
+	if (fh->async_writer) {
+		file_writer_flush(fh->async_writer);
+	}
 	
 	if (fh->buffer) {
 		switch_buffer_zero(fh->buffer);
@@ -504,6 +1550,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_truncate(switch_file_handle_t *
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->async_writer) {
+		file_writer_flush(fh->async_writer);
+	}
+
 	if ((status = fh->file_interface->file_truncate(fh, offset)) == SWITCH_STATUS_SUCCESS) {
 		if (fh->buffer) {
 			switch_buffer_zero(fh->buffer);
@@ -530,6 +1580,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(switch_file_handle_t *fh)
 		return SWITCH_STATUS_FALSE;
 	}
 
+	if (fh->async_writer) {
+		file_writer_release(fh);
+	}
+
 	if (fh->buffer) {
 		switch_buffer_destroy(&fh->buffer);
 	}
@@ -556,6 +1610,10 @@ SWITCH_DECLARE(switch_status_t) switch_core_file_close(switch_file_handle_t *fh)
 		switch_buffer_destroy(&fh->pre_buffer);
 	}
 
+	if (fh->prompt_cache) {
+		prompt_cache_release(fh);
+	}
+
 	switch_clear_flag(fh, SWITCH_FILE_OPEN);
 	status = fh->file_interface->file_close(fh);
 
@@ -35,13 +35,276 @@
 #include <switch.h>
 #include "private/switch_core_pvt.h"
 #include <sqlite3.h>
+/* the old chained table, still linked in through libsqlite, is kept only as the baseline for switch_core_hash_bench() */
+#define HashElem sqlite_hash_elem
 #include "../../../libs/sqlite/src/hash.h"
+#undef HashElem
+
+/*
+ * Open addressing with robin hood probing over a slot array of (hash, entry) pairs.
+ * The entries themselves live in chunks that never move once allocated, chunk n holding
+ * HASH_CHUNK0 << n of them, so a switch_hash_index_t stays valid while the table grows and
+ * while the element it points to is deleted.  Dead entries are reused through a free list.
+ */
+
+#define HASH_CHUNK0 8
+#define HASH_CHUNKS 28
+#define HASH_SLOTS0 16
+#define HASH_INLINE_KEY 40
+
+struct HashElem {
+	switch_hash_t *hash;
+	char *key;
+	void *val;
+	uint32_t hashval;
+	uint32_t index;
+	char inline_key[HASH_INLINE_KEY];
+};
+
+typedef struct {
+	uint32_t hashval;
+	/* entry index + 1, 0 is an empty slot */
+	uint32_t entry;
+} hash_slot_t;
 
 struct switch_hash {
-	Hash table;
 	switch_memory_pool_t *pool;
+	switch_bool_t case_sensitive;
+	hash_slot_t *slots;
+	uint32_t mask;
+	uint32_t count;
+	uint32_t used;
+	uint32_t free_head;
+	struct HashElem *chunks[HASH_CHUNKS];
+	hash_slot_t slots0[HASH_SLOTS0];
+	struct HashElem chunk0[HASH_CHUNK0];
 };
 
+static inline uint32_t hash_chunk_of(uint32_t index)
+{
+	uint32_t n = index / HASH_CHUNK0 + 1;
+#ifdef __GNUC__
+	return 31 - __builtin_clz(n);
+#else
+	uint32_t k = 0;
+
+	while (n >>= 1) {
+		k++;
+	}
+
+	return k;
+#endif
+}
+
+static inline struct HashElem *hash_entry(switch_hash_t *hash, uint32_t index)
+{
+	uint32_t k = hash_chunk_of(index);
+
+	return &hash->chunks[k][index - HASH_CHUNK0 * ((1 << k) - 1)];
+}
+
+/* ASCII A-Z to a-z in all 8 bytes at once, the same folding sqlite3StrNICmp did */
+static inline uint64_t hash_fold(uint64_t w)
+{
+	const uint64_t ones = 0x0101010101010101ULL, highs = ones * 0x80;
+	uint64_t a = w & ~highs, ge_a = a + ones * (0x80 - 'A'), gt_z = a + ones * (0x80 - 'Z' - 1);
+
+	return w | ((ge_a & ~gt_z & ~w & highs) >> 2);
+}
+
+static inline uint32_t hash_key(const char *key, size_t len, switch_bool_t case_sensitive)
+{
+	uint64_t h = 0x9E3779B97F4A7C15ULL ^ len, w;
+
+	for (; len >= 8; key += 8, len -= 8) {
+		memcpy(&w, key, 8);
+		if (!case_sensitive) {
+			w = hash_fold(w);
+		}
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+
+	if (len) {
+		w = 0;
+		memcpy(&w, key, len);
+		if (!case_sensitive) {
+			w = hash_fold(w);
+		}
+		h = (h ^ w) * 0xff51afd7ed558ccdULL;
+	}
+
+	h ^= h >> 29;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 32;
+
+	return (uint32_t) h;
+}
+
+static inline int hash_key_eq(switch_hash_t *hash, struct HashElem *e, const char *key)
+{
+	return hash->case_sensitive ? !strcmp(e->key, key) : !strcasecmp(e->key, key);
+}
+
+/* the slot holding key, or -1 */
+static int64_t hash_lookup(switch_hash_t *hash, const char *key, uint32_t hashval)
+{
+	uint32_t pos = hashval & hash->mask, dist = 0;
+	hash_slot_t *slot;
+
+	for (;; pos = (pos + 1) & hash->mask, dist++) {
+		slot = &hash->slots[pos];
+
+		if (!slot->entry || ((pos - slot->hashval) & hash->mask) < dist) {
+			return -1;
+		}
+
+		if (slot->hashval == hashval && hash_key_eq(hash, hash_entry(hash, slot->entry - 1), key)) {
+			return pos;
+		}
+	}
+}
+
+static void hash_place(hash_slot_t *slots, uint32_t mask, hash_slot_t in)
+{
+	uint32_t pos = in.hashval & mask, dist = 0, their;
+	hash_slot_t tmp;
+
+	for (;; pos = (pos + 1) & mask, dist++) {
+		if (!slots[pos].entry) {
+			slots[pos] = in;
+			return;
+		}
+
+		/* take the place of anyone closer to home than we are */
+		if ((their = (pos - slots[pos].hashval) & mask) < dist) {
+			tmp = slots[pos];
+			slots[pos] = in;
+			in = tmp;
+			dist = their;
+		}
+	}
+}
+
+static void hash_grow(switch_hash_t *hash)
+{
+	uint32_t size = (hash->mask + 1) * 2, x;
+	hash_slot_t *slots;
+
+	switch_zmalloc(slots, size * sizeof(*slots));
+
+	for (x = 0; x <= hash->mask; x++) {
+		if (hash->slots[x].entry) {
+			hash_place(slots, size - 1, hash->slots[x]);
+		}
+	}
+
+	if (hash->slots != hash->slots0) {
+		free(hash->slots);
+	}
+
+	hash->slots = slots;
+	hash->mask = size - 1;
+}
+
+static struct HashElem *hash_new_entry(switch_hash_t *hash)
+{
+	struct HashElem *e;
+	uint32_t k;
+
+	if (hash->free_head) {
+		e = hash_entry(hash, hash->free_head - 1);
+		hash->free_head = (uint32_t) (intptr_t) e->val;
+		return e;
+	}
+
+	k = hash_chunk_of(hash->used);
+
+	if (!hash->chunks[k]) {
+		switch_zmalloc(hash->chunks[k], (HASH_CHUNK0 << k) * sizeof(struct HashElem));
+	}
+
+	e = hash_entry(hash, hash->used);
+	e->hash = hash;
+	e->index = hash->used++;
+
+	return e;
+}
+
+static void hash_set(switch_hash_t *hash, const char *key, const void *data)
+{
+	size_t len = strlen(key);
+	uint32_t hashval = hash_key(key, len, hash->case_sensitive);
+	int64_t pos = hash_lookup(hash, key, hashval);
+	struct HashElem *e;
+	hash_slot_t slot;
+
+	if (pos >= 0) {
+		e = hash_entry(hash, hash->slots[pos].entry - 1);
+
+		if (data) {
+			e->val = (void *) data;
+			return;
+		}
+
+		/* backward shift so lookups never need tombstones */
+		for (;;) {
+			uint32_t next = ((uint32_t) pos + 1) & hash->mask;
+
+			if (!hash->slots[next].entry || !((next - hash->slots[next].hashval) & hash->mask)) {
+				break;
+			}
+
+			hash->slots[pos] = hash->slots[next];
+			pos = next;
+		}
+		hash->slots[pos].entry = 0;
+
+		if (e->key != e->inline_key) {
+			free(e->key);
+		}
+		e->key = NULL;
+		e->val = (void *) (intptr_t) hash->free_head;
+		hash->free_head = e->index + 1;
+		hash->count--;
+
+		return;
+	}
+
+	if (!data) {
+		return;
+	}
+
+	if ((hash->count + 1) * 5 > (hash->mask + 1) * 4) {
+		hash_grow(hash);
+	}
+
+	e = hash_new_entry(hash);
+
+	if (len < HASH_INLINE_KEY) {
+		e->key = e->inline_key;
+	} else {
+		e->key = malloc(len + 1);
+		switch_assert(e->key);
+	}
+	memcpy(e->key, key, len + 1);
+
+	e->val = (void *) data;
+	e->hashval = hashval;
+
+	slot.hashval = hashval;
+	slot.entry = e->index + 1;
+	hash_place(hash->slots, hash->mask, slot);
+	hash->count++;
+}
+
+static void *hash_get(switch_hash_t *hash, const char *key)
+{
+	int64_t pos = hash_lookup(hash, key, hash_key(key, strlen(key), hash->case_sensitive));
+
+	return pos < 0 ? NULL : hash_entry(hash, hash->slots[pos].entry - 1)->val;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_hash_init_case(switch_hash_t **hash, switch_memory_pool_t *pool, switch_bool_t case_sensitive)
 {
 	switch_hash_t *newhash;
@@ -55,7 +318,11 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_init_case(switch_hash_t **hash,
 
 	switch_assert(newhash);
 
-	sqlite3HashInit(&newhash->table, case_sensitive ? SQLITE_HASH_BINARY : SQLITE_HASH_STRING, 1);
+	/* the first few entries and slots come with the header, from the pool when there is one */
+	newhash->case_sensitive = case_sensitive;
+	newhash->slots = newhash->slots0;
+	newhash->mask = HASH_SLOTS0 - 1;
+	newhash->chunks[0] = newhash->chunk0;
 	*hash = newhash;
 
 	return SWITCH_STATUS_SUCCESS;
@@ -63,11 +330,30 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_init_case(switch_hash_t **hash,
 
 SWITCH_DECLARE(switch_status_t) switch_core_hash_destroy(switch_hash_t **hash)
 {
+	switch_hash_t *h;
+	uint32_t x;
+
 	switch_assert(hash != NULL && *hash != NULL);
-	sqlite3HashClear(&(*hash)->table);
+	h = *hash;
+
+	for (x = 0; x < h->used; x++) {
+		struct HashElem *e = hash_entry(h, x);
+
+		if (e->key && e->key != e->inline_key) {
+			free(e->key);
+		}
+	}
+
+	for (x = 1; x < HASH_CHUNKS; x++) {
+		switch_safe_free(h->chunks[x]);
+	}
+
+	if (h->slots != h->slots0) {
+		free(h->slots);
+	}
 
-	if (!(*hash)->pool) {
-		free(*hash);
+	if (!h->pool) {
+		free(h);
 	}
 
 	*hash = NULL;
@@ -77,7 +363,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_destroy(switch_hash_t **hash)
 
 SWITCH_DECLARE(switch_status_t) switch_core_hash_insert(switch_hash_t *hash, const char *key, const void *data)
 {
-	sqlite3HashInsert(&hash->table, key, (int) strlen(key) + 1, (void *) data);
+	hash_set(hash, key, data);
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -87,7 +373,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_insert_locked(switch_hash_t *ha
 		switch_mutex_lock(mutex);
 	}
 
-	sqlite3HashInsert(&hash->table, key, (int) strlen(key) + 1, (void *) data);
+	hash_set(hash, key, data);
 
 	if (mutex) {
 		switch_mutex_unlock(mutex);
@@ -102,7 +388,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_insert_wrlock(switch_hash_t *ha
 		switch_thread_rwlock_wrlock(rwlock);
 	}
 
-	sqlite3HashInsert(&hash->table, key, (int) strlen(key) + 1, (void *) data);
+	hash_set(hash, key, data);
 
 	if (rwlock) {
 		switch_thread_rwlock_unlock(rwlock);
@@ -113,7 +399,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_insert_wrlock(switch_hash_t *ha
 
 SWITCH_DECLARE(switch_status_t) switch_core_hash_delete(switch_hash_t *hash, const char *key)
 {
-	sqlite3HashInsert(&hash->table, key, (int) strlen(key) + 1, NULL);
+	hash_set(hash, key, NULL);
 	return SWITCH_STATUS_SUCCESS;
 }
 
@@ -123,7 +409,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_delete_locked(switch_hash_t *ha
 		switch_mutex_lock(mutex);
 	}
 
-	sqlite3HashInsert(&hash->table, key, (int) strlen(key) + 1, NULL);
+	hash_set(hash, key, NULL);
 
 	if (mutex) {
 		switch_mutex_unlock(mutex);
@@ -138,7 +424,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_delete_wrlock(switch_hash_t *ha
 		switch_thread_rwlock_wrlock(rwlock);
 	}
 
-	sqlite3HashInsert(&hash->table, key, (int) strlen(key) + 1, NULL);
+	hash_set(hash, key, NULL);
 
 	if (rwlock) {
 		switch_thread_rwlock_unlock(rwlock);
@@ -185,7 +471,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_hash_delete_multi(switch_hash_t *has
 
 SWITCH_DECLARE(void *) switch_core_hash_find(switch_hash_t *hash, const char *key)
 {
-	return sqlite3HashFind(&hash->table, key, (int) strlen(key) + 1);
+	return hash_get(hash, key);
 }
 
 SWITCH_DECLARE(void *) switch_core_hash_find_locked(switch_hash_t *hash, const char *key, switch_mutex_t *mutex)
@@ -196,7 +482,7 @@ SWITCH_DECLARE(void *) switch_core_hash_find_locked(switch_hash_t *hash, const c
 		switch_mutex_lock(mutex);
 	}
 
-	val = sqlite3HashFind(&hash->table, key, (int) strlen(key) + 1);
+	val = hash_get(hash, key);
 
 	if (mutex) {
 		switch_mutex_unlock(mutex);
@@ -213,7 +499,7 @@ SWITCH_DECLARE(void *) switch_core_hash_find_rdlock(switch_hash_t *hash, const c
 		switch_thread_rwlock_rdlock(rwlock);
 	}
 
-	val = sqlite3HashFind(&hash->table, key, (int) strlen(key) + 1);
+	val = hash_get(hash, key);
 
 	if (rwlock) {
 		switch_thread_rwlock_unlock(rwlock);
@@ -222,27 +508,158 @@ SWITCH_DECLARE(void *) switch_core_hash_find_rdlock(switch_hash_t *hash, const c
 	return val;
 }
 
+static switch_hash_index_t *hash_live_from(switch_hash_t *hash, uint32_t index)
+{
+	struct HashElem *e;
+
+	for (; index < hash->used; index++) {
+		if ((e = hash_entry(hash, index))->key) {
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
 SWITCH_DECLARE(switch_hash_index_t *) switch_hash_first(char *deprecate_me, switch_hash_t *hash)
 {
-	return (switch_hash_index_t *) sqliteHashFirst(&hash->table);
+	return hash_live_from(hash, 0);
 }
 
 SWITCH_DECLARE(switch_hash_index_t *) switch_hash_next(switch_hash_index_t *hi)
 {
-	return (switch_hash_index_t *) sqliteHashNext((HashElem *) hi);
+	return hash_live_from(hi->hash, hi->index + 1);
 }
 
 SWITCH_DECLARE(void) switch_hash_this(switch_hash_index_t *hi, const void **key, switch_ssize_t *klen, void **val)
 {
 	if (key) {
-		*key = sqliteHashKey((HashElem *) hi);
+		*key = hi->key;
 		if (klen) {
 			*klen = strlen((char *) *key) + 1;
 		}
 	}
 	if (val) {
-		*val = sqliteHashData((HashElem *) hi);
+		*val = hi->val;
+	}
+}
+
+static double hash_bench_ns(switch_time_t start, uint32_t ops)
+{
+	return (double) (switch_time_now() - start) * 1000 / ops;
+}
+
+SWITCH_DECLARE(void) switch_core_hash_bench(switch_stream_handle_t *stream, uint32_t keys, switch_bool_t case_sensitive)
+{
+	char **names;
+	uint32_t x, found;
+	switch_time_t start;
+	switch_hash_t *hash;
+	switch_hash_index_t *hi;
+	Hash old;
+	sqlite_hash_elem *elem;
+	void *val;
+
+	switch_zmalloc(names, keys * sizeof(char *));
+
+	/* uuid shaped keys for the session table and some short and long names for everyone else */
+	for (x = 0; x < keys; x++) {
+		switch (x % 3) {
+		case 0:
+			names[x] = switch_mprintf("%08x-%04x-4%03x-a%03x-%012x", x * 2654435761U, x & 0xffff, x & 0xfff, (x >> 12) & 0xfff, x);
+			break;
+		case 1:
+			names[x] = switch_mprintf("Gateway%u", x);
+			break;
+		default:
+			names[x] = switch_mprintf("sofia/internal/sip:user%u@some.longer.domain.example.com", x);
+			break;
+		}
+	}
+
+	stream->write_function(stream, "%-8s %8s %10s %10s %10s %10s %10s\n", "table", "keys", "insert", "find", "miss", "iterate", "delete");
+
+	sqlite3HashInit(&old, case_sensitive ? SQLITE_HASH_BINARY : SQLITE_HASH_STRING, 1);
+
+	stream->write_function(stream, "%-8s %8u", "sqlite", keys);
+
+	start = switch_time_now();
+	for (x = 0; x < keys; x++) {
+		sqlite3HashInsert(&old, names[x], (int) strlen(names[x]) + 1, names[x]);
+	}
+	stream->write_function(stream, " %8.1fns", hash_bench_ns(start, keys));
+
+	start = switch_time_now();
+	for (x = 0, found = 0; x < keys; x++) {
+		found += sqlite3HashFind(&old, names[(x * 7919) % keys], (int) strlen(names[(x * 7919) % keys]) + 1) != NULL;
+	}
+	stream->write_function(stream, " %8.1fns", hash_bench_ns(start, keys));
+
+	start = switch_time_now();
+	for (x = 0; x < keys; x++) {
+		names[x][0] ^= 0x40;
+		found += sqlite3HashFind(&old, names[x], (int) strlen(names[x]) + 1) != NULL;
+		names[x][0] ^= 0x40;
+	}
+	stream->write_function(stream, " %8.1fns", hash_bench_ns(start, keys));
+
+	start = switch_time_now();
+	for (elem = sqliteHashFirst(&old); elem; elem = sqliteHashNext(elem)) {
+		found += sqliteHashData(elem) != NULL;
+	}
+	stream->write_function(stream, " %8.1fns", hash_bench_ns(start, keys));
+
+	start = switch_time_now();
+	for (x = 0; x < keys; x++) {
+		sqlite3HashInsert(&old, names[x], (int) strlen(names[x]) + 1, NULL);
+	}
+	stream->write_function(stream, " %8.1fns %u\n", hash_bench_ns(start, keys), found);
+
+	sqlite3HashClear(&old);
+
+	switch_core_hash_init_case(&hash, NULL, case_sensitive);
+
+	stream->write_function(stream, "%-8s %8u", "core", keys);
+
+	start = switch_time_now();
+	for (x = 0; x < keys; x++) {
+		switch_core_hash_insert(hash, names[x], names[x]);
+	}
+	stream->write_function(stream, " %8.1fns", hash_bench_ns(start, keys));
+
+	start = switch_time_now();
+	for (x = 0, found = 0; x < keys; x++) {
+		found += switch_core_hash_find(hash, names[(x * 7919) % keys]) != NULL;
+	}
+	stream->write_function(stream, " %8.1fns", hash_bench_ns(start, keys));
+
+	start = switch_time_now();
+	for (x = 0; x < keys; x++) {
+		names[x][0] ^= 0x40;
+		found += switch_core_hash_find(hash, names[x]) != NULL;
+		names[x][0] ^= 0x40;
+	}
+	stream->write_function(stream, " %8.1fns", hash_bench_ns(start, keys));
+
+	start = switch_time_now();
+	for (hi = switch_hash_first(NULL, hash); hi; hi = switch_hash_next(hi)) {
+		switch_hash_this(hi, NULL, NULL, &val);
+		found += val != NULL;
+	}
+	stream->write_function(stream, " %8.1fns", hash_bench_ns(start, keys));
+
+	start = switch_time_now();
+	for (x = 0; x < keys; x++) {
+		switch_core_hash_delete(hash, names[x]);
+	}
+	stream->write_function(stream, " %8.1fns %u\n", hash_bench_ns(start, keys), found);
+
+	switch_core_hash_destroy(&hash);
+
+	for (x = 0; x < keys; x++) {
+		free(names[x]);
 	}
+	free(names);
 }
 
 /* For Emacs:
@@ -555,7 +555,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_read_frame(switch_core_sessi
 					switch_size_t bytes = session->read_impl.decoded_bytes_per_packet;
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Engaging Read Buffer at %u bytes vs %u\n",
 									  (uint32_t) bytes, (uint32_t) (*frame)->datalen);
-					switch_buffer_create_dynamic(&session->raw_read_buffer, bytes * SWITCH_BUFFER_BLOCK_FRAMES, bytes * SWITCH_BUFFER_START_FRAMES, 0);
+					switch_buffer_create_ring_dynamic(&session->raw_read_buffer, bytes * SWITCH_BUFFER_START_FRAMES, 0);
 				}
 
 				if (!switch_buffer_write(session->raw_read_buffer, read_frame->data, read_frame->datalen)) {
@@ -1108,9 +1108,8 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_write_frame(switch_core_sess
 				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG,
 								  "Engaging Write Buffer at %u bytes to accommodate %u->%u\n",
 								  (uint32_t) bytes_per_packet, write_frame->datalen, session->write_impl.decoded_bytes_per_packet);
-				if ((status = switch_buffer_create_dynamic(&session->raw_write_buffer,
-														   bytes_per_packet * SWITCH_BUFFER_BLOCK_FRAMES,
-														   bytes_per_packet * SWITCH_BUFFER_START_FRAMES, 0)) != SWITCH_STATUS_SUCCESS) {
+				if ((status = switch_buffer_create_ring_dynamic(&session->raw_write_buffer,
+																bytes_per_packet * SWITCH_BUFFER_START_FRAMES, 0)) != SWITCH_STATUS_SUCCESS) {
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Write Buffer Failed!\n");
 					goto error;
 				}
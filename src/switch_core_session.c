@@ -39,6 +39,83 @@
 
 struct switch_session_manager session_manager;
 
+/* The session table is striped over SWITCH_SESSION_TABLE_SHARDS hashes, each with its own rwlock,
+   so locates only share a lock with sessions that hash to the same stripe and never wait on
+   creation or teardown elsewhere.  runtime.session_hash_mutex now only guards the counters. */
+
+static struct switch_session_shard *session_shard(const char *uuid_str)
+{
+	switch_ssize_t len = -1;
+	unsigned int hash = switch_hashfunc_default(uuid_str, &len);
+
+	return &session_manager.shards[(hash ^ (hash >> 16)) % SWITCH_SESSION_TABLE_SHARDS];
+}
+
+static switch_core_session_t *session_table_find(const char *uuid_str, struct switch_session_shard **shardp)
+{
+	struct switch_session_shard *shard = session_shard(uuid_str);
+
+	*shardp = shard;
+	switch_thread_rwlock_rdlock(shard->rwlock);
+
+	return (switch_core_session_t *) switch_core_hash_find(shard->table, uuid_str);
+}
+
+static void session_table_insert(switch_core_session_t *session)
+{
+	struct switch_session_shard *shard = session_shard(session->uuid_str);
+
+	switch_thread_rwlock_wrlock(shard->rwlock);
+	switch_core_hash_insert(shard->table, session->uuid_str, session);
+	switch_thread_rwlock_unlock(shard->rwlock);
+}
+
+static void session_table_delete(switch_core_session_t *session)
+{
+	struct switch_session_shard *shard = session_shard(session->uuid_str);
+
+	switch_thread_rwlock_wrlock(shard->rwlock);
+	switch_core_hash_delete(shard->table, session->uuid_str);
+	switch_thread_rwlock_unlock(shard->rwlock);
+}
+
+/* move a session to a new uuid with both stripes held, so a locate finds it under one name or the other */
+static switch_status_t session_table_rename(switch_core_session_t *session, const char *use_uuid)
+{
+	struct switch_session_shard *from = session_shard(session->uuid_str), *to = session_shard(use_uuid);
+	struct switch_session_shard *first = from < to ? from : to, *second = from < to ? to : from;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	switch_thread_rwlock_wrlock(first->rwlock);
+	if (second != first) {
+		switch_thread_rwlock_wrlock(second->rwlock);
+	}
+
+	if (!switch_core_hash_find(to->table, use_uuid)) {
+		switch_core_hash_delete(from->table, session->uuid_str);
+		switch_set_string(session->uuid_str, use_uuid);
+		switch_core_hash_insert(to->table, session->uuid_str, session);
+		status = SWITCH_STATUS_SUCCESS;
+	}
+
+	if (second != first) {
+		switch_thread_rwlock_unlock(second->rwlock);
+	}
+	switch_thread_rwlock_unlock(first->rwlock);
+
+	return status;
+}
+
+static switch_bool_t session_table_exists(const char *uuid_str)
+{
+	struct switch_session_shard *shard;
+	switch_bool_t exists = session_table_find(uuid_str, &shard) ? SWITCH_TRUE : SWITCH_FALSE;
+
+	switch_thread_rwlock_unlock(shard->rwlock);
+
+	return exists;
+}
+
 SWITCH_DECLARE(void) switch_core_session_set_dmachine(switch_core_session_t *session, switch_ivr_dmachine_t *dmachine, switch_digit_action_target_t target)
 {
 	int i = (int) target;
@@ -114,8 +191,9 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_locate(const char *u
 	switch_core_session_t *session = NULL;
 
 	if (uuid_str) {
-		switch_mutex_lock(runtime.session_hash_mutex);
-		if ((session = switch_core_hash_find(session_manager.session_table, uuid_str))) {
+		struct switch_session_shard *shard;
+
+		if ((session = session_table_find(uuid_str, &shard))) {
 			/* Acquire a read lock on the session */
 #ifdef SWITCH_DEBUG_RWLOCKS
 			if (switch_core_session_perform_read_lock(session, file, func, line) != SWITCH_STATUS_SUCCESS) {
@@ -129,7 +207,7 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_locate(const char *u
 				session = NULL;
 			}
 		}
-		switch_mutex_unlock(runtime.session_hash_mutex);
+		switch_thread_rwlock_unlock(shard->rwlock);
 	}
 
 	/* if its not NULL, now it's up to you to rwunlock this */
@@ -149,8 +227,9 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_force_locate(const c
 	switch_status_t status;
 
 	if (uuid_str) {
-		switch_mutex_lock(runtime.session_hash_mutex);
-		if ((session = switch_core_hash_find(session_manager.session_table, uuid_str))) {
+		struct switch_session_shard *shard;
+
+		if ((session = session_table_find(uuid_str, &shard))) {
 			/* Acquire a read lock on the session */
 
 			if (switch_test_flag(session, SSF_DESTROYED)) {
@@ -172,7 +251,7 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_force_locate(const c
 				session = NULL;
 			}
 		}
-		switch_mutex_unlock(runtime.session_hash_mutex);
+		switch_thread_rwlock_unlock(shard->rwlock);
 	}
 
 	/* if its not NULL, now it's up to you to rwunlock this */
@@ -200,10 +279,42 @@ struct str_node {
 	struct str_node *next;
 };
 
-SWITCH_DECLARE(void) switch_core_session_hupall_matching_var(const char *var_name, const char *var_val, switch_call_cause_t cause)
+/* copy the uuids of live sessions one stripe at a time, optionally only those of one endpoint */
+static struct str_node *session_table_snapshot(switch_memory_pool_t *pool, const switch_endpoint_interface_t *endpoint_interface)
 {
+	struct str_node *head = NULL, *np;
 	switch_hash_index_t *hi;
+	switch_core_session_t *session;
 	void *val;
+	int i;
+
+	for (i = 0; i < SWITCH_SESSION_TABLE_SHARDS; i++) {
+		struct switch_session_shard *shard = &session_manager.shards[i];
+
+		switch_thread_rwlock_rdlock(shard->rwlock);
+		for (hi = switch_hash_first(NULL, shard->table); hi; hi = switch_hash_next(hi)) {
+			switch_hash_this(hi, NULL, NULL, &val);
+			if (val) {
+				session = (switch_core_session_t *) val;
+				if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
+					if (!endpoint_interface || session->endpoint_interface == endpoint_interface) {
+						np = switch_core_alloc(pool, sizeof(*np));
+						np->str = switch_core_strdup(pool, session->uuid_str);
+						np->next = head;
+						head = np;
+					}
+					switch_core_session_rwunlock(session);
+				}
+			}
+		}
+		switch_thread_rwlock_unlock(shard->rwlock);
+	}
+
+	return head;
+}
+
+SWITCH_DECLARE(void) switch_core_session_hupall_matching_var(const char *var_name, const char *var_val, switch_call_cause_t cause)
+{
 	switch_core_session_t *session;
 	switch_memory_pool_t *pool;
 	struct str_node *head = NULL, *np;
@@ -213,21 +324,7 @@ SWITCH_DECLARE(void) switch_core_session_hupall_matching_var(const char *var_nam
 	if (!var_val)
 		return;
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_hash_first(NULL, session_manager.session_table); hi; hi = switch_hash_next(hi)) {
-		switch_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				np = switch_core_alloc(pool, sizeof(*np));
-				np->str = switch_core_strdup(pool, session->uuid_str);
-				np->next = head;
-				head = np;
-				switch_core_session_rwunlock(session);
-			}
-		}
-	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
+	head = session_table_snapshot(pool, NULL);
 
 	for(np = head; np; np = np->next) {
 		if ((session = switch_core_session_locate(np->str))) {
@@ -246,31 +343,13 @@ SWITCH_DECLARE(void) switch_core_session_hupall_matching_var(const char *var_nam
 
 SWITCH_DECLARE(void) switch_core_session_hupall_endpoint(const switch_endpoint_interface_t *endpoint_interface, switch_call_cause_t cause)
 {
-	switch_hash_index_t *hi;
-	void *val;
 	switch_core_session_t *session;
 	switch_memory_pool_t *pool;
     struct str_node *head = NULL, *np;
 	
 	switch_core_new_memory_pool(&pool);
 	
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_hash_first(NULL, session_manager.session_table); hi; hi = switch_hash_next(hi)) {
-		switch_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				if (session->endpoint_interface == endpoint_interface) {
-					np = switch_core_alloc(pool, sizeof(*np));
-                    np->str = switch_core_strdup(pool, session->uuid_str);
-                    np->next = head;
-					head = np;
-				}
-				switch_core_session_rwunlock(session);
-			}
-		}
-	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
+	head = session_table_snapshot(pool, endpoint_interface);
 
 	for(np = head; np; np = np->next) {
 		if ((session = switch_core_session_locate(np->str))) {
@@ -285,30 +364,13 @@ SWITCH_DECLARE(void) switch_core_session_hupall_endpoint(const switch_endpoint_i
 
 SWITCH_DECLARE(void) switch_core_session_hupall(switch_call_cause_t cause)
 {
-	switch_hash_index_t *hi;
-	void *val;
 	switch_core_session_t *session;
 	switch_memory_pool_t *pool;
 	struct str_node *head = NULL, *np;
 
 	switch_core_new_memory_pool(&pool);
 
-
-	switch_mutex_lock(runtime.session_hash_mutex);
-	for (hi = switch_hash_first(NULL, session_manager.session_table); hi; hi = switch_hash_next(hi)) {
-		switch_hash_this(hi, NULL, NULL, &val);
-		if (val) {
-			session = (switch_core_session_t *) val;
-			if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-				np = switch_core_alloc(pool, sizeof(*np));
-				np->str = switch_core_strdup(pool, session->uuid_str);
-				np->next = head;
-				head = np;
-				switch_core_session_rwunlock(session);
-			}
-		}
-	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
+	head = session_table_snapshot(pool, NULL);
 
 	for(np = head; np; np = np->next) { 
 		if ((session = switch_core_session_locate(np->str))) {
@@ -326,18 +388,21 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_message_send(const char *uui
 {
 	switch_core_session_t *session = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
+	struct switch_session_shard *shard;
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	if ((session = switch_core_hash_find(session_manager.session_table, uuid_str)) != 0) {
-		/* Acquire a read lock on the session or forget it the channel is dead */
-		if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-			if (switch_channel_up_nosig(session->channel)) {
-				status = switch_core_session_receive_message(session, message);
-			}
-			switch_core_session_rwunlock(session);
+	/* the read lock keeps the session around, deliver without holding up the shard */
+	if ((session = session_table_find(uuid_str, &shard)) != 0 && switch_core_session_read_lock(session) != SWITCH_STATUS_SUCCESS) {
+		session = NULL;
+	}
+	switch_thread_rwlock_unlock(shard->rwlock);
+
+	if (session) {
+		/* forget it if the channel is dead */
+		if (switch_channel_up_nosig(session->channel)) {
+			status = switch_core_session_receive_message(session, message);
 		}
+		switch_core_session_rwunlock(session);
 	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
 
 	return status;
 }
@@ -346,18 +411,21 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_event_send(const char *uuid_
 {
 	switch_core_session_t *session = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
+	struct switch_session_shard *shard;
 
-	switch_mutex_lock(runtime.session_hash_mutex);
-	if ((session = switch_core_hash_find(session_manager.session_table, uuid_str)) != 0) {
-		/* Acquire a read lock on the session or forget it the channel is dead */
-		if (switch_core_session_read_lock(session) == SWITCH_STATUS_SUCCESS) {
-			if (switch_channel_up_nosig(session->channel)) {
-				status = switch_core_session_queue_event(session, event);
-			}
-			switch_core_session_rwunlock(session);
+	/* the read lock keeps the session around, deliver without holding up the shard */
+	if ((session = session_table_find(uuid_str, &shard)) != 0 && switch_core_session_read_lock(session) != SWITCH_STATUS_SUCCESS) {
+		session = NULL;
+	}
+	switch_thread_rwlock_unlock(shard->rwlock);
+
+	if (session) {
+		/* forget it if the channel is dead */
+		if (switch_channel_up_nosig(session->channel)) {
+			status = switch_core_session_queue_event(session, event);
 		}
+		switch_core_session_rwunlock(session);
 	}
-	switch_mutex_unlock(runtime.session_hash_mutex);
 
 	return status;
 }
@@ -1248,8 +1316,9 @@ SWITCH_DECLARE(void) switch_core_session_perform_destroy(switch_core_session_t *
 
 	switch_scheduler_del_task_group((*session)->uuid_str);
 
+	session_table_delete(*session);
+
 	switch_mutex_lock(runtime.session_hash_mutex);
-	switch_core_hash_delete(session_manager.session_table, (*session)->uuid_str);
 	if (session_manager.session_count) {
 		session_manager.session_count--;
 		if (session_manager.session_count == 0) {
@@ -1421,6 +1490,371 @@ static void *SWITCH_THREAD_FUNC switch_core_session_thread(switch_thread_t *thre
 	return NULL;
 }
 
+/* Session thread pool: workers are spawned ahead of time and wait on one queue for session and
+   helper threads to run, so a call does not pay for a thread create and teardown.  A launch first
+   claims an idle worker, so the job never sits behind a call that is still running; with nothing
+   idle it grows the pool up to its limit and after that falls back to a thread of its own. */
+
+#define SESSION_POOL_IDLE_SEC 30
+
+typedef struct session_pool_job_s {
+	switch_thread_start_t func;
+	void *obj;
+	switch_time_t queued;
+} session_pool_job_t;
+
+static struct {
+	switch_memory_pool_t *pool;
+	switch_queue_t *queue;
+	switch_mutex_t *mutex;
+	uint32_t min;
+	uint32_t max;
+	switch_bool_t affinity;
+	int started;
+	int enabled;
+	int shutdown;
+	volatile switch_atomic_t running;
+	volatile switch_atomic_t idle;
+	volatile switch_atomic_t busy;
+	volatile switch_atomic_t next_cpu;
+	volatile switch_atomic_t spawned;
+	volatile switch_atomic_t retired;
+	volatile switch_atomic_t overflow;
+	volatile switch_atomic_t direct;
+	uint64_t jobs;
+	uint64_t wait_total;
+	switch_time_t wait_max;
+#ifndef WIN32
+	/*! set to the worker's pool while a job runs, its destructor only fires if the job ends the thread */
+	pthread_key_t job_key;
+	int job_key_created;
+#endif
+} SESSION_POOL;
+
+static switch_status_t session_pool_spawn(switch_bool_t claimed);
+
+/* take an idle worker for a job about to be queued */
+static int session_pool_claim(void)
+{
+	uint32_t idle;
+
+	while ((idle = switch_atomic_read(&SESSION_POOL.idle))) {
+		if (switch_atomic_cas(&SESSION_POOL.idle, idle - 1, idle) == idle) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* an idle worker above the minimum may leave unless a job has already claimed it */
+static int session_pool_retire(void)
+{
+	uint32_t idle;
+
+	while (switch_atomic_read(&SESSION_POOL.running) > SESSION_POOL.min && (idle = switch_atomic_read(&SESSION_POOL.idle))) {
+		if (switch_atomic_cas(&SESSION_POOL.idle, idle - 1, idle) == idle) {
+			switch_atomic_inc(&SESSION_POOL.retired);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+#ifndef WIN32
+/* a job called switch_thread_exit() on the worker it was given, account for the worker and put another in its place */
+static void session_pool_worker_lost(void *data)
+{
+	switch_memory_pool_t *pool = (switch_memory_pool_t *) data;
+
+	switch_atomic_dec(&SESSION_POOL.busy);
+	switch_atomic_dec(&SESSION_POOL.running);
+	switch_core_destroy_memory_pool(&pool);
+
+	if (SESSION_POOL.shutdown) {
+		return;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "A pooled session job ended its thread, starting a new worker\n");
+
+	switch_mutex_lock(SESSION_POOL.mutex);
+	session_pool_spawn(SWITCH_FALSE);
+	switch_mutex_unlock(SESSION_POOL.mutex);
+}
+#endif
+
+static void *SWITCH_THREAD_FUNC session_pool_worker(switch_thread_t *thread, void *obj)
+{
+	switch_memory_pool_t *pool = (switch_memory_pool_t *) obj;
+	session_pool_job_t *job;
+	switch_time_t wait, idle_since = switch_micro_time_now();
+	void *pop;
+
+#ifdef HAVE_CPU_SET_MACROS
+	if (SESSION_POOL.affinity) {
+		cpu_set_t set;
+		uint32_t cpus = switch_core_cpu_count();
+
+		CPU_ZERO(&set);
+		CPU_SET((switch_atomic_read(&SESSION_POOL.next_cpu) % (cpus ? cpus : 1)), &set);
+		switch_atomic_inc(&SESSION_POOL.next_cpu);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+#endif
+
+	while (!SESSION_POOL.shutdown) {
+		if (switch_queue_pop_timeout(SESSION_POOL.queue, &pop, SESSION_POOL_IDLE_SEC * 1000000) != SWITCH_STATUS_SUCCESS) {
+			/* the queue also wakes us early when it is interrupted, only a full idle period counts */
+			if (switch_micro_time_now() - idle_since >= SESSION_POOL_IDLE_SEC * 1000000 && session_pool_retire()) {
+				break;
+			}
+			continue;
+		}
+
+		if (!(job = (session_pool_job_t *) pop)) {
+			break;
+		}
+
+		wait = switch_micro_time_now() - job->queued;
+
+		switch_mutex_lock(SESSION_POOL.mutex);
+		SESSION_POOL.jobs++;
+		SESSION_POOL.wait_total += wait;
+		if (wait > SESSION_POOL.wait_max) {
+			SESSION_POOL.wait_max = wait;
+		}
+		switch_mutex_unlock(SESSION_POOL.mutex);
+
+		switch_atomic_inc(&SESSION_POOL.busy);
+#ifndef WIN32
+		if (SESSION_POOL.job_key_created) {
+			pthread_setspecific(SESSION_POOL.job_key, pool);
+		}
+#endif
+		job->func(thread, job->obj);
+#ifndef WIN32
+		if (SESSION_POOL.job_key_created) {
+			pthread_setspecific(SESSION_POOL.job_key, NULL);
+		}
+#endif
+		switch_atomic_dec(&SESSION_POOL.busy);
+
+		idle_since = switch_micro_time_now();
+		switch_atomic_inc(&SESSION_POOL.idle);
+	}
+
+	switch_atomic_dec(&SESSION_POOL.running);
+	switch_core_destroy_memory_pool(&pool);
+
+	return NULL;
+}
+
+/* called with SESSION_POOL.mutex held; a claimed worker starts out owing a job to the queue */
+static switch_status_t session_pool_spawn(switch_bool_t claimed)
+{
+	switch_memory_pool_t *pool;
+	switch_threadattr_t *thd_attr;
+	switch_thread_t *thread;
+
+	if (switch_core_new_memory_pool(&pool) != SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_MEMERR;
+	}
+
+	switch_atomic_inc(&SESSION_POOL.running);
+	if (!claimed) {
+		switch_atomic_inc(&SESSION_POOL.idle);
+	}
+
+	switch_threadattr_create(&thd_attr, pool);
+	switch_threadattr_detach_set(thd_attr, 1);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+	if (switch_thread_create(&thread, thd_attr, session_pool_worker, pool, pool) != SWITCH_STATUS_SUCCESS) {
+		switch_atomic_dec(&SESSION_POOL.running);
+		if (!claimed) {
+			switch_atomic_dec(&SESSION_POOL.idle);
+		}
+		switch_core_destroy_memory_pool(&pool);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	switch_atomic_inc(&SESSION_POOL.spawned);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* hand a thread function to the pool; SWITCH_STATUS_FALSE means the caller starts its own thread */
+static switch_status_t session_pool_launch(switch_thread_start_t func, void *obj, switch_memory_pool_t *pool)
+{
+	session_pool_job_t *job;
+
+	if (!SESSION_POOL.enabled || SESSION_POOL.shutdown) {
+		switch_atomic_inc(&SESSION_POOL.direct);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!session_pool_claim()) {
+		switch_status_t status = SWITCH_STATUS_FALSE;
+
+		switch_mutex_lock(SESSION_POOL.mutex);
+		if (switch_atomic_read(&SESSION_POOL.running) < SESSION_POOL.max) {
+			status = session_pool_spawn(SWITCH_TRUE);
+		}
+		switch_mutex_unlock(SESSION_POOL.mutex);
+
+		if (status != SWITCH_STATUS_SUCCESS) {
+			switch_atomic_inc(&SESSION_POOL.overflow);
+			return SWITCH_STATUS_FALSE;
+		}
+	}
+
+	job = switch_core_alloc(pool, sizeof(*job));
+	job->func = func;
+	job->obj = obj;
+	job->queued = switch_micro_time_now();
+
+	if (switch_queue_trypush(SESSION_POOL.queue, job) != SWITCH_STATUS_SUCCESS) {
+		/* give the claim back, the worker stays idle */
+		switch_atomic_inc(&SESSION_POOL.idle);
+		switch_atomic_inc(&SESSION_POOL.overflow);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+SWITCH_DECLARE(void) switch_core_session_thread_pool_set(uint32_t min, uint32_t max, switch_bool_t affinity)
+{
+	if (SESSION_POOL.started) {
+		return;
+	}
+
+	SESSION_POOL.min = min;
+	SESSION_POOL.max = max;
+	SESSION_POOL.affinity = affinity;
+}
+
+void switch_core_session_thread_pool_start(void)
+{
+	uint32_t i;
+
+	if (SESSION_POOL.started || !SESSION_POOL.min) {
+		return;
+	}
+
+	if (!SESSION_POOL.max) {
+		/* every call has a session thread on each leg plus the odd helper */
+		SESSION_POOL.max = session_manager.session_limit * 2;
+	}
+
+	if (SESSION_POOL.max < SESSION_POOL.min) {
+		SESSION_POOL.max = SESSION_POOL.min;
+	}
+
+	SESSION_POOL.pool = session_manager.memory_pool;
+	switch_mutex_init(&SESSION_POOL.mutex, SWITCH_MUTEX_NESTED, SESSION_POOL.pool);
+#ifndef WIN32
+	if (!SESSION_POOL.job_key_created && !pthread_key_create(&SESSION_POOL.job_key, session_pool_worker_lost)) {
+		SESSION_POOL.job_key_created = 1;
+	}
+#endif
+	/* only claimed jobs and shutdown markers are ever queued, never more than there are workers */
+	switch_queue_create(&SESSION_POOL.queue, SESSION_POOL.max * 2, SESSION_POOL.pool);
+	SESSION_POOL.shutdown = 0;
+
+	switch_mutex_lock(SESSION_POOL.mutex);
+	for (i = 0; i < SESSION_POOL.min; i++) {
+		if (session_pool_spawn(SWITCH_FALSE) != SWITCH_STATUS_SUCCESS) {
+			break;
+		}
+	}
+	switch_mutex_unlock(SESSION_POOL.mutex);
+
+	SESSION_POOL.started = 1;
+	SESSION_POOL.enabled = 1;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Session thread pool started with %u of up to %u threads%s\n",
+					  switch_atomic_read(&SESSION_POOL.running), SESSION_POOL.max, SESSION_POOL.affinity ? ", pinned" : "");
+}
+
+void switch_core_session_thread_pool_stop(void)
+{
+	uint32_t i, running;
+
+	if (!SESSION_POOL.started) {
+		return;
+	}
+
+	SESSION_POOL.enabled = 0;
+	SESSION_POOL.shutdown = 1;
+
+	running = switch_atomic_read(&SESSION_POOL.running);
+	for (i = 0; i < running; i++) {
+		switch_queue_trypush(SESSION_POOL.queue, NULL);
+	}
+
+	for (i = 0; i < 500 && switch_atomic_read(&SESSION_POOL.running); i++) {
+		switch_yield(10000);
+	}
+
+	if ((running = switch_atomic_read(&SESSION_POOL.running))) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%u session pool threads still busy at shutdown\n", running);
+	}
+
+	SESSION_POOL.started = 0;
+}
+
+SWITCH_DECLARE(switch_bool_t) switch_core_session_thread_pool_use(switch_bool_t enable)
+{
+	switch_bool_t was = SESSION_POOL.enabled ? SWITCH_TRUE : SWITCH_FALSE;
+
+	if (enable && !SESSION_POOL.started) {
+		if (!SESSION_POOL.min) {
+			SESSION_POOL.min = switch_core_cpu_count();
+		}
+		switch_core_session_thread_pool_start();
+	}
+
+	SESSION_POOL.enabled = (enable && SESSION_POOL.started) ? 1 : 0;
+
+	return was;
+}
+
+SWITCH_DECLARE(void) switch_core_session_thread_pool_stats(switch_stream_handle_t *stream, switch_bool_t reset)
+{
+	uint64_t jobs = 0, wait_total = 0;
+	switch_time_t wait_max = 0;
+
+	if (SESSION_POOL.mutex) {
+		switch_mutex_lock(SESSION_POOL.mutex);
+		jobs = SESSION_POOL.jobs;
+		wait_total = SESSION_POOL.wait_total;
+		wait_max = SESSION_POOL.wait_max;
+		if (reset) {
+			SESSION_POOL.jobs = 0;
+			SESSION_POOL.wait_total = 0;
+			SESSION_POOL.wait_max = 0;
+		}
+		switch_mutex_unlock(SESSION_POOL.mutex);
+	}
+
+	stream->write_function(stream, "enabled,running,idle,busy,min,max,spawned,retired,overflow,direct,jobs,wait_avg_us,wait_max_us\n");
+	stream->write_function(stream, "%s,%u,%u,%u,%u,%u,%u,%u,%u,%u,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_INT64_T_FMT "\n",
+						   SESSION_POOL.enabled ? "true" : "false",
+						   switch_atomic_read(&SESSION_POOL.running), switch_atomic_read(&SESSION_POOL.idle), switch_atomic_read(&SESSION_POOL.busy),
+						   SESSION_POOL.min, SESSION_POOL.max, switch_atomic_read(&SESSION_POOL.spawned), switch_atomic_read(&SESSION_POOL.retired),
+						   switch_atomic_read(&SESSION_POOL.overflow), switch_atomic_read(&SESSION_POOL.direct),
+						   jobs, jobs ? wait_total / jobs : 0, (int64_t) wait_max);
+
+	if (reset) {
+		switch_atomic_set(&SESSION_POOL.spawned, 0);
+		switch_atomic_set(&SESSION_POOL.retired, 0);
+		switch_atomic_set(&SESSION_POOL.overflow, 0);
+		switch_atomic_set(&SESSION_POOL.direct, 0);
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_core_session_thread_launch(switch_core_session_t *session)
 {
 	switch_status_t status = SWITCH_STATUS_FALSE;
@@ -1444,7 +1878,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_thread_launch(switch_core_se
 		switch_set_flag(session, SSF_THREAD_RUNNING);
 		switch_set_flag(session, SSF_THREAD_STARTED);
 		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-		if (switch_thread_create(&thread, thd_attr, switch_core_session_thread, session, session->pool) == SWITCH_STATUS_SUCCESS) {
+		if (session_pool_launch(switch_core_session_thread, session, session->pool) == SWITCH_STATUS_SUCCESS) {
+			status = SWITCH_STATUS_SUCCESS;
+		} else if (switch_thread_create(&thread, thd_attr, switch_core_session_thread, session, session->pool) == SWITCH_STATUS_SUCCESS) {
 			switch_set_flag(session, SSF_THREAD_STARTED);
 			status = SWITCH_STATUS_SUCCESS;
 		} else {
@@ -1465,6 +1901,11 @@ SWITCH_DECLARE(void) switch_core_session_launch_thread(switch_core_session_t *se
 {
 	switch_thread_t *thread;
 	switch_threadattr_t *thd_attr = NULL;
+
+	if (session_pool_launch(func, obj, session->pool) == SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
 	switch_threadattr_create(&thd_attr, session->pool);
 	switch_threadattr_detach_set(thd_attr, 1);
 
@@ -1481,8 +1922,9 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_set_uuid(switch_core_session
 
 	switch_assert(use_uuid);
 
+	/* keeps two renames from both claiming the same new uuid between the check and the move */
 	switch_mutex_lock(runtime.session_hash_mutex);
-	if (switch_core_hash_find(session_manager.session_table, use_uuid)) {
+	if (session_table_exists(use_uuid)) {
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_CRIT, "Duplicate UUID!\n");
 		switch_mutex_unlock(runtime.session_hash_mutex);
 		return SWITCH_STATUS_FALSE;
@@ -1503,9 +1945,7 @@ SWITCH_DECLARE(switch_status_t) switch_core_session_set_uuid(switch_core_session
 
 	switch_event_create(&event, SWITCH_EVENT_CHANNEL_UUID);
 	switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Old-Unique-ID", session->uuid_str);
-	switch_core_hash_delete(session_manager.session_table, session->uuid_str);
-	switch_set_string(session->uuid_str, use_uuid);
-	switch_core_hash_insert(session_manager.session_table, session->uuid_str, session);
+	session_table_rename(session, use_uuid);
 	switch_mutex_unlock(runtime.session_hash_mutex);
 	switch_channel_event_set_data(session->channel, event);
 	switch_event_fire(&event);
@@ -1797,7 +2237,7 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_request_uuid(switch_
 	int32_t sps = 0;
 
 
-	if (use_uuid && switch_core_hash_find(session_manager.session_table, use_uuid)) {
+	if (use_uuid && session_table_exists(use_uuid)) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Duplicate UUID!\n");
 		return NULL;
 	}
@@ -1905,8 +2345,9 @@ SWITCH_DECLARE(switch_core_session_t *) switch_core_session_request_uuid(switch_
 	switch_queue_create(&session->private_event_queue, SWITCH_EVENT_QUEUE_LEN, session->pool);
 	switch_queue_create(&session->private_event_queue_pri, SWITCH_EVENT_QUEUE_LEN, session->pool);
 
+	session_table_insert(session);
+
 	switch_mutex_lock(runtime.session_hash_mutex);
-	switch_core_hash_insert(session_manager.session_table, session->uuid_str, session);
 	session->id = session_manager.session_id++;
 	session_manager.session_count++;
 	switch_mutex_unlock(runtime.session_hash_mutex);
@@ -2011,16 +2452,25 @@ SWITCH_DECLARE(uint32_t) switch_core_sessions_per_second(uint32_t new_limit)
 
 void switch_core_session_init(switch_memory_pool_t *pool)
 {
+	int i;
+
 	memset(&session_manager, 0, sizeof(session_manager));
 	session_manager.session_limit = 1000;
 	session_manager.session_id = 1;
 	session_manager.memory_pool = pool;
-	switch_core_hash_init(&session_manager.session_table, session_manager.memory_pool);
+	for (i = 0; i < SWITCH_SESSION_TABLE_SHARDS; i++) {
+		switch_thread_rwlock_create(&session_manager.shards[i].rwlock, session_manager.memory_pool);
+		switch_core_hash_init(&session_manager.shards[i].table, session_manager.memory_pool);
+	}
 }
 
 void switch_core_session_uninit(void)
 {
-	switch_core_hash_destroy(&session_manager.session_table);
+	int i;
+
+	for (i = 0; i < SWITCH_SESSION_TABLE_SHARDS; i++) {
+		switch_core_hash_destroy(&session_manager.shards[i].table);
+	}
 }
 
 SWITCH_DECLARE(switch_app_log_t *) switch_core_session_get_app_log(switch_core_session_t *session)
@@ -35,8 +35,120 @@
 #include <switch.h>
 #include "private/switch_core_pvt.h"
 
+#include <sqlite3.h>
+
 #define SWITCH_SQL_QUEUE_LEN 100000
 #define SWITCH_SQL_QUEUE_PAUSE_LEN 90000
+#define SWITCH_SQL_MAX_WRITERS 16
+/* upper bound on statements per transaction, the byte bound comes from max-sql-buffer-len */
+#define SWITCH_SQL_BATCH_MAX 20000
+
+/* statements the core writes over and over, prepared once per writer and fed with bound values */
+typedef enum {
+	CORE_SQL_RAW,
+	CORE_SQL_TASK_ADD,
+	CORE_SQL_TASK_DEL,
+	CORE_SQL_TASK_UPDATE,
+	CORE_SQL_CHANNEL_ADD,
+	CORE_SQL_CHANNEL_DEL,
+	CORE_SQL_CHANNEL_UUID,
+	CORE_SQL_CHANNEL_CALL_UUID_RENAME,
+	CORE_SQL_CHANNEL_CODEC,
+	CORE_SQL_CHANNEL_APPLICATION,
+	CORE_SQL_CHANNEL_ORIGINATE,
+	CORE_SQL_CHANNEL_CALLEE,
+	CORE_SQL_CHANNEL_CALLSTATE,
+	CORE_SQL_CHANNEL_ROUTING,
+	CORE_SQL_CHANNEL_STATE,
+	CORE_SQL_CHANNEL_CALL_UUID,
+	CORE_SQL_CHANNEL_UNBRIDGE,
+	CORE_SQL_CHANNEL_SECURE,
+	CORE_SQL_CALL_ADD,
+	CORE_SQL_CALL_DEL,
+	CORE_SQL_INTERFACE_ADD,
+	CORE_SQL_INTERFACE_DEL,
+	CORE_SQL_NAT_ADD,
+	CORE_SQL_NAT_DEL,
+	CORE_SQL_REG_ADD,
+	CORE_SQL_REG_DEL_URL,
+	CORE_SQL_REG_DEL_USER,
+	CORE_SQL_REG_DEL_TOKEN,
+	CORE_SQL_REG_EXPIRE,
+	CORE_SQL_REG_EXPIRE_ALL,
+	CORE_SQL_STMT_MAX
+} core_sql_stmt_t;
+
+static const char *CORE_SQL_STMTS[CORE_SQL_STMT_MAX] = {
+	NULL,
+	"insert into tasks values(?,?,?,?,?)",
+	"delete from tasks where task_id=? and hostname=?",
+	"update tasks set task_desc=?,task_group=?, task_sql_manager=? where task_id=? and hostname=?",
+	"insert into channels (uuid,direction,created,created_epoch, name,state,callstate,dialplan,context,hostname) "
+	"values(?,?,?,?,?,?,?,?,?,?)",
+	"delete from channels where uuid=?",
+	"update channels set uuid=? where uuid=?",
+	"update channels set call_uuid=? where call_uuid=?",
+	"update channels set read_codec=?,read_rate=?,read_bit_rate=?,write_codec=?,write_rate=?,write_bit_rate=? where uuid=?",
+	"update channels set application=?,application_data=?,presence_id=?,presence_data=? where uuid=?",
+	"update channels set presence_id=?,presence_data=?, call_uuid=? where uuid=?",
+	"update channels set callee_name=?,callee_num=?,sent_callee_name=?,sent_callee_num=?,callee_direction=?,"
+	"cid_name=?,cid_num=? where uuid=?",
+	"update channels set callstate=? where uuid=?",
+	"update channels set state=?,cid_name=?,cid_num=?,callee_name=?,callee_num=?,sent_callee_name=?,sent_callee_num=?,"
+	"ip_addr=?,dest=?,dialplan=?,context=?,presence_id=?,presence_data=? where uuid=?",
+	"update channels set state=? where uuid=?",
+	"update channels set call_uuid=? where uuid=?",
+	"update channels set call_uuid=uuid where call_uuid=?",
+	"update channels set secure=? where uuid=?",
+	"insert into calls (call_uuid,call_created,call_created_epoch,caller_uuid,callee_uuid,hostname) values (?,?,?,?,?,?)",
+	"delete from calls where (caller_uuid=? or callee_uuid=?)",
+	"insert into interfaces (type,name,description,syntax,ikey,filename,hostname) values(?,?,?,?,?,?,?)",
+	"delete from interfaces where type=? and name=? and hostname=?",
+	"insert into nat (port, proto, sticky, hostname) values (?,?,?,?)",
+	"delete from nat where port=? and proto=? and hostname=?",
+	"insert into registrations (reg_user,realm,token,url,expires,network_ip,network_port,network_proto,hostname) "
+	"values (?,?,?,?,?,?,?,?,?)",
+	"delete from registrations where hostname=? and (url=? or token=?)",
+	"delete from registrations where reg_user=? and realm=? and hostname=?",
+	"delete from registrations where reg_user=? and realm=? and hostname=? and token=?",
+	"delete from registrations where expires > 0 and expires <= ? and hostname=?",
+	"delete from registrations where hostname=?"
+};
+
+/*! \brief A queued write, the values are stored in the same allocation */
+typedef struct {
+	core_sql_stmt_t stmt;
+	int argc;
+	char **argv;
+	/*! the statement text for CORE_SQL_RAW */
+	char *sql;
+	switch_size_t len;
+	/*! the statement failed on its own, retries of its batch leave it out */
+	int failed;
+} core_sql_t;
+
+/*! \brief A writer thread with its own connection and queue, statements are sharded to it by uuid */
+typedef struct {
+	uint32_t id;
+	switch_queue_t *queue;
+	switch_thread_t *thread;
+	volatile int running;
+	switch_cache_db_handle_t *dbh;
+	switch_core_db_stmt_t *stmts[CORE_SQL_STMT_MAX];
+	/*! statements pushed and statements written, used for depth and by switch_core_sqldb_sync() */
+	volatile switch_atomic_t queued;
+	volatile switch_atomic_t committed;
+	uint32_t max_depth;
+	uint32_t batches;
+	uint32_t max_batch;
+	uint32_t errors;
+	/*! commit latency in microseconds */
+	switch_time_t total_latency;
+	switch_time_t max_latency;
+	switch_time_t last_latency;
+} core_sql_writer_t;
+
+static void core_registry_attach(switch_cache_db_handle_t *dbh);
 
 struct switch_cache_db_handle {
 	char name[CACHE_DB_LEN];
@@ -56,24 +168,515 @@ struct switch_cache_db_handle {
 };
 
 static struct {
-	switch_cache_db_handle_t *event_db;
-	switch_queue_t *sql_queue[2];
+	core_sql_writer_t writers[SWITCH_SQL_MAX_WRITERS];
+	uint32_t writer_count;
+	int stmt_argc[CORE_SQL_STMT_MAX];
+	/*! uuids that were renamed stay on the writer of their original uuid */
+	switch_hash_t *pins;
+	switch_mutex_t *pin_mutex;
+	/*! callers of switch_core_sqldb_sync() waiting for the writers to commit */
+	volatile switch_atomic_t sync_waiters;
 	switch_memory_pool_t *memory_pool;
 	switch_event_node_t *event_node;
-	switch_thread_t *thread;
 	switch_thread_t *db_thread;
-	int thread_running;
 	int db_thread_running;
 	switch_bool_t manage;
 	switch_mutex_t *io_mutex;
 	switch_mutex_t *dbh_mutex;
 	switch_cache_db_handle_t *handle_pool;
-	switch_thread_cond_t *cond;
-	switch_mutex_t *cond_mutex;
 	uint32_t total_handles;
 	uint32_t total_used_handles;
 } sql_manager;
 
+/* 
+   The channel registry keeps the channels and calls tables in memory when core-channel-registry is set.
+   Rows are striped by uuid so event updates and readers only contend on one stripe, the sql tables are
+   only written by the snapshot thread and reads go through the core_registry virtual tables.
+*/
+#define CORE_REGISTRY_STRIPES 32
+
+typedef enum {
+	CH_UUID,
+	CH_DIRECTION,
+	CH_CREATED,
+	CH_CREATED_EPOCH,
+	CH_NAME,
+	CH_STATE,
+	CH_CID_NAME,
+	CH_CID_NUM,
+	CH_IP_ADDR,
+	CH_DEST,
+	CH_APPLICATION,
+	CH_APPLICATION_DATA,
+	CH_DIALPLAN,
+	CH_CONTEXT,
+	CH_READ_CODEC,
+	CH_READ_RATE,
+	CH_READ_BIT_RATE,
+	CH_WRITE_CODEC,
+	CH_WRITE_RATE,
+	CH_WRITE_BIT_RATE,
+	CH_SECURE,
+	CH_HOSTNAME,
+	CH_PRESENCE_ID,
+	CH_PRESENCE_DATA,
+	CH_CALLSTATE,
+	CH_CALLEE_NAME,
+	CH_CALLEE_NUM,
+	CH_CALLEE_DIRECTION,
+	CH_CALL_UUID,
+	CH_SENT_CALLEE_NAME,
+	CH_SENT_CALLEE_NUM,
+	CH_COL_MAX
+} core_channel_col_t;
+
+/* same order as create_channels_sql */
+static const char *CORE_CHANNEL_COLS[CH_COL_MAX] = {
+	"uuid", "direction", "created", "created_epoch", "name", "state", "cid_name", "cid_num", "ip_addr", "dest",
+	"application", "application_data", "dialplan", "context", "read_codec", "read_rate", "read_bit_rate",
+	"write_codec", "write_rate", "write_bit_rate", "secure", "hostname", "presence_id", "presence_data",
+	"callstate", "callee_name", "callee_num", "callee_direction", "call_uuid", "sent_callee_name", "sent_callee_num"
+};
+
+typedef enum {
+	CALL_UUID,
+	CALL_CREATED,
+	CALL_CREATED_EPOCH,
+	CALL_CALLER_UUID,
+	CALL_CALLEE_UUID,
+	CALL_HOSTNAME,
+	CALL_COL_MAX
+} core_call_col_t;
+
+/* same order as create_calls_sql */
+static const char *CORE_CALL_COLS[CALL_COL_MAX] = {
+	"call_uuid", "call_created", "call_created_epoch", "caller_uuid", "callee_uuid", "hostname"
+};
+
+/*! \brief The channels columns written by a statement, in the order of its values */
+typedef struct {
+	core_sql_stmt_t stmt;
+	int count;
+	core_channel_col_t cols[14];
+} core_registry_update_t;
+
+/* every statement but CHANNEL_ADD takes the uuid as its last value */
+static const core_registry_update_t CORE_REGISTRY_UPDATES[] = {
+	{CORE_SQL_CHANNEL_ADD, 10, {CH_UUID, CH_DIRECTION, CH_CREATED, CH_CREATED_EPOCH, CH_NAME, CH_STATE, CH_CALLSTATE, CH_DIALPLAN, CH_CONTEXT,
+								CH_HOSTNAME}},
+	{CORE_SQL_CHANNEL_CODEC, 6, {CH_READ_CODEC, CH_READ_RATE, CH_READ_BIT_RATE, CH_WRITE_CODEC, CH_WRITE_RATE, CH_WRITE_BIT_RATE}},
+	{CORE_SQL_CHANNEL_APPLICATION, 4, {CH_APPLICATION, CH_APPLICATION_DATA, CH_PRESENCE_ID, CH_PRESENCE_DATA}},
+	{CORE_SQL_CHANNEL_ORIGINATE, 3, {CH_PRESENCE_ID, CH_PRESENCE_DATA, CH_CALL_UUID}},
+	{CORE_SQL_CHANNEL_CALLEE, 7, {CH_CALLEE_NAME, CH_CALLEE_NUM, CH_SENT_CALLEE_NAME, CH_SENT_CALLEE_NUM, CH_CALLEE_DIRECTION, CH_CID_NAME,
+								  CH_CID_NUM}},
+	{CORE_SQL_CHANNEL_CALLSTATE, 1, {CH_CALLSTATE}},
+	{CORE_SQL_CHANNEL_ROUTING, 13, {CH_STATE, CH_CID_NAME, CH_CID_NUM, CH_CALLEE_NAME, CH_CALLEE_NUM, CH_SENT_CALLEE_NAME, CH_SENT_CALLEE_NUM,
+									CH_IP_ADDR, CH_DEST, CH_DIALPLAN, CH_CONTEXT, CH_PRESENCE_ID, CH_PRESENCE_DATA}},
+	{CORE_SQL_CHANNEL_STATE, 1, {CH_STATE}},
+	{CORE_SQL_CHANNEL_CALL_UUID, 1, {CH_CALL_UUID}},
+	{CORE_SQL_CHANNEL_SECURE, 1, {CH_SECURE}}
+};
+
+/*! \brief A channels row, it also carries the calls row while the channel is the caller */
+typedef struct {
+	char *col[CH_COL_MAX];
+	char *call[CALL_COL_MAX];
+	/*! the caller uuid while the channel is the callee */
+	char *caller;
+} core_registry_row_t;
+
+/*! \brief A channel whose call_uuid is the key it is filed under */
+typedef struct core_registry_member {
+	char *uuid;
+	struct core_registry_member *next;
+} core_registry_member_t;
+
+typedef struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *rows;
+	/*! call_uuid -> core_registry_member_t list, filed in the stripe of the call_uuid */
+	switch_hash_t *members;
+} core_registry_stripe_t;
+
+static struct {
+	switch_bool_t enabled;
+	core_registry_stripe_t stripes[CORE_REGISTRY_STRIPES];
+	const core_registry_update_t *updates[CORE_SQL_STMT_MAX];
+	volatile switch_atomic_t channels;
+	volatile switch_atomic_t calls;
+	/*! bumped on every change so the snapshot thread can skip idle periods */
+	volatile switch_atomic_t version;
+	/*! set once the schema is in place, handles opened after that get the virtual tables */
+	switch_bool_t attach;
+	/*! "main." when the virtual tables shadow the real ones */
+	const char *prefix;
+	switch_thread_t *snapshot_thread;
+	volatile int snapshot_running;
+	uint32_t snapshot_sec;
+} registry;
+
+static core_registry_stripe_t *core_registry_stripe(const char *uuid)
+{
+	switch_ssize_t len = -1;
+
+	return &registry.stripes[switch_ci_hashfunc_default(uuid, &len) % CORE_REGISTRY_STRIPES];
+}
+
+static void core_registry_set(char **slot, const char *val)
+{
+	if (*slot && val && !strcmp(*slot, val)) {
+		return;
+	}
+
+	switch_safe_free(*slot);
+	*slot = val ? strdup(val) : NULL;
+}
+
+/* file uuid under call_uuid, or take it out again, so replacing a call_uuid does not have to walk every stripe */
+static void core_registry_member(const char *call_uuid, const char *uuid, switch_bool_t add)
+{
+	core_registry_stripe_t *stripe;
+	core_registry_member_t *head, *m, **mp;
+
+	if (zstr(call_uuid) || zstr(uuid)) {
+		return;
+	}
+
+	stripe = core_registry_stripe(call_uuid);
+
+	switch_mutex_lock(stripe->mutex);
+	head = switch_core_hash_find(stripe->members, call_uuid);
+
+	for (mp = &head; (m = *mp); mp = &m->next) {
+		if (!strcmp(m->uuid, uuid)) {
+			break;
+		}
+	}
+
+	if (add && !m) {
+		switch_zmalloc(m, sizeof(*m));
+		m->uuid = strdup(uuid);
+		m->next = head;
+		switch_core_hash_insert(stripe->members, call_uuid, m);
+	} else if (!add && m) {
+		*mp = m->next;
+		free(m->uuid);
+		free(m);
+		if (head) {
+			switch_core_hash_insert(stripe->members, call_uuid, head);
+		} else {
+			switch_core_hash_delete(stripe->members, call_uuid);
+		}
+	}
+	switch_mutex_unlock(stripe->mutex);
+}
+
+static void core_registry_free_members(core_registry_member_t *m)
+{
+	core_registry_member_t *next;
+
+	for (; m; m = next) {
+		next = m->next;
+		free(m->uuid);
+		free(m);
+	}
+}
+
+static void core_registry_clear_call(core_registry_row_t *row)
+{
+	int i;
+
+	if (row->call[CALL_CALLER_UUID]) {
+		switch_atomic_dec(&registry.calls);
+	}
+
+	for (i = 0; i < CALL_COL_MAX; i++) {
+		switch_safe_free(row->call[i]);
+	}
+}
+
+static void core_registry_free_row(core_registry_row_t *row)
+{
+	int i;
+
+	for (i = 0; i < CH_COL_MAX; i++) {
+		switch_safe_free(row->col[i]);
+	}
+	core_registry_clear_call(row);
+	switch_safe_free(row->caller);
+	free(row);
+}
+
+static void core_registry_add(const core_registry_update_t *update, const char **argv)
+{
+	core_registry_stripe_t *stripe = core_registry_stripe(argv[0]);
+	core_registry_row_t *row;
+	int i;
+
+	switch_mutex_lock(stripe->mutex);
+	if (!(row = switch_core_hash_find(stripe->rows, argv[0]))) {
+		switch_zmalloc(row, sizeof(*row));
+		switch_core_hash_insert(stripe->rows, argv[0], row);
+		switch_atomic_inc(&registry.channels);
+	}
+	for (i = 0; i < update->count; i++) {
+		core_registry_set(&row->col[update->cols[i]], argv[i]);
+	}
+	switch_mutex_unlock(stripe->mutex);
+}
+
+static void core_registry_del(const char *uuid)
+{
+	core_registry_stripe_t *stripe = core_registry_stripe(uuid);
+	core_registry_row_t *row;
+
+	switch_mutex_lock(stripe->mutex);
+	if ((row = switch_core_hash_find(stripe->rows, uuid))) {
+		switch_core_hash_delete(stripe->rows, uuid);
+		switch_atomic_dec(&registry.channels);
+	}
+	switch_mutex_unlock(stripe->mutex);
+
+	if (row) {
+		core_registry_member(row->col[CH_CALL_UUID], uuid, SWITCH_FALSE);
+		core_registry_free_row(row);
+	}
+}
+
+static void core_registry_update(const core_registry_update_t *update, const char **argv)
+{
+	const char *uuid = argv[update->count];
+	core_registry_stripe_t *stripe = core_registry_stripe(uuid);
+	core_registry_row_t *row;
+	char *old_call = NULL, *new_call = NULL;
+	int i;
+
+	switch_mutex_lock(stripe->mutex);
+	if ((row = switch_core_hash_find(stripe->rows, uuid))) {
+		for (i = 0; i < update->count; i++) {
+			if (update->cols[i] == CH_CALL_UUID && !(row->col[CH_CALL_UUID] && argv[i] && !strcmp(row->col[CH_CALL_UUID], argv[i]))) {
+				old_call = row->col[CH_CALL_UUID];
+				row->col[CH_CALL_UUID] = NULL;
+				new_call = argv[i] ? strdup(argv[i]) : NULL;
+			}
+			core_registry_set(&row->col[update->cols[i]], argv[i]);
+		}
+	}
+	switch_mutex_unlock(stripe->mutex);
+
+	if (old_call || new_call) {
+		core_registry_member(new_call, uuid, SWITCH_TRUE);
+		core_registry_member(old_call, uuid, SWITCH_FALSE);
+		switch_safe_free(old_call);
+		switch_safe_free(new_call);
+	}
+}
+
+static void core_registry_rename(const char *old_uuid, const char *new_uuid)
+{
+	core_registry_stripe_t *stripe = core_registry_stripe(old_uuid);
+	core_registry_row_t *row;
+	char *call_uuid;
+
+	switch_mutex_lock(stripe->mutex);
+	if ((row = switch_core_hash_find(stripe->rows, old_uuid))) {
+		switch_core_hash_delete(stripe->rows, old_uuid);
+	}
+	switch_mutex_unlock(stripe->mutex);
+
+	if (!row) {
+		return;
+	}
+
+	core_registry_set(&row->col[CH_UUID], new_uuid);
+	call_uuid = row->col[CH_CALL_UUID] ? strdup(row->col[CH_CALL_UUID]) : NULL;
+
+	stripe = core_registry_stripe(new_uuid);
+	switch_mutex_lock(stripe->mutex);
+	switch_core_hash_insert(stripe->rows, new_uuid, row);
+	switch_mutex_unlock(stripe->mutex);
+
+	if (call_uuid) {
+		core_registry_member(call_uuid, new_uuid, SWITCH_TRUE);
+		core_registry_member(call_uuid, old_uuid, SWITCH_FALSE);
+		free(call_uuid);
+	}
+}
+
+/* set call_uuid on every row whose call_uuid is match, to_uuid NULL means the row's own uuid */
+static void core_registry_replace_call_uuid(const char *match, const char *to_uuid)
+{
+	core_registry_stripe_t *stripe = core_registry_stripe(match);
+	core_registry_member_t *members, *m;
+	core_registry_row_t *row;
+
+	/* the rows filed under match move out as a whole, each one is checked against its own stripe below */
+	switch_mutex_lock(stripe->mutex);
+	if ((members = switch_core_hash_find(stripe->members, match))) {
+		switch_core_hash_delete(stripe->members, match);
+	}
+	switch_mutex_unlock(stripe->mutex);
+
+	for (m = members; m; m = m->next) {
+		char *to = NULL;
+
+		stripe = core_registry_stripe(m->uuid);
+		switch_mutex_lock(stripe->mutex);
+		if ((row = switch_core_hash_find(stripe->rows, m->uuid)) && row->col[CH_CALL_UUID] && !strcmp(row->col[CH_CALL_UUID], match)) {
+			core_registry_set(&row->col[CH_CALL_UUID], to_uuid ? to_uuid : row->col[CH_UUID]);
+			to = strdup(row->col[CH_CALL_UUID]);
+		}
+		switch_mutex_unlock(stripe->mutex);
+
+		if (to) {
+			core_registry_member(to, m->uuid, SWITCH_TRUE);
+			free(to);
+		}
+	}
+
+	core_registry_free_members(members);
+}
+
+static void core_registry_call_add(const char **argv)
+{
+	core_registry_stripe_t *stripe = core_registry_stripe(argv[CALL_CALLER_UUID]);
+	core_registry_row_t *row;
+	int i;
+
+	switch_mutex_lock(stripe->mutex);
+	if ((row = switch_core_hash_find(stripe->rows, argv[CALL_CALLER_UUID]))) {
+		core_registry_clear_call(row);
+		for (i = 0; i < CALL_COL_MAX; i++) {
+			row->call[i] = strdup(argv[i]);
+		}
+		switch_atomic_inc(&registry.calls);
+	}
+	switch_mutex_unlock(stripe->mutex);
+
+	if (!row) {
+		return;
+	}
+
+	stripe = core_registry_stripe(argv[CALL_CALLEE_UUID]);
+	switch_mutex_lock(stripe->mutex);
+	if ((row = switch_core_hash_find(stripe->rows, argv[CALL_CALLEE_UUID]))) {
+		core_registry_set(&row->caller, argv[CALL_CALLER_UUID]);
+	}
+	switch_mutex_unlock(stripe->mutex);
+}
+
+/* drop the call uuid is part of, as caller or as callee */
+static void core_registry_call_del(const char *uuid)
+{
+	core_registry_stripe_t *stripe = core_registry_stripe(uuid);
+	core_registry_row_t *row;
+	char *callee = NULL, *caller = NULL;
+
+	switch_mutex_lock(stripe->mutex);
+	if ((row = switch_core_hash_find(stripe->rows, uuid))) {
+		if (row->call[CALL_CALLER_UUID]) {
+			callee = row->call[CALL_CALLEE_UUID];
+			row->call[CALL_CALLEE_UUID] = NULL;
+			core_registry_clear_call(row);
+		}
+		caller = row->caller;
+		row->caller = NULL;
+	}
+	switch_mutex_unlock(stripe->mutex);
+
+	if (callee) {
+		stripe = core_registry_stripe(callee);
+		switch_mutex_lock(stripe->mutex);
+		if ((row = switch_core_hash_find(stripe->rows, callee)) && row->caller && !strcmp(row->caller, uuid)) {
+			switch_safe_free(row->caller);
+		}
+		switch_mutex_unlock(stripe->mutex);
+		free(callee);
+	}
+
+	if (caller) {
+		stripe = core_registry_stripe(caller);
+		switch_mutex_lock(stripe->mutex);
+		if ((row = switch_core_hash_find(stripe->rows, caller)) && row->call[CALL_CALLEE_UUID] && !strcmp(row->call[CALL_CALLEE_UUID], uuid)) {
+			core_registry_clear_call(row);
+		}
+		switch_mutex_unlock(stripe->mutex);
+		free(caller);
+	}
+}
+
+/* apply a channels or calls statement to the registry instead of the db, returns SWITCH_FALSE for other tables */
+static switch_bool_t core_registry_apply(core_sql_stmt_t stmt, const char **argv)
+{
+	switch (stmt) {
+	case CORE_SQL_CHANNEL_ADD:
+		core_registry_add(registry.updates[stmt], argv);
+		break;
+	case CORE_SQL_CHANNEL_DEL:
+		core_registry_del(argv[0]);
+		break;
+	case CORE_SQL_CHANNEL_UUID:
+		core_registry_rename(argv[1], argv[0]);
+		break;
+	case CORE_SQL_CHANNEL_CALL_UUID_RENAME:
+		core_registry_replace_call_uuid(argv[1], argv[0]);
+		break;
+	case CORE_SQL_CHANNEL_UNBRIDGE:
+		core_registry_replace_call_uuid(argv[0], NULL);
+		break;
+	case CORE_SQL_CALL_ADD:
+		core_registry_call_add(argv);
+		break;
+	case CORE_SQL_CALL_DEL:
+		core_registry_call_del(argv[0]);
+		break;
+	default:
+		if (!registry.updates[stmt]) {
+			return SWITCH_FALSE;
+		}
+		core_registry_update(registry.updates[stmt], argv);
+		break;
+	}
+
+	switch_atomic_inc(&registry.version);
+
+	return SWITCH_TRUE;
+}
+
+/* the presence-data-cols of an event name channels columns to copy from the matching variables */
+static void core_registry_presence_cols(const char *uuid, switch_event_t *event)
+{
+	core_registry_stripe_t *stripe = core_registry_stripe(uuid);
+	core_registry_row_t *row;
+	char *cols[25] = { 0 };
+	char col_name[128] = "";
+	char *data_copy;
+	int col_count, i, j;
+
+	data_copy = strdup(switch_event_get_header(event, "presence-data-cols"));
+	col_count = switch_split(data_copy, ':', cols);
+
+	switch_mutex_lock(stripe->mutex);
+	if ((row = switch_core_hash_find(stripe->rows, uuid))) {
+		for (i = 0; i < col_count; i++) {
+			for (j = 0; j < CH_COL_MAX; j++) {
+				if (!strcasecmp(cols[i], CORE_CHANNEL_COLS[j])) {
+					const char *val;
+
+					switch_snprintf(col_name, sizeof(col_name), "variable_%s", cols[i]);
+					val = switch_event_get_header(event, col_name);
+					core_registry_set(&row->col[j], zstr(val) ? NULL : val);
+					break;
+				}
+			}
+		}
+	}
+	switch_mutex_unlock(stripe->mutex);
+
+	switch_atomic_inc(&registry.version);
+	free(data_copy);
+}
+
 
 static switch_cache_db_handle_t *create_handle(switch_cache_db_handle_type_t type)
 {
@@ -437,6 +1040,10 @@ SWITCH_DECLARE(switch_status_t) _switch_cache_db_get_db_handle(switch_cache_db_h
 
 	if (new_dbh) {
 		new_dbh->last_used = switch_epoch_time_now(NULL);
+
+		if (registry.attach && new_dbh->type == SCDB_TYPE_CORE_DB && !switch_test_flag(new_dbh, CDF_REGISTRY) && !strcmp(db_name, SWITCH_CORE_DB)) {
+			core_registry_attach(new_dbh);
+		}
 	}
 	
 	*dbh = new_dbh;
@@ -498,19 +1105,6 @@ static switch_status_t switch_cache_db_execute_sql_real(switch_cache_db_handle_t
 	return status;
 }
 
-static void wake_thread(int force)
-{
-	if (force) {
-		switch_thread_cond_signal(sql_manager.cond);
-		return;
-	}
-
-	if (switch_mutex_trylock(sql_manager.cond_mutex) == SWITCH_STATUS_SUCCESS) {
-		switch_thread_cond_signal(sql_manager.cond);
-		switch_mutex_unlock(sql_manager.cond_mutex);
-	}
-}
-
 /**
    OMFG you cruel bastards.  Who chooses 64k as a max buffer len for a sql statement, have you ever heard of transactions?
 **/
@@ -935,7 +1529,6 @@ static void *SWITCH_THREAD_FUNC switch_core_sql_db_thread(switch_thread_t *threa
 	while (sql_manager.db_thread_running == 1) {
 		if (++sec == SQL_CACHE_TIMEOUT) {
 			sql_close(switch_epoch_time_now(NULL));		
-			wake_thread(0);
 			sec = 0;
 		}
 
@@ -950,195 +1543,447 @@ static void *SWITCH_THREAD_FUNC switch_core_sql_db_thread(switch_thread_t *threa
 	return NULL;
 }
 
-static void *SWITCH_THREAD_FUNC switch_core_sql_thread(switch_thread_t *thread, void *obj)
+static core_sql_writer_t *core_sql_writer(const char *key)
 {
-	void *pop = NULL;
-	uint32_t iterations = 0;
-	uint8_t trans = 0;
-	uint32_t target = 20000;
-	switch_size_t len = 0, sql_len = runtime.sql_buffer_len;
-	char *tmp, *sqlbuf = (char *) malloc(sql_len);
-	char *sql = NULL, *save_sql = NULL;
-	switch_size_t newlen;
-	int lc = 0, wrote = 0, do_sleep = 1;
-	uint32_t sanity = 120;
-	int auto_pause = 0;
-
-	switch_assert(sqlbuf);
-
-	while (!sql_manager.event_db) {
-		if (switch_core_db_handle(&sql_manager.event_db) == SWITCH_STATUS_SUCCESS && sql_manager.event_db)
-			break;
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Error getting core db, Retrying\n");
-		switch_yield(500000);
-		sanity--;
+	switch_ssize_t len = -1;
+	void *val;
+
+	if (sql_manager.writer_count < 2 || zstr(key)) {
+		return &sql_manager.writers[0];
 	}
 
-	if (!sql_manager.event_db) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error getting core db Disabling core sql functionality\n");
-		return NULL;
+	switch_mutex_lock(sql_manager.pin_mutex);
+	val = switch_core_hash_find(sql_manager.pins, key);
+	switch_mutex_unlock(sql_manager.pin_mutex);
+
+	if (val) {
+		return (core_sql_writer_t *) val;
 	}
 
-	sql_manager.thread_running = 1;
+	return &sql_manager.writers[switch_ci_hashfunc_default(key, &len) % sql_manager.writer_count];
+}
 
-	switch_mutex_lock(sql_manager.cond_mutex);
+static void core_sql_push(core_sql_writer_t *writer, core_sql_t *item)
+{
+	uint32_t depth;
 
-	switch (sql_manager.event_db->type) {
-		case SCDB_TYPE_ODBC:
-			break;
-		case SCDB_TYPE_CORE_DB:
-			{
-				switch_cache_db_execute_sql(sql_manager.event_db, "PRAGMA synchronous=OFF;", NULL);
-				switch_cache_db_execute_sql(sql_manager.event_db, "PRAGMA count_changes=OFF;", NULL);
-				switch_cache_db_execute_sql(sql_manager.event_db, "PRAGMA temp_store=MEMORY;", NULL);
-				switch_cache_db_execute_sql(sql_manager.event_db, "PRAGMA journal_mode=OFF;", NULL);
-			}
-			break;
+	switch_atomic_inc(&writer->queued);
+	switch_queue_push(writer->queue, item);
+
+	if ((depth = switch_queue_size(writer->queue)) > writer->max_depth) {
+		writer->max_depth = depth;
 	}
+}
 
-	while (sql_manager.thread_running == 1) {
-		if (save_sql || switch_queue_trypop(sql_manager.sql_queue[0], &pop) == SWITCH_STATUS_SUCCESS ||
-			switch_queue_trypop(sql_manager.sql_queue[1], &pop) == SWITCH_STATUS_SUCCESS) {
+/* queue a prepared statement, key picks the writer and the values are copied so callers can pass event headers */
+static void core_sql_queue(const char *key, core_sql_stmt_t stmt, ...)
+{
+	int argc = sql_manager.stmt_argc[stmt], i;
+	const char *argv[32];
+	switch_size_t len = 0, vlen;
+	core_sql_t *item;
+	char *p;
+	va_list ap;
 
-			if (save_sql) {
-				sql = save_sql;
-				save_sql = NULL;
-			} else if ((sql = (char *) pop)) {
-				pop = NULL;
-			}
-			
-			if (sql) {
-				newlen = strlen(sql) + 2;
+	switch_assert(argc <= 32);
 
-				if (iterations == 0) {
-					trans = 1;
-				}
+	va_start(ap, stmt);
+	for (i = 0; i < argc; i++) {
+		argv[i] = va_arg(ap, const char *);
+		if (!argv[i]) {
+			argv[i] = "";
+		}
+		len += strlen(argv[i]) + 1;
+	}
+	va_end(ap);
 
-				if (len + newlen + 1 > sql_len) {
-					int new_mlen = len + newlen + 10240;
-					
-					if (new_mlen < runtime.max_sql_buffer_len) {
-						sql_len = new_mlen;
-						if (switch_test_flag((&runtime), SCF_DEBUG_SQL)) {
-							switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, 
-											  "REALLOC %ld %d %d\n", (long int)sql_len, switch_queue_size(sql_manager.sql_queue[0]), 
-											  switch_queue_size(sql_manager.sql_queue[1]));
-						}
-						if (!(tmp = realloc(sqlbuf, sql_len))) {
-							switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "SQL thread ending on mem err\n");
-							abort();
-							break;
-						}
-						sqlbuf = tmp;
-					} else {
-						if (switch_test_flag((&runtime), SCF_DEBUG_SQL)) {
-							switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, 
-											  "SAVE %d %d\n", switch_queue_size(sql_manager.sql_queue[0]), switch_queue_size(sql_manager.sql_queue[1]));
-						}
-						save_sql = sql;
-						sql = NULL;
-						lc = 0;
-						goto skip;
-					}
-				}
+	if (registry.enabled && core_registry_apply(stmt, argv)) {
+		return;
+	}
 
-				iterations++;				
-				sprintf(sqlbuf + len, "%s;\n", sql);
-				len += newlen;
-				free(sql);
-				sql = NULL;
-			} else {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "SQL thread ending\n");
-				break;
-			}
-		}
+	item = malloc(sizeof(*item) + sizeof(char *) * argc + len);
+	switch_assert(item);
+	item->stmt = stmt;
+	item->argc = argc;
+	item->argv = (char **) (item + 1);
+	item->sql = NULL;
+	item->len = len;
 
-		lc = switch_queue_size(sql_manager.sql_queue[0]) + switch_queue_size(sql_manager.sql_queue[1]);
+	p = (char *) (item->argv + argc);
+	for (i = 0; i < argc; i++) {
+		vlen = strlen(argv[i]) + 1;
+		memcpy(p, argv[i], vlen);
+		item->argv[i] = p;
+		p += vlen;
+	}
 
+	core_sql_push(core_sql_writer(key), item);
+}
 
-		if (lc > SWITCH_SQL_QUEUE_PAUSE_LEN) {
-			if (!auto_pause) {
-				auto_pause = 1;
-				switch_core_session_ctl(SCSC_PAUSE_INBOUND, &auto_pause);
-				auto_pause = 1;
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SQL Queue overflowing [%d], Pausing calls.\n", lc);
-			}
-		} else {
-			if (auto_pause && lc < 1000) {
-				auto_pause = 0;
-				switch_core_session_ctl(SCSC_PAUSE_INBOUND, &auto_pause);
-				auto_pause = 0;
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SQL Queue back to normal size, resuming..\n");
-			}
-		}
+/* queue free form sql, takes ownership of the string */
+static void core_sql_queue_raw(const char *key, char *sql)
+{
+	core_sql_t *item;
 
-	skip:
-		
-		wrote = 0;
+	switch_zmalloc(item, sizeof(*item));
+	item->stmt = CORE_SQL_RAW;
+	item->sql = sql;
+	item->len = strlen(sql);
 
-		if (trans && iterations && (iterations > target || !lc)) {
-			if (switch_test_flag((&runtime), SCF_DEBUG_SQL)) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, 
-								  "RUN %d %d %d\n", switch_queue_size(sql_manager.sql_queue[0]), switch_queue_size(sql_manager.sql_queue[1]), iterations);
-			}
-			if (switch_cache_db_persistant_execute_trans(sql_manager.event_db, sqlbuf, 1) != SWITCH_STATUS_SUCCESS) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "SQL thread unable to commit transaction, records lost!\n");
-			}
-			if (switch_test_flag((&runtime), SCF_DEBUG_SQL)) { 
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "DONE\n");
-			}
+	core_sql_push(core_sql_writer(key), item);
+}
 
+static void core_sql_free(core_sql_t *item)
+{
+	if (item->stmt == CORE_SQL_RAW) {
+		free(item->sql);
+	}
+	free(item);
+}
 
-			iterations = 0;
-			trans = 0;
-			len = 0;
-			*sqlbuf = '\0';
-			lc = 0;
-			if (do_sleep) {
-				switch_yield(200000);
-			} else {
-				switch_yield(1000);
-			}
-			wrote = 1;
-		}
+/* the text form of a statement for handles that cannot bind values */
+static char *core_sql_expand(core_sql_t *item)
+{
+	const char *t = CORE_SQL_STMTS[item->stmt], *v;
+	switch_size_t len = strlen(t) + 1;
+	char *sql, *p;
+	int i;
 
-		lc = switch_queue_size(sql_manager.sql_queue[0]) + switch_queue_size(sql_manager.sql_queue[1]);
-		
-		if (!lc) {
-			switch_thread_cond_wait(sql_manager.cond, sql_manager.cond_mutex);
-		} else if (wrote) {
-			if (lc > 2000) {
-				do_sleep = 0;
-			} else {
-				do_sleep = 1;
+	for (i = 0; i < item->argc; i++) {
+		len += strlen(item->argv[i]) * 2 + 2;
+	}
+
+	sql = malloc(len);
+	switch_assert(sql);
+
+	for (p = sql, i = 0; *t; t++) {
+		if (*t == '?' && i < item->argc) {
+			*p++ = '\'';
+			for (v = item->argv[i++]; *v; v++) {
+				if (*v == '\'') {
+					*p++ = '\'';
+				}
+				*p++ = *v;
 			}
+			*p++ = '\'';
+		} else {
+			*p++ = *t;
 		}
-		
-		
 	}
+	*p = '\0';
+
+	return sql;
+}
+
+/* the sqlite result of one statement, never waits on a busy database */
+static int core_sql_step(core_sql_writer_t *writer, core_sql_t *item)
+{
+	switch_core_db_t *db = writer->dbh->native_handle.core_db_dbh;
+	switch_core_db_stmt_t *stmt;
+	int i, ret;
 
-	switch_mutex_unlock(sql_manager.cond_mutex);
+	if (item->stmt == CORE_SQL_RAW) {
+		char *errmsg = NULL;
 
-	while (switch_queue_trypop(sql_manager.sql_queue[0], &pop) == SWITCH_STATUS_SUCCESS) {
-		free(pop);
+		if ((ret = switch_core_db_exec(db, item->sql, NULL, NULL, &errmsg)) != SWITCH_CORE_DB_OK && ret != SWITCH_CORE_DB_BUSY && ret != SWITCH_CORE_DB_LOCKED) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SQL ERR [%s]\n%s\n", switch_str_nil(errmsg), item->sql);
+		}
+		switch_core_db_free(errmsg);
+		return ret;
 	}
 
-	while (switch_queue_trypop(sql_manager.sql_queue[1], &pop) == SWITCH_STATUS_SUCCESS) {
-		free(pop);
+	if (!(stmt = writer->stmts[item->stmt])) {
+		if ((ret = switch_core_db_prepare(db, CORE_SQL_STMTS[item->stmt], -1, &writer->stmts[item->stmt], NULL)) != SWITCH_CORE_DB_OK) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SQL ERR [%s]\n%s\n", switch_core_db_errmsg(db), CORE_SQL_STMTS[item->stmt]);
+			return ret;
+		}
+		stmt = writer->stmts[item->stmt];
 	}
 
-	free(sqlbuf);
+	for (i = 0; i < item->argc; i++) {
+		switch_core_db_bind_text(stmt, i + 1, item->argv[i], -1, SWITCH_CORE_DB_STATIC);
+	}
 
-	sql_manager.thread_running = 0;
+	if ((ret = switch_core_db_step(stmt)) == SWITCH_CORE_DB_DONE) {
+		ret = SWITCH_CORE_DB_OK;
+	} else if (ret != SWITCH_CORE_DB_BUSY && ret != SWITCH_CORE_DB_LOCKED) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "SQL ERR [%s]\n%s\n", switch_core_db_errmsg(db), CORE_SQL_STMTS[item->stmt]);
+	}
 
-	switch_cache_db_release_db_handle(&sql_manager.event_db);
+	switch_core_db_reset(stmt);
 
-	return NULL;
+	return ret;
 }
 
-static char *parse_presence_data_cols(switch_event_t *event)
+static int core_sql_exec(core_sql_writer_t *writer, const char *sql)
 {
-	char *cols[25] = { 0 };
+	return switch_core_db_exec(writer->dbh->native_handle.core_db_dbh, sql, NULL, NULL, NULL);
+}
+
+/*
+ * One transaction per batch.  A busy database rolls the batch back and retries it after a backoff taken
+ * without the io mutex, a statement that fails on its own is rolled back with its batch, logged once and
+ * left out of the retry.
+ */
+static void core_sql_commit_core_db(core_sql_writer_t *writer, core_sql_t **batch, uint32_t count)
+{
+	switch_mutex_t *io_mutex = writer->dbh->io_mutex;
+	switch_interval_time_t backoff = 10000;
+	switch_time_t give_up = switch_time_now() + 30000000;
+	uint32_t i, lost = 0;
+	int ret, stmt_failed;
+
+	for (;;) {
+		stmt_failed = 0;
+
+		if (io_mutex) switch_mutex_lock(io_mutex);
+
+		if ((ret = core_sql_exec(writer, "BEGIN")) == SWITCH_CORE_DB_OK) {
+			for (i = 0; i < count; i++) {
+				if (batch[i]->failed) {
+					continue;
+				}
+				if ((ret = core_sql_step(writer, batch[i])) != SWITCH_CORE_DB_OK) {
+					if (ret != SWITCH_CORE_DB_BUSY && ret != SWITCH_CORE_DB_LOCKED) {
+						batch[i]->failed = 1;
+						stmt_failed = 1;
+						writer->errors++;
+					}
+					break;
+				}
+			}
+
+			if (ret == SWITCH_CORE_DB_OK) {
+				ret = core_sql_exec(writer, "COMMIT");
+			}
+
+			if (ret != SWITCH_CORE_DB_OK) {
+				core_sql_exec(writer, "ROLLBACK");
+			}
+		}
+
+		if (io_mutex) switch_mutex_unlock(io_mutex);
+
+		if (ret == SWITCH_CORE_DB_OK) {
+			break;
+		}
+
+		if (ret == SWITCH_CORE_DB_BUSY || ret == SWITCH_CORE_DB_LOCKED) {
+			if (switch_time_now() > give_up) {
+				break;
+			}
+			switch_yield(backoff);
+			if (backoff < 1000000) {
+				backoff *= 2;
+			}
+		} else if (!stmt_failed) {
+			/* BEGIN or COMMIT itself failed for something other than a busy database */
+			break;
+		}
+	}
+
+	if (ret != SWITCH_CORE_DB_OK) {
+		for (i = 0; i < count; i++) {
+			lost += !batch[i]->failed;
+		}
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "SQL writer %u unable to commit transaction [%s], %u records lost!\n",
+						  writer->id, switch_core_db_errmsg(writer->dbh->native_handle.core_db_dbh), lost);
+		writer->errors++;
+	}
+}
+
+static void core_sql_commit(core_sql_writer_t *writer, core_sql_t **batch, uint32_t count)
+{
+	switch_time_t start = switch_time_now(), latency;
+	uint32_t i;
+
+	if (switch_test_flag((&runtime), SCF_DEBUG_SQL)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "RUN writer %u %u %d\n", writer->id, count, switch_queue_size(writer->queue));
+	}
+
+	if (writer->dbh->type == SCDB_TYPE_CORE_DB) {
+		core_sql_commit_core_db(writer, batch, count);
+	} else {
+		switch_stream_handle_t stream = { 0 };
+		char *sql;
+
+		SWITCH_STANDARD_STREAM(stream);
+
+		for (i = 0; i < count; i++) {
+			sql = batch[i]->stmt == CORE_SQL_RAW ? batch[i]->sql : core_sql_expand(batch[i]);
+			stream.write_function(&stream, "%s;\n", sql);
+			if (sql != batch[i]->sql) {
+				free(sql);
+			}
+		}
+
+		if (switch_cache_db_persistant_execute_trans(writer->dbh, (char *) stream.data, 1) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "SQL thread unable to commit transaction, records lost!\n");
+			writer->errors++;
+		}
+
+		free(stream.data);
+	}
+
+	for (i = 0; i < count; i++) {
+		core_sql_free(batch[i]);
+		batch[i] = NULL;
+	}
+
+	latency = switch_time_now() - start;
+	writer->last_latency = latency;
+	writer->total_latency += latency;
+	if (latency > writer->max_latency) {
+		writer->max_latency = latency;
+	}
+	if (count > writer->max_batch) {
+		writer->max_batch = count;
+	}
+	writer->batches++;
+	switch_atomic_add(&writer->committed, count);
+
+	if (switch_test_flag((&runtime), SCF_DEBUG_SQL)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "DONE writer %u %ldus\n", writer->id, (long) latency);
+	}
+}
+
+static void *SWITCH_THREAD_FUNC switch_core_sql_thread(switch_thread_t *thread, void *obj)
+{
+	core_sql_writer_t *writer = (core_sql_writer_t *) obj;
+	core_sql_t **batch;
+	void *pop = NULL;
+	uint32_t count = 0, sanity = 120, i;
+	switch_size_t bytes = 0;
+	switch_time_t started = 0, now, wait;
+	switch_interval_time_t batch_time = (switch_interval_time_t) runtime.sql_batch_ms * 1000;
+	int auto_pause = 0, lc;
+
+	while (!writer->dbh) {
+		if (switch_core_db_handle(&writer->dbh) == SWITCH_STATUS_SUCCESS && writer->dbh)
+			break;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Error getting core db, Retrying\n");
+		switch_yield(500000);
+		if (!--sanity) {
+			break;
+		}
+	}
+
+	if (!writer->dbh) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Error getting core db Disabling core sql functionality\n");
+		return NULL;
+	}
+
+	batch = malloc(sizeof(*batch) * SWITCH_SQL_BATCH_MAX);
+	switch_assert(batch);
+
+	switch (writer->dbh->type) {
+		case SCDB_TYPE_ODBC:
+			break;
+		case SCDB_TYPE_CORE_DB:
+			{
+				switch_cache_db_execute_sql(writer->dbh, "PRAGMA synchronous=OFF;", NULL);
+				switch_cache_db_execute_sql(writer->dbh, "PRAGMA count_changes=OFF;", NULL);
+				switch_cache_db_execute_sql(writer->dbh, "PRAGMA temp_store=MEMORY;", NULL);
+				switch_cache_db_execute_sql(writer->dbh, "PRAGMA journal_mode=OFF;", NULL);
+			}
+			break;
+	}
+
+	writer->running = 1;
+
+	while (writer->running == 1) {
+		/* sleep until the next statement or until the open batch is due */
+		wait = 1000000;
+		if (count) {
+			wait = started + batch_time - switch_time_now();
+		}
+
+		if (wait > 0 && switch_queue_pop_timeout(writer->queue, &pop, wait) == SWITCH_STATUS_SUCCESS) {
+			do {
+				if (!pop) {
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "SQL writer %u ending\n", writer->id);
+					writer->running = 0;
+					break;
+				}
+
+				if (!count) {
+					started = switch_time_now();
+				}
+				batch[count++] = (core_sql_t *) pop;
+				bytes += ((core_sql_t *) pop)->len;
+				pop = NULL;
+			} while (count < SWITCH_SQL_BATCH_MAX && bytes < (switch_size_t) runtime.max_sql_buffer_len &&
+					 switch_queue_trypop(writer->queue, &pop) == SWITCH_STATUS_SUCCESS);
+		}
+
+		lc = switch_queue_size(writer->queue);
+
+		if (writer->id == 0) {
+			for (i = 1; i < sql_manager.writer_count; i++) {
+				lc += switch_queue_size(sql_manager.writers[i].queue);
+			}
+
+			if (lc > SWITCH_SQL_QUEUE_PAUSE_LEN) {
+				if (!auto_pause) {
+					auto_pause = 1;
+					switch_core_session_ctl(SCSC_PAUSE_INBOUND, &auto_pause);
+					auto_pause = 1;
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SQL Queue overflowing [%d], Pausing calls.\n", lc);
+				}
+			} else {
+				if (auto_pause && lc < 1000) {
+					auto_pause = 0;
+					switch_core_session_ctl(SCSC_PAUSE_INBOUND, &auto_pause);
+					auto_pause = 0;
+					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "SQL Queue back to normal size, resuming..\n");
+				}
+			}
+		}
+
+		if (!count) {
+			continue;
+		}
+
+		now = switch_time_now();
+
+		/* commit when the batch is full, old enough, someone is waiting on it or we are on the way out */
+		if (count >= SWITCH_SQL_BATCH_MAX || bytes >= (switch_size_t) runtime.max_sql_buffer_len || now - started >= batch_time ||
+			sql_manager.sync_waiters || writer->running != 1) {
+			core_sql_commit(writer, batch, count);
+			count = 0;
+			bytes = 0;
+		}
+	}
+
+	if (count) {
+		core_sql_commit(writer, batch, count);
+	}
+
+	while (switch_queue_trypop(writer->queue, &pop) == SWITCH_STATUS_SUCCESS) {
+		if (pop) {
+			core_sql_free((core_sql_t *) pop);
+		}
+	}
+
+	free(batch);
+
+	for (i = 0; i < CORE_SQL_STMT_MAX; i++) {
+		if (writer->stmts[i]) {
+			switch_core_db_finalize(writer->stmts[i]);
+			writer->stmts[i] = NULL;
+		}
+	}
+
+	writer->running = 0;
+
+	switch_cache_db_release_db_handle(&writer->dbh);
+
+	return NULL;
+}
+
+static char *parse_presence_data_cols(switch_event_t *event)
+{
+	char *cols[25] = { 0 };
 	int col_count = 0;
 	char *data_copy;
 	switch_stream_handle_t stream = { 0 };
@@ -1182,14 +2027,27 @@ static char *parse_presence_data_cols(switch_event_t *event)
 }
 
 
-#define MAX_SQL 5
-#define new_sql() switch_assert(sql_idx+1 < MAX_SQL); sql[sql_idx++]
+static void core_presence_data_cols(const char *uuid, switch_event_t *event)
+{
+	char *extra_cols;
+
+	if (zstr(uuid) || zstr(switch_event_get_header(event, "presence-data-cols"))) {
+		return;
+	}
+
+	if (registry.enabled) {
+		core_registry_presence_cols(uuid, event);
+	} else if ((extra_cols = parse_presence_data_cols(event))) {
+		core_sql_queue_raw(uuid, switch_mprintf("update channels set %s where uuid='%q'", extra_cols, uuid));
+		free(extra_cols);
+	}
+}
+
 
 static void core_event_handler(switch_event_t *event)
 {
-	char *sql[MAX_SQL] = { 0 };
-	int sql_idx = 0;
-	char *extra_cols;
+	const char *uuid = switch_event_get_header(event, "unique-id");
+	char epoch[32];
 
 	switch_assert(event);
 
@@ -1200,18 +2058,15 @@ static void core_event_handler(switch_event_t *event)
 			const char *manager = switch_event_get_header(event, "task-sql_manager");
 
 			if (id) {
-				new_sql() = switch_mprintf("insert into tasks values(%q,'%q','%q',%q, '%q')",
-										   id,
-										   switch_event_get_header_nil(event, "task-desc"),
-										   switch_event_get_header_nil(event, "task-group"), manager ? manager : "0", switch_core_get_switchname()
-										   );
+				core_sql_queue(NULL, CORE_SQL_TASK_ADD, id,
+							   switch_event_get_header_nil(event, "task-desc"),
+							   switch_event_get_header_nil(event, "task-group"), manager ? manager : "0", switch_core_get_switchname());
 			}
 		}
 		break;
 	case SWITCH_EVENT_DEL_SCHEDULE:
 	case SWITCH_EVENT_EXE_SCHEDULE:
-		new_sql() = switch_mprintf("delete from tasks where task_id=%q and hostname='%q'",
-								   switch_event_get_header_nil(event, "task-id"), switch_core_get_switchname());
+		core_sql_queue(NULL, CORE_SQL_TASK_DEL, switch_event_get_header_nil(event, "task-id"), switch_core_get_switchname());
 		break;
 	case SWITCH_EVENT_RE_SCHEDULE:
 		{
@@ -1219,119 +2074,104 @@ static void core_event_handler(switch_event_t *event)
 			const char *manager = switch_event_get_header(event, "task-sql_manager");
 
 			if (id) {
-				new_sql() = switch_mprintf("update tasks set task_desc='%q',task_group='%q', task_sql_manager=%q where task_id=%q and hostname='%q'",
-										   switch_event_get_header_nil(event, "task-desc"),
-										   switch_event_get_header_nil(event, "task-group"), manager ? manager : "0", id,
-										   switch_core_get_switchname());
+				core_sql_queue(NULL, CORE_SQL_TASK_UPDATE,
+							   switch_event_get_header_nil(event, "task-desc"),
+							   switch_event_get_header_nil(event, "task-group"), manager ? manager : "0", id,
+							   switch_core_get_switchname());
 			}
 		}
 		break;
 	case SWITCH_EVENT_CHANNEL_DESTROY:
 		{
-			const char *uuid = switch_event_get_header(event, "unique-id");
-			
 			if (uuid) {
-				new_sql() = switch_mprintf("delete from channels where uuid='%q'",
-										   uuid);
-
-				new_sql() = switch_mprintf("delete from calls where (caller_uuid='%q' or callee_uuid='%q')",
-										   uuid, uuid);
+				core_sql_queue(uuid, CORE_SQL_CHANNEL_DEL, uuid);
+				core_sql_queue(switch_event_get_header(event, "channel-call-uuid"), CORE_SQL_CALL_DEL, uuid, uuid);
 
+				if (sql_manager.writer_count > 1) {
+					switch_mutex_lock(sql_manager.pin_mutex);
+					switch_core_hash_delete(sql_manager.pins, uuid);
+					switch_mutex_unlock(sql_manager.pin_mutex);
+				}
 			}
 		}
 		break;
 	case SWITCH_EVENT_CHANNEL_UUID:
 		{
-			new_sql() = switch_mprintf("update channels set uuid='%q' where uuid='%q'",
-									   switch_event_get_header_nil(event, "unique-id"),
-									   switch_event_get_header_nil(event, "old-unique-id")
-									   );
-
-			new_sql() = switch_mprintf("update channels set call_uuid='%q' where call_uuid='%q'",
-									   switch_event_get_header_nil(event, "unique-id"),
-									   switch_event_get_header_nil(event, "old-unique-id")
-									   );
+			const char *old_uuid = switch_event_get_header_nil(event, "old-unique-id");
+			core_sql_writer_t *writer = core_sql_writer(old_uuid);
+
+			/* keep the renamed channel on the writer that already holds its pending rows */
+			if (uuid && sql_manager.writer_count > 1) {
+				switch_mutex_lock(sql_manager.pin_mutex);
+				switch_core_hash_insert(sql_manager.pins, uuid, writer);
+				switch_core_hash_delete(sql_manager.pins, old_uuid);
+				switch_mutex_unlock(sql_manager.pin_mutex);
+			}
+
+			core_sql_queue(uuid, CORE_SQL_CHANNEL_UUID, switch_str_nil(uuid), old_uuid);
+			core_sql_queue(uuid, CORE_SQL_CHANNEL_CALL_UUID_RENAME, switch_str_nil(uuid), old_uuid);
 			break;
 		}
 	case SWITCH_EVENT_CHANNEL_CREATE:
-		new_sql() = switch_mprintf("insert into channels (uuid,direction,created,created_epoch, name,state,callstate,dialplan,context,hostname) "
-								   "values('%q','%q','%q','%ld','%q','%q','%q','%q','%q','%q')",
-								   switch_event_get_header_nil(event, "unique-id"),
-								   switch_event_get_header_nil(event, "call-direction"),
-								   switch_event_get_header_nil(event, "event-date-local"),
-								   (long) switch_epoch_time_now(NULL),
-								   switch_event_get_header_nil(event, "channel-name"),
-								   switch_event_get_header_nil(event, "channel-state"),
-								   switch_event_get_header_nil(event, "channel-call-state"),
-								   switch_event_get_header_nil(event, "caller-dialplan"),
-								   switch_event_get_header_nil(event, "caller-context"), switch_core_get_switchname()
-								   );
+		switch_snprintf(epoch, sizeof(epoch), "%ld", (long) switch_epoch_time_now(NULL));
+		core_sql_queue(uuid, CORE_SQL_CHANNEL_ADD,
+					   switch_event_get_header_nil(event, "unique-id"),
+					   switch_event_get_header_nil(event, "call-direction"),
+					   switch_event_get_header_nil(event, "event-date-local"),
+					   epoch,
+					   switch_event_get_header_nil(event, "channel-name"),
+					   switch_event_get_header_nil(event, "channel-state"),
+					   switch_event_get_header_nil(event, "channel-call-state"),
+					   switch_event_get_header_nil(event, "caller-dialplan"),
+					   switch_event_get_header_nil(event, "caller-context"), switch_core_get_switchname());
 		break;
 	case SWITCH_EVENT_CODEC:
-
-		new_sql() =
-			switch_mprintf
-			("update channels set read_codec='%q',read_rate='%q',read_bit_rate='%q',write_codec='%q',write_rate='%q',write_bit_rate='%q' where uuid='%q'",
-			 switch_event_get_header_nil(event, "channel-read-codec-name"),
-			 switch_event_get_header_nil(event, "channel-read-codec-rate"),
-			 switch_event_get_header_nil(event, "channel-read-codec-bit-rate"),
-			 switch_event_get_header_nil(event, "channel-write-codec-name"),
-			 switch_event_get_header_nil(event, "channel-write-codec-rate"),
-			 switch_event_get_header_nil(event, "channel-write-codec-bit-rate"),
-			 switch_event_get_header_nil(event, "unique-id"));
+		core_sql_queue(uuid, CORE_SQL_CHANNEL_CODEC,
+					   switch_event_get_header_nil(event, "channel-read-codec-name"),
+					   switch_event_get_header_nil(event, "channel-read-codec-rate"),
+					   switch_event_get_header_nil(event, "channel-read-codec-bit-rate"),
+					   switch_event_get_header_nil(event, "channel-write-codec-name"),
+					   switch_event_get_header_nil(event, "channel-write-codec-rate"),
+					   switch_event_get_header_nil(event, "channel-write-codec-bit-rate"),
+					   switch_event_get_header_nil(event, "unique-id"));
 		break;
 	case SWITCH_EVENT_CHANNEL_HOLD:
 	case SWITCH_EVENT_CHANNEL_UNHOLD:
 	case SWITCH_EVENT_CHANNEL_EXECUTE: {
 		
-		new_sql() = switch_mprintf("update channels set application='%q',application_data='%q',"
-								   "presence_id='%q',presence_data='%q' where uuid='%q'",
-								   switch_event_get_header_nil(event, "application"),
-								   switch_event_get_header_nil(event, "application-data"),
-								   switch_event_get_header_nil(event, "channel-presence-id"),
-								   switch_event_get_header_nil(event, "channel-presence-data"),
-								   switch_event_get_header_nil(event, "unique-id")
-								   );
+		core_sql_queue(uuid, CORE_SQL_CHANNEL_APPLICATION,
+					   switch_event_get_header_nil(event, "application"),
+					   switch_event_get_header_nil(event, "application-data"),
+					   switch_event_get_header_nil(event, "channel-presence-id"),
+					   switch_event_get_header_nil(event, "channel-presence-data"),
+					   switch_event_get_header_nil(event, "unique-id"));
 
 	}
 		break;
 
 	case SWITCH_EVENT_CHANNEL_ORIGINATE:
 		{
-			if ((extra_cols = parse_presence_data_cols(event))) {
-				new_sql() = switch_mprintf("update channels set "
-										   "presence_id='%q',presence_data='%q', call_uuid='%q',%s where uuid='%q'",
-										   switch_event_get_header_nil(event, "channel-presence-id"),
-										   switch_event_get_header_nil(event, "channel-presence-data"),
-										   switch_event_get_header_nil(event, "channel-call-uuid"),
-										   extra_cols,
-										   switch_event_get_header_nil(event, "unique-id"));
-				free(extra_cols);
-			} else {
-				new_sql() = switch_mprintf("update channels set "
-										   "presence_id='%q',presence_data='%q', call_uuid='%q' where uuid='%q'",
-										   switch_event_get_header_nil(event, "channel-presence-id"),
-										   switch_event_get_header_nil(event, "channel-presence-data"),
-										   switch_event_get_header_nil(event, "channel-call-uuid"),
-										   switch_event_get_header_nil(event, "unique-id"));
-			}
+			core_sql_queue(uuid, CORE_SQL_CHANNEL_ORIGINATE,
+						   switch_event_get_header_nil(event, "channel-presence-id"),
+						   switch_event_get_header_nil(event, "channel-presence-data"),
+						   switch_event_get_header_nil(event, "channel-call-uuid"),
+						   switch_event_get_header_nil(event, "unique-id"));
 
+			core_presence_data_cols(uuid, event);
 		}
 
 		break;
 	case SWITCH_EVENT_CALL_UPDATE:
 		{
-			new_sql() = switch_mprintf("update channels set callee_name='%q',callee_num='%q',sent_callee_name='%q',sent_callee_num='%q',callee_direction='%q',"
-									   "cid_name='%q',cid_num='%q' where uuid='%s'",
-									   switch_event_get_header_nil(event, "caller-callee-id-name"),
-									   switch_event_get_header_nil(event, "caller-callee-id-number"),
-									   switch_event_get_header_nil(event, "sent-callee-id-name"),
-									   switch_event_get_header_nil(event, "sent-callee-id-number"),
-									   switch_event_get_header_nil(event, "direction"),
-									   switch_event_get_header_nil(event, "caller-caller-id-name"),
-									   switch_event_get_header_nil(event, "caller-caller-id-number"),
-									   switch_event_get_header_nil(event, "unique-id")
-									   );
+			core_sql_queue(uuid, CORE_SQL_CHANNEL_CALLEE,
+						   switch_event_get_header_nil(event, "caller-callee-id-name"),
+						   switch_event_get_header_nil(event, "caller-callee-id-number"),
+						   switch_event_get_header_nil(event, "sent-callee-id-name"),
+						   switch_event_get_header_nil(event, "sent-callee-id-number"),
+						   switch_event_get_header_nil(event, "direction"),
+						   switch_event_get_header_nil(event, "caller-caller-id-name"),
+						   switch_event_get_header_nil(event, "caller-caller-id-number"),
+						   switch_event_get_header_nil(event, "unique-id"));
 		}
 		break;
 	case SWITCH_EVENT_CHANNEL_CALLSTATE:
@@ -1344,17 +2184,11 @@ static void core_event_handler(switch_event_t *event)
 			}
 
 			if (callstate != CCS_DOWN && callstate != CCS_HANGUP) {
-				if ((extra_cols = parse_presence_data_cols(event))) {
-					new_sql() = switch_mprintf("update channels set callstate='%q',%s where uuid='%q'",
-											   switch_event_get_header_nil(event, "channel-call-state"),
-											   extra_cols,
-											   switch_event_get_header_nil(event, "unique-id"));
-					free(extra_cols);
-				} else {
-					new_sql() = switch_mprintf("update channels set callstate='%q' where uuid='%q'",
-											   switch_event_get_header_nil(event, "channel-call-state"),
-											   switch_event_get_header_nil(event, "unique-id"));
-				}
+				core_sql_queue(uuid, CORE_SQL_CHANNEL_CALLSTATE,
+							   switch_event_get_header_nil(event, "channel-call-state"),
+							   switch_event_get_header_nil(event, "unique-id"));
+
+				core_presence_data_cols(uuid, event);
 			}
 
 		}
@@ -1375,52 +2209,28 @@ static void core_event_handler(switch_event_t *event)
 			case CS_REPORTING:
 				break;
 			case CS_ROUTING:
-				if ((extra_cols = parse_presence_data_cols(event))) {
-					new_sql() = switch_mprintf("update channels set state='%s',cid_name='%q',cid_num='%q',callee_name='%q',callee_num='%q',"
-											   "sent_callee_name='%q',sent_callee_num='%q',"
-											   "ip_addr='%s',dest='%q',dialplan='%q',context='%q',presence_id='%q',presence_data='%q',%s "
-											   "where uuid='%s'",
-											   switch_event_get_header_nil(event, "channel-state"),
-											   switch_event_get_header_nil(event, "caller-caller-id-name"),
-											   switch_event_get_header_nil(event, "caller-caller-id-number"),
-											   switch_event_get_header_nil(event, "caller-callee-id-name"),
-											   switch_event_get_header_nil(event, "caller-callee-id-number"),
-											   switch_event_get_header_nil(event, "sent-callee-id-name"),
-											   switch_event_get_header_nil(event, "sent-callee-id-number"),
-											   switch_event_get_header_nil(event, "caller-network-addr"),
-											   switch_event_get_header_nil(event, "caller-destination-number"),
-											   switch_event_get_header_nil(event, "caller-dialplan"),
-											   switch_event_get_header_nil(event, "caller-context"),
-											   switch_event_get_header_nil(event, "channel-presence-id"),
-											   switch_event_get_header_nil(event, "channel-presence-data"),
-											   extra_cols,
-											   switch_event_get_header_nil(event, "unique-id"));
-					free(extra_cols);
-				} else {
-					new_sql() = switch_mprintf("update channels set state='%s',cid_name='%q',cid_num='%q',callee_name='%q',callee_num='%q',"
-											   "sent_callee_name='%q',sent_callee_num='%q',"
-											   "ip_addr='%s',dest='%q',dialplan='%q',context='%q',presence_id='%q',presence_data='%q' "
-											   "where uuid='%s'",
-											   switch_event_get_header_nil(event, "channel-state"),
-											   switch_event_get_header_nil(event, "caller-caller-id-name"),
-											   switch_event_get_header_nil(event, "caller-caller-id-number"),
-											   switch_event_get_header_nil(event, "caller-callee-id-name"),
-											   switch_event_get_header_nil(event, "caller-callee-id-number"),
-											   switch_event_get_header_nil(event, "sent-callee-id-name"),
-											   switch_event_get_header_nil(event, "sent-callee-id-number"),
-											   switch_event_get_header_nil(event, "caller-network-addr"),
-											   switch_event_get_header_nil(event, "caller-destination-number"),
-											   switch_event_get_header_nil(event, "caller-dialplan"),
-											   switch_event_get_header_nil(event, "caller-context"),
-											   switch_event_get_header_nil(event, "channel-presence-id"),
-											   switch_event_get_header_nil(event, "channel-presence-data"),
-											   switch_event_get_header_nil(event, "unique-id"));
-				}
+				core_sql_queue(uuid, CORE_SQL_CHANNEL_ROUTING,
+							   switch_event_get_header_nil(event, "channel-state"),
+							   switch_event_get_header_nil(event, "caller-caller-id-name"),
+							   switch_event_get_header_nil(event, "caller-caller-id-number"),
+							   switch_event_get_header_nil(event, "caller-callee-id-name"),
+							   switch_event_get_header_nil(event, "caller-callee-id-number"),
+							   switch_event_get_header_nil(event, "sent-callee-id-name"),
+							   switch_event_get_header_nil(event, "sent-callee-id-number"),
+							   switch_event_get_header_nil(event, "caller-network-addr"),
+							   switch_event_get_header_nil(event, "caller-destination-number"),
+							   switch_event_get_header_nil(event, "caller-dialplan"),
+							   switch_event_get_header_nil(event, "caller-context"),
+							   switch_event_get_header_nil(event, "channel-presence-id"),
+							   switch_event_get_header_nil(event, "channel-presence-data"),
+							   switch_event_get_header_nil(event, "unique-id"));
+
+				core_presence_data_cols(uuid, event);
 				break;
 			default:
-				new_sql() = switch_mprintf("update channels set state='%s' where uuid='%s'",
-										   switch_event_get_header_nil(event, "channel-state"),
-										   switch_event_get_header_nil(event, "unique-id"));
+				core_sql_queue(uuid, CORE_SQL_CHANNEL_STATE,
+							   switch_event_get_header_nil(event, "channel-state"),
+							   switch_event_get_header_nil(event, "unique-id"));
 				break;
 			}
 
@@ -1430,61 +2240,52 @@ static void core_event_handler(switch_event_t *event)
 		}
 	case SWITCH_EVENT_CHANNEL_BRIDGE:
 		{
-			const char *a_uuid, *b_uuid, *uuid;
+			const char *a_uuid, *b_uuid;
+			const char *call_uuid = switch_event_get_header_nil(event, "channel-call-uuid");
 
 			a_uuid = switch_event_get_header(event, "Bridge-A-Unique-ID");
 			b_uuid = switch_event_get_header(event, "Bridge-B-Unique-ID");
-			uuid = switch_event_get_header(event, "unique-id");
 
 			if (zstr(a_uuid) || zstr(b_uuid)) {
 				a_uuid = switch_event_get_header_nil(event, "caller-unique-id");
 				b_uuid = switch_event_get_header_nil(event, "other-leg-unique-id");
 			}
 
-			if (uuid && (extra_cols = parse_presence_data_cols(event))) {
-				new_sql() = switch_mprintf("update channels set %s where uuid='%s'", extra_cols, uuid);
-				free(extra_cols);
-			} 
+			core_presence_data_cols(uuid, event);
 
-			new_sql() = switch_mprintf("update channels set call_uuid='%q' where uuid='%s' or uuid='%s'",
-										   switch_event_get_header_nil(event, "channel-call-uuid"), a_uuid, b_uuid);
-			
+			/* one statement per leg so each lands on the writer that owns that leg */
+			core_sql_queue(a_uuid, CORE_SQL_CHANNEL_CALL_UUID, call_uuid, a_uuid);
+			core_sql_queue(b_uuid, CORE_SQL_CHANNEL_CALL_UUID, call_uuid, b_uuid);
 
-			new_sql() = switch_mprintf("insert into calls (call_uuid,call_created,call_created_epoch,"
-									   "caller_uuid,callee_uuid,hostname) "
-									   "values ('%s','%s','%ld','%q','%q','%q')",
-									   switch_event_get_header_nil(event, "channel-call-uuid"),
-									   switch_event_get_header_nil(event, "event-date-local"),
-									   (long) switch_epoch_time_now(NULL),
-									   a_uuid,
-									   b_uuid,
-									   switch_core_get_switchname()
-									   );
+			/* rows of the calls table go by call uuid so adds and deletes of one call share a writer */
+			switch_snprintf(epoch, sizeof(epoch), "%ld", (long) switch_epoch_time_now(NULL));
+			core_sql_queue(call_uuid, CORE_SQL_CALL_ADD,
+						   call_uuid,
+						   switch_event_get_header_nil(event, "event-date-local"),
+						   epoch,
+						   a_uuid,
+						   b_uuid,
+						   switch_core_get_switchname());
 		}
 		break;
 	case SWITCH_EVENT_CHANNEL_UNBRIDGE:
 		{
 			char *cuuid = switch_event_get_header_nil(event, "caller-unique-id");
-			char *uuid = switch_event_get_header(event, "unique-id");
+			const char *call_uuid = switch_event_get_header_nil(event, "channel-call-uuid");
 
-			if (uuid && (extra_cols = parse_presence_data_cols(event))) {
-				new_sql() = switch_mprintf("update channels set %s where uuid='%s'", extra_cols, uuid);
-				free(extra_cols);
-			} 
+			core_presence_data_cols(uuid, event);
 
-			new_sql() = switch_mprintf("update channels set call_uuid=uuid where call_uuid='%s'",
-									   switch_event_get_header_nil(event, "channel-call-uuid"));
-			
-			new_sql() = switch_mprintf("delete from calls where (caller_uuid='%q' or callee_uuid='%q')",
-									   cuuid, cuuid);
+			core_sql_queue(call_uuid, CORE_SQL_CHANNEL_UNBRIDGE, call_uuid);
+			core_sql_queue(call_uuid, CORE_SQL_CALL_DEL, cuuid, cuuid);
 			break;
 		}
 	case SWITCH_EVENT_SHUTDOWN:
-		new_sql() = switch_mprintf("delete from channels where hostname='%q';"
-								   "delete from interfaces where hostname='%q';"
-								   "delete from calls where hostname='%q'",
-								   switch_core_get_switchname(), switch_core_get_switchname(), switch_core_get_switchname()
-								   );
+		core_sql_queue_raw(NULL, switch_mprintf("delete from %schannels where hostname='%q';"
+												"delete from interfaces where hostname='%q';"
+												"delete from %scalls where hostname='%q'",
+												registry.prefix, switch_core_get_switchname(), switch_core_get_switchname(),
+												registry.prefix, switch_core_get_switchname()
+												));
 		break;
 	case SWITCH_EVENT_LOG:
 		return;
@@ -1497,12 +2298,9 @@ static void core_event_handler(switch_event_t *event)
 			const char *key = switch_event_get_header_nil(event, "key");
 			const char *filename = switch_event_get_header_nil(event, "filename");
 			if (!zstr(type) && !zstr(name)) {
-				new_sql() =
-					switch_mprintf
-					("insert into interfaces (type,name,description,syntax,ikey,filename,hostname) values('%q','%q','%q','%q','%q','%q','%q')", type, name,
-					 switch_str_nil(description), switch_str_nil(syntax), switch_str_nil(key), switch_str_nil(filename),
-					 switch_core_get_switchname()
-					 );
+				core_sql_queue(NULL, CORE_SQL_INTERFACE_ADD, type, name,
+							   switch_str_nil(description), switch_str_nil(syntax), switch_str_nil(key), switch_str_nil(filename),
+							   switch_core_get_switchname());
 			}
 			break;
 		}
@@ -1511,21 +2309,19 @@ static void core_event_handler(switch_event_t *event)
 			const char *type = switch_event_get_header_nil(event, "type");
 			const char *name = switch_event_get_header_nil(event, "name");
 			if (!zstr(type) && !zstr(name)) {
-				new_sql() = switch_mprintf("delete from interfaces where type='%q' and name='%q' and hostname='%q'", type, name,
-										   switch_core_get_switchname());
+				core_sql_queue(NULL, CORE_SQL_INTERFACE_DEL, type, name, switch_core_get_switchname());
 			}
 			break;
 		}
 	case SWITCH_EVENT_CALL_SECURE:
 		{
 			const char *type = switch_event_get_header_nil(event, "secure_type");
+			const char *cuuid = switch_event_get_header_nil(event, "caller-unique-id");
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Secure Type: %s\n", type);
 			if (zstr(type)) {
 				break;
 			}
-			new_sql() = switch_mprintf("update channels set secure='%s' where uuid='%s'",
-									   type, switch_event_get_header_nil(event, "caller-unique-id")
-									   );
+			core_sql_queue(cuuid, CORE_SQL_CHANNEL_SECURE, type, cuuid);
 			break;
 		}
 	case SWITCH_EVENT_NAT:
@@ -1533,14 +2329,13 @@ static void core_event_handler(switch_event_t *event)
 			const char *op = switch_event_get_header_nil(event, "op");
 			switch_bool_t sticky = switch_true(switch_event_get_header_nil(event, "sticky"));
 			if (!strcmp("add", op)) {
-				new_sql() = switch_mprintf("insert into nat (port, proto, sticky, hostname) values (%s, %s, %d,'%q')",
-										   switch_event_get_header_nil(event, "port"),
-										   switch_event_get_header_nil(event, "proto"), sticky, switch_core_get_switchname()
-										   );
+				core_sql_queue(NULL, CORE_SQL_NAT_ADD,
+							   switch_event_get_header_nil(event, "port"),
+							   switch_event_get_header_nil(event, "proto"), sticky ? "1" : "0", switch_core_get_switchname());
 			} else if (!strcmp("del", op)) {
-				new_sql() = switch_mprintf("delete from nat where port=%s and proto=%s and hostname='%q'",
-										   switch_event_get_header_nil(event, "port"),
-										   switch_event_get_header_nil(event, "proto"), switch_core_get_switchname());
+				core_sql_queue(NULL, CORE_SQL_NAT_DEL,
+							   switch_event_get_header_nil(event, "port"),
+							   switch_event_get_header_nil(event, "proto"), switch_core_get_switchname());
 			} else if (!strcmp("status", op)) {
 				/* call show nat api */
 			} else if (!strcmp("status_response", op)) {
@@ -1553,21 +2348,6 @@ static void core_event_handler(switch_event_t *event)
 	default:
 		break;
 	}
-
-	if (sql_idx) {
-		int i = 0;
-		
-
-		for (i = 0; i < sql_idx; i++) {
-			if (switch_stristr("update channels", sql[i]) || switch_stristr("delete from channels", sql[i])) {
-				switch_queue_push(sql_manager.sql_queue[1], sql[i]);
-			} else {
-				switch_queue_push(sql_manager.sql_queue[0], sql[i]);
-			}
-			sql[i] = NULL;
-			wake_thread(0);
-		}
-	}
 }
 
 
@@ -1812,37 +2592,29 @@ static char basic_calls_sql[] =
 SWITCH_DECLARE(switch_status_t) switch_core_add_registration(const char *user, const char *realm, const char *token, const char *url, uint32_t expires, 
 															 const char *network_ip, const char *network_port, const char *network_proto)
 {
-	char *sql;
+	char exp[32];
 
 	if (!switch_test_flag((&runtime), SCF_USE_SQL)) {
 		return SWITCH_STATUS_FALSE;
 	}
 
 	if (runtime.multiple_registrations) {
-		sql = switch_mprintf("delete from registrations where hostname='%q' and (url='%q' or token='%q')", 
-							 switch_core_get_switchname(), url, switch_str_nil(token));
+		core_sql_queue(NULL, CORE_SQL_REG_DEL_URL, switch_core_get_switchname(), url, switch_str_nil(token));
 	} else {
-		sql = switch_mprintf("delete from registrations where reg_user='%q' and realm='%q' and hostname='%q'", 
-							 user, realm, switch_core_get_switchname());
-	}
-
-	switch_queue_push(sql_manager.sql_queue[0], sql);
-	
-	sql = switch_mprintf("insert into registrations (reg_user,realm,token,url,expires,network_ip,network_port,network_proto,hostname) "
-						 "values ('%q','%q','%q','%q',%ld,'%q','%q','%q','%q')",
-						 switch_str_nil(user),
-						 switch_str_nil(realm),
-						 switch_str_nil(token),
-						 switch_str_nil(url),
-						 expires,
-						 switch_str_nil(network_ip),
-						 switch_str_nil(network_port),
-						 switch_str_nil(network_proto),
-						 switch_core_get_switchname()
-						 );
-
-	
-	switch_queue_push(sql_manager.sql_queue[0], sql);
+		core_sql_queue(NULL, CORE_SQL_REG_DEL_USER, user, realm, switch_core_get_switchname());
+	}
+
+	switch_snprintf(exp, sizeof(exp), "%ld", (long) expires);
+	core_sql_queue(NULL, CORE_SQL_REG_ADD,
+				   switch_str_nil(user),
+				   switch_str_nil(realm),
+				   switch_str_nil(token),
+				   switch_str_nil(url),
+				   exp,
+				   switch_str_nil(network_ip),
+				   switch_str_nil(network_port),
+				   switch_str_nil(network_proto),
+				   switch_core_get_switchname());
 	
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -1850,61 +2622,476 @@ SWITCH_DECLARE(switch_status_t) switch_core_add_registration(const char *user, c
 SWITCH_DECLARE(switch_status_t) switch_core_del_registration(const char *user, const char *realm, const char *token)
 {
 
-	char *sql;
-
 	if (!switch_test_flag((&runtime), SCF_USE_SQL)) {
 		return SWITCH_STATUS_FALSE;
 	}
 
 	if (!zstr(token) && runtime.multiple_registrations) {
-		sql = switch_mprintf("delete from registrations where reg_user='%q' and realm='%q' and hostname='%q' and token='%q'", user, realm, switch_core_get_switchname(), token);
+		core_sql_queue(NULL, CORE_SQL_REG_DEL_TOKEN, user, realm, switch_core_get_switchname(), token);
 	} else {
-		sql = switch_mprintf("delete from registrations where reg_user='%q' and realm='%q' and hostname='%q'", user, realm, switch_core_get_switchname());
+		core_sql_queue(NULL, CORE_SQL_REG_DEL_USER, user, realm, switch_core_get_switchname());
 	}
 
-	switch_queue_push(sql_manager.sql_queue[0], sql);
-
 	return SWITCH_STATUS_SUCCESS;
 }
 
 SWITCH_DECLARE(switch_status_t) switch_core_expire_registration(int force)
 {
-	
-	char *sql;
-	time_t now;
+	char now[32];
 
 	if (!switch_test_flag((&runtime), SCF_USE_SQL)) {
 		return SWITCH_STATUS_FALSE;
 	}
 
-	now = switch_epoch_time_now(NULL);
-
 	if (force) {
-		sql = switch_mprintf("delete from registrations where hostname='%q'", switch_core_get_switchname());
+		core_sql_queue(NULL, CORE_SQL_REG_EXPIRE_ALL, switch_core_get_switchname());
 	} else {
-		sql = switch_mprintf("delete from registrations where expires > 0 and expires <= %ld and hostname='%q'", now, switch_core_get_switchname());
+		switch_snprintf(now, sizeof(now), "%ld", (long) switch_epoch_time_now(NULL));
+		core_sql_queue(NULL, CORE_SQL_REG_EXPIRE, now, switch_core_get_switchname());
 	}
 
-	switch_queue_push(sql_manager.sql_queue[0], sql);
-
 	return SWITCH_STATUS_SUCCESS;
 
 }
 
+SWITCH_DECLARE(switch_status_t) switch_core_sqldb_sync(uint32_t timeout_ms)
+{
+	switch_atomic_t target[SWITCH_SQL_MAX_WRITERS];
+	switch_time_t expires = switch_time_now() + (switch_time_t) timeout_ms * 1000;
+	switch_status_t status = SWITCH_STATUS_SUCCESS;
+	uint32_t i;
+
+	if (!sql_manager.manage || !sql_manager.writer_count) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	for (i = 0; i < sql_manager.writer_count; i++) {
+		target[i] = switch_atomic_read(&sql_manager.writers[i].queued);
+	}
+
+	switch_atomic_inc(&sql_manager.sync_waiters);
+
+	for (i = 0; i < sql_manager.writer_count; i++) {
+		core_sql_writer_t *writer = &sql_manager.writers[i];
+
+		while (writer->running == 1 && (int32_t) (switch_atomic_read(&writer->committed) - target[i]) < 0) {
+			if (switch_time_now() > expires) {
+				status = SWITCH_STATUS_TIMEOUT;
+				goto done;
+			}
+			switch_yield(1000);
+		}
+	}
+
+  done:
+
+	switch_atomic_dec(&sql_manager.sync_waiters);
+
+	return status;
+}
+
+/* the core_registry module serves the channels and calls tables straight from the registry */
+
+typedef struct {
+	sqlite3_vtab base;
+	switch_bool_t calls;
+} core_registry_vtab_t;
+
+typedef struct {
+	sqlite3_vtab_cursor base;
+	/*! copies of the matching rows, each one allocation holding the column pointers and values */
+	char ***rows;
+	int count;
+	int size;
+	int pos;
+} core_registry_cursor_t;
+
+static int core_registry_vtab_connect(sqlite3 *db, void *aux, int argc, const char *const *argv, sqlite3_vtab **vtab, char **err)
+{
+	core_registry_vtab_t *table;
+	switch_bool_t calls = (argc > 3 && !strcasecmp(argv[3], "calls"));
+
+	if (sqlite3_declare_vtab(db, calls ? create_calls_sql : create_channels_sql) != SQLITE_OK) {
+		return SQLITE_ERROR;
+	}
+
+	if (!(table = sqlite3_malloc(sizeof(*table)))) {
+		return SQLITE_NOMEM;
+	}
+	memset(table, 0, sizeof(*table));
+	table->calls = calls;
+	*vtab = &table->base;
+
+	return SQLITE_OK;
+}
+
+static int core_registry_vtab_disconnect(sqlite3_vtab *vtab)
+{
+	sqlite3_free(vtab);
+	return SQLITE_OK;
+}
+
+/* uuid = ? on channels is a single stripe lookup, everything else is a scan */
+static int core_registry_vtab_best_index(sqlite3_vtab *vtab, sqlite3_index_info *info)
+{
+	core_registry_vtab_t *table = (core_registry_vtab_t *) vtab;
+	int i;
+
+	info->idxNum = 0;
+	info->estimatedCost = 1000000;
+
+	if (table->calls) {
+		return SQLITE_OK;
+	}
+
+	for (i = 0; i < info->nConstraint; i++) {
+		if (info->aConstraint[i].usable && info->aConstraint[i].iColumn == CH_UUID && info->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_EQ) {
+			info->aConstraintUsage[i].argvIndex = 1;
+			info->aConstraintUsage[i].omit = 1;
+			info->idxNum = 1;
+			info->estimatedCost = 1;
+			break;
+		}
+	}
+
+	return SQLITE_OK;
+}
+
+static int core_registry_vtab_open(sqlite3_vtab *vtab, sqlite3_vtab_cursor **cursor)
+{
+	core_registry_cursor_t *cur;
+
+	if (!(cur = sqlite3_malloc(sizeof(*cur)))) {
+		return SQLITE_NOMEM;
+	}
+	memset(cur, 0, sizeof(*cur));
+	*cursor = &cur->base;
+
+	return SQLITE_OK;
+}
+
+static void core_registry_cursor_reset(core_registry_cursor_t *cur)
+{
+	int i;
+
+	for (i = 0; i < cur->count; i++) {
+		free(cur->rows[i]);
+	}
+	cur->count = 0;
+	cur->pos = 0;
+}
+
+static int core_registry_vtab_close(sqlite3_vtab_cursor *cursor)
+{
+	core_registry_cursor_t *cur = (core_registry_cursor_t *) cursor;
+
+	core_registry_cursor_reset(cur);
+	switch_safe_free(cur->rows);
+	sqlite3_free(cur);
+
+	return SQLITE_OK;
+}
+
+static void core_registry_cursor_add(core_registry_cursor_t *cur, char **cols, int ncols)
+{
+	switch_size_t len = 0;
+	char **copy, *p;
+	int i;
+
+	for (i = 0; i < ncols; i++) {
+		if (cols[i]) {
+			len += strlen(cols[i]) + 1;
+		}
+	}
+
+	if (cur->count == cur->size) {
+		cur->size = cur->size ? cur->size * 2 : 64;
+		cur->rows = realloc(cur->rows, sizeof(char **) * cur->size);
+		switch_assert(cur->rows);
+	}
+
+	copy = malloc(sizeof(char *) * ncols + len);
+	switch_assert(copy);
+	p = (char *) (copy + ncols);
+
+	for (i = 0; i < ncols; i++) {
+		if (cols[i]) {
+			len = strlen(cols[i]) + 1;
+			memcpy(p, cols[i], len);
+			copy[i] = p;
+			p += len;
+		} else {
+			copy[i] = NULL;
+		}
+	}
+
+	cur->rows[cur->count++] = copy;
+}
+
+static void core_registry_cursor_fill(core_registry_cursor_t *cur, core_registry_stripe_t *stripe, switch_bool_t calls, const char *uuid)
+{
+	switch_hash_index_t *hi;
+	core_registry_row_t *row;
+	const void *var;
+	void *val;
+
+	switch_mutex_lock(stripe->mutex);
+	if (uuid) {
+		if ((row = switch_core_hash_find(stripe->rows, uuid))) {
+			core_registry_cursor_add(cur, row->col, CH_COL_MAX);
+		}
+	} else {
+		for (hi = switch_hash_first(NULL, stripe->rows); hi; hi = switch_hash_next(hi)) {
+			switch_hash_this(hi, &var, NULL, &val);
+			row = (core_registry_row_t *) val;
+
+			if (!calls) {
+				core_registry_cursor_add(cur, row->col, CH_COL_MAX);
+			} else if (row->call[CALL_CALLER_UUID]) {
+				core_registry_cursor_add(cur, row->call, CALL_COL_MAX);
+			}
+		}
+	}
+	switch_mutex_unlock(stripe->mutex);
+}
+
+static int core_registry_vtab_filter(sqlite3_vtab_cursor *cursor, int idx_num, const char *idx_str, int argc, sqlite3_value **argv)
+{
+	core_registry_cursor_t *cur = (core_registry_cursor_t *) cursor;
+	core_registry_vtab_t *table = (core_registry_vtab_t *) cursor->pVtab;
+	int i;
+
+	core_registry_cursor_reset(cur);
+
+	if (idx_num == 1 && argc == 1) {
+		const char *uuid = (const char *) sqlite3_value_text(argv[0]);
+
+		if (uuid) {
+			core_registry_cursor_fill(cur, core_registry_stripe(uuid), SWITCH_FALSE, uuid);
+		}
+	} else {
+		for (i = 0; i < CORE_REGISTRY_STRIPES; i++) {
+			core_registry_cursor_fill(cur, &registry.stripes[i], table->calls, NULL);
+		}
+	}
+
+	return SQLITE_OK;
+}
+
+static int core_registry_vtab_next(sqlite3_vtab_cursor *cursor)
+{
+	((core_registry_cursor_t *) cursor)->pos++;
+	return SQLITE_OK;
+}
+
+static int core_registry_vtab_eof(sqlite3_vtab_cursor *cursor)
+{
+	core_registry_cursor_t *cur = (core_registry_cursor_t *) cursor;
+
+	return cur->pos >= cur->count;
+}
+
+static int core_registry_vtab_column(sqlite3_vtab_cursor *cursor, sqlite3_context *ctx, int i)
+{
+	core_registry_cursor_t *cur = (core_registry_cursor_t *) cursor;
+	core_registry_vtab_t *table = (core_registry_vtab_t *) cursor->pVtab;
+	const char *val = cur->rows[cur->pos][i];
+
+	if (!val) {
+		sqlite3_result_null(ctx);
+	} else if ((table->calls ? i == CALL_CREATED_EPOCH : i == CH_CREATED_EPOCH) && switch_is_number(val)) {
+		/* INTEGER columns in the real tables */
+		sqlite3_result_int64(ctx, strtoll(val, NULL, 10));
+	} else {
+		sqlite3_result_text(ctx, val, -1, SQLITE_TRANSIENT);
+	}
+
+	return SQLITE_OK;
+}
+
+static int core_registry_vtab_rowid(sqlite3_vtab_cursor *cursor, sqlite_int64 *rowid)
+{
+	*rowid = ((core_registry_cursor_t *) cursor)->pos;
+	return SQLITE_OK;
+}
+
+static sqlite3_module core_registry_module = {
+	0,
+	core_registry_vtab_connect,
+	core_registry_vtab_connect,
+	core_registry_vtab_best_index,
+	core_registry_vtab_disconnect,
+	core_registry_vtab_disconnect,
+	core_registry_vtab_open,
+	core_registry_vtab_close,
+	core_registry_vtab_filter,
+	core_registry_vtab_next,
+	core_registry_vtab_eof,
+	core_registry_vtab_column,
+	core_registry_vtab_rowid,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL
+};
+
+/* temp tables shadow main ones for unqualified names, so existing queries and views read the registry */
+static void core_registry_attach(switch_cache_db_handle_t *dbh)
+{
+	sqlite3 *db = dbh->native_handle.core_db_dbh;
+
+	switch_set_flag(dbh, CDF_REGISTRY);
+
+	if (sqlite3_create_module(db, "core_registry", &core_registry_module, NULL) != SQLITE_OK ||
+		sqlite3_exec(db, "CREATE VIRTUAL TABLE temp.channels USING core_registry(channels);"
+					 "CREATE VIRTUAL TABLE temp.calls USING core_registry(calls)", NULL, NULL, NULL) != SQLITE_OK) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot attach the channel registry [%s]\n", sqlite3_errmsg(db));
+	}
+}
+
+static void core_registry_snapshot_rows(switch_stream_handle_t *stream, switch_bool_t calls)
+{
+	const char **names = calls ? CORE_CALL_COLS : CORE_CHANNEL_COLS;
+	int ncols = calls ? CALL_COL_MAX : CH_COL_MAX;
+	core_registry_cursor_t cur = { { 0 } };
+	int i, j;
+
+	for (i = 0; i < CORE_REGISTRY_STRIPES; i++) {
+		core_registry_cursor_fill(&cur, &registry.stripes[i], calls, NULL);
+	}
+
+	for (i = 0; i < cur.count; i++) {
+		stream->write_function(stream, "insert into %s%s (", registry.prefix, calls ? "calls" : "channels");
+		for (j = 0; j < ncols; j++) {
+			stream->write_function(stream, j ? ",%s" : "%s", names[j]);
+		}
+		stream->write_function(stream, ") values (");
+		for (j = 0; j < ncols; j++) {
+			if (cur.rows[i][j]) {
+				stream->write_function(stream, j ? ",'%q'" : "'%q'", cur.rows[i][j]);
+			} else {
+				stream->write_function(stream, j ? ",NULL" : "NULL");
+			}
+		}
+		stream->write_function(stream, ");\n");
+	}
+
+	core_registry_cursor_reset(&cur);
+	switch_safe_free(cur.rows);
+}
+
+/* replace the persisted channels and calls rows of this host in one transaction */
+static void core_registry_snapshot(void)
+{
+	switch_stream_handle_t stream = { 0 };
+	const char *hostname = switch_core_get_switchname();
+
+	SWITCH_STANDARD_STREAM(stream);
+
+	stream.write_function(&stream, "delete from %schannels where hostname='%q';\n", registry.prefix, hostname);
+	stream.write_function(&stream, "delete from %scalls where hostname='%q';\n", registry.prefix, hostname);
+	core_registry_snapshot_rows(&stream, SWITCH_FALSE);
+	core_registry_snapshot_rows(&stream, SWITCH_TRUE);
+
+	core_sql_queue_raw(NULL, (char *) stream.data);
+}
+
+static void *SWITCH_THREAD_FUNC core_registry_snapshot_thread(switch_thread_t *thread, void *obj)
+{
+	switch_atomic_t version = 0, last = 0;
+	uint32_t ticks = 0;
+
+	registry.snapshot_running = 1;
+
+	while (registry.snapshot_running == 1) {
+		switch_yield(100000);
+
+		if (++ticks < registry.snapshot_sec * 10) {
+			continue;
+		}
+		ticks = 0;
+
+		if ((version = switch_atomic_read(&registry.version)) != last) {
+			last = version;
+			core_registry_snapshot();
+		}
+	}
+
+	registry.snapshot_running = 0;
+
+	return NULL;
+}
+
+static void core_registry_destroy(void)
+{
+	switch_hash_index_t *hi;
+	const void *var;
+	void *val;
+	int i;
+
+	for (i = 0; i < CORE_REGISTRY_STRIPES; i++) {
+		core_registry_stripe_t *stripe = &registry.stripes[i];
+
+		switch_mutex_lock(stripe->mutex);
+		for (hi = switch_hash_first(NULL, stripe->rows); hi; hi = switch_hash_next(hi)) {
+			switch_hash_this(hi, &var, NULL, &val);
+			core_registry_free_row((core_registry_row_t *) val);
+		}
+		for (hi = switch_hash_first(NULL, stripe->members); hi; hi = switch_hash_next(hi)) {
+			switch_hash_this(hi, &var, NULL, &val);
+			core_registry_free_members((core_registry_member_t *) val);
+		}
+		switch_core_hash_destroy(&stripe->rows);
+		switch_core_hash_init(&stripe->rows, sql_manager.memory_pool);
+		switch_core_hash_destroy(&stripe->members);
+		switch_core_hash_init(&stripe->members, sql_manager.memory_pool);
+		switch_mutex_unlock(stripe->mutex);
+	}
+}
+
 switch_status_t switch_core_sqldb_start(switch_memory_pool_t *pool, switch_bool_t manage)
 {
 	switch_threadattr_t *thd_attr;
 	switch_cache_db_handle_t *dbh;
 	uint32_t sanity = 400;
+	int i;
 
 	sql_manager.memory_pool = pool;
 	sql_manager.manage = manage;
 
 	switch_mutex_init(&sql_manager.dbh_mutex, SWITCH_MUTEX_NESTED, sql_manager.memory_pool);
 	switch_mutex_init(&sql_manager.io_mutex, SWITCH_MUTEX_NESTED, sql_manager.memory_pool);
-	switch_mutex_init(&sql_manager.cond_mutex, SWITCH_MUTEX_NESTED, sql_manager.memory_pool);
+	switch_mutex_init(&sql_manager.pin_mutex, SWITCH_MUTEX_NESTED, sql_manager.memory_pool);
+	switch_core_hash_init(&sql_manager.pins, sql_manager.memory_pool);
+
+	registry.prefix = "";
+	registry.enabled = manage && runtime.channel_registry;
+	registry.snapshot_sec = runtime.sql_snapshot_sec;
+
+	if (registry.enabled) {
+		for (i = 0; i < CORE_REGISTRY_STRIPES; i++) {
+			switch_mutex_init(&registry.stripes[i].mutex, SWITCH_MUTEX_NESTED, sql_manager.memory_pool);
+			switch_core_hash_init(&registry.stripes[i].rows, sql_manager.memory_pool);
+			switch_core_hash_init(&registry.stripes[i].members, sql_manager.memory_pool);
+		}
 
-	switch_thread_cond_create(&sql_manager.cond, sql_manager.memory_pool);
+		for (i = 0; i < (int) (sizeof(CORE_REGISTRY_UPDATES) / sizeof(CORE_REGISTRY_UPDATES[0])); i++) {
+			registry.updates[CORE_REGISTRY_UPDATES[i].stmt] = &CORE_REGISTRY_UPDATES[i];
+		}
+	}
+
+	for (i = 0; i < CORE_SQL_STMT_MAX; i++) {
+		const char *p;
+
+		sql_manager.stmt_argc[i] = 0;
+		for (p = CORE_SQL_STMTS[i]; p && *p; p++) {
+			if (*p == '?') {
+				sql_manager.stmt_argc[i]++;
+			}
+		}
+	}
 
  top:
 
@@ -2053,6 +3240,33 @@ switch_status_t switch_core_sqldb_start(switch_memory_pool_t *pool, switch_bool_
 	switch_cache_db_execute_sql(dbh, "create index eeuuindex2 on calls (call_uuid)", NULL);
 	switch_cache_db_execute_sql(dbh, "create index regindex1 on registrations (reg_user,realm,hostname)", NULL);
 
+	/* sqlite serializes writers on the file lock so extra writers only add contention */
+	sql_manager.writer_count = runtime.sql_writers;
+	if (sql_manager.writer_count < 1) {
+		sql_manager.writer_count = 1;
+	} else if (sql_manager.writer_count > SWITCH_SQL_MAX_WRITERS) {
+		sql_manager.writer_count = SWITCH_SQL_MAX_WRITERS;
+	}
+
+	if (dbh->type == SCDB_TYPE_CORE_DB && sql_manager.writer_count > 1) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING,
+						  "core-db-writers %u ignored, the core db is sqlite which takes one writer at a time; use ODBC to shard the writers\n",
+						  sql_manager.writer_count);
+		sql_manager.writer_count = 1;
+	}
+
+	if (registry.enabled) {
+		if (dbh->type == SCDB_TYPE_CORE_DB) {
+			/* the tables on disk are only written by the snapshot from here on */
+			registry.prefix = "main.";
+			registry.attach = SWITCH_TRUE;
+		} else if (!registry.snapshot_sec) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "The channel registry can only be queried through the snapshot with ODBC, "
+							  "saving it every second.\n");
+			registry.snapshot_sec = 1;
+		}
+	}
+
 
  skip:
 
@@ -2062,20 +3276,30 @@ switch_status_t switch_core_sqldb_start(switch_memory_pool_t *pool, switch_bool_
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Couldn't bind event handler!\n");
 		}
 
-		switch_queue_create(&sql_manager.sql_queue[0], SWITCH_SQL_QUEUE_LEN, sql_manager.memory_pool);
-		switch_queue_create(&sql_manager.sql_queue[1], SWITCH_SQL_QUEUE_LEN, sql_manager.memory_pool);
 	}
 
 	switch_threadattr_create(&thd_attr, sql_manager.memory_pool);
 	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 	if (sql_manager.manage) {
-		switch_thread_create(&sql_manager.thread, thd_attr, switch_core_sql_thread, NULL, sql_manager.memory_pool);
-	}
-	switch_thread_create(&sql_manager.db_thread, thd_attr, switch_core_sql_db_thread, NULL, sql_manager.memory_pool);
+		for (i = 0; i < (int) sql_manager.writer_count; i++) {
+			core_sql_writer_t *writer = &sql_manager.writers[i];
+
+			writer->id = i;
+			switch_queue_create(&writer->queue, SWITCH_SQL_QUEUE_LEN, sql_manager.memory_pool);
+			switch_thread_create(&writer->thread, thd_attr, switch_core_sql_thread, writer, sql_manager.memory_pool);
+		}
+
+		for (i = 0; i < (int) sql_manager.writer_count; i++) {
+			while (!sql_manager.writers[i].running && --sanity) {
+				switch_yield(10000);
+			}
+		}
 
-	while (sql_manager.manage && !sql_manager.thread_running && --sanity) {
-		switch_yield(10000);
+		if (registry.enabled && registry.snapshot_sec) {
+			switch_thread_create(&registry.snapshot_thread, thd_attr, core_registry_snapshot_thread, NULL, sql_manager.memory_pool);
+		}
 	}
+	switch_thread_create(&sql_manager.db_thread, thd_attr, switch_core_sql_db_thread, NULL, sql_manager.memory_pool);
 
 	if (sql_manager.manage) switch_cache_db_release_db_handle(&dbh);
 
@@ -2086,23 +3310,38 @@ void switch_core_sqldb_stop(void)
 {
 	switch_status_t st;
 
+	uint32_t i;
+
 	switch_event_unbind(&sql_manager.event_node);
 
-	if (sql_manager.thread && sql_manager.thread_running) {
+	if (registry.snapshot_thread) {
+		registry.snapshot_running = -1;
+		switch_thread_join(&st, registry.snapshot_thread);
+		registry.snapshot_thread = NULL;
+	}
 
-		if (sql_manager.manage) {
-			switch_queue_push(sql_manager.sql_queue[0], NULL);
-			switch_queue_push(sql_manager.sql_queue[1], NULL);
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG10, "Waiting for unfinished SQL transactions\n");
-			wake_thread(0);
+	if (sql_manager.manage) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG10, "Waiting for unfinished SQL transactions\n");
+
+		for (i = 0; i < sql_manager.writer_count; i++) {
+			if (sql_manager.writers[i].thread) {
+				switch_queue_push(sql_manager.writers[i].queue, NULL);
+			}
 		}
 
-		sql_manager.thread_running = -1;
-		switch_thread_join(&st, sql_manager.thread);
+		for (i = 0; i < sql_manager.writer_count; i++) {
+			if (sql_manager.writers[i].thread) {
+				switch_thread_join(&st, sql_manager.writers[i].thread);
+				sql_manager.writers[i].thread = NULL;
+			}
+		}
 	}
 
+	if (registry.enabled) {
+		core_registry_destroy();
+	}
 
-	if (sql_manager.thread && sql_manager.db_thread_running) {
+	if (sql_manager.db_thread && sql_manager.db_thread_running) {
 		sql_manager.db_thread_running = -1;
 		switch_thread_join(&st, sql_manager.db_thread);
 	}
@@ -2121,6 +3360,7 @@ SWITCH_DECLARE(void) switch_cache_db_status(switch_stream_handle_t *stream)
 	char *pos1 = NULL;
 	char *pos2 = NULL;
 	int count = 0, used = 0;
+	uint32_t i;
 
 	switch_mutex_lock(sql_manager.dbh_mutex);
 
@@ -2162,6 +3402,23 @@ SWITCH_DECLARE(void) switch_cache_db_status(switch_stream_handle_t *stream)
 	stream->write_function(stream, "%d total. %d in use.\n", count, used);
 
 	switch_mutex_unlock(sql_manager.dbh_mutex);
+
+	if (registry.enabled) {
+		stream->write_function(stream, "Channel Registry\n\tChannels: %u\n\tCalls: %u\n\tSnapshot interval: %us\n",
+							   switch_atomic_read(&registry.channels), switch_atomic_read(&registry.calls), registry.snapshot_sec);
+	}
+
+	for (i = 0; sql_manager.manage && i < sql_manager.writer_count; i++) {
+		core_sql_writer_t *writer = &sql_manager.writers[i];
+		uint32_t queued = switch_atomic_read(&writer->queued), committed = switch_atomic_read(&writer->committed);
+
+		stream->write_function(stream, "SQL Writer %u\n\tDepth: %u (max %u)\n\tCommitted: %u in %u batches (max %u)\n"
+							   "\tCommit latency: avg %" SWITCH_TIME_T_FMT "us max %" SWITCH_TIME_T_FMT "us last %" SWITCH_TIME_T_FMT "us\n"
+							   "\tErrors: %u\n",
+							   writer->id, queued - committed, writer->max_depth, committed, writer->batches, writer->max_batch,
+							   writer->batches ? writer->total_latency / writer->batches : 0, writer->max_latency, writer->last_latency,
+							   writer->errors);
+	}
 }
 
 SWITCH_DECLARE(char*)switch_sql_concat(void)
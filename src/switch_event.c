@@ -34,10 +34,35 @@
 
 #include <switch.h>
 #include <switch_event.h>
-//#define SWITCH_EVENT_RECYCLE
-#define DISPATCH_QUEUE_LEN 10000
+/* must be a power of 2 */
+#define DISPATCH_QUEUE_LEN 8192
+/* ring for SWITCH_PRIORITY_HIGH events, drained before the normal one, must be a power of 2 */
+#define DISPATCH_HIGH_QUEUE_LEN 1024
 //#define DEBUG_DISPATCH_QUEUES
 
+/*! \brief A slot in a subscriber dispatch ring */
+typedef struct {
+	/*! sequence number used to hand the slot between producers and the consumer */
+	volatile switch_atomic_t seq;
+	/*! the queued event */
+	switch_event_t * volatile event;
+	/*! when the event was queued */
+	switch_time_t queued;
+} event_ring_slot_t;
+
+/*! \brief A bounded multi-producer single-consumer ring */
+typedef struct {
+	event_ring_slot_t *slots;
+	uint32_t mask;
+	/*! next slot a producer will claim */
+	volatile switch_atomic_t head;
+	/*! next slot the dispatch thread will consume */
+	volatile switch_atomic_t tail;
+} event_ring_t;
+
+#define EVENT_RING_HIGH 0
+#define EVENT_RING_NORMAL 1
+
 /*! \brief A node to store binded events */
 struct switch_event_node {
 	/*! the id of the node */
@@ -50,6 +75,31 @@ struct switch_event_node {
 	switch_event_callback_t callback;
 	/*! private data */
 	void *user_data;
+	/*! rings feeding this subscriber, high priority events first */
+	event_ring_t rings[2];
+	/*! set while the dispatch thread is waiting on cond */
+	volatile switch_atomic_t sleeping;
+	volatile switch_atomic_t running;
+	/*! set while a full ring holds inbound calls back */
+	volatile switch_atomic_t overloaded;
+	/*! the node was unbound from its own callback, the dispatch thread frees it on the way out */
+	int self_destroy;
+	switch_thread_id_t thread_id;
+	/*! events handed to the callback */
+	volatile switch_atomic_t delivered;
+	/*! events discarded because the ring was full */
+	volatile switch_atomic_t dropped;
+	/*! high water mark of the ring */
+	uint32_t max_depth;
+	/*! queueing latency totals in microseconds */
+	switch_time_t total_latency;
+	switch_time_t max_latency;
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	switch_memory_pool_t *pool;
+	/*! link used while the node waits to be reclaimed after an unbind */
+	struct switch_event_node *reclaim_next;
 	struct switch_event_node *next;
 };
 
@@ -63,35 +113,24 @@ struct switch_event_subclass {
 	int bind;
 };
 
-#define MAX_DISPATCH_VAL 20
-static unsigned int MAX_DISPATCH = MAX_DISPATCH_VAL;
-static unsigned int SOFT_MAX_DISPATCH = 0;
 static char guess_ip_v4[80] = "";
 static char guess_ip_v6[80] = "";
 static switch_event_node_t *EVENT_NODES[SWITCH_EVENT_ALL + 1] = { NULL };
-static switch_thread_rwlock_t *RWLOCK = NULL;
+/* readers of EVENT_NODES register in the current epoch instead of taking a lock,
+   writers serialize on BLOCK and wait for the previous epoch to drain before freeing */
+static volatile switch_atomic_t NODE_EPOCH = 0;
+static volatile switch_atomic_t NODE_READERS[2] = { 0 };
 static switch_mutex_t *BLOCK = NULL;
+/* subscribers whose rings are too full, inbound calls are paused while any is */
+static volatile switch_atomic_t OVERLOADED_NODES = 0;
+static volatile switch_atomic_t DROPPED_EVENTS = 0;
 static switch_mutex_t *POOL_LOCK = NULL;
 static switch_memory_pool_t *RUNTIME_POOL = NULL;
 static switch_memory_pool_t *THRUNTIME_POOL = NULL;
-#define NUMBER_OF_QUEUES 3
-static switch_thread_t *EVENT_QUEUE_THREADS[NUMBER_OF_QUEUES] = { 0 };
-static switch_queue_t *EVENT_QUEUE[NUMBER_OF_QUEUES] = { 0 };
-static switch_thread_t *EVENT_DISPATCH_QUEUE_THREADS[MAX_DISPATCH_VAL] = { 0 };
-static uint8_t EVENT_DISPATCH_QUEUE_RUNNING[MAX_DISPATCH_VAL] = { 0 };
-static switch_queue_t *EVENT_DISPATCH_QUEUE[MAX_DISPATCH_VAL] = { 0 };
-static int POOL_COUNT_MAX = SWITCH_CORE_QUEUE_LEN;
 static switch_mutex_t *EVENT_QUEUE_MUTEX = NULL;
 static switch_hash_t *CUSTOM_HASH = NULL;
-static int THREAD_COUNT = 0;
 static int SYSTEM_RUNNING = 0;
 static uint64_t EVENT_SEQUENCE_NR = 0;
-#ifdef SWITCH_EVENT_RECYCLE
-static switch_queue_t *EVENT_RECYCLE_QUEUE = NULL;
-static switch_queue_t *EVENT_HEADER_RECYCLE_QUEUE = NULL;
-#endif
-static void launch_dispatch_threads(uint32_t max, int len, switch_memory_pool_t *pool);
-
 static char *my_dup(const char *s)
 {
 	size_t len = strlen(s) + 1;
@@ -237,151 +276,306 @@ static int switch_events_match(switch_event_t *event, switch_event_node_t *node)
 	return match;
 }
 
-static void *SWITCH_THREAD_FUNC switch_event_dispatch_thread(switch_thread_t *thread, void *obj)
+static uint32_t event_nodes_read_lock(void)
 {
-	switch_queue_t *queue = (switch_queue_t *) obj;
-	int my_id = 0;
+	uint32_t epoch;
 
-	switch_mutex_lock(EVENT_QUEUE_MUTEX);
-	THREAD_COUNT++;
+	for (;;) {
+		epoch = switch_atomic_read(&NODE_EPOCH) & 1;
+		switch_atomic_inc(&NODE_READERS[epoch]);
 
-	for (my_id = 0; my_id < NUMBER_OF_QUEUES; my_id++) {
-		if (EVENT_DISPATCH_QUEUE[my_id] == queue) {
-			break;
+		if ((switch_atomic_read(&NODE_EPOCH) & 1) == epoch) {
+			return epoch;
 		}
+
+		switch_atomic_dec(&NODE_READERS[epoch]);
 	}
+}
 
-	EVENT_DISPATCH_QUEUE_RUNNING[my_id] = 1;
-	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+static void event_nodes_read_unlock(uint32_t epoch)
+{
+	switch_atomic_dec(&NODE_READERS[epoch]);
+}
+
+/* must be called with BLOCK held after a node was unlinked, once it returns no reader can still see it */
+static void event_nodes_synchronize(void)
+{
+	uint32_t old = switch_atomic_read(&NODE_EPOCH) & 1;
+
+	switch_atomic_inc(&NODE_EPOCH);
+
+	while (switch_atomic_read(&NODE_READERS[old])) {
+		switch_cond_next();
+	}
+}
+
+static void event_ring_init(event_ring_t *ring, uint32_t len, switch_memory_pool_t *pool)
+{
+	uint32_t x;
+
+	ring->mask = len - 1;
+	ring->slots = switch_core_alloc(pool, sizeof(event_ring_slot_t) * len);
+	for (x = 0; x < len; x++) {
+		ring->slots[x].seq = x;
+	}
+}
+
+static uint32_t event_ring_depth(event_ring_t *ring)
+{
+	return switch_atomic_read(&ring->head) - switch_atomic_read(&ring->tail);
+}
+
+static switch_bool_t event_ring_push(event_ring_t *ring, switch_event_t *event)
+{
+	event_ring_slot_t *slot;
+	uint32_t pos, seq;
+	int32_t dif;
+
+	pos = switch_atomic_read(&ring->head);
 
 	for (;;) {
-		void *pop = NULL;
-		switch_event_t *event = NULL;
+		slot = &ring->slots[pos & ring->mask];
+		seq = switch_atomic_read_acquire(&slot->seq);
+		dif = (int32_t) (seq - pos);
 
-		if (!SYSTEM_RUNNING) {
-			break;
+		if (dif == 0) {
+			if (switch_atomic_cas(&ring->head, pos + 1, pos) == pos) {
+				break;
+			}
+			pos = switch_atomic_read(&ring->head);
+		} else if (dif < 0) {
+			return SWITCH_FALSE;
+		} else {
+			pos = switch_atomic_read(&ring->head);
 		}
+	}
 
-		if (switch_queue_pop(queue, &pop) != SWITCH_STATUS_SUCCESS) {
-			break;
-		}
+	slot->event = event;
+	slot->queued = switch_micro_time_now();
+	/* the slot is ours until seq moves, publish the event and its stamp with it */
+	switch_atomic_set_release(&slot->seq, pos + 1);
 
-		if (!pop) {
-			break;
-		}
+	return SWITCH_TRUE;
+}
+
+static switch_event_t *event_ring_pop(event_ring_t *ring, switch_time_t *queued)
+{
+	event_ring_slot_t *slot;
+	switch_event_t *event;
+	uint32_t pos = ring->tail;
 
-		event = (switch_event_t *) pop;
-		switch_event_deliver(&event);
+	slot = &ring->slots[pos & ring->mask];
+
+	if (switch_atomic_read_acquire(&slot->seq) != pos + 1) {
+		return NULL;
 	}
 
+	event = slot->event;
+	*queued = slot->queued;
+	slot->event = NULL;
+	switch_atomic_set_release(&slot->seq, pos + ring->mask + 1);
+	switch_atomic_set_release(&ring->tail, pos + 1);
 
-	switch_mutex_lock(EVENT_QUEUE_MUTEX);
-	EVENT_DISPATCH_QUEUE_RUNNING[my_id] = 0;
-	THREAD_COUNT--;
-	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+	return event;
+}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Dispatch Thread %d Ended.\n", my_id);
-	return NULL;
+static switch_bool_t event_ring_empty(event_ring_t *ring)
+{
+	uint32_t pos = ring->tail;
 
+	return switch_atomic_read_acquire(&ring->slots[pos & ring->mask].seq) != pos + 1 ? SWITCH_TRUE : SWITCH_FALSE;
 }
 
+/* the next event for a subscriber, high priority ones go first */
+static switch_event_t *event_node_pop(switch_event_node_t *node, switch_time_t *queued)
+{
+	switch_event_t *event;
+
+	if (!(event = event_ring_pop(&node->rings[EVENT_RING_HIGH], queued))) {
+		event = event_ring_pop(&node->rings[EVENT_RING_NORMAL], queued);
+	}
 
-static void *SWITCH_THREAD_FUNC switch_event_thread(switch_thread_t *thread, void *obj)
+	return event;
+}
+
+static switch_bool_t event_node_empty(switch_event_node_t *node)
 {
-	switch_queue_t *queue = (switch_queue_t *) obj;
-	uint32_t index = 0;
-	int my_id = 0;
-	int auto_pause = 0;
+	return event_ring_empty(&node->rings[EVENT_RING_HIGH]) && event_ring_empty(&node->rings[EVENT_RING_NORMAL]) ? SWITCH_TRUE : SWITCH_FALSE;
+}
 
-	switch_mutex_lock(EVENT_QUEUE_MUTEX);
-	THREAD_COUNT++;
-	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+static void event_node_flush(switch_event_node_t *node)
+{
+	switch_event_t *event;
+	switch_time_t queued;
 
-	for (my_id = 0; my_id < NUMBER_OF_QUEUES; my_id++) {
-		if (EVENT_QUEUE[my_id] == queue) {
-			break;
-		}
+	while ((event = event_node_pop(node, &queued))) {
+		switch_atomic_inc(&node->dropped);
+		switch_event_destroy(&event);
 	}
+}
 
-	for (;;) {
-		void *pop = NULL;
-		switch_event_t *event = NULL;
-		int loops = 0;
+/* a full ring holds inbound calls back until every overloaded subscriber caught up, like the old dispatch queues did */
+static void event_node_overload(switch_event_node_t *node)
+{
+	int arg = 1;
 
-		if (auto_pause) {
-			if (!--auto_pause) {
-				switch_core_session_ctl(SCSC_PAUSE_INBOUND, &auto_pause);
-			} else {
-				switch_cond_next();
-			}
-		}
+	if (switch_atomic_cas(&node->overloaded, 1, 0) != 0) {
+		return;
+	}
 
-		if (switch_queue_pop(queue, &pop) != SWITCH_STATUS_SUCCESS) {
-			break;
-		}
+	if (switch_atomic_read(&OVERLOADED_NODES) == 0) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Event system overloading, %s is not keeping up. Pausing inbound calls.\n", node->id);
+		switch_core_session_ctl(SCSC_PAUSE_INBOUND, &arg);
+	}
+	switch_atomic_inc(&OVERLOADED_NODES);
+}
 
-		if (!pop) {
-			break;
-		}
+static void event_node_recover(switch_event_node_t *node)
+{
+	int arg = 0;
 
-		if (!SYSTEM_RUNNING) {
-			break;
+	if (switch_atomic_cas(&node->overloaded, 0, 1) != 1) {
+		return;
+	}
+
+	if (!switch_atomic_dec(&OVERLOADED_NODES)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Event system caught up. Resuming inbound calls.\n");
+		switch_core_session_ctl(SCSC_PAUSE_INBOUND, &arg);
+	}
+}
+
+static void event_node_queue(switch_event_node_t *node, switch_event_t *event, switch_priority_t priority)
+{
+	switch_bool_t queued;
+
+	/* high priority events may spill into the normal ring, never the other way around */
+	if (!(queued = priority == SWITCH_PRIORITY_HIGH && event_ring_push(&node->rings[EVENT_RING_HIGH], event))) {
+		queued = event_ring_push(&node->rings[EVENT_RING_NORMAL], event);
+	}
+
+	if (!queued) {
+		uint32_t dropped;
+
+		switch_event_destroy(&event);
+		switch_atomic_inc(&node->dropped);
+		switch_atomic_inc(&DROPPED_EVENTS);
+		dropped = switch_atomic_read(&node->dropped);
+
+		if (dropped == 1 || !(dropped % 1000)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Event queue for %s is full! %u event(s) dropped.\n", node->id, dropped);
 		}
 
-		event = (switch_event_t *) pop;
+		event_node_overload(node);
+	}
+
+	if (switch_atomic_read(&node->sleeping)) {
+		switch_mutex_lock(node->mutex);
+		switch_thread_cond_signal(node->cond);
+		switch_mutex_unlock(node->mutex);
+	}
+}
 
-		while (event) {
+static void event_node_free(switch_event_node_t *node)
+{
+	event_node_flush(node);
+	event_node_recover(node);
+	FREE(node->subclass_name);
+	FREE(node->id);
+	switch_core_destroy_memory_pool(&node->pool);
+	FREE(node);
+}
 
+static void *SWITCH_THREAD_FUNC switch_event_dispatch_thread(switch_thread_t *thread, void *obj)
+{
+	switch_event_node_t *node = (switch_event_node_t *) obj;
 
-			if (++loops > 2) {
-				if (auto_pause) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Event system *still* overloading.\n");
-				} else {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, 
-									  "Event system overloading. Taking a 10 second break\n");
-					auto_pause = 10;
-					switch_core_session_ctl(SCSC_PAUSE_INBOUND, &auto_pause);
-				}
-				switch_yield(1000000);
-			}
+	node->thread_id = switch_thread_self();
 
-			for (index = 0; index < SOFT_MAX_DISPATCH; index++) {
-				if (switch_queue_trypush(EVENT_DISPATCH_QUEUE[index], event) == SWITCH_STATUS_SUCCESS) {
-					event = NULL;
-					break;
-				}
+	while (switch_atomic_read(&node->running)) {
+		switch_event_t *event = NULL;
+		switch_time_t queued = 0, latency;
+		uint32_t depth;
+
+		if (!(event = event_node_pop(node, &queued))) {
+			switch_mutex_lock(node->mutex);
+			switch_atomic_cas(&node->sleeping, 1, 0);
+			if (event_node_empty(node) && switch_atomic_read(&node->running)) {
+				switch_thread_cond_timedwait(node->cond, node->mutex, 100000);
 			}
+			switch_atomic_set(&node->sleeping, 0);
+			switch_mutex_unlock(node->mutex);
+			continue;
+		}
 
-			if (event) {
-				if (SOFT_MAX_DISPATCH + 1 < MAX_DISPATCH) {
-					switch_mutex_lock(EVENT_QUEUE_MUTEX);
-					launch_dispatch_threads(SOFT_MAX_DISPATCH + 1, DISPATCH_QUEUE_LEN, RUNTIME_POOL);
-					switch_mutex_unlock(EVENT_QUEUE_MUTEX);
-				} else {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Out of event dispatch threads! Slowing things down.\n");
-					switch_yield(1000000);
-				}
-			}
+		depth = event_ring_depth(&node->rings[EVENT_RING_HIGH]) + event_ring_depth(&node->rings[EVENT_RING_NORMAL]) + 1;
+		if (depth > node->max_depth) {
+			node->max_depth = depth;
+		}
+
+		/* let calls in again once the ring is back under a quarter full */
+		if (switch_atomic_read(&node->overloaded) && depth < (node->rings[EVENT_RING_NORMAL].mask + 1) / 4) {
+			event_node_recover(node);
 		}
+
+		latency = switch_micro_time_now() - queued;
+		node->total_latency += latency;
+		if (latency > node->max_latency) {
+			node->max_latency = latency;
+		}
+
+		event->bind_user_data = node->user_data;
+		node->callback(event);
+		switch_atomic_inc(&node->delivered);
+		switch_event_destroy(&event);
 	}
 
-	switch_mutex_lock(EVENT_QUEUE_MUTEX);
-	THREAD_COUNT--;
-	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+	if (node->self_destroy) {
+		event_node_free(node);
+	}
 
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Event Thread %d Ended.\n", my_id);
 	return NULL;
+}
 
+static void event_node_stop(switch_event_node_t *node)
+{
+	switch_status_t st;
+
+	if (node->thread) {
+		switch_atomic_set(&node->running, 0);
+		switch_mutex_lock(node->mutex);
+		switch_thread_cond_signal(node->cond);
+		switch_mutex_unlock(node->mutex);
+		switch_thread_join(&st, node->thread);
+		node->thread = NULL;
+	}
 }
 
+static void event_node_destroy(switch_event_node_t **node)
+{
+	switch_event_node_t *n = *node;
+
+	*node = NULL;
+
+	if (n->thread && switch_thread_equal(n->thread_id, switch_thread_self())) {
+		/* unbound from its own callback, the thread cannot join itself so it lets go of itself instead */
+		switch_thread_detach(n->thread);
+		switch_atomic_set(&n->running, 0);
+		n->self_destroy = 1;
+		return;
+	}
+
+	event_node_stop(n);
+	event_node_free(n);
+}
 
 SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event)
 {
 	switch_event_types_t e;
 	switch_event_node_t *node;
+	uint32_t epoch;
 
 	if (SYSTEM_RUNNING) {
-		switch_thread_rwlock_rdlock(RWLOCK);
+		epoch = event_nodes_read_lock();
 		for (e = (*event)->event_id;; e = SWITCH_EVENT_ALL) {
 			for (node = EVENT_NODES[e]; node; node = node->next) {
 				if (switch_events_match(*event, node)) {
@@ -394,12 +588,40 @@ SWITCH_DECLARE(void) switch_event_deliver(switch_event_t **event)
 				break;
 			}
 		}
-		switch_thread_rwlock_unlock(RWLOCK);
+		event_nodes_read_unlock(epoch);
 	}
 
 	switch_event_destroy(event);
 }
 
+SWITCH_DECLARE(void) switch_event_dispatch_status(switch_stream_handle_t *stream)
+{
+	switch_event_node_t *node;
+	int x, count = 0;
+	uint32_t dropped = 0;
+
+	switch_mutex_lock(BLOCK);
+	for (x = 0; x <= SWITCH_EVENT_ALL; x++) {
+		for (node = EVENT_NODES[x]; node; node = node->next) {
+			uint32_t delivered = switch_atomic_read(&node->delivered);
+			uint32_t depth = event_ring_depth(&node->rings[EVENT_RING_HIGH]) + event_ring_depth(&node->rings[EVENT_RING_NORMAL]);
+
+			stream->write_function(stream, "%s\n\tEvent: %s%s%s\n\tDepth: %u/%u (max %u)\n\tDelivered: %u\n\tDropped: %u\n"
+								   "\tLatency: avg %" SWITCH_TIME_T_FMT "us max %" SWITCH_TIME_T_FMT "us\n",
+								   node->id, switch_event_name(node->event_id),
+								   node->subclass_name ? " " : "", switch_str_nil(node->subclass_name),
+								   depth, node->rings[EVENT_RING_NORMAL].mask + 1, node->max_depth, delivered, switch_atomic_read(&node->dropped),
+								   delivered ? node->total_latency / delivered : 0, node->max_latency);
+			dropped += switch_atomic_read(&node->dropped);
+			count++;
+		}
+	}
+	switch_mutex_unlock(BLOCK);
+
+	stream->write_function(stream, "%d subscriber(s). %u event(s) dropped, %u since startup. %u subscriber(s) overloaded.\n",
+						   count, dropped, switch_atomic_read(&DROPPED_EVENTS), switch_atomic_read(&OVERLOADED_NODES));
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_running(void)
 {
 	return SYSTEM_RUNNING ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
@@ -439,14 +661,14 @@ SWITCH_DECLARE(switch_status_t) switch_event_free_subclass_detailed(const char *
 
 	if ((subclass = switch_core_hash_find(CUSTOM_HASH, subclass_name))) {
 		if (!strcmp(owner, subclass->owner)) {
-			switch_thread_rwlock_wrlock(RWLOCK);
+			switch_mutex_lock(BLOCK);
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Subclass reservation deleted for %s:%s\n", owner, subclass_name);
 			switch_core_hash_delete(CUSTOM_HASH, subclass_name);
 			FREE(subclass->owner);
 			FREE(subclass->name);
 			FREE(subclass);
 			status = SWITCH_STATUS_SUCCESS;
-			switch_thread_rwlock_unlock(RWLOCK);
+			switch_mutex_unlock(BLOCK);
 		} else {
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Subclass reservation %s inuse by listeners, detaching..\n", subclass_name);
 			subclass->bind = 1;
@@ -484,87 +706,40 @@ SWITCH_DECLARE(switch_status_t) switch_event_reserve_subclass_detailed(const cha
 
 SWITCH_DECLARE(void) switch_core_memory_reclaim_events(void)
 {
-#ifdef SWITCH_EVENT_RECYCLE
-
-	void *pop;
-	int size;
-	size = switch_queue_size(EVENT_RECYCLE_QUEUE);
-
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %d recycled event(s) %d bytes\n", size, (int) sizeof(switch_event_t) * size);
-	size = switch_queue_size(EVENT_HEADER_RECYCLE_QUEUE);
-	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Returning %d recycled event header(s) %d bytes\n",
-					  size, (int) sizeof(switch_event_header_t) * size);
-
-	while (switch_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		free(pop);
-	}
-	while (switch_queue_trypop(EVENT_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		free(pop);
-	}
-#else
+	/* events keep no free lists, their arenas go back to the heap when they are destroyed */
 	return;
-#endif
-
 }
 
 SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 {
 	uint32_t x = 0;
-	int last = 0;
 	switch_hash_index_t *hi;
 	const void *var;
 	void *val;
+	switch_event_node_t *node, *dead = NULL;
 
 	switch_mutex_lock(EVENT_QUEUE_MUTEX);
 	SYSTEM_RUNNING = 0;
 	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
 
-	for (x = 0; x < 3; x++) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Stopping event queue %d\n", x);
-		switch_queue_trypush(EVENT_QUEUE[x], NULL);
-		switch_queue_interrupt_all(EVENT_QUEUE[x]);
-	}
-
-	for (x = 0; x < SOFT_MAX_DISPATCH; x++) {
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Stopping dispatch queue %d\n", x);
-		switch_queue_trypush(EVENT_DISPATCH_QUEUE[x], NULL);
-		switch_queue_interrupt_all(EVENT_DISPATCH_QUEUE[x]);
-	}
-
-	while (x < 10000 && THREAD_COUNT) {
-		switch_cond_next();
-		if (THREAD_COUNT == last) {
-			x++;
+	/* unlink everything first, callbacks that bind or unbind while their thread is stopped need BLOCK */
+	switch_mutex_lock(BLOCK);
+	for (x = 0; x <= SWITCH_EVENT_ALL; x++) {
+		while ((node = EVENT_NODES[x])) {
+			EVENT_NODES[x] = node->next;
+			node->reclaim_next = dead;
+			dead = node;
 		}
-		last = THREAD_COUNT;
 	}
-
-	for (x = 0; x < SOFT_MAX_DISPATCH; x++) {
-		void *pop = NULL;
-		switch_event_t *event = NULL;
-		switch_status_t st;
-
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Stopping dispatch thread %d\n", x);
-		switch_thread_join(&st, EVENT_DISPATCH_QUEUE_THREADS[x]);
-
-		while (switch_queue_trypop(EVENT_DISPATCH_QUEUE[x], &pop) == SWITCH_STATUS_SUCCESS && pop) {
-			event = (switch_event_t *) pop;
-			switch_event_destroy(&event);
-		}
+	if (dead) {
+		event_nodes_synchronize();
 	}
+	switch_mutex_unlock(BLOCK);
 
-	for (x = 0; x < NUMBER_OF_QUEUES; x++) {
-		void *pop = NULL;
-		switch_event_t *event = NULL;
-		switch_status_t st;
-
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Stopping queue thread %d\n", x);
-		switch_thread_join(&st, EVENT_QUEUE_THREADS[x]);
-
-		while (switch_queue_trypop(EVENT_QUEUE[x], &pop) == SWITCH_STATUS_SUCCESS && pop) {
-			event = (switch_event_t *) pop;
-			switch_event_destroy(&event);
-		}
+	while ((node = dead)) {
+		dead = node->reclaim_next;
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Stopping dispatch thread for %s\n", node->id);
+		event_node_destroy(&node);
 	}
 
 	for (hi = switch_hash_first(NULL, CUSTOM_HASH); hi; hi = switch_hash_next(hi)) {
@@ -583,43 +758,8 @@ SWITCH_DECLARE(switch_status_t) switch_event_shutdown(void)
 	return SWITCH_STATUS_SUCCESS;
 }
 
-static void launch_dispatch_threads(uint32_t max, int len, switch_memory_pool_t *pool)
-{
-	switch_threadattr_t *thd_attr;
-	uint32_t index = 0;
-	int launched = 0;
-	uint32_t sanity = 200;
-
-	if (max > MAX_DISPATCH) {
-		return;
-	}
-
-	if (max < SOFT_MAX_DISPATCH) {
-		return;
-	}
-
-	for (index = SOFT_MAX_DISPATCH; index < max && index < MAX_DISPATCH; index++) {
-		if (EVENT_DISPATCH_QUEUE[index]) {
-			continue;
-		}
-		switch_queue_create(&EVENT_DISPATCH_QUEUE[index], len, pool);
-		switch_threadattr_create(&thd_attr, pool);
-		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-		switch_threadattr_priority_increase(thd_attr);
-		switch_thread_create(&EVENT_DISPATCH_QUEUE_THREADS[index], thd_attr, switch_event_dispatch_thread, EVENT_DISPATCH_QUEUE[index], pool);
-		while(--sanity && !EVENT_DISPATCH_QUEUE_RUNNING[index]) switch_yield(10000);
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Create event dispatch thread %d\n", index);
-		launched++;
-		break;
-	}
-
-	SOFT_MAX_DISPATCH = index;
-}
-
 SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 {
-	switch_threadattr_t *thd_attr;;
-
 	/* 
 	   This statement doesn't do anything commenting it out for now.
 
@@ -630,73 +770,304 @@ SWITCH_DECLARE(switch_status_t) switch_event_init(switch_memory_pool_t *pool)
 	switch_assert(pool != NULL);
 	THRUNTIME_POOL = RUNTIME_POOL = pool;
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Activate Eventing Engine.\n");
-	switch_thread_rwlock_create(&RWLOCK, RUNTIME_POOL);
 	switch_mutex_init(&BLOCK, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_mutex_init(&POOL_LOCK, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_mutex_init(&EVENT_QUEUE_MUTEX, SWITCH_MUTEX_NESTED, RUNTIME_POOL);
 	switch_core_hash_init(&CUSTOM_HASH, RUNTIME_POOL);
 
+	switch_find_local_ip(guess_ip_v4, sizeof(guess_ip_v4), NULL, AF_INET);
+	switch_find_local_ip(guess_ip_v6, sizeof(guess_ip_v6), NULL, AF_INET6);
+
 	switch_mutex_lock(EVENT_QUEUE_MUTEX);
-	SYSTEM_RUNNING = -1;
+	SYSTEM_RUNNING = 1;
 	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
 
-	switch_threadattr_create(&thd_attr, pool);
-	switch_find_local_ip(guess_ip_v4, sizeof(guess_ip_v4), NULL, AF_INET);
-	switch_find_local_ip(guess_ip_v6, sizeof(guess_ip_v6), NULL, AF_INET6);
+	return SWITCH_STATUS_SUCCESS;
+}
 
+/* header names, values and arrays are carved out of blocks owned by the event and released with it */
+#define EVENT_ARENA_SIZE 4096
+#define EVENT_ARENA_GROW 32768
+/* once this many bytes were deleted or replaced, further allocations come from the heap
+   so long lived events like channel variables do not keep growing */
+#define EVENT_ARENA_MAX_WASTE 16384
+#define EVENT_ARENA_ALIGN(len) (((len) + 7) & ~((switch_size_t) 7))
+
+typedef struct event_arena_block {
+	struct event_arena_block *next;
+	switch_size_t size;
+	switch_size_t used;
+	/*! the block shares the allocation of the event itself */
+	switch_bool_t embedded;
+} event_arena_block_t;
+
+#define EVENT_ARENA_DATA(block) ((char *) (block) + sizeof(event_arena_block_t))
+
+static switch_bool_t event_arena_spilled(switch_event_t *event)
+{
+	return event->arena_waste > EVENT_ARENA_MAX_WASTE ? SWITCH_TRUE : SWITCH_FALSE;
+}
 
-	switch_queue_create(&EVENT_QUEUE[0], POOL_COUNT_MAX + 10, THRUNTIME_POOL);
-	switch_queue_create(&EVENT_QUEUE[1], POOL_COUNT_MAX + 10, THRUNTIME_POOL);
-	switch_queue_create(&EVENT_QUEUE[2], POOL_COUNT_MAX + 10, THRUNTIME_POOL);
-#ifdef SWITCH_EVENT_RECYCLE
-	switch_queue_create(&EVENT_RECYCLE_QUEUE, 250000, THRUNTIME_POOL);
-	switch_queue_create(&EVENT_HEADER_RECYCLE_QUEUE, 250000, THRUNTIME_POOL);
-#endif
+static void event_arena_reserve(switch_event_t *event, switch_size_t len)
+{
+	event_arena_block_t *block = event->arena;
+	switch_size_t size;
+
+	if (block && block->used + len <= block->size) {
+		return;
+	}
+
+	size = block ? (block->size < EVENT_ARENA_GROW ? EVENT_ARENA_GROW : block->size * 2) : EVENT_ARENA_SIZE;
+	if (size < len) {
+		size = EVENT_ARENA_ALIGN(len);
+	}
 
-	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
-	switch_threadattr_priority_increase(thd_attr);
+	block = ALLOC(sizeof(*block) + size);
+	switch_assert(block);
+	block->size = size;
+	block->used = 0;
+	block->embedded = SWITCH_FALSE;
+	block->next = event->arena;
+	event->arena = block;
+}
+
+static void *event_alloc(switch_event_t *event, switch_size_t len)
+{
+	event_arena_block_t *block;
+	void *ptr;
 
-	launch_dispatch_threads(1, DISPATCH_QUEUE_LEN, RUNTIME_POOL);
-	switch_thread_create(&EVENT_QUEUE_THREADS[0], thd_attr, switch_event_thread, EVENT_QUEUE[0], RUNTIME_POOL);
-	switch_thread_create(&EVENT_QUEUE_THREADS[1], thd_attr, switch_event_thread, EVENT_QUEUE[1], RUNTIME_POOL);
-	switch_thread_create(&EVENT_QUEUE_THREADS[2], thd_attr, switch_event_thread, EVENT_QUEUE[2], RUNTIME_POOL);
+	len = EVENT_ARENA_ALIGN(len);
 
-	while (!THREAD_COUNT) {
-		switch_cond_next();
+	if (event_arena_spilled(event)) {
+		ptr = ALLOC(len);
+		switch_assert(ptr);
+		return ptr;
 	}
 
+	event_arena_reserve(event, len);
+	block = event->arena;
+	ptr = EVENT_ARENA_DATA(block) + block->used;
+	block->used += len;
 
-	switch_mutex_lock(EVENT_QUEUE_MUTEX);
-	SYSTEM_RUNNING = 1;
-	switch_mutex_unlock(EVENT_QUEUE_MUTEX);
+	return ptr;
+}
 
-	return SWITCH_STATUS_SUCCESS;
+static void event_free(switch_event_t *event, void *ptr, switch_size_t len)
+{
+	event_arena_block_t *block;
+
+	if (!ptr) {
+		return;
+	}
+
+	if (event_arena_spilled(event) || event->heap_strings) {
+		for (block = event->arena; block; block = block->next) {
+			if ((char *) ptr >= EVENT_ARENA_DATA(block) && (char *) ptr < EVENT_ARENA_DATA(block) + block->size) {
+				event->arena_waste += EVENT_ARENA_ALIGN(len);
+				return;
+			}
+		}
+		free(ptr);
+		return;
+	}
+
+	event->arena_waste += EVENT_ARENA_ALIGN(len);
+}
+
+static char *event_strndup(switch_event_t *event, const char *str, switch_size_t len)
+{
+	char *new = event_alloc(event, len + 1);
+
+	memcpy(new, str, len);
+	new[len] = '\0';
+
+	return new;
+}
+
+#define event_strdup(_event, _str) event_strndup(_event, _str, strlen(_str))
+
+static void event_strfree(switch_event_t *event, char *str)
+{
+	if (str) {
+		event_free(event, str, strlen(str) + 1);
+	}
+}
+
+static switch_event_t *event_new(void)
+{
+	switch_event_t *event;
+	event_arena_block_t *block;
+
+	/* the first block lives right behind the event so small events cost a single allocation */
+	event = ALLOC(sizeof(*event) + sizeof(*block) + EVENT_ARENA_SIZE);
+	switch_assert(event);
+	memset(event, 0, sizeof(*event));
+
+	block = (event_arena_block_t *) (event + 1);
+	block->next = NULL;
+	block->size = EVENT_ARENA_SIZE;
+	block->used = 0;
+	block->embedded = SWITCH_TRUE;
+	event->arena = block;
+	event->refs = 1;
+
+	return event;
+}
+
+static void event_arena_free(switch_event_t *event)
+{
+	event_arena_block_t *block, *next;
+
+	for (block = event->arena; block; block = next) {
+		next = block->next;
+		if (!block->embedded) {
+			free(block);
+		}
+	}
+	event->arena = NULL;
+}
+
+static void event_release(switch_event_t *event)
+{
+	switch_event_header_t *hp;
+	int i;
+
+	/* a count of one means nobody else can take a reference any more */
+	if (event->refs != 1 && switch_atomic_dec(&event->refs)) {
+		return;
+	}
+
+	if (event_arena_spilled(event) || event->heap_strings) {
+		for (hp = event->headers; hp; hp = hp->next) {
+			event_strfree(event, hp->name);
+			for (i = 0; i < hp->idx; i++) {
+				event_strfree(event, hp->array[i]);
+			}
+			event_free(event, hp->array, sizeof(char *) * hp->idx);
+			event_strfree(event, hp->value);
+			event_free(event, hp, sizeof(*hp));
+		}
+	}
+
+	FREE(event->body);
+	FREE(event->subclass_name);
+	FREE(event->index);
+
+	event_arena_free(event);
+
+	FREE(event);
+}
+
+/* copies every header of from verbatim, sizing the arena up front so the copy lands in one block */
+static void event_copy_headers(switch_event_t *event, switch_event_t *from)
+{
+	switch_event_header_t *hp, *header;
+	switch_size_t len = 0;
+	int i;
+
+	for (hp = from->headers; hp; hp = hp->next) {
+		len += EVENT_ARENA_ALIGN(sizeof(*hp)) + EVENT_ARENA_ALIGN(strlen(hp->name) + 1);
+		if (hp->value) {
+			len += EVENT_ARENA_ALIGN(strlen(hp->value) + 1);
+		}
+		if (hp->idx) {
+			len += EVENT_ARENA_ALIGN(sizeof(char *) * hp->idx);
+			for (i = 0; i < hp->idx; i++) {
+				len += EVENT_ARENA_ALIGN(strlen(hp->array[i]) + 1);
+			}
+		}
+	}
+
+	if (!event_arena_spilled(event)) {
+		event_arena_reserve(event, len);
+	}
+
+	for (hp = from->headers; hp; hp = hp->next) {
+		header = event_alloc(event, sizeof(*header));
+		memset(header, 0, sizeof(*header));
+		header->name = event_strdup(event, hp->name);
+		header->hash = hp->hash;
+
+		if (hp->value) {
+			header->value = event_strdup(event, hp->value);
+		}
+
+		if (hp->idx) {
+			header->array = event_alloc(event, sizeof(char *) * hp->idx);
+			for (i = 0; i < hp->idx; i++) {
+				header->array[i] = event_strdup(event, hp->array[i]);
+			}
+			header->idx = hp->idx;
+		}
+
+		if (event->last_header) {
+			event->last_header->next = header;
+		} else {
+			event->headers = header;
+		}
+		event->last_header = header;
+		event->header_count++;
+	}
+}
+
+/* a read-only view of a fired event, every subscriber gets its own so it can keep private bind data */
+static switch_event_t *event_share(switch_event_t *event)
+{
+	switch_event_t *view, *root = event->parent ? event->parent : event;
+
+	view = ALLOC(sizeof(*view));
+	switch_assert(view);
+	*view = *event;
+	view->parent = root;
+	view->refs = 1;
+	view->arena = NULL;
+	view->arena_waste = 0;
+	view->heap_strings = SWITCH_FALSE;
+	view->next = NULL;
+
+	switch_atomic_inc(&root->refs);
+
+	return view;
+}
+
+/* give a view its own copy of the shared event before anything modifies it */
+static void event_unshare(switch_event_t *event)
+{
+	switch_event_t *root = event->parent;
+
+	if (!root) {
+		return;
+	}
+
+	event->headers = event->last_header = NULL;
+	event->header_count = 0;
+	event->index = NULL;
+	event->index_size = 0;
+
+	if (event->body) {
+		event->body = DUP(event->body);
+	}
+
+	if (event->subclass_name) {
+		event->subclass_name = DUP(event->subclass_name);
+	}
+
+	event_copy_headers(event, root);
+	event->parent = NULL;
+
+	event_release(root);
 }
 
 SWITCH_DECLARE(switch_status_t) switch_event_create_subclass_detailed(const char *file, const char *func, int line,
 																	  switch_event_t **event, switch_event_types_t event_id, const char *subclass_name)
 {
-#ifdef SWITCH_EVENT_RECYCLE
-	void *pop;
-#endif
-
 	*event = NULL;
 
 	if ((event_id != SWITCH_EVENT_CLONE && event_id != SWITCH_EVENT_CUSTOM) && subclass_name) {
 		return SWITCH_STATUS_GENERR;
 	}
-#ifdef SWITCH_EVENT_RECYCLE
-	if (EVENT_RECYCLE_QUEUE && switch_queue_trypop(EVENT_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS && pop) {
-		*event = (switch_event_t *) pop;
-	} else {
-#endif
-		*event = ALLOC(sizeof(switch_event_t));
-		switch_assert(*event);
-#ifdef SWITCH_EVENT_RECYCLE
-	}
-#endif
 
-	memset(*event, 0, sizeof(switch_event_t));
+	*event = event_new();
 
 	if (event_id == SWITCH_EVENT_REQUEST_PARAMS || event_id == SWITCH_EVENT_CHANNEL_DATA || event_id == SWITCH_EVENT_MESSAGE) {
 		(*event)->flags |= EF_UNIQ_HEADERS;
@@ -722,6 +1093,95 @@ SWITCH_DECLARE(switch_status_t) switch_event_set_priority(switch_event_t *event,
 	return SWITCH_STATUS_SUCCESS;
 }
 
+/* events with at least this many headers get a lookup index on their first search */
+#define EVENT_INDEX_MIN_HEADERS 32
+#define EVENT_INDEX_MIN_SIZE 64
+
+static void event_index_free(switch_event_t *event)
+{
+	FREE(event->index);
+	event->index = NULL;
+	event->index_size = 0;
+}
+
+/* returns the slot holding header_name or the empty slot where it belongs */
+static uint32_t event_index_slot(switch_event_t *event, const char *header_name, unsigned long hash)
+{
+	uint32_t mask = event->index_size - 1;
+	uint32_t i;
+
+	for (i = hash & mask; event->index[i]; i = (i + 1) & mask) {
+		if (event->index[i]->hash == hash && !strcasecmp(event->index[i]->name, header_name)) {
+			break;
+		}
+	}
+
+	return i;
+}
+
+static void event_index_remove_slot(switch_event_t *event, uint32_t i)
+{
+	uint32_t mask = event->index_size - 1;
+	uint32_t j = i, k;
+
+	/* backward shift so probe chains stay unbroken without tombstones */
+	for (;;) {
+		j = (j + 1) & mask;
+
+		if (!event->index[j]) {
+			break;
+		}
+
+		k = event->index[j]->hash & mask;
+
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+			event->index[i] = event->index[j];
+			i = j;
+		}
+	}
+
+	event->index[i] = NULL;
+}
+
+static void event_index_build(switch_event_t *event)
+{
+	switch_event_header_t *hp;
+	uint32_t size = EVENT_INDEX_MIN_SIZE, i;
+
+	while (size < event->header_count * 2) {
+		size <<= 1;
+	}
+
+	FREE(event->index);
+	event->index = calloc(size, sizeof(switch_event_header_t *));
+	switch_assert(event->index);
+	event->index_size = size;
+
+	/* the first header in list order wins, the same one a linear scan would find */
+	for (hp = event->headers; hp; hp = hp->next) {
+		i = event_index_slot(event, hp->name, hp->hash);
+		if (!event->index[i]) {
+			event->index[i] = hp;
+		}
+	}
+}
+
+static void event_index_add(switch_event_t *event, switch_event_header_t *header, switch_bool_t top)
+{
+	uint32_t i;
+
+	if (event->header_count * 2 > event->index_size) {
+		event_index_build(event);
+		return;
+	}
+
+	i = event_index_slot(event, header->name, header->hash);
+
+	if (!event->index[i] || top) {
+		event->index[i] = header;
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_event_rename_header(switch_event_t *event, const char *header_name, const char *new_header_name)
 {
 	switch_event_header_t *hp;
@@ -736,17 +1196,22 @@ SWITCH_DECLARE(switch_status_t) switch_event_rename_header(switch_event_t *event
 	}
 
 	hash = switch_ci_hashfunc_default(header_name, &hlen);
+	event_unshare(event);
 
 	for (hp = event->headers; hp; hp = hp->next) {
 		if ((!hp->hash || hash == hp->hash) && !strcasecmp(hp->name, header_name)) {
-			FREE(hp->name);
-			hp->name = DUP(new_header_name);
+			event_strfree(event, hp->name);
+			hp->name = event_strdup(event, new_header_name);
 			hlen = -1;
 			hp->hash = switch_ci_hashfunc_default(hp->name, &hlen);
 			x++;
 		}
 	}
 
+	if (x && event->index) {
+		event_index_free(event);
+	}
+
 	return x ? SWITCH_STATUS_SUCCESS : SWITCH_STATUS_FALSE;
 }
 
@@ -764,6 +1229,15 @@ SWITCH_DECLARE(switch_event_header_t *) switch_event_get_header_ptr(switch_event
 
 	hash = switch_ci_hashfunc_default(header_name, &hlen);
 
+	/* shared events are indexed before they are fired, their views never write to them */
+	if (!event->index && !event->parent && event->header_count >= EVENT_INDEX_MIN_HEADERS && !switch_test_flag(event, EF_NO_INDEX)) {
+		event_index_build(event);
+	}
+
+	if (event->index) {
+		return event->index[event_index_slot(event, header_name, hash)];
+	}
+
 	for (hp = event->headers; hp; hp = hp->next) {
 		if ((!hp->hash || hash == hp->hash) && !strcasecmp(hp->name, header_name)) {
 			return hp;
@@ -800,11 +1274,28 @@ SWITCH_DECLARE(char *) switch_event_get_body(switch_event_t *event)
 
 SWITCH_DECLARE(switch_status_t) switch_event_del_header_val(switch_event_t *event, const char *header_name, const char *val)
 {
-	switch_event_header_t *hp, *lp = NULL, *tp;
+	switch_event_header_t *hp, *lp = NULL, *tp, *first = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 	int x = 0;
 	switch_ssize_t hlen = -1;
 	unsigned long hash = 0;
+	uint32_t slot = 0;
+
+	hash = switch_ci_hashfunc_default(header_name, &hlen);
+
+	if (event->index) {
+		slot = event_index_slot(event, header_name, hash);
+		if (!event->index[slot]) {
+			return status;
+		}
+	}
+
+	if (event->parent) {
+		event_unshare(event);
+		if (event->index) {
+			slot = event_index_slot(event, header_name, hash);
+		}
+	}
 
 	tp = event->headers;
 	while (tp) {
@@ -813,9 +1304,16 @@ SWITCH_DECLARE(switch_status_t) switch_event_del_header_val(switch_event_t *even
 
 		x++;
 		switch_assert(x < 1000000);
-		hash = switch_ci_hashfunc_default(header_name, &hlen);
 
-		if ((!hp->hash || hash == hp->hash) && !strcasecmp(header_name, hp->name) && (zstr(val) || !strcmp(hp->value, val))) {
+		if ((!hp->hash || hash == hp->hash) && !strcasecmp(header_name, hp->name)) {
+			if (!zstr(val) && strcmp(hp->value, val)) {
+				if (!first) {
+					first = hp;
+				}
+				lp = hp;
+				continue;
+			}
+
 			if (lp) {
 				lp->next = hp->next;
 			} else {
@@ -824,57 +1322,48 @@ SWITCH_DECLARE(switch_status_t) switch_event_del_header_val(switch_event_t *even
 			if (hp == event->last_header || !hp->next) {
 				event->last_header = lp;
 			}
-			FREE(hp->name);
+			event->header_count--;
+			event_strfree(event, hp->name);
 
 			if (hp->idx) {
 				int i = 0;
 
 				for (i = 0; i < hp->idx; i++) {
-					FREE(hp->array[i]);
+					event_strfree(event, hp->array[i]);
 				}
-				FREE(hp->array);
+				event_free(event, hp->array, sizeof(char *) * hp->idx);
 			}
 
-			FREE(hp->value);
+			event_strfree(event, hp->value);
 			
 			memset(hp, 0, sizeof(*hp));
-#ifdef SWITCH_EVENT_RECYCLE
-			if (switch_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, hp) != SWITCH_STATUS_SUCCESS) {
-				FREE(hp);
-			}
-#else
-			FREE(hp);
-#endif
+			event_free(event, hp, sizeof(*hp));
 			status = SWITCH_STATUS_SUCCESS;
 		} else {
 			lp = hp;
 		}
 	}
 
+	if (event->index && status == SWITCH_STATUS_SUCCESS) {
+		if (first) {
+			event->index[slot] = first;
+		} else {
+			event_index_remove_slot(event, slot);
+		}
+	}
+
 	return status;
 }
 
-static switch_event_header_t *new_header(const char *header_name)
+static switch_event_header_t *new_header(switch_event_t *event, const char *header_name)
 {
 	switch_event_header_t *header;
 
-#ifdef SWITCH_EVENT_RECYCLE
-		void *pop;
-		if (EVENT_HEADER_RECYCLE_QUEUE && switch_queue_trypop(EVENT_HEADER_RECYCLE_QUEUE, &pop) == SWITCH_STATUS_SUCCESS) {
-			header = (switch_event_header_t *) pop;
-		} else {
-#endif
-			header = ALLOC(sizeof(*header));
-			switch_assert(header);
-#ifdef SWITCH_EVENT_RECYCLE
-		}
-#endif	
-
-		memset(header, 0, sizeof(*header));
-		header->name = DUP(header_name);
-
-		return header;
+	header = event_alloc(event, sizeof(*header));
+	memset(header, 0, sizeof(*header));
+	header->name = event_strdup(event, header_name);
 
+	return header;
 }
 
 SWITCH_DECLARE(int) switch_event_add_array(switch_event_t *event, const char *var, const char *val)
@@ -923,6 +1412,7 @@ SWITCH_DECLARE(int) switch_event_add_array(switch_event_t *event, const char *va
 	return 0;
 }
 
+/* data must already belong to the event, see event_alloc() */
 static switch_status_t switch_event_base_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name, char *data)
 {
 	switch_event_header_t *header = NULL;
@@ -932,6 +1422,7 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 	int index = 0;
 	char *real_header_name = NULL;
 
+	event_unshare(event);
 
 	if (!strcmp(header_name, "_body")) {
 		switch_event_set_body(event, data);
@@ -951,7 +1442,7 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 		
 		if (!(header = switch_event_get_header_ptr(event, header_name)) && index_ptr) {
 
-			header = new_header(header_name);
+			header = new_header(event, header_name);
 
 			if (switch_test_flag(event, EF_UNIQ_HEADERS)) {
 				switch_event_del_header(event, header_name);
@@ -965,19 +1456,22 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 			if (index_ptr) {
 				if (index > -1 && index <= 4000) {
 					if (index < header->idx) {
-						FREE(header->array[index]);
-						header->array[index] = DUP(data);
+						event_strfree(event, header->array[index]);
+						header->array[index] = data;
 					} else {
 						int i;
 						char **m;
 					
-						m = realloc(header->array, sizeof(char *) * (index + 1));
-						switch_assert(m);
+						m = event_alloc(event, sizeof(char *) * (index + 1));
+						if (header->idx) {
+							memcpy(m, header->array, sizeof(char *) * header->idx);
+						}
+						event_free(event, header->array, sizeof(char *) * header->idx);
 						header->array = m;
 						for (i = header->idx; i < index; i++) {
-							m[i] = DUP("");
+							m[i] = event_strdup(event, "");
 						}
-						m[index] = DUP(data);
+						m[index] = data;
 						header->idx = index + 1;
 						if (!fly) {
 							exists = 1;
@@ -985,6 +1479,8 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 
 						goto redraw;
 					}
+				} else {
+					event_strfree(event, data);
 				}
 				goto end;
 			} else {
@@ -1003,7 +1499,7 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 
 		if (zstr(data)) {
 			switch_event_del_header(event, header_name);
-			FREE(data);
+			event_strfree(event, data);
 			goto end;
 		}
 
@@ -1013,12 +1509,12 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 
 		if (strstr(data, "ARRAY::")) {
 			switch_event_add_array(event, header_name, data);
-			FREE(data);
+			event_strfree(event, data);
 			goto end;
 		}
 
 
-		header = new_header(header_name);
+		header = new_header(event, header_name);
 	}
 	
 	if ((stack & SWITCH_STACK_PUSH) || (stack & SWITCH_STACK_UNSHIFT)) {
@@ -1028,8 +1524,7 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 		int i = 0, j = 0;
 
 		if (header->value && !header->idx) {
-			m = malloc(sizeof(char *));
-			switch_assert(m);
+			m = event_alloc(event, sizeof(char *));
 			m[0] = header->value;
 			header->value = NULL;
 			header->array = m;
@@ -1038,8 +1533,9 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 		}
 
 		i = header->idx + 1;
-		m = realloc(header->array, sizeof(char *) * i); 
-		switch_assert(m);
+		m = event_alloc(event, sizeof(char *) * i);
+		memcpy(m, header->array, sizeof(char *) * header->idx);
+		event_free(event, header->array, sizeof(char *) * header->idx);
 
 		if ((stack & SWITCH_STACK_PUSH)) {
 			m[header->idx] = data;
@@ -1061,8 +1557,8 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 
 		if (len) {
 			len += 8;
-			hv = realloc(header->value, len);
-			switch_assert(hv);
+			hv = event_alloc(event, len);
+			event_strfree(event, header->value);
 			header->value = hv;
 
 			switch_snprintf(header->value, len, "ARRAY::");
@@ -1093,6 +1589,12 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 			}
 			event->last_header = header;
 		}
+
+		event->header_count++;
+
+		if (event->index) {
+			event_index_add(event, header, (stack & SWITCH_STACK_TOP) ? SWITCH_TRUE : SWITCH_FALSE);
+		}
 	}
 
  end:
@@ -1105,15 +1607,30 @@ static switch_status_t switch_event_base_add_header(switch_event_t *event, switc
 SWITCH_DECLARE(switch_status_t) switch_event_add_header(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *fmt, ...)
 {
 	int ret = 0;
+	char buf[512];
 	char *data;
 	va_list ap;
 
+	/* format on the stack so the value costs one copy into the arena */
 	va_start(ap, fmt);
-	ret = switch_vasprintf(&data, fmt, ap);
+	ret = vsnprintf(buf, sizeof(buf), fmt, ap);
 	va_end(ap);
 
-	if (ret == -1) {
-		return SWITCH_STATUS_MEMERR;
+	if (ret >= 0 && ret < (int) sizeof(buf)) {
+		data = event_strndup(event, buf, ret);
+	} else {
+		char *tmp;
+
+		va_start(ap, fmt);
+		ret = switch_vasprintf(&tmp, fmt, ap);
+		va_end(ap);
+
+		if (ret == -1) {
+			return SWITCH_STATUS_MEMERR;
+		}
+
+		data = event_strndup(event, tmp, ret);
+		free(tmp);
 	}
 
 	return switch_event_base_add_header(event, stack, header_name, data);
@@ -1124,6 +1641,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_set_subclass_name(switch_event_t *e
 	if (!event || !subclass_name)
 		return SWITCH_STATUS_GENERR;
 
+	event_unshare(event);
 	switch_safe_free(event->subclass_name);
 	event->subclass_name = DUP(subclass_name);
 	switch_event_del_header(event, "Event-Subclass");
@@ -1133,14 +1651,25 @@ SWITCH_DECLARE(switch_status_t) switch_event_set_subclass_name(switch_event_t *e
 
 SWITCH_DECLARE(switch_status_t) switch_event_add_header_string(switch_event_t *event, switch_stack_t stack, const char *header_name, const char *data)
 {
+	char *value;
+
 	if (data) {
-		return switch_event_base_add_header(event, stack, header_name, (stack & SWITCH_STACK_NODUP) ? (char *)data : DUP(data));
+		if ((stack & SWITCH_STACK_NODUP)) {
+			/* NODUP hands us a malloc'd string, keep it as is and free it with the header */
+			value = (char *) data;
+			event->heap_strings = SWITCH_TRUE;
+		} else {
+			value = event_strdup(event, data);
+		}
+
+		return switch_event_base_add_header(event, stack, header_name, value);
 	}
 	return SWITCH_STATUS_GENERR;
 }
 
 SWITCH_DECLARE(switch_status_t) switch_event_set_body(switch_event_t *event, const char *body)
 {
+	event_unshare(event);
 	switch_safe_free(event->body);
 
 	if (body) {
@@ -1164,6 +1693,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_add_body(switch_event_t *event, con
 		if (ret == -1) {
 			return SWITCH_STATUS_GENERR;
 		} else {
+			event_unshare(event);
 			switch_safe_free(event->body);
 			event->body = data;
 			return SWITCH_STATUS_SUCCESS;
@@ -1176,46 +1706,18 @@ SWITCH_DECLARE(switch_status_t) switch_event_add_body(switch_event_t *event, con
 SWITCH_DECLARE(void) switch_event_destroy(switch_event_t **event)
 {
 	switch_event_t *ep = *event;
-	switch_event_header_t *hp, *this;
 
 	if (ep) {
-		for (hp = ep->headers; hp;) {
-			this = hp;
-			hp = hp->next;
-			FREE(this->name);
+		if (ep->parent) {
+			switch_event_t *root = ep->parent;
 
-			if (this->idx) {
-				int i = 0;
-
-				for (i = 0; i < this->idx; i++) {
-					FREE(this->array[i]);
-				}
-				FREE(this->array);
-			}
-
-			FREE(this->value);
-			
-
-#ifdef SWITCH_EVENT_RECYCLE
-			if (switch_queue_trypush(EVENT_HEADER_RECYCLE_QUEUE, this) != SWITCH_STATUS_SUCCESS) {
-				FREE(this);
-			}
-#else
-			FREE(this);
-#endif
-
-
-		}
-		FREE(ep->body);
-		FREE(ep->subclass_name);
-#ifdef SWITCH_EVENT_RECYCLE
-		if (switch_queue_trypush(EVENT_RECYCLE_QUEUE, ep) != SWITCH_STATUS_SUCCESS) {
+			/* a view can still own arena blocks, a value is copied in before the write that unshares it */
+			event_arena_free(ep);
 			FREE(ep);
+			event_release(root);
+		} else {
+			event_release(ep);
 		}
-#else
-		FREE(ep);
-#endif
-
 	}
 	*event = NULL;
 }
@@ -1240,33 +1742,41 @@ SWITCH_DECLARE(void) switch_event_merge(switch_event_t *event, switch_event_t *t
 	}
 }
 
-SWITCH_DECLARE(switch_status_t) switch_event_dup(switch_event_t **event, switch_event_t *todup)
+SWITCH_DECLARE(uint32_t) switch_event_allocations(switch_event_t *event)
 {
-	switch_event_header_t *hp;
+	event_arena_block_t *block;
+	uint32_t count = 1;
 
-	if (switch_event_create_subclass(event, SWITCH_EVENT_CLONE, todup->subclass_name) != SWITCH_STATUS_SUCCESS) {
-		return SWITCH_STATUS_GENERR;
+	for (block = event->arena; block; block = block->next) {
+		if (!block->embedded) {
+			count++;
+		}
 	}
 
+	return count;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_event_dup(switch_event_t **event, switch_event_t *todup)
+{
+	/* fired events are immutable, another reference is as good as a copy */
+	if (todup->parent) {
+		*event = event_share(todup);
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	*event = event_new();
+
 	(*event)->event_id = todup->event_id;
 	(*event)->event_user_data = todup->event_user_data;
 	(*event)->bind_user_data = todup->bind_user_data;
 	(*event)->flags = todup->flags;
-	for (hp = todup->headers; hp; hp = hp->next) {
-		if (todup->subclass_name && !strcmp(hp->name, "Event-Subclass")) {
-			continue;
-		}
-		
-		if (hp->idx) {
-			int i;
-			for (i = 0; i < hp->idx; i++) {
-				switch_event_add_header_string(*event, SWITCH_STACK_PUSH, hp->name, hp->array[i]);
-			}
-		} else {
-			switch_event_add_header_string(*event, SWITCH_STACK_BOTTOM, hp->name, hp->value);
-		}
+
+	if (todup->subclass_name) {
+		(*event)->subclass_name = DUP(todup->subclass_name);
 	}
 
+	event_copy_headers(*event, todup);
+
 	if (todup->body) {
 		(*event)->body = DUP(todup->body);
 	}
@@ -1774,8 +2284,10 @@ SWITCH_DECLARE(void) switch_event_prep_for_delivery_detailed(const char *file, c
 
 SWITCH_DECLARE(switch_status_t) switch_event_fire_detailed(const char *file, const char *func, int line, switch_event_t **event, void *user_data)
 {
-
-	int index;
+	switch_event_types_t e;
+	switch_event_node_t *node;
+	switch_priority_t priority;
+	uint32_t epoch;
 
 	switch_assert(BLOCK != NULL);
 	switch_assert(RUNTIME_POOL != NULL);
@@ -1792,20 +2304,29 @@ SWITCH_DECLARE(switch_status_t) switch_event_fire_detailed(const char *file, con
 		(*event)->event_user_data = user_data;
 	}
 
-	for (;;) {
-		for (index = (*event)->priority; index < 3; index++) {
-			if (switch_queue_trypush(EVENT_QUEUE[index], *event) == SWITCH_STATUS_SUCCESS) {
-				goto end;
+	/* the event is frozen from here on, build the index now since no view may write to it later */
+	if (!(*event)->parent && !(*event)->index && (*event)->header_count >= EVENT_INDEX_MIN_HEADERS && !switch_test_flag((*event), EF_NO_INDEX)) {
+		event_index_build(*event);
+	}
+
+	priority = (*event)->priority;
+
+	/* every matching subscriber gets a read-only view sharing the one copy of the headers */
+	epoch = event_nodes_read_lock();
+	for (e = (*event)->event_id;; e = SWITCH_EVENT_ALL) {
+		for (node = EVENT_NODES[e]; node; node = node->next) {
+			if (switch_events_match(*event, node)) {
+				event_node_queue(node, event_share(*event), priority);
 			}
 		}
 
-		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CRIT, "Event queue is full!\n");
-		switch_yield(100000);
+		if (e == SWITCH_EVENT_ALL) {
+			break;
+		}
 	}
+	event_nodes_read_unlock(epoch);
 
-  end:
-
-	*event = NULL;
+	switch_event_destroy(event);
 
 	return SWITCH_STATUS_SUCCESS;
 }
@@ -1815,6 +2336,7 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 {
 	switch_event_node_t *event_node;
 	switch_event_subclass_t *subclass = NULL;
+	switch_threadattr_t *thd_attr;
 
 	switch_assert(BLOCK != NULL);
 	switch_assert(RUNTIME_POOL != NULL);
@@ -1837,9 +2359,6 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 
 	if (event <= SWITCH_EVENT_ALL) {
 		switch_zmalloc(event_node, sizeof(*event_node));
-		switch_thread_rwlock_wrlock(RWLOCK);
-		switch_mutex_lock(BLOCK);
-		/* <LOCKED> ----------------------------------------------- */
 		event_node->id = DUP(id);
 		event_node->event_id = event;
 		if (subclass_name) {
@@ -1848,13 +2367,24 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind_removable(const char *id, swit
 		event_node->callback = callback;
 		event_node->user_data = user_data;
 
-		if (EVENT_NODES[event]) {
-			event_node->next = EVENT_NODES[event];
-		}
+		switch_core_new_memory_pool(&event_node->pool);
+		event_ring_init(&event_node->rings[EVENT_RING_HIGH], DISPATCH_HIGH_QUEUE_LEN, event_node->pool);
+		event_ring_init(&event_node->rings[EVENT_RING_NORMAL], DISPATCH_QUEUE_LEN, event_node->pool);
+		switch_mutex_init(&event_node->mutex, SWITCH_MUTEX_NESTED, event_node->pool);
+		switch_thread_cond_create(&event_node->cond, event_node->pool);
+		switch_atomic_set(&event_node->running, 1);
 
-		EVENT_NODES[event] = event_node;
+		switch_threadattr_create(&thd_attr, event_node->pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_increase(thd_attr);
+		switch_thread_create(&event_node->thread, thd_attr, switch_event_dispatch_thread, event_node, event_node->pool);
+
+		switch_mutex_lock(BLOCK);
+		/* <LOCKED> ----------------------------------------------- */
+		event_node->next = EVENT_NODES[event];
+		/* publish the fully built node to lockless readers */
+		switch_atomic_casptr((volatile void **) &EVENT_NODES[event], event_node, event_node->next);
 		switch_mutex_unlock(BLOCK);
-		switch_thread_rwlock_unlock(RWLOCK);
 		/* </LOCKED> ----------------------------------------------- */
 
 		if (node) {
@@ -1877,11 +2407,10 @@ SWITCH_DECLARE(switch_status_t) switch_event_bind(const char *id, switch_event_t
 
 SWITCH_DECLARE(switch_status_t) switch_event_unbind_callback(switch_event_callback_t callback)
 {
-	switch_event_node_t *n, *np, *lnp = NULL;
+	switch_event_node_t *n, *np, *lnp = NULL, *dead = NULL;
 	switch_status_t status = SWITCH_STATUS_FALSE;
 	int id;
 
-	switch_thread_rwlock_wrlock(RWLOCK);
 	switch_mutex_lock(BLOCK);
 	/* <LOCKED> ----------------------------------------------- */
 	for (id = 0; id <= SWITCH_EVENT_ALL; id++) {
@@ -1898,19 +2427,27 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind_callback(switch_event_callba
 				}
 
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Event Binding deleted for %s:%s\n", n->id, switch_event_name(n->event_id));
-				FREE(n->subclass_name);
-				FREE(n->id);
-				FREE(n);
+				/* n->next must stay intact for readers still walking the list */
+				n->reclaim_next = dead;
+				dead = n;
 				status = SWITCH_STATUS_SUCCESS;
 			} else {
 				lnp = n;
 			}
 		}
 	}
+
+	if (dead) {
+		event_nodes_synchronize();
+	}
 	switch_mutex_unlock(BLOCK);
-	switch_thread_rwlock_unlock(RWLOCK);
 	/* </LOCKED> ----------------------------------------------- */
 
+	while ((n = dead)) {
+		dead = n->reclaim_next;
+		event_node_destroy(&n);
+	}
+
 	return status;
 }
 
@@ -1927,7 +2464,6 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind(switch_event_node_t **node)
 		return status;
 	}
 
-	switch_thread_rwlock_wrlock(RWLOCK);
 	switch_mutex_lock(BLOCK);
 	/* <LOCKED> ----------------------------------------------- */
 	for (np = EVENT_NODES[n->event_id]; np; np = np->next) {
@@ -1938,19 +2474,23 @@ SWITCH_DECLARE(switch_status_t) switch_event_unbind(switch_event_node_t **node)
 				EVENT_NODES[n->event_id] = n->next;
 			}
 			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Event Binding deleted for %s:%s\n", n->id, switch_event_name(n->event_id));
-			FREE(n->subclass_name);
-			FREE(n->id);
-			FREE(n);
-			*node = NULL;
 			status = SWITCH_STATUS_SUCCESS;
 			break;
 		}
 		lnp = np;
 	}
+
+	if (status == SWITCH_STATUS_SUCCESS) {
+		event_nodes_synchronize();
+	}
 	switch_mutex_unlock(BLOCK);
-	switch_thread_rwlock_unlock(RWLOCK);
 	/* </LOCKED> ----------------------------------------------- */
 
+	if (status == SWITCH_STATUS_SUCCESS) {
+		event_node_destroy(&n);
+		*node = NULL;
+	}
+
 	return status;
 }
 
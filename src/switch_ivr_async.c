@@ -1024,6 +1024,7 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 				switch_size_t len;
 				uint8_t data[SWITCH_RECOMMENDED_BUFFER_SIZE];
 				switch_frame_t frame = { 0 };
+				switch_file_async_stats_t async_stats;
 
 				frame.data = data;
 				frame.buflen = SWITCH_RECOMMENDED_BUFFER_SIZE;
@@ -1040,7 +1041,14 @@ static switch_bool_t record_callback(switch_media_bug_t *bug, void *user_data, s
 				}
 
 
+				if (switch_core_file_get_async_stats(rh->fh, &async_stats) == SWITCH_STATUS_SUCCESS) {
+					/* nothing is queued after the last frame so the figures are final */
+					switch_channel_set_variable_printf(channel, "record_async_max_lag_ms", "%u", async_stats.max_lag_ms);
+					switch_channel_set_variable_printf(channel, "record_async_dropped_samples", "%" SWITCH_SIZE_T_FMT, async_stats.dropped_samples);
+				}
+
 				switch_core_file_close(rh->fh);
+
 				if (rh->fh->samples_out < rh->fh->samplerate * rh->min_sec) {
 					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Discarding short file %s\n", rh->file);
 					switch_channel_set_variable(channel, "RECORD_DISCARDED", "true");
@@ -1743,6 +1751,21 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_record_session(switch_core_session_t
 		switch_channel_set_variable(channel, "RECORD_DATE", NULL);
 	}
 
+	/* keep libsndfile and the disk off the media thread unless told otherwise */
+	if (!((p = switch_channel_get_variable(channel, "RECORD_ASYNC")) && !switch_true(p))) {
+		uint32_t buffer_ms = 0, max_block_ms = 0;
+
+		if ((p = switch_channel_get_variable(channel, "RECORD_ASYNC_BUFFER_MS")) && atoi(p) > 0) {
+			buffer_ms = atoi(p);
+		}
+
+		if ((p = switch_channel_get_variable(channel, "RECORD_ASYNC_MAX_BLOCK_MS")) && atoi(p) > 0) {
+			max_block_ms = atoi(p);
+		}
+
+		switch_core_file_set_async(fh, switch_core_session_get_uuid(session), buffer_ms, max_block_ms);
+	}
+
 	if (limit) {
 		to = switch_epoch_time_now(NULL) + limit;
 	}
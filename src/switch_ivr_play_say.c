@@ -1011,6 +1011,205 @@ static void add_playback_vars_to_event(switch_core_session_t *session, switch_ev
 	}
 }
 
+/* Native siblings are headerless streams of encoded frames that mod_native_file hands
+   straight to the write codec.  Codecs whose stream does not depend on the packetisation
+   (G.711, G.722, G.729 ...) use <base>.<IANA>, the rest carry the ptime and, when the
+   name is registered at several rates, the rate too. */
+static void native_file_shape(const switch_codec_implementation_t *impl, int *need_rate, int *need_ptime)
+{
+	switch_codec_interface_t *codec_interface;
+	const switch_codec_implementation_t *ip;
+
+	*need_rate = *need_ptime = 0;
+
+	if (!(codec_interface = switch_loadable_module_get_codec_interface(impl->iananame))) {
+		*need_rate = *need_ptime = 1;
+		return;
+	}
+
+	for (ip = codec_interface->implementations; ip; ip = ip->next) {
+		if (strcasecmp(ip->iananame, impl->iananame)) {
+			continue;
+		}
+		if (ip->actual_samples_per_second != impl->actual_samples_per_second) {
+			*need_rate = 1;
+			continue;
+		}
+		if ((uint64_t) ip->encoded_bytes_per_packet * impl->samples_per_packet !=
+			(uint64_t) impl->encoded_bytes_per_packet * ip->samples_per_packet) {
+			*need_ptime = 1;
+		}
+	}
+
+	UNPROTECT_INTERFACE(codec_interface);
+}
+
+SWITCH_DECLARE(char *) switch_ivr_native_file_path(switch_memory_pool_t *pool, const char *file, const switch_codec_implementation_t *impl)
+{
+	const char *ext, *p;
+	char rate[32] = "", ptime[32] = "";
+	int need_rate, need_ptime;
+	size_t len;
+
+	/* variable sized frames can't be cut back into packets and L16 has nothing to save */
+	if (zstr(file) || !impl || !impl->encoded_bytes_per_packet || !impl->microseconds_per_packet || !strcasecmp(impl->iananame, "L16")) {
+		return NULL;
+	}
+
+	len = strlen(file);
+
+	if ((ext = strrchr(file, '.'))) {
+		for (p = ext; *p && *p != '/' && *p != '\\'; p++);
+		if (!*p) {
+			len = ext - file;
+		}
+	}
+
+	native_file_shape(impl, &need_rate, &need_ptime);
+
+	if (need_rate) {
+		switch_snprintf(rate, sizeof(rate), ".%uhz", impl->actual_samples_per_second);
+	}
+
+	if (need_ptime) {
+		switch_snprintf(ptime, sizeof(ptime), ".%ums", impl->microseconds_per_packet / 1000);
+	}
+
+	return switch_core_sprintf(pool, "%.*s%s%s.%s", (int) len, file, rate, ptime, impl->iananame);
+}
+
+SWITCH_DECLARE(switch_status_t) switch_ivr_native_file_encode(switch_memory_pool_t *pool, const char *file, const switch_codec_implementation_t *impl,
+															  char **native_file)
+{
+	switch_file_handle_t fh = { 0 };
+	switch_codec_t codec = { 0 };
+	switch_file_t *out = NULL;
+	int16_t *pcm = NULL;
+	uint8_t enc[SWITCH_RECOMMENDED_BUFFER_SIZE];
+	char *dest, *tmp = NULL;
+	switch_size_t have = 0, len, wlen;
+	uint32_t samples, enc_len, enc_rate, flag = 0;
+	int eof = 0;
+	switch_status_t status = SWITCH_STATUS_GENERR;
+
+	if (native_file) {
+		*native_file = NULL;
+	}
+
+	if (!(dest = switch_ivr_native_file_path(pool, file, impl))) {
+		return SWITCH_STATUS_NOTIMPL;
+	}
+
+	if (switch_core_codec_init(&codec, impl->iananame, NULL, impl->actual_samples_per_second, impl->microseconds_per_packet / 1000,
+							   impl->number_of_channels, SWITCH_CODEC_FLAG_ENCODE | SWITCH_CODEC_FLAG_DECODE, NULL, pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't load codec %s@%uh@%ui\n",
+						  impl->iananame, impl->actual_samples_per_second, impl->microseconds_per_packet / 1000);
+		return SWITCH_STATUS_GENERR;
+	}
+
+	if (switch_core_file_open(&fh, file, codec.implementation->number_of_channels, codec.implementation->actual_samples_per_second,
+							  SWITCH_FILE_FLAG_READ | SWITCH_FILE_DATA_SHORT, pool) != SWITCH_STATUS_SUCCESS) {
+		switch_core_codec_destroy(&codec);
+		return SWITCH_STATUS_NOTFOUND;
+	}
+
+	if (switch_test_flag(&fh, SWITCH_FILE_NATIVE)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s is already encoded\n", file);
+		goto end;
+	}
+
+	/* write next to the target and rename so a running playback never sees half a file */
+	tmp = switch_core_sprintf(pool, "%s.tmp", dest);
+
+	if (switch_file_open(&out, tmp, SWITCH_FOPEN_WRITE | SWITCH_FOPEN_CREATE | SWITCH_FOPEN_TRUNCATE | SWITCH_FOPEN_BINARY,
+						 SWITCH_FPROT_OS_DEFAULT, pool) != SWITCH_STATUS_SUCCESS) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Can't open %s\n", tmp);
+		goto end;
+	}
+
+	samples = codec.implementation->decoded_bytes_per_packet / sizeof(*pcm);
+	switch_zmalloc(pcm, codec.implementation->decoded_bytes_per_packet);
+
+	while (!eof) {
+		len = samples - have;
+		if (switch_core_file_read(&fh, pcm + have, &len) != SWITCH_STATUS_SUCCESS || !len) {
+			if (!have) {
+				break;
+			}
+			memset(pcm + have, 0, (samples - have) * sizeof(*pcm));
+			have = samples;
+			eof++;
+		} else {
+			have += len;
+		}
+
+		if (have < samples) {
+			continue;
+		}
+
+		enc_len = sizeof(enc);
+		enc_rate = codec.implementation->actual_samples_per_second;
+
+		if (switch_core_codec_encode(&codec, NULL, pcm, codec.implementation->decoded_bytes_per_packet, codec.implementation->actual_samples_per_second,
+									 enc, &enc_len, &enc_rate, &flag) != SWITCH_STATUS_SUCCESS || enc_len != codec.implementation->encoded_bytes_per_packet) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "%s can't encode fixed size frames\n", codec.implementation->iananame);
+			goto end;
+		}
+
+		wlen = enc_len;
+		if (switch_file_write(out, enc, &wlen) != SWITCH_STATUS_SUCCESS || wlen != enc_len) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Error writing %s\n", tmp);
+			goto end;
+		}
+
+		have = 0;
+	}
+
+	switch_file_close(out);
+	out = NULL;
+
+	if ((status = switch_file_rename(tmp, dest, pool)) == SWITCH_STATUS_SUCCESS && native_file) {
+		*native_file = dest;
+	}
+
+  end:
+
+	if (out) {
+		switch_file_close(out);
+		switch_file_remove(tmp, pool);
+	}
+
+	switch_safe_free(pcm);
+	switch_core_file_close(&fh);
+	switch_core_codec_destroy(&codec);
+
+	return status;
+}
+
+/* swap a plain prompt for an up to date pre-encoded sibling matching the write codec */
+static const char *native_file_sibling(switch_core_session_t *session, const char *file, const switch_codec_implementation_t *impl)
+{
+	struct stat src, dst;
+	const char *ext;
+	char *sibling;
+
+	if (!(ext = strrchr(file, '.')) || !strcasecmp(ext + 1, impl->iananame)) {
+		return file;
+	}
+
+	if (!(sibling = switch_ivr_native_file_path(switch_core_session_get_pool(session), file, impl))) {
+		return file;
+	}
+
+	if (stat(sibling, &dst) || (!stat(file, &src) && src.st_mtime > dst.st_mtime)) {
+		return file;
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Playing native %s for %s\n", sibling, file);
+
+	return sibling;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *session, switch_file_handle_t *fh, const char *file, switch_input_args_t *args)
 {
 	switch_channel_t *channel = switch_core_session_get_channel(session);
@@ -1041,6 +1240,8 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 	switch_size_t bread = 0;
 	int l16 = 0;
 	switch_codec_implementation_t read_impl = { 0 };
+	switch_codec_implementation_t write_impl = { 0 };
+	int native_siblings = 1;
 	char *file_dup;
 	char *argv[128] = { 0 };
 	int argc;
@@ -1058,6 +1259,11 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 	}
 
 	switch_core_session_get_read_impl(session, &read_impl);
+	switch_core_session_get_write_impl(session, &write_impl);
+
+	if ((var = switch_channel_get_variable(channel, "playback_native_siblings")) && !switch_true(var)) {
+		native_siblings = 0;
+	}
 
 	if ((var = switch_channel_get_variable(channel, "playback_timeout_sec"))) {
 		int tmp = atoi(var);
@@ -1229,6 +1435,11 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 			}
 		}
 
+		/* volume and speed only work on decoded audio */
+		if (native_siblings && !fh->vol && !fh->speed && *file != '[' && !strstr(file, SWITCH_URL_SEPARATOR) && switch_is_file_path(file)) {
+			file = native_file_sibling(session, file, &write_impl);
+		}
+
 
 		if (!fh->prefix) {
 			fh->prefix = prefix;
@@ -1328,9 +1539,9 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 		test_native = switch_test_flag(fh, SWITCH_FILE_NATIVE);
 
 		if (test_native) {
-			write_frame.codec = switch_core_session_get_read_codec(session);
-			samples = read_impl.samples_per_packet;
-			framelen = read_impl.encoded_bytes_per_packet;
+			write_frame.codec = switch_core_session_get_write_codec(session);
+			samples = write_impl.samples_per_packet;
+			framelen = write_impl.encoded_bytes_per_packet;
 		} else {
 			write_frame.codec = &codec;
 			samples = codec.implementation->samples_per_packet;
@@ -1492,9 +1703,9 @@ SWITCH_DECLARE(switch_status_t) switch_ivr_play_file(switch_core_session_t *sess
 
 				if (test_native != last_native) {
 					if (test_native) {
-						write_frame.codec = switch_core_session_get_read_codec(session);
-						samples = read_impl.samples_per_packet;
-						framelen = read_impl.encoded_bytes_per_packet;						
+						write_frame.codec = switch_core_session_get_write_codec(session);
+						samples = write_impl.samples_per_packet;
+						framelen = write_impl.encoded_bytes_per_packet;						
 					} else {
 						write_frame.codec = &codec;
 						samples = codec.implementation->samples_per_packet;
@@ -112,6 +112,9 @@ SWITCH_DECLARE(switch_log_node_t *) switch_log_node_dup(const switch_log_node_t
 	if (!zstr(node->data)) {
 		newnode->data = strdup(node->data);
 		switch_assert(node->data);
+		if (node->content >= node->data && node->content < node->data + strlen(node->data)) {
+			newnode->content = newnode->data + (node->content - node->data);
+		}
 	}
 
 	if (!zstr(node->userdata)) {
@@ -215,6 +218,902 @@ SWITCH_DECLARE(switch_log_level_t) switch_log_str2level(const char *str)
 	return level;
 }
 
+/* Lines are not formatted by the thread logging them.  Each thread owns a ring it appends
+   compact records to: the format string, the raw arguments and the origin, and the logger
+   thread merges the rings by time and formats only what a binding actually wants. */
+
+#define LOG_RING_SIZE (32 * 1024)
+#define LOG_BENCH_RING_SIZE (8 * 1024 * 1024)
+#define LOG_RING_FREE 0
+#define LOG_RING_OWNED 1
+#define LOG_RING_DEAD 2
+/* at most this many threads get a ring, the rest log through the queue */
+#define LOG_RING_MAX 256
+/* rings of exited threads kept for reuse, drained ones past this are freed */
+#define LOG_RING_KEEP 64
+#define LOG_BATCH_MAX 4096
+#define LOG_RECORD_SKIP 1
+#define LOG_RECORD_ALIGN(_x) (((_x) + 7) & ~7U)
+
+typedef struct {
+	uint32_t size;
+	uint16_t flags;
+	uint8_t level;
+	uint8_t channel;
+	int32_t line;
+	switch_time_t timestamp;
+	uint16_t file_len;
+	uint16_t func_len;
+	uint16_t userdata_len;
+	uint16_t fmt_len;
+} log_record_t;
+
+typedef struct log_ring {
+	uint8_t *buf;
+	uint32_t size;
+	uint32_t mask;
+	volatile switch_atomic_t head;
+	volatile switch_atomic_t tail;
+	volatile switch_atomic_t state;
+	uint32_t consumed;
+	struct log_ring *next;
+} log_ring_t;
+
+typedef enum {
+	LOG_ARG_INT,
+	LOG_ARG_LONG,
+	LOG_ARG_LLONG,
+	LOG_ARG_SIZE,
+	LOG_ARG_INTMAX,
+	LOG_ARG_PTRDIFF,
+	LOG_ARG_DOUBLE,
+	LOG_ARG_STR,
+	LOG_ARG_PTR,
+	LOG_ARG_BAD
+} log_arg_type_t;
+
+typedef struct {
+	switch_time_t timestamp;
+	uint32_t order;
+	log_ring_t *ring;
+	log_record_t *record;
+	switch_log_node_t *node;
+} log_item_t;
+
+static log_ring_t * volatile LOG_RINGS = NULL;
+static switch_mutex_t *LOG_RING_MUTEX = NULL;
+static uint32_t LOG_RING_COUNT = 0;
+static switch_mutex_t *LOG_WAKE_MUTEX = NULL;
+static switch_thread_cond_t *LOG_WAKE_COND = NULL;
+static volatile switch_atomic_t LOG_SLEEPING = 0;
+static volatile switch_atomic_t LOG_RING_FALLBACKS = 0;
+static log_ring_t LOG_NO_RING = { 0 };
+#ifndef WIN32
+static pthread_key_t LOG_RING_KEY;
+#endif
+
+/* parse the conversion after a '%', returns the char after it; precision is -1 without one and -2 when it is a '*' */
+static const char *log_fmt_spec(const char *p, log_arg_type_t *type, int *stars, int *precision)
+{
+	int len = 0;
+
+	*stars = 0;
+	*precision = -1;
+
+	while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0' || *p == '\'') {
+		p++;
+	}
+
+	if (*p == '*') {
+		(*stars)++;
+		p++;
+	} else {
+		while (*p >= '0' && *p <= '9') {
+			p++;
+		}
+		if (*p == '$') {
+			*type = LOG_ARG_BAD;
+			return p;
+		}
+	}
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			(*stars)++;
+			*precision = -2;
+			p++;
+		} else {
+			*precision = atoi(p);
+			while (*p >= '0' && *p <= '9') {
+				p++;
+			}
+		}
+	}
+
+	switch (*p) {
+	case 'h':
+		p += (p[1] == 'h') ? 2 : 1;
+		break;
+	case 'l':
+		if (p[1] == 'l') {
+			len = 2;
+			p += 2;
+		} else {
+			len = 1;
+			p++;
+		}
+		break;
+	case 'q':
+		len = 2;
+		p++;
+		break;
+	case 'z':
+		len = 'z';
+		p++;
+		break;
+	case 'j':
+		len = 'j';
+		p++;
+		break;
+	case 't':
+		len = 't';
+		p++;
+		break;
+	case 'L':
+		len = 'L';
+		p++;
+		break;
+	}
+
+	switch (*p) {
+	case 'd':
+	case 'i':
+	case 'u':
+	case 'o':
+	case 'x':
+	case 'X':
+		switch (len) {
+		case 0:
+			*type = LOG_ARG_INT;
+			break;
+		case 1:
+			*type = LOG_ARG_LONG;
+			break;
+		case 2:
+			*type = LOG_ARG_LLONG;
+			break;
+		case 'z':
+			*type = LOG_ARG_SIZE;
+			break;
+		case 'j':
+			*type = LOG_ARG_INTMAX;
+			break;
+		case 't':
+			*type = LOG_ARG_PTRDIFF;
+			break;
+		default:
+			*type = LOG_ARG_BAD;
+			break;
+		}
+		break;
+	case 'c':
+		*type = len ? LOG_ARG_BAD : LOG_ARG_INT;
+		break;
+	case 's':
+		*type = len ? LOG_ARG_BAD : LOG_ARG_STR;
+		break;
+	case 'p':
+		*type = LOG_ARG_PTR;
+		break;
+	case 'f':
+	case 'F':
+	case 'e':
+	case 'E':
+	case 'g':
+	case 'G':
+	case 'a':
+	case 'A':
+		*type = (len == 0 || len == 1) ? LOG_ARG_DOUBLE : LOG_ARG_BAD;
+		break;
+	default:
+		/* %n, wide chars, long double and anything we don't know are formatted on the spot */
+		*type = LOG_ARG_BAD;
+		return p;
+	}
+
+	return p + 1;
+}
+
+/* copy the arguments fmt consumes into out, or just measure them when out is NULL, -1 if fmt can't be deferred */
+static int log_args_encode(const char *fmt, va_list ap, uint8_t *out)
+{
+	const char *p = fmt;
+	log_arg_type_t type;
+	int stars, precision, i, len = 0;
+
+	while ((p = strchr(p, '%'))) {
+		if (p[1] == '%') {
+			p += 2;
+			continue;
+		}
+
+		p = log_fmt_spec(p + 1, &type, &stars, &precision);
+
+		if (type == LOG_ARG_BAD) {
+			return -1;
+		}
+
+		for (i = 0; i < stars; i++) {
+			int v = va_arg(ap, int);
+			if (out) {
+				memcpy(out + len, &v, sizeof(v));
+			}
+			len += sizeof(v);
+			if (precision == -2 && i == stars - 1) {
+				/* a negative precision counts as none */
+				precision = v < 0 ? -1 : v;
+			}
+		}
+
+#define LOG_ARG_COPY(_type) {											\
+			_type v = va_arg(ap, _type);								\
+			if (out) {													\
+				memcpy(out + len, &v, sizeof(v));						\
+			}															\
+			len += sizeof(v);											\
+		}
+
+		switch (type) {
+		case LOG_ARG_INT:
+			LOG_ARG_COPY(int);
+			break;
+		case LOG_ARG_LONG:
+			LOG_ARG_COPY(long);
+			break;
+		case LOG_ARG_LLONG:
+			LOG_ARG_COPY(long long);
+			break;
+		case LOG_ARG_SIZE:
+			LOG_ARG_COPY(size_t);
+			break;
+		case LOG_ARG_INTMAX:
+			LOG_ARG_COPY(intmax_t);
+			break;
+		case LOG_ARG_PTRDIFF:
+			LOG_ARG_COPY(ptrdiff_t);
+			break;
+		case LOG_ARG_DOUBLE:
+			LOG_ARG_COPY(double);
+			break;
+		case LOG_ARG_PTR:
+			LOG_ARG_COPY(void *);
+			break;
+		case LOG_ARG_STR:
+			{
+				const char *s = va_arg(ap, const char *);
+				uint32_t slen = UINT32_MAX;
+
+				/* with a precision the string need not be terminated, never read past it */
+				if (s) {
+					slen = (uint32_t) (precision >= 0 ? strnlen(s, (size_t) precision) : strlen(s));
+				}
+
+				if (out) {
+					memcpy(out + len, &slen, sizeof(slen));
+					if (s) {
+						memcpy(out + len + sizeof(slen), s, slen);
+					}
+				}
+				len += sizeof(slen) + (s ? slen : 0);
+			}
+			break;
+		default:
+			break;
+		}
+#undef LOG_ARG_COPY
+	}
+
+	return len;
+}
+
+typedef struct {
+	char *data;
+	switch_size_t len;
+	switch_size_t size;
+} log_buf_t;
+
+static void log_buf_grow(log_buf_t *b, switch_size_t need)
+{
+	if (b->len + need + 1 > b->size) {
+		void *mem;
+
+		while (b->len + need + 1 > b->size) {
+			b->size = b->size ? b->size * 2 : 1024;
+		}
+		mem = realloc(b->data, b->size);
+		switch_assert(mem);
+		b->data = mem;
+	}
+}
+
+static void log_buf_append(log_buf_t *b, const char *s, switch_size_t len)
+{
+	log_buf_grow(b, len);
+	memcpy(b->data + b->len, s, len);
+	b->len += len;
+	b->data[b->len] = '\0';
+}
+
+#define LOG_BUF_PRINTF(_b, ...) {											\
+		int _r = snprintf((_b)->data + (_b)->len, (_b)->size - (_b)->len, __VA_ARGS__); \
+		if (_r >= 0 && (switch_size_t) _r >= (_b)->size - (_b)->len) {	\
+			log_buf_grow((_b), _r);										\
+			_r = snprintf((_b)->data + (_b)->len, (_b)->size - (_b)->len, __VA_ARGS__); \
+		}																\
+		if (_r > 0) {													\
+			(_b)->len += _r;											\
+		}																\
+	}
+
+/* format a record's message the way vasprintf would have */
+static void log_args_render(log_buf_t *b, const char *fmt, const uint8_t *args)
+{
+	const char *p = fmt, *start;
+	char spec[64];
+	log_arg_type_t type;
+	int stars, precision, star[2] = { 0 }, i;
+
+	log_buf_grow(b, 0);
+
+	while (*p) {
+		const char *pct = strchr(p, '%');
+
+		if (!pct) {
+			log_buf_append(b, p, strlen(p));
+			break;
+		}
+
+		if (pct > p) {
+			log_buf_append(b, p, pct - p);
+		}
+
+		if (pct[1] == '%') {
+			log_buf_append(b, "%", 1);
+			p = pct + 2;
+			continue;
+		}
+
+		start = pct;
+		p = log_fmt_spec(pct + 1, &type, &stars, &precision);
+
+		if ((switch_size_t) (p - start) >= sizeof(spec)) {
+			log_buf_append(b, start, p - start);
+			continue;
+		}
+
+		memcpy(spec, start, p - start);
+		spec[p - start] = '\0';
+
+		for (i = 0; i < stars; i++) {
+			memcpy(&star[i], args, sizeof(int));
+			args += sizeof(int);
+		}
+
+#define LOG_ARG_PRINT(_type) {											\
+			_type v;													\
+			memcpy(&v, args, sizeof(v));								\
+			args += sizeof(v);											\
+			if (stars == 2) {											\
+				LOG_BUF_PRINTF(b, spec, star[0], star[1], v);			\
+			} else if (stars == 1) {									\
+				LOG_BUF_PRINTF(b, spec, star[0], v);					\
+			} else {													\
+				LOG_BUF_PRINTF(b, spec, v);								\
+			}															\
+		}
+
+		switch (type) {
+		case LOG_ARG_INT:
+			LOG_ARG_PRINT(int);
+			break;
+		case LOG_ARG_LONG:
+			LOG_ARG_PRINT(long);
+			break;
+		case LOG_ARG_LLONG:
+			LOG_ARG_PRINT(long long);
+			break;
+		case LOG_ARG_SIZE:
+			LOG_ARG_PRINT(size_t);
+			break;
+		case LOG_ARG_INTMAX:
+			LOG_ARG_PRINT(intmax_t);
+			break;
+		case LOG_ARG_PTRDIFF:
+			LOG_ARG_PRINT(ptrdiff_t);
+			break;
+		case LOG_ARG_DOUBLE:
+			LOG_ARG_PRINT(double);
+			break;
+		case LOG_ARG_PTR:
+			LOG_ARG_PRINT(void *);
+			break;
+		case LOG_ARG_STR:
+			{
+				uint32_t slen;
+				char *s, sbuf[256];
+
+				memcpy(&slen, args, sizeof(slen));
+				args += sizeof(slen);
+
+				if (slen == UINT32_MAX) {
+					s = "(null)";
+				} else {
+					s = slen < sizeof(sbuf) ? sbuf : malloc(slen + 1);
+					switch_assert(s);
+					memcpy(s, args, slen);
+					s[slen] = '\0';
+					args += slen;
+				}
+
+				if (!strcmp(spec, "%s")) {
+					log_buf_append(b, s, strlen(s));
+				} else if (stars == 2) {
+					LOG_BUF_PRINTF(b, spec, star[0], star[1], s);
+				} else if (stars == 1) {
+					LOG_BUF_PRINTF(b, spec, star[0], s);
+				} else {
+					LOG_BUF_PRINTF(b, spec, s);
+				}
+
+				if (slen != UINT32_MAX && s != sbuf) {
+					free(s);
+				}
+			}
+			break;
+		default:
+			break;
+		}
+#undef LOG_ARG_PRINT
+	}
+}
+
+/* size must be a power of 2 */
+static log_ring_t *log_ring_create(uint32_t size)
+{
+	log_ring_t *ring;
+
+	switch_zmalloc(ring, sizeof(*ring));
+	ring->buf = malloc(size);
+	switch_assert(ring->buf);
+	ring->size = size;
+	ring->mask = size - 1;
+
+	return ring;
+}
+
+#ifndef WIN32
+static void log_ring_release(void *ptr)
+{
+	log_ring_t *ring = (log_ring_t *) ptr;
+
+	if (ring == &LOG_NO_RING) {
+		return;
+	}
+
+	/* the logger hands it to a new thread or frees it once it has drained it */
+	switch_atomic_set_release(&ring->state, LOG_RING_DEAD);
+}
+#endif
+
+/* the calling thread's ring, recycled from an exited thread when possible */
+static log_ring_t *log_thread_ring(void)
+{
+#ifdef WIN32
+	return NULL;
+#else
+	log_ring_t *ring;
+
+	if ((ring = pthread_getspecific(LOG_RING_KEY))) {
+		return ring;
+	}
+
+	if (!LOG_RING_MUTEX) {
+		return NULL;
+	}
+
+	switch_mutex_lock(LOG_RING_MUTEX);
+	for (ring = LOG_RINGS; ring; ring = ring->next) {
+		if (switch_atomic_cas(&ring->state, LOG_RING_OWNED, LOG_RING_FREE) == LOG_RING_FREE) {
+			break;
+		}
+	}
+
+	if (!ring) {
+		if (LOG_RING_COUNT < LOG_RING_MAX) {
+			ring = log_ring_create(LOG_RING_SIZE);
+			ring->state = LOG_RING_OWNED;
+			ring->next = LOG_RINGS;
+			switch_atomic_casptr((volatile void **) &LOG_RINGS, ring, ring->next);
+			LOG_RING_COUNT++;
+		} else {
+			/* the pool is full, this thread formats its lines on the spot for the rest of its life */
+			ring = &LOG_NO_RING;
+		}
+	}
+	switch_mutex_unlock(LOG_RING_MUTEX);
+
+	pthread_setspecific(LOG_RING_KEY, ring);
+
+	return ring;
+#endif
+}
+
+static void log_wake(void)
+{
+	if (switch_atomic_read(&LOG_SLEEPING)) {
+		switch_mutex_lock(LOG_WAKE_MUTEX);
+		switch_thread_cond_signal(LOG_WAKE_COND);
+		switch_mutex_unlock(LOG_WAKE_MUTEX);
+	}
+}
+
+/* append one record, SWITCH_STATUS_BREAK when the ring is full and SWITCH_STATUS_FALSE if it has to be formatted on the spot */
+static switch_status_t log_ring_write(log_ring_t *ring, switch_text_channel_t channel, const char *file, const char *func, int line,
+									  const char *userdata, switch_log_level_t level, switch_time_t now, const char *fmt, va_list ap)
+{
+	log_record_t *rec;
+	uint32_t file_len, func_len, userdata_len, fmt_len, size, head, off, need;
+	uint8_t *p;
+	int args_len;
+	va_list aq;
+
+	if (!ring || !ring->size) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	va_copy(aq, ap);
+	args_len = log_args_encode(fmt, aq, NULL);
+	va_end(aq);
+
+	if (args_len < 0) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	file_len = (uint32_t) strlen(file);
+	func_len = (uint32_t) strlen(func);
+	userdata_len = userdata ? (uint32_t) strlen(userdata) : 0;
+	fmt_len = (uint32_t) strlen(fmt);
+
+	if (file_len >= UINT16_MAX || func_len >= UINT16_MAX || userdata_len >= UINT16_MAX || fmt_len >= UINT16_MAX) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	size = LOG_RECORD_ALIGN(sizeof(*rec) + file_len + func_len + userdata_len + fmt_len + 4 + args_len);
+
+	if (size > ring->size / 4) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	head = switch_atomic_read(&ring->head);
+	off = head & ring->mask;
+	/* records never wrap, the tail of the ring is skipped instead */
+	need = ring->size - off < size ? ring->size - off + size : size;
+
+	if (ring->size - (head - switch_atomic_read_acquire(&ring->tail)) < need) {
+		return SWITCH_STATUS_BREAK;
+	}
+
+	if (need > size) {
+		rec = (log_record_t *) (ring->buf + off);
+		rec->size = ring->size - off;
+		rec->flags = LOG_RECORD_SKIP;
+		off = 0;
+	}
+
+	rec = (log_record_t *) (ring->buf + off);
+	rec->size = size;
+	rec->flags = 0;
+	rec->level = (uint8_t) level;
+	rec->channel = (uint8_t) channel;
+	rec->line = line;
+	rec->timestamp = now;
+	rec->file_len = (uint16_t) file_len;
+	rec->func_len = (uint16_t) func_len;
+	rec->userdata_len = userdata ? (uint16_t) userdata_len : UINT16_MAX;
+	rec->fmt_len = (uint16_t) fmt_len;
+
+	p = (uint8_t *) (rec + 1);
+	memcpy(p, file, file_len + 1);
+	p += file_len + 1;
+	memcpy(p, func, func_len + 1);
+	p += func_len + 1;
+	if (userdata) {
+		memcpy(p, userdata, userdata_len);
+	}
+	p[userdata_len] = '\0';
+	p += userdata_len + 1;
+	memcpy(p, fmt, fmt_len + 1);
+	p += fmt_len + 1;
+
+	va_copy(aq, ap);
+	log_args_encode(fmt, aq, p);
+	va_end(aq);
+
+	switch_atomic_set_release(&ring->head, head + need);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* log_ring_write() that hands a full ring straight back to the queue rather than stall the caller */
+static switch_status_t log_ring_put(log_ring_t *ring, switch_text_channel_t channel, const char *file, const char *func, int line,
+								   const char *userdata, switch_log_level_t level, switch_time_t now, const char *fmt, va_list ap)
+{
+	switch_status_t status;
+
+	if ((status = log_ring_write(ring, channel, file, func, line, userdata, level, now, fmt, ap)) == SWITCH_STATUS_BREAK) {
+		switch_atomic_inc(&LOG_RING_FALLBACKS);
+		log_wake();
+	}
+
+	return status;
+}
+
+static switch_status_t log_ring_puts(log_ring_t *ring, switch_text_channel_t channel, const char *file, const char *func, int line,
+									 const char *userdata, switch_log_level_t level, switch_time_t now, const char *fmt, ...)
+{
+	switch_status_t status;
+	va_list ap;
+
+	va_start(ap, fmt);
+	status = log_ring_put(ring, channel, file, func, line, userdata, level, now, fmt, ap);
+	va_end(ap);
+
+	return status;
+}
+
+typedef struct {
+	log_buf_t buf;
+	switch_time_t last_sec;
+	char date[32];
+} log_render_t;
+
+/* the node a binding sees for a record, formatted into r's buffer */
+static void log_record_render(log_render_t *r, log_record_t *rec, switch_log_node_t *node)
+{
+	const char *file = (const char *) (rec + 1);
+	const char *func = file + rec->file_len + 1;
+	const char *userdata = func + rec->func_len + 1;
+	const char *fmt = userdata + (rec->userdata_len == UINT16_MAX ? 0 : rec->userdata_len) + 1;
+	const uint8_t *args = (const uint8_t *) fmt + rec->fmt_len + 1;
+	switch_size_t content;
+
+	r->buf.len = 0;
+
+	if (rec->channel != SWITCH_CHANNEL_ID_LOG_CLEAN) {
+		switch_time_t sec = rec->timestamp / 1000000;
+
+		if (sec != r->last_sec) {
+			switch_time_exp_t tm;
+
+			switch_time_exp_lt(&tm, rec->timestamp);
+			switch_snprintf(r->date, sizeof(r->date), "%0.4d-%0.2d-%0.2d %0.2d:%0.2d:%0.2d",
+							tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+			r->last_sec = sec;
+		}
+
+		log_buf_grow(&r->buf, 0);
+#ifdef SWITCH_FUNC_IN_LOG
+		LOG_BUF_PRINTF(&r->buf, "%s.%.6d [%s] %s:%d %s()", r->date, (int) (rec->timestamp % 1000000), switch_log_level2str(rec->level), file, rec->line, func);
+#else
+		LOG_BUF_PRINTF(&r->buf, "%s.%.6d [%s] %s:%d", r->date, (int) (rec->timestamp % 1000000), switch_log_level2str(rec->level), file, rec->line);
+#endif
+		content = r->buf.len;
+		log_buf_append(&r->buf, " ", 1);
+	} else {
+		content = 0;
+	}
+
+	log_args_render(&r->buf, fmt, args);
+
+	node->data = r->buf.data;
+	node->content = r->buf.data + content;
+	switch_set_string(node->file, file);
+	switch_set_string(node->func, func);
+	node->line = rec->line;
+	node->level = rec->level;
+	node->timestamp = rec->timestamp;
+	node->channel = rec->channel;
+	node->userdata = rec->userdata_len == UINT16_MAX ? NULL : (char *) userdata;
+}
+
+static int log_item_cmp(const void *a, const void *b)
+{
+	const log_item_t *x = (const log_item_t *) a, *y = (const log_item_t *) b;
+
+	if (x->timestamp != y->timestamp) {
+		return x->timestamp < y->timestamp ? -1 : 1;
+	}
+
+	return x->order < y->order ? -1 : (x->order > y->order ? 1 : 0);
+}
+
+/* queue up to max - count pending records from rings, the space stays reserved until log_rings_release() */
+static uint32_t log_rings_collect(log_ring_t *rings, log_item_t *items, uint32_t count, uint32_t max, uint32_t *order)
+{
+	log_ring_t *ring;
+
+	for (ring = rings; ring; ring = ring->next) {
+		uint32_t tail = switch_atomic_read(&ring->tail), head = switch_atomic_read_acquire(&ring->head);
+
+		while (tail != head && count < max) {
+			log_record_t *rec = (log_record_t *) (ring->buf + (tail & ring->mask));
+
+			tail += rec->size;
+
+			if ((rec->flags & LOG_RECORD_SKIP)) {
+				continue;
+			}
+
+			items[count].node = NULL;
+			items[count].ring = ring;
+			items[count].record = rec;
+			items[count].timestamp = rec->timestamp;
+			items[count].order = (*order)++;
+			count++;
+		}
+
+		ring->consumed = tail;
+	}
+
+	return count;
+}
+
+static void log_rings_release(log_ring_t *rings)
+{
+	log_ring_t *ring;
+
+	for (ring = rings; ring; ring = ring->next) {
+		if (ring->consumed != switch_atomic_read(&ring->tail)) {
+			switch_atomic_set_release(&ring->tail, ring->consumed);
+		}
+	}
+}
+
+static int log_rings_pending(log_ring_t *rings)
+{
+	log_ring_t *ring;
+
+	for (ring = rings; ring; ring = ring->next) {
+		if (switch_atomic_read_acquire(&ring->head) != switch_atomic_read(&ring->tail)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/* called by the logger only: drained rings of exited threads go back to the pool, or are freed once it holds more than LOG_RING_KEEP */
+static void log_rings_reap(void)
+{
+	log_ring_t *ring, *prev = NULL, *next;
+	int dead = 0;
+
+	for (ring = LOG_RINGS; ring; ring = ring->next) {
+		if (switch_atomic_read_acquire(&ring->state) == LOG_RING_DEAD && switch_atomic_read_acquire(&ring->head) == switch_atomic_read(&ring->tail)) {
+			dead++;
+		}
+	}
+
+	if (!dead) {
+		return;
+	}
+
+	switch_mutex_lock(LOG_RING_MUTEX);
+	for (ring = LOG_RINGS; ring; ring = next) {
+		next = ring->next;
+
+		if (switch_atomic_read_acquire(&ring->state) != LOG_RING_DEAD || switch_atomic_read_acquire(&ring->head) != switch_atomic_read(&ring->tail)) {
+			prev = ring;
+			continue;
+		}
+
+		if (LOG_RING_COUNT <= LOG_RING_KEEP) {
+			switch_atomic_set(&ring->state, LOG_RING_FREE);
+			prev = ring;
+			continue;
+		}
+
+		/* no thread owns it and new rings are only linked in under the mutex, nothing else can reach it */
+		if (prev) {
+			prev->next = next;
+		} else {
+			switch_atomic_casptr((volatile void **) &LOG_RINGS, next, ring);
+		}
+		LOG_RING_COUNT--;
+		free(ring->buf);
+		free(ring);
+	}
+	switch_mutex_unlock(LOG_RING_MUTEX);
+}
+
+/* the full line as it has always looked, "<date> [<LEVEL>] <file>:<line> <message>" */
+static char *log_format_line(switch_text_channel_t channel, const char *filep, const char *funcp, int line,
+							 switch_log_level_t level, switch_time_t now, const char *fmt, va_list ap, char **content)
+{
+	char *data = NULL;
+	char *new_fmt = NULL;
+	uint32_t len;
+#ifdef SWITCH_FUNC_IN_LOG
+	const char *extra_fmt = "%s [%s] %s:%d %s()%c%s";
+#else
+	const char *extra_fmt = "%s [%s] %s:%d%c%s";
+#endif
+
+	if (channel != SWITCH_CHANNEL_ID_LOG_CLEAN) {
+		char date[80] = "";
+		switch_time_exp_t tm;
+
+		switch_time_exp_lt(&tm, now);
+		switch_snprintf(date, sizeof(date), "%0.4d-%0.2d-%0.2d %0.2d:%0.2d:%0.2d.%0.6d",
+						tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_usec);
+
+#ifdef SWITCH_FUNC_IN_LOG
+		len = (uint32_t) (strlen(extra_fmt) + strlen(date) + strlen(filep) + 32 + strlen(funcp) + strlen(fmt));
+#else
+		len = (uint32_t) (strlen(extra_fmt) + strlen(date) + strlen(filep) + 32 + strlen(fmt));
+#endif
+		new_fmt = malloc(len + 1);
+		switch_assert(new_fmt);
+#ifdef SWITCH_FUNC_IN_LOG
+		switch_snprintf(new_fmt, len, extra_fmt, date, switch_log_level2str(level), filep, line, funcp, 128, fmt);
+#else
+		switch_snprintf(new_fmt, len, extra_fmt, date, switch_log_level2str(level), filep, line, 128, fmt);
+#endif
+
+		fmt = new_fmt;
+	}
+
+	if (switch_vasprintf(&data, fmt, ap) == -1) {
+		data = NULL;
+	} else if (channel == SWITCH_CHANNEL_ID_LOG_CLEAN) {
+		*content = data;
+	} else if ((*content = strchr(data, 128))) {
+		**content = ' ';
+	}
+
+	switch_safe_free(new_fmt);
+
+	return data;
+}
+
+static switch_log_level_t log_bindings_max_level(void)
+{
+	switch_log_binding_t *binding;
+	switch_log_level_t level = 0;
+
+	for (binding = BINDINGS; binding; binding = binding->next) {
+		if (binding->level > level) {
+			level = binding->level;
+		}
+	}
+
+	return level;
+}
+
+static void log_dispatch(switch_log_node_t *node)
+{
+	switch_log_binding_t *binding;
+
+	switch_mutex_lock(BINDLOCK);
+	for (binding = BINDINGS; binding; binding = binding->next) {
+		if (binding->level >= node->level) {
+			binding->function(node, node->level);
+		}
+	}
+	switch_mutex_unlock(BINDLOCK);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_log_unbind_logger(switch_log_function_t function)
 {
 	switch_log_binding_t *ptr = NULL, *last = NULL;
@@ -237,6 +1136,7 @@ SWITCH_DECLARE(switch_status_t) switch_log_unbind_logger(switch_log_function_t f
 		}
 		last = ptr;
 	}
+	MAX_LEVEL = (uint8_t) log_bindings_max_level();
 	switch_mutex_unlock(BINDLOCK);
 
 	return status;
@@ -251,10 +1151,6 @@ SWITCH_DECLARE(switch_status_t) switch_log_bind_logger(switch_log_function_t fun
 		return SWITCH_STATUS_MEMERR;
 	}
 
-	if ((uint8_t) level > MAX_LEVEL) {
-		MAX_LEVEL = level;
-	}
-
 	binding->function = function;
 	binding->level = level;
 	binding->is_console = is_console;
@@ -271,47 +1167,107 @@ SWITCH_DECLARE(switch_status_t) switch_log_bind_logger(switch_log_function_t fun
 		console_mods_loaded++;
 	}
 	mods_loaded++;
+	MAX_LEVEL = (uint8_t) log_bindings_max_level();
 	switch_mutex_unlock(BINDLOCK);
 
 	return SWITCH_STATUS_SUCCESS;
 }
 
+SWITCH_DECLARE(switch_status_t) switch_log_set_logger_level(switch_log_function_t function, switch_log_level_t level)
+{
+	switch_log_binding_t *ptr = NULL;
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	switch_mutex_lock(BINDLOCK);
+	for (ptr = BINDINGS; ptr; ptr = ptr->next) {
+		if (ptr->function == function) {
+			ptr->level = level;
+			status = SWITCH_STATUS_SUCCESS;
+		}
+	}
+	MAX_LEVEL = (uint8_t) log_bindings_max_level();
+	switch_mutex_unlock(BINDLOCK);
+
+	return status;
+}
+
 static switch_thread_t *thread;
 
 static void *SWITCH_THREAD_FUNC log_thread(switch_thread_t *t, void *obj)
 {
+	log_item_t *items;
+	log_render_t render = { { 0 } };
+	switch_log_node_t rnode = { 0 };
+	uint32_t order = 0;
+	int stop = 0;
 
 	if (!obj) {
 		obj = NULL;
 	}
+
+#ifndef WIN32
+	/* lines logged from the bindings go through the queue, this thread can't wait on its own ring */
+	pthread_setspecific(LOG_RING_KEY, &LOG_NO_RING);
+#endif
+
+	switch_zmalloc(items, sizeof(*items) * LOG_BATCH_MAX);
 	THREAD_RUNNING = 1;
 
-	while (THREAD_RUNNING == 1) {
+	while (!stop) {
 		void *pop = NULL;
-		switch_log_node_t *node = NULL;
-		switch_log_binding_t *binding;
+		uint32_t count = 0, i;
 
-		if (switch_queue_pop(LOG_QUEUE, &pop) != SWITCH_STATUS_SUCCESS) {
-			break;
+		while (count < LOG_BATCH_MAX / 2 && switch_queue_trypop(LOG_QUEUE, &pop) == SWITCH_STATUS_SUCCESS) {
+			if (!pop) {
+				stop = 1;
+				break;
+			}
+			items[count].node = (switch_log_node_t *) pop;
+			items[count].ring = NULL;
+			items[count].record = NULL;
+			items[count].timestamp = items[count].node->timestamp;
+			items[count].order = order++;
+			count++;
 		}
 
-		if (!pop) {
-			break;
-		}
+		count = log_rings_collect(LOG_RINGS, items, count, LOG_BATCH_MAX, &order);
 
-		node = (switch_log_node_t *) pop;
-		switch_mutex_lock(BINDLOCK);
-		for (binding = BINDINGS; binding; binding = binding->next) {
-			if (binding->level >= node->level) {
-				binding->function(node, node->level);
+		if (!count) {
+			if (stop) {
+				break;
+			}
+
+			switch_mutex_lock(LOG_WAKE_MUTEX);
+			switch_atomic_set(&LOG_SLEEPING, 1);
+			if (!switch_queue_size(LOG_QUEUE) && !log_rings_pending(LOG_RINGS)) {
+				switch_thread_cond_timedwait(LOG_WAKE_COND, LOG_WAKE_MUTEX, 100000);
 			}
+			switch_atomic_set(&LOG_SLEEPING, 0);
+			switch_mutex_unlock(LOG_WAKE_MUTEX);
+
+			log_rings_reap();
+			continue;
 		}
-		switch_mutex_unlock(BINDLOCK);
 
-		switch_log_node_free(&node);
+		qsort(items, count, sizeof(*items), log_item_cmp);
 
+		for (i = 0; i < count; i++) {
+			if (items[i].node) {
+				log_dispatch(items[i].node);
+				switch_log_node_free(&items[i].node);
+			} else if (items[i].record->level <= MAX_LEVEL) {
+				log_record_render(&render, items[i].record, &rnode);
+				log_dispatch(&rnode);
+			}
+		}
+
+		log_rings_release(LOG_RINGS);
+		log_rings_reap();
 	}
 
+	switch_safe_free(render.buf.data);
+	free(items);
+
 	THREAD_RUNNING = 0;
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Logger Ended.\n");
 	return NULL;
@@ -332,19 +1288,11 @@ SWITCH_DECLARE(void) switch_log_vprintf(switch_text_channel_t channel, const cha
 										const char *userdata, switch_log_level_t level, const char *fmt, va_list ap)
 {
 	char *data = NULL;
-	char *new_fmt = NULL;
-	int ret = 0;
 	FILE *handle;
 	const char *filep = (file ? switch_cut_path(file) : "");
 	const char *funcp = (func ? func : "");
 	char *content = NULL;
 	switch_time_t now = switch_micro_time_now();
-	uint32_t len;
-#ifdef SWITCH_FUNC_IN_LOG
-	const char *extra_fmt = "%s [%s] %s:%d %s()%c%s";
-#else
-	const char *extra_fmt = "%s [%s] %s:%d%c%s";
-#endif
 	switch_log_level_t limit_level = runtime.hard_log_level;
 
 	if (channel == SWITCH_CHANNEL_ID_SESSION && userdata) {
@@ -368,50 +1316,51 @@ SWITCH_DECLARE(void) switch_log_vprintf(switch_text_channel_t channel, const cha
 
 	switch_assert(level < SWITCH_LOG_INVALID);
 
-	handle = switch_core_data_channel(channel);
+	if (channel != SWITCH_CHANNEL_ID_EVENT && console_mods_loaded && do_mods) {
+		const char *uuid = NULL;
+		switch_status_t status;
+		log_ring_t *ring;
 
-	if (channel != SWITCH_CHANNEL_ID_LOG_CLEAN) {
-		char date[80] = "";
-		//switch_size_t retsize;
-		switch_time_exp_t tm;
+		/* no binding wants it, don't bother formatting it */
+		if (level > MAX_LEVEL) {
+			return;
+		}
 
-		switch_time_exp_lt(&tm, now);
-		switch_snprintf(date, sizeof(date), "%0.4d-%0.2d-%0.2d %0.2d:%0.2d:%0.2d.%0.6d",
-						tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, tm.tm_usec);
+		if (channel == SWITCH_CHANNEL_ID_SESSION) {
+			uuid = userdata ? switch_core_session_get_uuid((switch_core_session_t *) userdata) : NULL;
+		} else if (!zstr(userdata)) {
+			uuid = userdata;
+		}
 
-		//switch_strftime_nocheck(date, &retsize, sizeof(date), "%Y-%m-%d %T", &tm);
+		ring = log_thread_ring();
+		status = log_ring_put(ring, channel, filep, funcp, line, uuid, level, now, fmt, ap);
 
-#ifdef SWITCH_FUNC_IN_LOG
-		len = (uint32_t) (strlen(extra_fmt) + strlen(date) + strlen(filep) + 32 + strlen(funcp) + strlen(fmt));
-#else
-		len = (uint32_t) (strlen(extra_fmt) + strlen(date) + strlen(filep) + 32 + strlen(fmt));
-#endif
-		new_fmt = malloc(len + 1);
-		switch_assert(new_fmt);
-#ifdef SWITCH_FUNC_IN_LOG
-		switch_snprintf(new_fmt, len, extra_fmt, date, switch_log_level2str(level), filep, line, funcp, 128, fmt);
-#else
-		switch_snprintf(new_fmt, len, extra_fmt, date, switch_log_level2str(level), filep, line, 128, fmt);
-#endif
+		if (status == SWITCH_STATUS_FALSE && ring && ring->size) {
+			/* a format we can't defer still goes through the ring so the thread's lines stay in order */
+			char *msg = NULL;
+			va_list aq;
 
-		fmt = new_fmt;
+			va_copy(aq, ap);
+			if (switch_vasprintf(&msg, fmt, aq) != -1) {
+				status = log_ring_puts(ring, channel, filep, funcp, line, uuid, level, now, "%s", msg);
+				free(msg);
+			}
+			va_end(aq);
+		}
+
+		if (status == SWITCH_STATUS_SUCCESS) {
+			log_wake();
+			return;
+		}
 	}
 
-	ret = switch_vasprintf(&data, fmt, ap);
+	handle = switch_core_data_channel(channel);
 
-	if (ret == -1) {
+	if (!(data = log_format_line(channel, filep, funcp, line, level, now, fmt, ap, &content))) {
 		fprintf(stderr, "Memory Error\n");
 		goto end;
 	}
 
-	if (channel == SWITCH_CHANNEL_ID_LOG_CLEAN) {
-		content = data;
-	} else {
-		if ((content = strchr(data, 128))) {
-			*content = ' ';
-		}
-	}
-
 	if (channel == SWITCH_CHANNEL_ID_EVENT) {
 		switch_event_t *event;
 		if (switch_event_running() == SWITCH_STATUS_SUCCESS && switch_event_create(&event, SWITCH_EVENT_LOG) == SWITCH_STATUS_SUCCESS) {
@@ -488,16 +1437,229 @@ SWITCH_DECLARE(void) switch_log_vprintf(switch_text_channel_t channel, const cha
 
 		if (switch_queue_trypush(LOG_QUEUE, node) != SWITCH_STATUS_SUCCESS) {
 			switch_log_node_free(&node);
+		} else {
+			log_wake();
 		}
 	}
 
   end:
 
 	switch_safe_free(data);
-	switch_safe_free(new_fmt);
 
 }
 
+typedef struct {
+	int deferred;
+	uint32_t lines;
+	uint32_t threads;
+	switch_queue_t *queue;
+	log_ring_t *rings;
+	volatile switch_atomic_t go;
+	volatile switch_atomic_t produce_usec;
+	volatile switch_atomic_t stalls;
+	volatile switch_atomic_t stall_usec;
+	switch_time_t end;
+	switch_size_t bytes;
+} log_bench_t;
+
+typedef struct {
+	log_bench_t *bench;
+	log_ring_t *ring;
+} log_bench_producer_t;
+
+static void log_bench_line(log_bench_t *bench, log_ring_t *ring, const char *fmt, ...)
+{
+	switch_time_t now = switch_micro_time_now();
+	va_list ap;
+
+	va_start(ap, fmt);
+
+	if (bench->deferred) {
+		while (log_ring_write(ring, SWITCH_CHANNEL_ID_LOG, "switch_log.c", "log_bench_line", __LINE__, NULL, SWITCH_LOG_DEBUG, now, fmt, ap) != SWITCH_STATUS_SUCCESS) {
+			switch_time_t stalled = switch_time_now();
+
+			switch_atomic_inc(&bench->stalls);
+			switch_cond_next();
+			switch_atomic_add(&bench->stall_usec, (uint32_t) (switch_time_now() - stalled));
+		}
+	} else {
+		switch_log_node_t *node = switch_log_node_alloc();
+		char *content = NULL;
+
+		node->data = log_format_line(SWITCH_CHANNEL_ID_LOG, "switch_log.c", "log_bench_line", __LINE__, SWITCH_LOG_DEBUG, now, fmt, ap, &content);
+		switch_set_string(node->file, "switch_log.c");
+		switch_set_string(node->func, "log_bench_line");
+		node->line = __LINE__;
+		node->level = SWITCH_LOG_DEBUG;
+		node->content = content;
+		node->timestamp = now;
+		node->channel = SWITCH_CHANNEL_ID_LOG;
+		node->userdata = NULL;
+		switch_queue_push(bench->queue, node);
+	}
+
+	va_end(ap);
+}
+
+static void *SWITCH_THREAD_FUNC log_bench_producer(switch_thread_t *t, void *obj)
+{
+	log_bench_producer_t *producer = (log_bench_producer_t *) obj;
+	log_bench_t *bench = producer->bench;
+	switch_time_t start;
+	uint32_t i;
+
+	while (!switch_atomic_read(&bench->go)) {
+		switch_cond_next();
+	}
+
+	start = switch_time_now();
+
+	for (i = 0; i < bench->lines; i++) {
+		log_bench_line(bench, producer->ring, "Channel [%s] has been answered, codec %s@%dhz %dms remote %s:%d seq %u ts %u\n",
+					   "sofia/internal/1000@10.0.0.1", "PCMU", 8000, 20, "10.0.0.2", 16384 + (i & 1023), i, i * 160);
+	}
+
+	switch_atomic_add(&bench->produce_usec, (uint32_t) (switch_time_now() - start));
+
+	return NULL;
+}
+
+static void *SWITCH_THREAD_FUNC log_bench_consumer(switch_thread_t *t, void *obj)
+{
+	log_bench_t *bench = (log_bench_t *) obj;
+	uint32_t total = bench->lines * bench->threads, seen = 0, order = 0;
+	log_item_t *items = NULL;
+	log_render_t render = { { 0 } };
+	switch_log_node_t rnode = { 0 };
+
+	if (bench->deferred) {
+		switch_zmalloc(items, sizeof(*items) * LOG_BATCH_MAX);
+	}
+
+	while (seen < total) {
+		if (bench->deferred) {
+			uint32_t count, i;
+
+			if (!(count = log_rings_collect(bench->rings, items, 0, LOG_BATCH_MAX, &order))) {
+				switch_cond_next();
+				continue;
+			}
+
+			qsort(items, count, sizeof(*items), log_item_cmp);
+
+			for (i = 0; i < count; i++) {
+				log_record_render(&render, items[i].record, &rnode);
+				bench->bytes += strlen(rnode.data);
+			}
+
+			log_rings_release(bench->rings);
+			seen += count;
+		} else {
+			void *pop = NULL;
+			switch_log_node_t *node;
+
+			if (switch_queue_pop(bench->queue, &pop) != SWITCH_STATUS_SUCCESS) {
+				break;
+			}
+
+			node = (switch_log_node_t *) pop;
+			bench->bytes += strlen(node->data);
+			switch_log_node_free(&node);
+			seen++;
+		}
+	}
+
+	bench->end = switch_time_now();
+	switch_safe_free(render.buf.data);
+	switch_safe_free(items);
+
+	return NULL;
+}
+
+SWITCH_DECLARE(void) switch_log_bench(switch_stream_handle_t *stream, uint32_t lines, uint32_t threads)
+{
+	switch_memory_pool_t *pool = NULL;
+	log_ring_t *ring;
+	uint32_t rings = 0, owned = 0;
+	int deferred;
+
+	if (!lines || !threads || threads > 64) {
+		return;
+	}
+
+	stream->write_function(stream, "%u lines from %u thread%s\n", lines, threads, threads == 1 ? "" : "s");
+	stream->write_function(stream, "%-10s %12s %14s %10s %12s\n", "path", "ns/line", "lines/sec", "stalls", "bytes");
+
+	for (deferred = 0; deferred < 2; deferred++) {
+		log_bench_t bench = { 0 };
+		log_bench_producer_t producers[64] = { { 0 } };
+		switch_thread_t *producer_threads[64] = { 0 }, *consumer = NULL;
+		switch_threadattr_t *thd_attr = NULL;
+		switch_status_t st;
+		switch_time_t start;
+		uint32_t i;
+
+		switch_core_new_memory_pool(&pool);
+
+		bench.deferred = deferred;
+		bench.lines = lines;
+		bench.threads = threads;
+
+		if (deferred) {
+			for (i = 0; i < threads; i++) {
+				producers[i].ring = log_ring_create(LOG_BENCH_RING_SIZE);
+				producers[i].ring->next = bench.rings;
+				bench.rings = producers[i].ring;
+			}
+		} else {
+			switch_queue_create(&bench.queue, SWITCH_CORE_QUEUE_LEN, pool);
+		}
+
+		switch_threadattr_create(&thd_attr, pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+
+		switch_thread_create(&consumer, thd_attr, log_bench_consumer, &bench, pool);
+
+		for (i = 0; i < threads; i++) {
+			producers[i].bench = &bench;
+			switch_thread_create(&producer_threads[i], thd_attr, log_bench_producer, &producers[i], pool);
+		}
+
+		start = switch_time_now();
+		switch_atomic_set(&bench.go, 1);
+
+		for (i = 0; i < threads; i++) {
+			switch_thread_join(&st, producer_threads[i]);
+		}
+		switch_thread_join(&st, consumer);
+
+		stream->write_function(stream, "%-10s %10.1fns %14.0f %10u %12.0f\n", deferred ? "deferred" : "formatted",
+							   (double) (switch_atomic_read(&bench.produce_usec) - switch_atomic_read(&bench.stall_usec)) * 1000 / ((double) lines * threads),
+							   (double) lines * threads * 1000000 / (double) (bench.end > start ? bench.end - start : 1),
+							   switch_atomic_read(&bench.stalls), (double) bench.bytes);
+
+		while ((ring = bench.rings)) {
+			bench.rings = ring->next;
+			free(ring->buf);
+			free(ring);
+		}
+
+		switch_core_destroy_memory_pool(&pool);
+	}
+
+	switch_mutex_lock(LOG_RING_MUTEX);
+	for (ring = LOG_RINGS; ring; ring = ring->next) {
+		rings++;
+		if (switch_atomic_read(&ring->state) == LOG_RING_OWNED) {
+			owned++;
+		}
+	}
+	switch_mutex_unlock(LOG_RING_MUTEX);
+
+	stream->write_function(stream, "logger: %u thread rings, %u in use, %u lines formatted on the spot because a ring was full\n",
+						   rings, owned, switch_atomic_read(&LOG_RING_FALLBACKS));
+}
+
 SWITCH_DECLARE(switch_status_t) switch_log_init(switch_memory_pool_t *pool, switch_bool_t colorize)
 {
 	switch_threadattr_t *thd_attr;;
@@ -515,6 +1677,12 @@ SWITCH_DECLARE(switch_status_t) switch_log_init(switch_memory_pool_t *pool, swit
 	switch_queue_create(&LOG_RECYCLE_QUEUE, SWITCH_CORE_QUEUE_LEN, LOG_POOL);
 #endif
 	switch_mutex_init(&BINDLOCK, SWITCH_MUTEX_NESTED, LOG_POOL);
+	switch_mutex_init(&LOG_RING_MUTEX, SWITCH_MUTEX_NESTED, LOG_POOL);
+	switch_mutex_init(&LOG_WAKE_MUTEX, SWITCH_MUTEX_NESTED, LOG_POOL);
+	switch_thread_cond_create(&LOG_WAKE_COND, LOG_POOL);
+#ifndef WIN32
+	pthread_key_create(&LOG_RING_KEY, log_ring_release);
+#endif
 	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 	switch_thread_create(&thread, thd_attr, log_thread, NULL, LOG_POOL);
 
@@ -560,6 +1728,7 @@ SWITCH_DECLARE(switch_status_t) switch_log_shutdown(void)
 
 	THREAD_RUNNING = -1;
 	switch_queue_push(LOG_QUEUE, NULL);
+	log_wake();
 	while (THREAD_RUNNING) {
 		switch_cond_next();
 	}
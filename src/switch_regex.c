@@ -32,6 +32,7 @@
 
 #include <switch.h>
 #include <pcre.h>
+#include "private/switch_core_pvt.h"
 
 SWITCH_DECLARE(switch_regex_t *) switch_regex_compile(const char *pattern,
 													  int options, const char **errorptr, int *erroroffset, const unsigned char *tables)
@@ -52,11 +53,340 @@ SWITCH_DECLARE(void) switch_regex_free(void *data)
 
 }
 
+/* Compiled pattern cache: patterns are compiled and studied once and kept, keyed by their compile
+   flags and text, in a few lock-striped hashes each with its own LRU list.  Matches run against
+   the shared compiled pattern under a reference, and a caller that is handed the pattern back
+   gets its own copy to free as before. */
+
+#define REGEX_CACHE_STRIPES 16
+#define REGEX_CACHE_DEFAULT_SIZE 4096
+
+typedef struct regex_cache_entry_s {
+	char *key;
+	pcre *re;
+	pcre_extra *extra;
+	uint32_t refs;
+	int evicted;
+	struct regex_cache_entry_s *prev;
+	struct regex_cache_entry_s *next;
+} regex_cache_entry_t;
+
+typedef struct {
+	switch_mutex_t *mutex;
+	switch_hash_t *hash;
+	regex_cache_entry_t *head;
+	regex_cache_entry_t *tail;
+	uint32_t count;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	uint64_t errors;
+} regex_cache_stripe_t;
+
+static struct {
+	int ready;
+	uint32_t size;
+	regex_cache_stripe_t stripes[REGEX_CACHE_STRIPES];
+} REGEX_CACHE = { 0, REGEX_CACHE_DEFAULT_SIZE };
+
+static void regex_cache_entry_free(regex_cache_entry_t *entry)
+{
+	if (entry->extra) {
+		pcre_free(entry->extra);
+	}
+	pcre_free(entry->re);
+	free(entry->key);
+	free(entry);
+}
+
+/* take an entry out of its stripe, freeing it now unless a match still holds it */
+static void regex_cache_unlink(regex_cache_stripe_t *stripe, regex_cache_entry_t *entry)
+{
+	switch_core_hash_delete(stripe->hash, entry->key);
+
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		stripe->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		stripe->tail = entry->prev;
+	}
+
+	entry->prev = entry->next = NULL;
+	stripe->count--;
+
+	if (entry->refs) {
+		entry->evicted = 1;
+	} else {
+		regex_cache_entry_free(entry);
+	}
+}
+
+static void regex_cache_push_front(regex_cache_stripe_t *stripe, regex_cache_entry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = stripe->head;
+	if (stripe->head) {
+		stripe->head->prev = entry;
+	}
+	stripe->head = entry;
+	if (!stripe->tail) {
+		stripe->tail = entry;
+	}
+}
+
+static pcre *regex_compile_studied(const char *expression, int flags, pcre_extra **extra, const char **error, int *erroffset)
+{
+	const char *study_error = NULL;
+	pcre *re;
+
+	*extra = NULL;
+
+	if (!(re = pcre_compile(expression, flags, error, erroffset, NULL)) || *error) {
+		switch_regex_safe_free(re);
+		return NULL;
+	}
+
+	*extra = pcre_study(re, 0, &study_error);
+
+	return re;
+}
+
+/* a compiled pattern for the expression, from the cache when it is on; pair with regex_release */
+static pcre *regex_acquire(const char *expression, int flags, pcre_extra **extra, regex_cache_entry_t **entryp, const char **error, int *erroffset)
+{
+	regex_cache_stripe_t *stripe;
+	regex_cache_entry_t *entry, *found;
+	switch_ssize_t klen = -1;
+	uint32_t limit;
+	char kbuf[256];
+	char *key;
+	pcre *re;
+
+	*entryp = NULL;
+	*error = NULL;
+
+	if (!REGEX_CACHE.ready || !REGEX_CACHE.size) {
+		return regex_compile_studied(expression, flags, extra, error, erroffset);
+	}
+
+	if (strlen(expression) + 10 < sizeof(kbuf)) {
+		switch_snprintf(kbuf, sizeof(kbuf), "%x/%s", flags, expression);
+		key = kbuf;
+	} else {
+		key = switch_mprintf("%x/%s", flags, expression);
+	}
+
+	stripe = &REGEX_CACHE.stripes[switch_hashfunc_default(key, &klen) % REGEX_CACHE_STRIPES];
+
+	switch_mutex_lock(stripe->mutex);
+	if ((entry = switch_core_hash_find(stripe->hash, key))) {
+		stripe->hits++;
+		entry->refs++;
+		if (entry != stripe->head) {
+			entry->prev->next = entry->next;
+			if (entry->next) {
+				entry->next->prev = entry->prev;
+			} else {
+				stripe->tail = entry->prev;
+			}
+			regex_cache_push_front(stripe, entry);
+		}
+	} else {
+		stripe->misses++;
+	}
+	switch_mutex_unlock(stripe->mutex);
+
+	if (entry) {
+		goto end;
+	}
+
+	/* compile outside the lock, a racing thread may beat us to the insert */
+	if (!(re = regex_compile_studied(expression, flags, extra, error, erroffset))) {
+		switch_mutex_lock(stripe->mutex);
+		stripe->errors++;
+		switch_mutex_unlock(stripe->mutex);
+		goto end;
+	}
+
+	switch_zmalloc(entry, sizeof(*entry));
+	entry->key = strdup(key);
+	entry->re = re;
+	entry->extra = *extra;
+	entry->refs = 1;
+
+	limit = REGEX_CACHE.size / REGEX_CACHE_STRIPES;
+	if (!limit) {
+		limit = 1;
+	}
+
+	switch_mutex_lock(stripe->mutex);
+	if ((found = switch_core_hash_find(stripe->hash, key))) {
+		found->refs++;
+		switch_mutex_unlock(stripe->mutex);
+		regex_cache_entry_free(entry);
+		entry = found;
+		goto end;
+	}
+
+	while (stripe->count >= limit && stripe->tail) {
+		regex_cache_unlink(stripe, stripe->tail);
+		stripe->evictions++;
+	}
+
+	switch_core_hash_insert(stripe->hash, entry->key, entry);
+	regex_cache_push_front(stripe, entry);
+	stripe->count++;
+	switch_mutex_unlock(stripe->mutex);
+
+  end:
+
+	if (key != kbuf) {
+		free(key);
+	}
+
+	if (!entry) {
+		return NULL;
+	}
+
+	*entryp = entry;
+	*extra = entry->extra;
+
+	return entry->re;
+}
+
+static void regex_release(pcre *re, pcre_extra *extra, regex_cache_entry_t *entry)
+{
+	regex_cache_stripe_t *stripe;
+	switch_ssize_t klen = -1;
+
+	if (!entry) {
+		if (extra) {
+			pcre_free(extra);
+		}
+		switch_regex_safe_free(re);
+		return;
+	}
+
+	stripe = &REGEX_CACHE.stripes[switch_hashfunc_default(entry->key, &klen) % REGEX_CACHE_STRIPES];
+
+	switch_mutex_lock(stripe->mutex);
+	if (!--entry->refs && entry->evicted) {
+		regex_cache_entry_free(entry);
+	}
+	switch_mutex_unlock(stripe->mutex);
+}
+
+/* hand the caller a pattern it owns: the cached one stays put and it gets a copy */
+static pcre *regex_detach(pcre *re, pcre_extra *extra, regex_cache_entry_t *entry)
+{
+	size_t size = 0;
+	pcre *copy = NULL;
+
+	if (!entry) {
+		if (extra) {
+			pcre_free(extra);
+		}
+		return re;
+	}
+
+	if (!pcre_fullinfo(re, NULL, PCRE_INFO_SIZE, &size) && (copy = pcre_malloc(size))) {
+		memcpy(copy, re, size);
+	}
+
+	regex_release(re, extra, entry);
+
+	return copy;
+}
+
+void switch_regex_cache_init(switch_memory_pool_t *pool)
+{
+	int i;
+
+	for (i = 0; i < REGEX_CACHE_STRIPES; i++) {
+		switch_mutex_init(&REGEX_CACHE.stripes[i].mutex, SWITCH_MUTEX_NESTED, pool);
+		switch_core_hash_init(&REGEX_CACHE.stripes[i].hash, pool);
+	}
+
+	REGEX_CACHE.ready = 1;
+}
+
+SWITCH_DECLARE(void) switch_regex_cache_flush(void)
+{
+	int i;
+
+	if (!REGEX_CACHE.ready) {
+		return;
+	}
+
+	for (i = 0; i < REGEX_CACHE_STRIPES; i++) {
+		regex_cache_stripe_t *stripe = &REGEX_CACHE.stripes[i];
+
+		switch_mutex_lock(stripe->mutex);
+		while (stripe->head) {
+			regex_cache_unlink(stripe, stripe->head);
+		}
+		switch_mutex_unlock(stripe->mutex);
+	}
+}
+
+void switch_regex_cache_shutdown(void)
+{
+	int i;
+
+	switch_regex_cache_flush();
+	REGEX_CACHE.ready = 0;
+
+	for (i = 0; i < REGEX_CACHE_STRIPES; i++) {
+		switch_core_hash_destroy(&REGEX_CACHE.stripes[i].hash);
+	}
+}
+
+SWITCH_DECLARE(void) switch_regex_cache_set_size(uint32_t size)
+{
+	REGEX_CACHE.size = size;
+
+	if (!size) {
+		switch_regex_cache_flush();
+	}
+}
+
+SWITCH_DECLARE(void) switch_regex_cache_stats(switch_stream_handle_t *stream, switch_bool_t reset)
+{
+	uint64_t hits = 0, misses = 0, evictions = 0, errors = 0;
+	uint32_t count = 0;
+	int i;
+
+	for (i = 0; REGEX_CACHE.ready && i < REGEX_CACHE_STRIPES; i++) {
+		regex_cache_stripe_t *stripe = &REGEX_CACHE.stripes[i];
+
+		switch_mutex_lock(stripe->mutex);
+		count += stripe->count;
+		hits += stripe->hits;
+		misses += stripe->misses;
+		evictions += stripe->evictions;
+		errors += stripe->errors;
+		if (reset) {
+			stripe->hits = stripe->misses = stripe->evictions = stripe->errors = 0;
+		}
+		switch_mutex_unlock(stripe->mutex);
+	}
+
+	stream->write_function(stream, "size,max,hits,misses,hit_rate,evictions,errors\n");
+	stream->write_function(stream, "%u,%u,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%.1f%%,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT "\n",
+						   count, REGEX_CACHE.size, hits, misses, hits + misses ? hits * 100.0 / (hits + misses) : 0.0, evictions, errors);
+}
+
 SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expression, switch_regex_t **new_re, int *ovector, uint32_t olen)
 {
 	const char *error = NULL;
 	int erroffset = 0;
 	pcre *re = NULL;
+	pcre_extra *extra = NULL;
+	regex_cache_entry_t *entry = NULL;
 	int match_count = 0;
 	char *tmp = NULL;
 	uint32_t flags = 0;
@@ -92,19 +422,13 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 		}
 	}
 
-	re = pcre_compile(expression,	/* the pattern */
-					  flags,	/* default options */
-					  &error,	/* for error message */
-					  &erroffset,	/* for error offset */
-					  NULL);	/* use default character tables */
-	if (error) {
+	if (!(re = regex_acquire(expression, flags, &extra, &entry, &error, &erroffset))) {
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "COMPILE ERROR: %d [%s][%s]\n", erroffset, error, expression);
-		switch_regex_safe_free(re);
 		goto end;
 	}
 
 	match_count = pcre_exec(re,	/* result of pcre_compile() */
-							NULL,	/* we didn't study the pattern */
+							extra,	/* result of pcre_study() */
 							field,	/* the subject string */
 							(int) strlen(field),	/* the length of the subject string */
 							0,	/* start at offset 0 in the subject */
@@ -114,8 +438,11 @@ SWITCH_DECLARE(int) switch_regex_perform(const char *field, const char *expressi
 
 
 	if (match_count <= 0) {
-		switch_regex_safe_free(re);
+		regex_release(re, extra, entry);
+		re = NULL;
 		match_count = 0;
+	} else {
+		re = regex_detach(re, extra, entry);
 	}
 
 	*new_re = (switch_regex_t *) re;
@@ -192,20 +519,17 @@ SWITCH_DECLARE(switch_status_t) switch_regex_match_partial(const char *target, c
 	const char *error = NULL;	/* Used to hold any errors                                           */
 	int error_offset = 0;		/* Holds the offset of an error                                      */
 	pcre *pcre_prepared = NULL;	/* Holds the compiled regex                                          */
+	pcre_extra *extra = NULL;	/* Holds the study data                                              */
+	regex_cache_entry_t *entry = NULL;	/* Holds the cache reference                              */
 	int match_count = 0;		/* Number of times the regex was matched                             */
 	int offset_vectors[255];	/* not used, but has to exist or pcre won't even try to find a match */
 	int pcre_flags = 0;
 
-	/* Compile the expression */
-	pcre_prepared = pcre_compile(expression, 0, &error, &error_offset, NULL);
+	/* Compile the expression, or find it already compiled */
+	pcre_prepared = regex_acquire(expression, 0, &extra, &entry, &error, &error_offset);
 
 	/* See if there was an error in the expression */
-	if (error != NULL) {
-		/* Clean up after ourselves */
-		if (pcre_prepared) {
-			pcre_free(pcre_prepared);
-			pcre_prepared = NULL;
-		}
+	if (!pcre_prepared) {
 		/* Note our error */
 		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR,
 						  "Regular Expression Error expression[%s] error[%s] location[%d]\n", expression, error, error_offset);
@@ -220,13 +544,11 @@ SWITCH_DECLARE(switch_status_t) switch_regex_match_partial(const char *target, c
 
 	/* So far so good, run the regex */
 	match_count =
-		pcre_exec(pcre_prepared, NULL, target, (int) strlen(target), 0, pcre_flags, offset_vectors, sizeof(offset_vectors) / sizeof(offset_vectors[0]));
+		pcre_exec(pcre_prepared, extra, target, (int) strlen(target), 0, pcre_flags, offset_vectors, sizeof(offset_vectors) / sizeof(offset_vectors[0]));
 
 	/* Clean up */
-	if (pcre_prepared) {
-		pcre_free(pcre_prepared);
-		pcre_prepared = NULL;
-	}
+	regex_release(pcre_prepared, extra, entry);
+	pcre_prepared = NULL;
 
 	/* switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "number of matches: %d\n", match_count); */
 
@@ -52,6 +52,274 @@
 
 #define resample_buffer(a, b, c) a > b ? ((a / 1000) / 2) * c : ((b / 1000) / 2) * c
 
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(DISABLE_SLN_SIMD) && \
+	(defined(__clang__) || (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SLN_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+   Signed linear mixing kernels.  The scalar versions define the results, the simd ones have to
+   match them bit for bit (packs saturates exactly like switch_normalize_to_16bit and the volume
+   kernels multiply in double precision and truncate like the scalar cast).
+*/
+typedef struct {
+	const char *name;
+	void (*accumulate) (int32_t *mix, const int16_t *data, uint32_t samples);
+	void (*unmix) (int16_t *out, const int32_t *mix, const int16_t *self, uint32_t self_samples, uint32_t samples);
+	void (*scale) (int16_t *data, uint32_t samples, double rate);
+} sln_kernel_t;
+
+static int16_t sln_sat16(int32_t z)
+{
+	switch_normalize_to_16bit(z);
+	return (int16_t) z;
+}
+
+static void sln_accumulate_scalar(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		mix[x] += (int32_t) data[x];
+	}
+}
+
+static void sln_unmix_scalar(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t self_samples, uint32_t samples)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		out[x] = sln_sat16(self && x < self_samples ? mix[x] - (int32_t) self[x] : mix[x]);
+	}
+}
+
+static void sln_scale_scalar(int16_t *data, uint32_t samples, double rate)
+{
+	uint32_t x;
+
+	for (x = 0; x < samples; x++) {
+		data[x] = sln_sat16((int32_t) (data[x] * rate));
+	}
+}
+
+static const sln_kernel_t SLN_KERNEL_SCALAR = { "scalar", sln_accumulate_scalar, sln_unmix_scalar, sln_scale_scalar };
+
+#ifdef SLN_SIMD_X86
+
+__attribute__ ((target("sse2")))
+static void sln_accumulate_sse2(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x = 0;
+
+	for (; x + 8 <= samples; x += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *) (data + x));
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+
+		_mm_storeu_si128((__m128i *) (mix + x), _mm_add_epi32(_mm_loadu_si128((const __m128i *) (mix + x)), lo));
+		_mm_storeu_si128((__m128i *) (mix + x + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *) (mix + x + 4)), hi));
+	}
+
+	sln_accumulate_scalar(mix + x, data + x, samples - x);
+}
+
+__attribute__ ((target("sse2")))
+static void sln_unmix_sse2(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t self_samples, uint32_t samples)
+{
+	uint32_t x = 0, n = self ? MIN(self_samples, samples) : 0;
+
+	for (; x + 8 <= n; x += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *) (self + x));
+		__m128i lo = _mm_sub_epi32(_mm_loadu_si128((const __m128i *) (mix + x)), _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+		__m128i hi = _mm_sub_epi32(_mm_loadu_si128((const __m128i *) (mix + x + 4)), _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+
+		_mm_storeu_si128((__m128i *) (out + x), _mm_packs_epi32(lo, hi));
+	}
+
+	for (; x < n; x++) {
+		out[x] = sln_sat16(mix[x] - (int32_t) self[x]);
+	}
+
+	for (; x + 8 <= samples; x += 8) {
+		__m128i lo = _mm_loadu_si128((const __m128i *) (mix + x));
+		__m128i hi = _mm_loadu_si128((const __m128i *) (mix + x + 4));
+
+		_mm_storeu_si128((__m128i *) (out + x), _mm_packs_epi32(lo, hi));
+	}
+
+	sln_unmix_scalar(out + x, mix + x, NULL, 0, samples - x);
+}
+
+__attribute__ ((target("sse2")))
+static __m128i sln_scale4_sse2(__m128i v, __m128d rate)
+{
+	__m128i a = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(v), rate));
+	__m128i b = _mm_cvttpd_epi32(_mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), rate));
+
+	return _mm_unpacklo_epi64(a, b);
+}
+
+__attribute__ ((target("sse2")))
+static void sln_scale_sse2(int16_t *data, uint32_t samples, double rate)
+{
+	__m128d r = _mm_set1_pd(rate);
+	uint32_t x = 0;
+
+	for (; x + 8 <= samples; x += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *) (data + x));
+		__m128i lo = sln_scale4_sse2(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16), r);
+		__m128i hi = sln_scale4_sse2(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16), r);
+
+		_mm_storeu_si128((__m128i *) (data + x), _mm_packs_epi32(lo, hi));
+	}
+
+	sln_scale_scalar(data + x, samples - x, rate);
+}
+
+static const sln_kernel_t SLN_KERNEL_SSE2 = { "sse2", sln_accumulate_sse2, sln_unmix_sse2, sln_scale_sse2 };
+
+__attribute__ ((target("avx2")))
+static void sln_accumulate_avx2(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	uint32_t x = 0;
+
+	for (; x + 16 <= samples; x += 16) {
+		__m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x)));
+		__m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x + 8)));
+
+		_mm256_storeu_si256((__m256i *) (mix + x), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) (mix + x)), lo));
+		_mm256_storeu_si256((__m256i *) (mix + x + 8), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *) (mix + x + 8)), hi));
+	}
+
+	sln_accumulate_sse2(mix + x, data + x, samples - x);
+}
+
+/* packs works per 128 bit lane, put the quadwords back in sample order */
+#define sln_packs_avx2(_lo, _hi) _mm256_permute4x64_epi64(_mm256_packs_epi32(_lo, _hi), 0xd8)
+
+__attribute__ ((target("avx2")))
+static void sln_unmix_avx2(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t self_samples, uint32_t samples)
+{
+	uint32_t x = 0, n = self ? MIN(self_samples, samples) : 0;
+
+	for (; x + 16 <= n; x += 16) {
+		__m256i lo = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *) (mix + x)),
+									  _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (self + x))));
+		__m256i hi = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *) (mix + x + 8)),
+									  _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (self + x + 8))));
+
+		_mm256_storeu_si256((__m256i *) (out + x), sln_packs_avx2(lo, hi));
+	}
+
+	if (x < n) {
+		sln_unmix_sse2(out + x, mix + x, self + x, n - x, n - x);
+		x = n;
+	}
+
+	for (; x + 16 <= samples; x += 16) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *) (mix + x));
+		__m256i hi = _mm256_loadu_si256((const __m256i *) (mix + x + 8));
+
+		_mm256_storeu_si256((__m256i *) (out + x), sln_packs_avx2(lo, hi));
+	}
+
+	sln_unmix_sse2(out + x, mix + x, NULL, 0, samples - x);
+}
+
+__attribute__ ((target("avx2")))
+static void sln_scale_avx2(int16_t *data, uint32_t samples, double rate)
+{
+	__m256d r = _mm256_set1_pd(rate);
+	uint32_t x = 0;
+
+	for (; x + 8 <= samples; x += 8) {
+		__m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (data + x)));
+		__m128i lo = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(v)), r));
+		__m128i hi = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(v, 1)), r));
+
+		_mm_storeu_si128((__m128i *) (data + x), _mm_packs_epi32(lo, hi));
+	}
+
+	sln_scale_scalar(data + x, samples - x, rate);
+}
+
+static const sln_kernel_t SLN_KERNEL_AVX2 = { "avx2", sln_accumulate_avx2, sln_unmix_avx2, sln_scale_avx2 };
+
+#endif
+
+static const sln_kernel_t *SLN_KERNEL = NULL;
+
+static const sln_kernel_t *sln_kernel_best(void)
+{
+#ifdef SLN_SIMD_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		return &SLN_KERNEL_AVX2;
+	}
+
+	if (__builtin_cpu_supports("sse2")) {
+		return &SLN_KERNEL_SSE2;
+	}
+#endif
+
+	return &SLN_KERNEL_SCALAR;
+}
+
+static const sln_kernel_t *sln_kernel(void)
+{
+	if (!SLN_KERNEL) {
+		SLN_KERNEL = sln_kernel_best();
+	}
+
+	return SLN_KERNEL;
+}
+
+SWITCH_DECLARE(switch_status_t) switch_sln_kernel_set(const char *name)
+{
+	const sln_kernel_t *best = sln_kernel_best();
+
+	if (zstr(name) || !strcasecmp(name, "auto")) {
+		SLN_KERNEL = best;
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!strcasecmp(name, SLN_KERNEL_SCALAR.name)) {
+		SLN_KERNEL = &SLN_KERNEL_SCALAR;
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+#ifdef SLN_SIMD_X86
+	if (!strcasecmp(name, SLN_KERNEL_SSE2.name) && best != &SLN_KERNEL_SCALAR) {
+		SLN_KERNEL = &SLN_KERNEL_SSE2;
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!strcasecmp(name, SLN_KERNEL_AVX2.name) && best == &SLN_KERNEL_AVX2) {
+		SLN_KERNEL = &SLN_KERNEL_AVX2;
+		return SWITCH_STATUS_SUCCESS;
+	}
+#endif
+
+	return SWITCH_STATUS_FALSE;
+}
+
+SWITCH_DECLARE(const char *) switch_sln_kernel_name(void)
+{
+	return sln_kernel()->name;
+}
+
+SWITCH_DECLARE(void) switch_accumulate_sln(int32_t *mix, const int16_t *data, uint32_t samples)
+{
+	sln_kernel()->accumulate(mix, data, samples);
+}
+
+SWITCH_DECLARE(void) switch_unmix_sln(int16_t *out, const int32_t *mix, const int16_t *self, uint32_t self_samples, uint32_t samples)
+{
+	sln_kernel()->unmix(out, mix, self, self_samples, samples);
+}
+
 SWITCH_DECLARE(switch_status_t) switch_resample_perform_create(switch_audio_resampler_t **new_resampler,
 															   uint32_t from_rate, uint32_t to_rate,
 															   uint32_t to_size,
@@ -299,15 +567,7 @@ SWITCH_DECLARE(void) switch_change_sln_volume_granular(int16_t *data, uint32_t s
 	newrate = chart[i];
 
 	if (newrate) {
-		int32_t tmp;
-		uint32_t x;
-		int16_t *fp = data;
-
-		for (x = 0; x < samples; x++) {
-			tmp = (int32_t) (fp[x] * newrate);
-			switch_normalize_to_16bit(tmp);
-			fp[x] = (int16_t) tmp;
-		}
+		sln_kernel()->scale(data, samples, newrate);
 	}
 }
 
@@ -336,15 +596,7 @@ SWITCH_DECLARE(void) switch_change_sln_volume(int16_t *data, uint32_t samples, i
 	newrate = chart[i];
 
 	if (newrate) {
-		int32_t tmp;
-		uint32_t x;
-		int16_t *fp = data;
-
-		for (x = 0; x < samples; x++) {
-			tmp = (int32_t) (fp[x] * newrate);
-			switch_normalize_to_16bit(tmp);
-			fp[x] = (int16_t) tmp;
-		}
+		sln_kernel()->scale(data, samples, newrate);
 	}
 }
 
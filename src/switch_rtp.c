@@ -55,6 +55,13 @@
 
 #include "stfu.h"
 
+#if defined(__linux__) && !defined(DISABLE_RTP_REACTOR)
+#define RTP_REACTOR
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/udp.h>
+#endif
+
 #define rtp_header_len 12
 #define RTP_START_PORT 16384
 #define RTP_END_PORT 32768
@@ -149,6 +156,9 @@ struct switch_rtp_rfc2833_data {
 	uint8_t in_digit_queued;
 };
 
+typedef struct rtp_io rtp_io_t;
+typedef struct rtp_mux_group rtp_mux_group_t;
+
 struct switch_rtp {
 	/* 
 	 * Two sockets are needed because we might be transcoding protocol families
@@ -159,6 +169,8 @@ struct switch_rtp {
 	switch_socket_t *sock_input, *sock_output, *rtcp_sock_input, *rtcp_sock_output;
 	switch_pollfd_t *read_pollfd, *rtcp_read_pollfd;
 	switch_pollfd_t *jb_pollfd;
+	rtp_io_t *rio;
+	rtp_mux_group_t *mux;
 
 	switch_sockaddr_t *local_addr, *rtcp_local_addr;
 	rtp_msg_t send_msg;
@@ -302,188 +314,1756 @@ static handle_rfc2833_result_t handle_rfc2833(switch_rtp_t *rtp_session, switch_
 		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Failed DTMF sanity check.\n");
 	}
 
-	/* RFC2833 ... like all RFC RE: VoIP, guaranteed to drive you to insanity! 
-	   We know the real rules here, but if we enforce them, it's an interop nightmare so,
-	   we put up with as much as we can so we don't have to deal with being punished for
-	   doing it right. Nice guys finish last!
-	*/
-	if (bytes > rtp_header_len && !switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA) &&
-		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PASS_RFC2833) && rtp_session->recv_te && rtp_session->recv_msg.header.pt == rtp_session->recv_te) {
-		switch_size_t len = bytes - rtp_header_len;
-		unsigned char *packet = (unsigned char *) rtp_session->recv_msg.body;
-		int end;
-		uint16_t duration;
-		char key;
-		uint16_t in_digit_seq;
-		uint32_t ts;
+	/* RFC2833 ... like all RFC RE: VoIP, guaranteed to drive you to insanity! 
+	   We know the real rules here, but if we enforce them, it's an interop nightmare so,
+	   we put up with as much as we can so we don't have to deal with being punished for
+	   doing it right. Nice guys finish last!
+	*/
+	if (bytes > rtp_header_len && !switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PROXY_MEDIA) &&
+		!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_PASS_RFC2833) && rtp_session->recv_te && rtp_session->recv_msg.header.pt == rtp_session->recv_te) {
+		switch_size_t len = bytes - rtp_header_len;
+		unsigned char *packet = (unsigned char *) rtp_session->recv_msg.body;
+		int end;
+		uint16_t duration;
+		char key;
+		uint16_t in_digit_seq;
+		uint32_t ts;
+
+		if (!(packet[0] || packet[1] || packet[2] || packet[3]) && len >= 8) {
+			switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
+			packet += 4;
+			len -= 4;
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "DTMF payload offset by 4 bytes.\n");
+		}
+
+		if (!(packet[0] || packet[1] || packet[2] || packet[3])) {
+			switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Failed DTMF payload check.\n");
+			rtp_session->dtmf_data.last_digit = 0;
+			rtp_session->dtmf_data.in_digit_ts = 0;
+			rtp_session->dtmf_data.in_digit_sanity = 0;
+		}
+
+		end = packet[1] & 0x80 ? 1 : 0;
+		duration = (packet[2] << 8) + packet[3];
+		key = switch_rfc2833_to_char(packet[0]);
+		in_digit_seq = ntohs((uint16_t) rtp_session->recv_msg.header.seq);
+		ts = htonl(rtp_session->recv_msg.header.ts);
+
+		if (in_digit_seq < rtp_session->dtmf_data.in_digit_seq) {
+			if (rtp_session->dtmf_data.in_digit_seq - in_digit_seq > 100) {
+				rtp_session->dtmf_data.in_digit_seq = 0;
+			}
+		}
+#ifdef DEBUG_2833
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "packet[%d]: %02x %02x %02x %02x\n", (int) len, (unsigned) packet[0], (unsigned)
+			   packet[1], (unsigned) packet[2], (unsigned) packet[3]);
+#endif
+
+		if (in_digit_seq > rtp_session->dtmf_data.in_digit_seq) {
+
+			rtp_session->dtmf_data.in_digit_seq = in_digit_seq;
+#ifdef DEBUG_2833
+
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "read: %c %u %u %u %u %d %d %s\n",
+				   key, in_digit_seq, rtp_session->dtmf_data.in_digit_seq,
+				   ts, duration, rtp_session->recv_msg.header.m, end, end && !rtp_session->dtmf_data.in_digit_ts ? "ignored" : "");
+#endif
+
+			if (!rtp_session->dtmf_data.in_digit_queued && (rtp_session->rtp_bugs & RTP_BUG_IGNORE_DTMF_DURATION) &&
+				rtp_session->dtmf_data.in_digit_ts) {
+				switch_dtmf_t dtmf = { key, switch_core_min_dtmf_duration(0), 0, SWITCH_DTMF_RTP };
+#ifdef DEBUG_2833
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Early Queuing digit %c:%d\n", dtmf.digit, dtmf.duration / 8);
+#endif
+				switch_rtp_queue_rfc2833_in(rtp_session, &dtmf);
+				rtp_session->dtmf_data.in_digit_queued = 1;
+			}
+
+			/* only set sanity if we do NOT ignore the packet */
+			if (rtp_session->dtmf_data.in_digit_ts) {
+				rtp_session->dtmf_data.in_digit_sanity = 2000;
+			}
+
+			if (rtp_session->dtmf_data.last_duration > duration && 
+				rtp_session->dtmf_data.last_duration > 0xFC17 && ts == rtp_session->dtmf_data.in_digit_ts) {
+				rtp_session->dtmf_data.flip++;
+			}
+
+			if (end) {
+				if (!rtp_session->dtmf_data.in_digit_ts && rtp_session->dtmf_data.last_in_digit_ts != ts) {
+#ifdef DEBUG_2833
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "start with end packet %d\n", ts);
+#endif
+					rtp_session->dtmf_data.last_in_digit_ts = ts;
+					rtp_session->dtmf_data.in_digit_ts = ts;
+					rtp_session->dtmf_data.first_digit = key;
+					rtp_session->dtmf_data.in_digit_sanity = 2000;
+				}
+				if (rtp_session->dtmf_data.in_digit_ts) {
+					switch_dtmf_t dtmf = { key, duration, 0, SWITCH_DTMF_RTP };
+
+					if (ts > rtp_session->dtmf_data.in_digit_ts) {
+						dtmf.duration += (ts - rtp_session->dtmf_data.in_digit_ts);
+					}
+					if (rtp_session->dtmf_data.flip) {
+						dtmf.duration += rtp_session->dtmf_data.flip * 0xFFFF;
+						rtp_session->dtmf_data.flip = 0;
+#ifdef DEBUG_2833
+						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "you're welcome!\n");
+#endif
+					}
+#ifdef DEBUG_2833
+					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "done digit=%c ts=%u start_ts=%u dur=%u ddur=%u\n",
+						   dtmf.digit, ts, rtp_session->dtmf_data.in_digit_ts, duration, dtmf.duration);
+#endif
+						
+					if (!(rtp_session->rtp_bugs & RTP_BUG_IGNORE_DTMF_DURATION) && !rtp_session->dtmf_data.in_digit_queued) {
+#ifdef DEBUG_2833
+						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Queuing digit %c:%d\n", dtmf.digit, dtmf.duration / 8);
+#endif
+						switch_rtp_queue_rfc2833_in(rtp_session, &dtmf);
+					}
+
+					rtp_session->dtmf_data.last_digit = rtp_session->dtmf_data.first_digit;
+
+					rtp_session->dtmf_data.in_digit_ts = 0;
+					rtp_session->dtmf_data.in_digit_sanity = 0;
+					rtp_session->dtmf_data.in_digit_queued = 0;
+					*do_cng = 1;
+				} else {
+					if (!switch_rtp_ready(rtp_session)) {
+						return RESULT_GOTO_END;
+					}
+					switch_cond_next();
+					return RESULT_GOTO_RECVFROM;
+				}
+
+			} else if (!rtp_session->dtmf_data.in_digit_ts) {
+#ifdef DEBUG_2833
+				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "start %d\n", ts);
+#endif
+				rtp_session->dtmf_data.in_digit_ts = ts;
+				rtp_session->dtmf_data.last_in_digit_ts = ts;
+				rtp_session->dtmf_data.first_digit = key;
+				rtp_session->dtmf_data.in_digit_sanity = 2000;
+			}
+
+			rtp_session->dtmf_data.last_duration = duration;
+		} else {
+#ifdef DEBUG_2833
+			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "drop: %c %u %u %u %u %d %d\n",
+				   key, in_digit_seq, rtp_session->dtmf_data.in_digit_seq, ts, duration, rtp_session->recv_msg.header.m, end);
+#endif
+			switch_cond_next();
+			return RESULT_GOTO_RECVFROM;
+		}
+	}
+
+	if (bytes && rtp_session->dtmf_data.in_digit_ts) {
+		if (!switch_rtp_ready(rtp_session)) {
+			return RESULT_GOTO_END;
+		}
+
+		if (!rtp_session->dtmf_data.in_interleaved && rtp_session->recv_msg.header.pt != rtp_session->recv_te) {
+			/* Drat, they are sending audio still as well as DTMF ok fine..... *sigh* */
+			rtp_session->dtmf_data.in_interleaved = 1;
+		}
+			
+		if (rtp_session->dtmf_data.in_interleaved || (rtp_session->rtp_bugs & RTP_BUG_IGNORE_DTMF_DURATION)) {
+			if (rtp_session->recv_msg.header.pt == rtp_session->recv_te) {
+				return RESULT_GOTO_RECVFROM;
+			}
+		} else {
+			*do_cng = 1;
+			return RESULT_GOTO_TIMERCHECK;
+		}
+	}
+
+	return RESULT_CONTINUE;
+}
+
+struct switch_rtcp_report_block {
+	uint32_t ssrc; /* The SSRC identifier of the source to which the information in this reception report block pertains. */
+	unsigned int fraction :8; /* The fraction of RTP data packets from source SSRC_n lost since the previous SR or RR packet was sent */
+	int lost :24; /* The total number of RTP data packets from source SSRC_n that have been lost since the beginning of reception */
+	uint32_t highest_sequence_number_received;
+	uint32_t jitter; /* An estimate of the statistical variance of the RTP data packet interarrival time, measured in timestamp units and expressed as an unsigned integer. */
+	uint32_t lsr; /* The middle 32 bits out of 64 in the NTP timestamp */
+	uint32_t dlsr; /* The delay, expressed in units of 1/65536 seconds, between receiving the last SR packet from source SSRC_n and sending this reception report block */
+};
+
+static int global_init = 0;
+static int rtp_common_write(switch_rtp_t *rtp_session,
+							rtp_msg_t *send_msg, void *data, uint32_t datalen, switch_payload_t payload, uint32_t timestamp, switch_frame_flag_t *flags);
+
+
+/* Media reactor: a few epoll threads own the sockets of the legs, drain them with recvmmsg into a lock free queue
+   per leg and send what the legs queue while the reactor is busy with sendmmsg, or with one GSO send when the
+   packets are the same size.  A leg polls and reads its queue instead of the socket. */
+
+#ifdef RTP_REACTOR
+
+#define RTP_REACTOR_MAX 64
+#define RTP_REACTOR_BATCH 32
+#define RTP_REACTOR_EVENTS 256
+#define RTP_IO_QUEUE_LEN (1024 * 32)
+#define RTP_IO_MTU 1500
+#define RTP_IO_WAKE ((uint64_t) -1)
+
+typedef struct {
+	uint32_t len;
+	uint32_t salen;
+	union {
+		struct sockaddr_in sin;
+		struct sockaddr_in6 sin6;
+	} addr;
+} rtp_io_hdr_t;
+
+typedef struct rtp_reactor rtp_reactor_t;
+
+struct rtp_io {
+	rtp_reactor_t *reactor;
+	int fd;
+	uint32_t slot;
+	uint32_t gen;
+	switch_buffer_t *rx;
+	switch_buffer_t *tx;
+	switch_mutex_t *tx_mutex;
+	volatile switch_atomic_t tx_pending;
+	volatile switch_atomic_t waiting;
+	volatile switch_atomic_t dead;
+	volatile switch_atomic_t paused;
+	volatile switch_atomic_t kicked;
+	switch_mutex_t *rx_mutex;
+	switch_mutex_t *mutex;
+	switch_thread_cond_t *cond;
+	struct rtp_io *next;
+	switch_rtp_t *rtp_session;
+	rtp_mux_group_t *mux;
+	uint64_t mux_key;
+	uint64_t mux_ssrc_key;
+	uint32_t mux_ssrc;
+	rtp_io_hdr_t mux_addr;
+	switch_bool_t mux_latching;
+	struct rtp_io *latch_next;
+};
+
+struct rtp_reactor {
+	uint32_t id;
+	int epfd;
+	int evfd;
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+	rtp_io_t **ios;
+	uint32_t *gens;
+	uint32_t *free_slots;
+	uint32_t free_count;
+	uint32_t io_alloc;
+	uint32_t io_count;
+	rtp_io_t *volatile pending;
+	volatile switch_atomic_t sleeping;
+	struct mmsghdr msgs[RTP_REACTOR_BATCH];
+	struct iovec iov[RTP_REACTOR_BATCH];
+	rtp_io_hdr_t hdrs[RTP_REACTOR_BATCH];
+	char *rxbuf;
+	char *txbuf;
+	uint64_t rx_packets;
+	uint64_t rx_calls;
+	uint64_t rx_drops;
+	uint64_t rx_pauses;
+	uint64_t tx_packets;
+	uint64_t tx_calls;
+	uint64_t tx_gso;
+	uint64_t tx_errors;
+	volatile switch_atomic_t tx_drops;
+	uint64_t wakeups;
+	uint64_t mux_unknown;
+	uint64_t mux_ssrc_hits;
+	uint64_t mux_latched;
+};
+
+static struct {
+	rtp_reactor_t *reactors[RTP_REACTOR_MAX];
+	uint32_t count;
+	uint32_t next;
+	int wanted;
+	int running;
+	int gso;
+	volatile switch_atomic_t attached;
+	switch_memory_pool_t *pool;
+	switch_mutex_t *mutex;
+} rtp_reactor_globals;
+
+/* copy a header and its packet into a queue as one record, the consumer never sees half of it */
+static switch_bool_t rtp_io_put(switch_buffer_t *buffer, rtp_io_hdr_t *hdr, const void *data, uint32_t len)
+{
+	void *p1, *p2;
+	switch_size_t l1, l2, need = sizeof(*hdr) + len, off = 0;
+	const uint8_t *src[2] = { (const uint8_t *) hdr, (const uint8_t *) data };
+	switch_size_t srclen[2] = { sizeof(*hdr), len };
+	int i;
+
+	if (switch_buffer_freespace(buffer) < need || switch_buffer_reserve_segments(buffer, need, &p1, &l1, &p2, &l2) < need) {
+		return SWITCH_FALSE;
+	}
+
+	for (i = 0; i < 2; i++) {
+		switch_size_t done = 0;
+
+		while (done < srclen[i]) {
+			switch_size_t n;
+
+			if (off < l1) {
+				n = (l1 - off) < (srclen[i] - done) ? (l1 - off) : (srclen[i] - done);
+				memcpy((uint8_t *) p1 + off, src[i] + done, n);
+			} else {
+				n = srclen[i] - done;
+				memcpy((uint8_t *) p2 + (off - l1), src[i] + done, n);
+			}
+
+			done += n;
+			off += n;
+		}
+	}
+
+	switch_buffer_write_commit(buffer, need);
+
+	return SWITCH_TRUE;
+}
+
+static switch_bool_t rtp_io_get(switch_buffer_t *buffer, rtp_io_hdr_t *hdr, void *data, switch_size_t *len)
+{
+	switch_size_t want = *len;
+
+	if (switch_buffer_peek(buffer, hdr, sizeof(*hdr)) != sizeof(*hdr)) {
+		*len = 0;
+		return SWITCH_FALSE;
+	}
+
+	switch_buffer_toss(buffer, sizeof(*hdr));
+
+	if (hdr->len > want) {
+		switch_buffer_read(buffer, data, want);
+		switch_buffer_toss(buffer, hdr->len - want);
+		*len = want;
+	} else {
+		*len = switch_buffer_read(buffer, data, hdr->len);
+	}
+
+	return SWITCH_TRUE;
+}
+
+static void rtp_io_signal(rtp_io_t *io)
+{
+	if (switch_atomic_read(&io->waiting)) {
+		switch_mutex_lock(io->mutex);
+		switch_thread_cond_signal(io->cond);
+		switch_mutex_unlock(io->mutex);
+	}
+}
+
+static void rtp_reactor_wake(rtp_reactor_t *r)
+{
+	uint64_t one = 1;
+
+	if (write(r->evfd, &one, sizeof(one)) < 0) {
+		/* the counter is already non zero, it is awake */
+	}
+}
+
+static void rtp_reactor_recv(rtp_reactor_t *r, rtp_io_t *io)
+{
+	int n = 0, max = 0, i, got = 0, loops = 0;
+
+	/* level triggered, so stop after a few batches and let a busy leg come round again */
+	while (n == max && loops++ < 4) {
+		if ((max = (int) (switch_buffer_freespace(io->rx) / (sizeof(rtp_io_hdr_t) + RTP_IO_MTU))) > RTP_REACTOR_BATCH) {
+			max = RTP_REACTOR_BATCH;
+		}
+
+		if (!max) {
+			/* the leg is not keeping up, leave the rest in the socket buffer until it reads */
+			struct epoll_event ev = { 0 };
+
+			ev.events = EPOLLRDHUP;
+			ev.data.u64 = ((uint64_t) io->gen << 32) | io->slot;
+			epoll_ctl(r->epfd, EPOLL_CTL_MOD, io->fd, &ev);
+			switch_atomic_set(&io->paused, 1);
+			r->rx_pauses++;
+			break;
+		}
+
+		for (i = 0; i < max; i++) {
+			r->iov[i].iov_base = r->rxbuf + (i * sizeof(rtp_msg_t));
+			r->iov[i].iov_len = sizeof(rtp_msg_t);
+			memset(&r->msgs[i].msg_hdr, 0, sizeof(r->msgs[i].msg_hdr));
+			r->msgs[i].msg_hdr.msg_name = &r->hdrs[i].addr;
+			r->msgs[i].msg_hdr.msg_namelen = sizeof(r->hdrs[i].addr);
+			r->msgs[i].msg_hdr.msg_iov = &r->iov[i];
+			r->msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		n = recvmmsg(io->fd, r->msgs, max, MSG_DONTWAIT, NULL);
+		r->rx_calls++;
+
+		if (n <= 0) {
+			if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				switch_atomic_set(&io->dead, 1);
+				got++;
+			}
+			break;
+		}
+
+		r->rx_packets += n;
+
+		for (i = 0; i < n; i++) {
+			r->hdrs[i].len = r->msgs[i].msg_len;
+			r->hdrs[i].salen = r->msgs[i].msg_hdr.msg_namelen;
+
+			if (rtp_io_put(io->rx, &r->hdrs[i], r->iov[i].iov_base, r->hdrs[i].len)) {
+				got++;
+			} else {
+				r->rx_drops++;
+			}
+		}
+	}
+
+	if (got) {
+		rtp_io_signal(io);
+	}
+}
+
+static void rtp_reactor_send(rtp_reactor_t *r, rtp_io_t *io)
+{
+	switch_rtp_t *rtp_session = io->rtp_session;
+	rtp_io_hdr_t hdr;
+	const void *addr;
+	int salen, n, i, sent;
+	uint32_t lens[RTP_REACTOR_BATCH];
+	switch_size_t off, len;
+
+	switch_atomic_cas(&io->tx_pending, 0, 1);
+
+	if (!(addr = switch_sockaddr_get_raw(rtp_session->remote_addr, &salen))) {
+		return;
+	}
+
+	for (;;) {
+		int same = 1;
+
+		off = 0;
+
+		for (n = 0; n < RTP_REACTOR_BATCH; n++) {
+			len = RTP_IO_QUEUE_LEN - off;
+
+			if (!rtp_io_get(io->tx, &hdr, r->txbuf + off, &len)) {
+				break;
+			}
+
+			lens[n] = (uint32_t) len;
+			off += len;
+
+			if (n && lens[n] != lens[0]) {
+				same = 0;
+			}
+		}
+
+		if (!n) {
+			break;
+		}
+
+#ifdef UDP_SEGMENT
+		/* all the same size: one datagram split by the stack */
+		if (rtp_reactor_globals.gso && n > 1 && same && off <= 65000) {
+			struct msghdr mh = { 0 };
+			struct iovec iov;
+			char control[CMSG_SPACE(sizeof(uint16_t))] = { 0 };
+			struct cmsghdr *cm;
+
+			iov.iov_base = r->txbuf;
+			iov.iov_len = off;
+			mh.msg_name = (void *) addr;
+			mh.msg_namelen = salen;
+			mh.msg_iov = &iov;
+			mh.msg_iovlen = 1;
+			mh.msg_control = control;
+			mh.msg_controllen = sizeof(control);
+			cm = CMSG_FIRSTHDR(&mh);
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			*((uint16_t *) CMSG_DATA(cm)) = (uint16_t) lens[0];
+
+			r->tx_calls++;
+
+			if (sendmsg(io->fd, &mh, MSG_DONTWAIT) >= 0) {
+				r->tx_packets += n;
+				r->tx_gso++;
+				continue;
+			}
+
+			if (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT) {
+				/* the kernel or the nic can't do it, stop trying */
+				rtp_reactor_globals.gso = 0;
+			}
+		}
+#endif
+
+		for (i = 0, off = 0; i < n; i++) {
+			r->iov[i].iov_base = r->txbuf + off;
+			r->iov[i].iov_len = lens[i];
+			memset(&r->msgs[i].msg_hdr, 0, sizeof(r->msgs[i].msg_hdr));
+			r->msgs[i].msg_hdr.msg_name = (void *) addr;
+			r->msgs[i].msg_hdr.msg_namelen = salen;
+			r->msgs[i].msg_hdr.msg_iov = &r->iov[i];
+			r->msgs[i].msg_hdr.msg_iovlen = 1;
+			off += lens[i];
+		}
+
+		for (i = 0; i < n; i += sent) {
+			r->tx_calls++;
+
+			if ((sent = sendmmsg(io->fd, r->msgs + i, n - i, MSG_DONTWAIT)) <= 0) {
+				r->tx_errors += n - i;
+				break;
+			}
+
+			r->tx_packets += sent;
+		}
+	}
+}
+
+static void rtp_reactor_push(rtp_reactor_t *r, rtp_io_t *io)
+{
+	rtp_io_t *head;
+
+	do {
+		head = r->pending;
+		io->next = head;
+	} while (switch_atomic_casptr((volatile void **) &r->pending, io, head) != head);
+}
+
+static rtp_io_t *rtp_reactor_take(rtp_reactor_t *r)
+{
+	rtp_io_t *head;
+
+	do {
+		head = r->pending;
+	} while (head && switch_atomic_casptr((volatile void **) &r->pending, NULL, head) != head);
+
+	return head;
+}
+
+/* Shared ports: a few SO_REUSEPORT sockets per local address carry the media of every leg bound to the mux port.
+   The reactors find the leg of a packet by its source address, or by its SSRC once the far end moved, in an open
+   addressing table readers walk without a lock.  Writers hold the table mutex; a leg or an old table is only freed
+   after every reactor went round its loop once, since they only look things up with their own mutex held. */
+
+#define RTP_MUX_TABLE_MIN 1024
+#define RTP_MUX_KEY_EMPTY 0
+#define RTP_MUX_KEY_TOMB 1
+
+typedef struct {
+	volatile uint64_t key;
+	rtp_io_t *volatile io;
+} rtp_mux_slot_t;
+
+typedef struct rtp_mux_table {
+	uint32_t mask;
+	uint32_t used;
+	uint32_t tombs;
+	struct rtp_mux_table *next;
+	rtp_mux_slot_t slots[1];
+} rtp_mux_table_t;
+
+struct rtp_mux_group {
+	uint8_t id;
+	char *host;
+	switch_socket_t *socks[RTP_REACTOR_MAX];
+	rtp_io_t *ios[RTP_REACTOR_MAX];
+	switch_pollfd_t *pollfd;
+	/* legs that have not heard from their far end yet, a sender nobody knows may be the one behind a NAT */
+	rtp_io_t *volatile latch_head;
+	volatile uint32_t latch_count;
+	struct rtp_mux_group *next;
+};
+
+static struct {
+	switch_port_t port;
+	rtp_mux_group_t *groups;
+	uint32_t group_count;
+	rtp_mux_table_t *volatile table;
+	rtp_mux_table_t *retired;
+	switch_mutex_t *mutex;
+	volatile switch_atomic_t legs;
+} rtp_mux_globals;
+
+static uint64_t rtp_mux_hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+
+	return key;
+}
+
+/* the top two bits say what the key is, then the group, then the address or the ssrc */
+static uint64_t rtp_mux_addr_key(uint8_t group, const void *raw)
+{
+	const struct sockaddr *sa = (const struct sockaddr *) raw;
+
+	if (sa->sa_family == AF_INET) {
+		const struct sockaddr_in *sin = (const struct sockaddr_in *) raw;
+
+		return (1ULL << 62) | ((uint64_t) group << 48) | ((uint64_t) ntohl(sin->sin_addr.s_addr) << 16) | ntohs(sin->sin_port);
+	} else if (sa->sa_family == AF_INET6) {
+		const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) raw;
+		const uint8_t *p = (const uint8_t *) &sin6->sin6_addr;
+		uint64_t h = 14695981039346656037ULL;
+		int i;
+
+		for (i = 0; i < 16; i++) {
+			h = (h ^ p[i]) * 1099511628211ULL;
+		}
+		h = (h ^ sin6->sin6_port) * 1099511628211ULL;
+
+		return (2ULL << 62) | ((uint64_t) group << 48) | (h & 0xffffffffffffULL);
+	}
+
+	return 0;
+}
+
+static uint64_t rtp_mux_ssrc_key(uint8_t group, uint32_t ssrc)
+{
+	return (3ULL << 62) | ((uint64_t) group << 48) | ssrc;
+}
+
+static int rtp_mux_same_addr(const rtp_io_hdr_t *a, const void *raw)
+{
+	const struct sockaddr *sa = (const struct sockaddr *) raw;
+
+	if (a->addr.sin.sin_family != sa->sa_family) {
+		return 0;
+	}
+
+	if (sa->sa_family == AF_INET) {
+		const struct sockaddr_in *sin = (const struct sockaddr_in *) raw;
+		return a->addr.sin.sin_port == sin->sin_port && a->addr.sin.sin_addr.s_addr == sin->sin_addr.s_addr;
+	} else {
+		const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) raw;
+		return a->addr.sin6.sin6_port == sin6->sin6_port && !memcmp(&a->addr.sin6.sin6_addr, &sin6->sin6_addr, sizeof(sin6->sin6_addr));
+	}
+}
+
+static int rtp_mux_same_host(const rtp_io_hdr_t *a, const void *raw)
+{
+	const struct sockaddr *sa = (const struct sockaddr *) raw;
+
+	if (a->addr.sin.sin_family != sa->sa_family) {
+		return 0;
+	}
+
+	if (sa->sa_family == AF_INET) {
+		return a->addr.sin.sin_addr.s_addr == ((const struct sockaddr_in *) raw)->sin_addr.s_addr;
+	} else {
+		return !memcmp(&a->addr.sin6.sin6_addr, &((const struct sockaddr_in6 *) raw)->sin6_addr, sizeof(a->addr.sin6.sin6_addr));
+	}
+}
+
+/* would the leg take a packet from this address on a port of its own: only its far end, or anybody while it
+   may still auto adjust */
+static int rtp_mux_trusted(rtp_io_t *io, const void *raw)
+{
+	switch_rtp_t *rtp_session = io->rtp_session;
+
+	return rtp_mux_same_host(&io->mux_addr, raw) || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_AUTOADJ) ||
+		(rtp_session->rtp_bugs & RTP_BUG_ACCEPT_ANY_PACKETS);
+}
+
+/* call with the table mutex held */
+static void rtp_mux_latch_add(rtp_io_t *io)
+{
+	rtp_mux_group_t *g = io->mux;
+
+	if (io->mux_latching) {
+		return;
+	}
+
+	io->latch_next = g->latch_head;
+	g->latch_head = io;
+	g->latch_count++;
+	io->mux_latching = SWITCH_TRUE;
+}
+
+/* call with the table mutex held */
+static void rtp_mux_latch_del(rtp_io_t *io)
+{
+	rtp_mux_group_t *g = io->mux;
+	rtp_io_t **pp;
+
+	if (!io->mux_latching) {
+		return;
+	}
+
+	for (pp = (rtp_io_t **) &g->latch_head; *pp; pp = &(*pp)->latch_next) {
+		if (*pp == io) {
+			*pp = io->latch_next;
+			g->latch_count--;
+			break;
+		}
+	}
+
+	io->latch_next = NULL;
+	io->mux_latching = SWITCH_FALSE;
+}
+
+/* the one leg of the group still waiting for its far end, when there is exactly one and it may auto adjust */
+static rtp_io_t *rtp_mux_latcher(rtp_mux_group_t *g)
+{
+	rtp_io_t *io;
+
+	if (g->latch_count != 1 || !(io = g->latch_head) || io->latch_next) {
+		return NULL;
+	}
+
+	return switch_test_flag(io->rtp_session, SWITCH_RTP_FLAG_AUTOADJ) ? io : NULL;
+}
+
+static rtp_io_t *rtp_mux_lookup(rtp_mux_table_t *t, uint64_t key)
+{
+	uint32_t i, n;
+
+	if (!t) {
+		return NULL;
+	}
+
+	for (i = (uint32_t) rtp_mux_hash(key) & t->mask, n = 0; n <= t->mask; i = (i + 1) & t->mask, n++) {
+		uint64_t k = t->slots[i].key;
+
+		if (k == RTP_MUX_KEY_EMPTY) {
+			break;
+		}
+
+		if (k == key) {
+			return t->slots[i].io;
+		}
+	}
+
+	return NULL;
+}
+
+static rtp_mux_table_t *rtp_mux_table_alloc(uint32_t size)
+{
+	rtp_mux_table_t *t;
+
+	switch_zmalloc(t, sizeof(*t) + (size - 1) * sizeof(rtp_mux_slot_t));
+	t->mask = size - 1;
+
+	return t;
+}
+
+static void rtp_mux_table_place(rtp_mux_table_t *t, uint64_t key, rtp_io_t *io)
+{
+	uint32_t i;
+
+	for (i = (uint32_t) rtp_mux_hash(key) & t->mask;; i = (i + 1) & t->mask) {
+		uint64_t k = t->slots[i].key;
+
+		if (k == RTP_MUX_KEY_EMPTY || k == RTP_MUX_KEY_TOMB) {
+			if (k == RTP_MUX_KEY_TOMB) {
+				t->tombs--;
+			}
+			/* the leg goes in before its key so a reader that sees the key never sees a stale leg */
+			t->slots[i].io = io;
+			switch_atomic_casptr((volatile void **) &t->slots[i].io, io, io);
+			t->slots[i].key = key;
+			t->used++;
+			return;
+		}
+	}
+}
+
+/* wait until every reactor went round its loop once, taking their mutexes one at a time, never with a leg locked */
+static void rtp_reactor_quiesce(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < rtp_reactor_globals.count; i++) {
+		switch_mutex_lock(rtp_reactor_globals.reactors[i]->mutex);
+		switch_mutex_unlock(rtp_reactor_globals.reactors[i]->mutex);
+	}
+}
+
+/* call with the table mutex held, hands back a table to free once the reactors went round */
+static rtp_mux_table_t *rtp_mux_insert(uint64_t key, rtp_io_t *io, switch_bool_t grow)
+{
+	rtp_mux_table_t *t = rtp_mux_globals.table, *old = NULL;
+	uint32_t i, n;
+
+	for (i = (uint32_t) rtp_mux_hash(key) & t->mask, n = 0; n <= t->mask; i = (i + 1) & t->mask, n++) {
+		uint64_t k = t->slots[i].key;
+
+		if (k == RTP_MUX_KEY_EMPTY) {
+			break;
+		}
+
+		if (k == key) {
+			t->slots[i].io = io;
+			return NULL;
+		}
+	}
+
+	if ((t->used + t->tombs + 1) * 4 > (t->mask + 1) * 3) {
+		rtp_mux_table_t *nt;
+		uint32_t size = RTP_MUX_TABLE_MIN;
+
+		if (!grow) {
+			return NULL;
+		}
+
+		while (size < (t->used + 1) * 4) {
+			size <<= 1;
+		}
+
+		nt = rtp_mux_table_alloc(size);
+
+		for (i = 0; i <= t->mask; i++) {
+			if (t->slots[i].key > RTP_MUX_KEY_TOMB && t->slots[i].io) {
+				rtp_mux_table_place(nt, t->slots[i].key, t->slots[i].io);
+			}
+		}
+
+		switch_atomic_casptr((volatile void **) &rtp_mux_globals.table, nt, t);
+		old = t;
+		t = nt;
+	}
+
+	rtp_mux_table_place(t, key, io);
+
+	return old;
+}
+
+static void rtp_mux_remove(uint64_t key, rtp_io_t *io)
+{
+	rtp_mux_table_t *t = rtp_mux_globals.table;
+	uint32_t i, n;
+
+	for (i = (uint32_t) rtp_mux_hash(key) & t->mask, n = 0; n <= t->mask; i = (i + 1) & t->mask, n++) {
+		uint64_t k = t->slots[i].key;
+
+		if (k == RTP_MUX_KEY_EMPTY) {
+			return;
+		}
+
+		if (k == key && t->slots[i].io == io) {
+			t->slots[i].io = NULL;
+			t->slots[i].key = RTP_MUX_KEY_TOMB;
+			t->used--;
+			t->tombs++;
+			return;
+		}
+	}
+}
+
+/* free the tables a grow left behind, once the reactors let go of them; never call it with the write mutex held */
+static void rtp_mux_reap(void)
+{
+	rtp_mux_table_t *old;
+
+	if (!rtp_mux_globals.retired) {
+		return;
+	}
+
+	switch_mutex_lock(rtp_mux_globals.mutex);
+	old = rtp_mux_globals.retired;
+	rtp_mux_globals.retired = NULL;
+	switch_mutex_unlock(rtp_mux_globals.mutex);
+
+	if (old) {
+		rtp_reactor_quiesce();
+	}
+
+	while (old) {
+		rtp_mux_table_t *next = old->next;
+		free(old);
+		old = next;
+	}
+}
+
+/* point the leg's address key at its current far end, rtp_mux_reap() frees the table it may have outgrown */
+static void rtp_mux_set_remote(switch_rtp_t *rtp_session)
+{
+	rtp_io_t *io = rtp_session->rio;
+	rtp_mux_table_t *old = NULL;
+	const void *raw;
+	uint64_t key;
+	int salen;
+
+	if (!io || !io->mux || !rtp_session->remote_addr || !(raw = switch_sockaddr_get_raw(rtp_session->remote_addr, &salen))) {
+		return;
+	}
+
+	if (!(key = rtp_mux_addr_key(io->mux->id, raw)) || (key == io->mux_key && rtp_mux_same_addr(&io->mux_addr, raw))) {
+		return;
+	}
+
+	switch_mutex_lock(rtp_mux_globals.mutex);
+
+	if (io->mux_key) {
+		rtp_mux_remove(io->mux_key, io);
+	}
+
+	memcpy(&io->mux_addr.addr, raw, salen < (int) sizeof(io->mux_addr.addr) ? salen : (int) sizeof(io->mux_addr.addr));
+	io->mux_key = key;
+
+	if ((old = rtp_mux_insert(key, io, SWITCH_TRUE))) {
+		old->next = rtp_mux_globals.retired;
+		rtp_mux_globals.retired = old;
+	}
+
+	switch_mutex_unlock(rtp_mux_globals.mutex);
+}
+
+/* a reactor learned the ssrc of a leg, never blocks and never grows the table */
+static void rtp_mux_learn_ssrc(rtp_io_t *io, uint32_t ssrc)
+{
+	uint64_t key = rtp_mux_ssrc_key(io->mux->id, ssrc);
+
+	if (switch_mutex_trylock(rtp_mux_globals.mutex) != SWITCH_STATUS_SUCCESS) {
+		return;
+	}
+
+	/* the lookup that found the leg may have raced its detach */
+	if (!switch_atomic_read(&io->dead) && !rtp_mux_lookup(rtp_mux_globals.table, key)) {
+		if (io->mux_ssrc_key) {
+			rtp_mux_remove(io->mux_ssrc_key, io);
+		}
+		io->mux_ssrc = ssrc;
+		io->mux_ssrc_key = key;
+		rtp_mux_insert(key, io, SWITCH_FALSE);
+		rtp_mux_latch_del(io);
+	}
+
+	switch_mutex_unlock(rtp_mux_globals.mutex);
+}
+
+static void rtp_reactor_recv_mux(rtp_reactor_t *r, rtp_io_t *mio)
+{
+	int n = RTP_REACTOR_BATCH, i, loops = 0;
+	rtp_mux_table_t *t = rtp_mux_globals.table;
+	uint8_t id = mio->mux->id;
+
+	while (n == RTP_REACTOR_BATCH && loops++ < 4) {
+		for (i = 0; i < RTP_REACTOR_BATCH; i++) {
+			r->iov[i].iov_base = r->rxbuf + (i * sizeof(rtp_msg_t));
+			r->iov[i].iov_len = sizeof(rtp_msg_t);
+			memset(&r->msgs[i].msg_hdr, 0, sizeof(r->msgs[i].msg_hdr));
+			r->msgs[i].msg_hdr.msg_name = &r->hdrs[i].addr;
+			r->msgs[i].msg_hdr.msg_namelen = sizeof(r->hdrs[i].addr);
+			r->msgs[i].msg_hdr.msg_iov = &r->iov[i];
+			r->msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		if ((n = recvmmsg(mio->fd, r->msgs, RTP_REACTOR_BATCH, MSG_DONTWAIT, NULL)) <= 0) {
+			break;
+		}
+
+		r->rx_calls++;
+		r->rx_packets += n;
+
+		for (i = 0; i < n; i++) {
+			const uint8_t *pkt = (const uint8_t *) r->iov[i].iov_base;
+			uint32_t len = r->msgs[i].msg_len, ssrc = 0;
+			int is_rtp = len >= rtp_header_len && (pkt[0] & 0xc0) == 0x80 && !(pkt[1] >= 200 && pkt[1] <= 204);
+			rtp_io_t *io;
+
+			r->hdrs[i].len = len;
+			r->hdrs[i].salen = r->msgs[i].msg_hdr.msg_namelen;
+
+			if (is_rtp) {
+				ssrc = ((uint32_t) pkt[8] << 24) | ((uint32_t) pkt[9] << 16) | ((uint32_t) pkt[10] << 8) | pkt[11];
+			}
+
+			if ((io = rtp_mux_lookup(t, rtp_mux_addr_key(id, &r->hdrs[i].addr))) && rtp_mux_same_addr(&io->mux_addr, &r->hdrs[i].addr)) {
+				if (is_rtp && io->mux_ssrc != ssrc) {
+					rtp_mux_learn_ssrc(io, ssrc);
+				}
+			} else if (is_rtp && (io = rtp_mux_lookup(t, rtp_mux_ssrc_key(id, ssrc))) && io->mux_ssrc == ssrc &&
+					   rtp_mux_trusted(io, &r->hdrs[i].addr)) {
+				/* the far end moved, the leg sees the new source and adjusts like it would on its own port */
+				r->mux_ssrc_hits++;
+			} else if ((io = rtp_mux_latcher(mio->mux))) {
+				/* nobody knows the sender, the only leg still waiting for media latches onto it if it stays */
+				r->mux_latched++;
+			} else {
+				r->mux_unknown++;
+				continue;
+			}
+
+			switch_mutex_lock(io->rx_mutex);
+			if (!rtp_io_put(io->rx, &r->hdrs[i], pkt, len)) {
+				r->rx_drops++;
+			}
+			switch_mutex_unlock(io->rx_mutex);
+
+			rtp_io_signal(io);
+		}
+	}
+}
+
+static void *SWITCH_THREAD_FUNC rtp_reactor_run(switch_thread_t *thread, void *obj)
+{
+	rtp_reactor_t *r = (rtp_reactor_t *) obj;
+	struct epoll_event events[RTP_REACTOR_EVENTS];
+	int n, i;
+
+	while (rtp_reactor_globals.running) {
+		rtp_io_t *pending;
+
+		/* nobody may queue behind our back once we say we are asleep, so look again after saying it */
+		switch_atomic_cas(&r->sleeping, 1, 0);
+
+		n = epoll_wait(r->epfd, events, RTP_REACTOR_EVENTS, r->pending ? 0 : 1000);
+
+		switch_atomic_cas(&r->sleeping, 0, 1);
+
+		switch_mutex_lock(r->mutex);
+
+		for (i = 0; i < n; i++) {
+			uint32_t slot = (uint32_t) (events[i].data.u64 & 0xffffffff);
+			uint32_t gen = (uint32_t) (events[i].data.u64 >> 32);
+			rtp_io_t *io;
+
+			if (events[i].data.u64 == RTP_IO_WAKE) {
+				uint64_t val;
+
+				if (read(r->evfd, &val, sizeof(val)) > 0) {
+					r->wakeups++;
+				}
+				continue;
+			}
+
+			if (slot >= r->io_alloc || r->gens[slot] != gen || !(io = r->ios[slot])) {
+				continue;
+			}
+
+			if (!io->rtp_session) {
+				rtp_reactor_recv_mux(r, io);
+				continue;
+			}
+
+			if ((events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))) {
+				epoll_ctl(r->epfd, EPOLL_CTL_DEL, io->fd, NULL);
+				switch_atomic_set(&io->dead, 1);
+				switch_mutex_lock(io->mutex);
+				switch_thread_cond_signal(io->cond);
+				switch_mutex_unlock(io->mutex);
+				continue;
+			}
+
+			rtp_reactor_recv(r, io);
+		}
+
+		if ((pending = rtp_reactor_take(r))) {
+			/* the list was built by pushing, sends still go out per leg in the order they were queued */
+			while (pending) {
+				rtp_io_t *io = pending;
+
+				pending = pending->next;
+				io->next = NULL;
+				rtp_reactor_send(r, io);
+			}
+		}
+
+		switch_mutex_unlock(r->mutex);
+	}
+
+	return NULL;
+}
+
+static void rtp_reactor_start(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	int threads = rtp_reactor_globals.wanted;
+	uint32_t i;
+
+	if (!threads && rtp_mux_globals.port) {
+		/* the shared port lives on the reactors */
+		threads = -1;
+	}
+
+	if (threads < 0) {
+		threads = (int) switch_core_cpu_count();
+	}
+
+	if (threads > RTP_REACTOR_MAX) {
+		threads = RTP_REACTOR_MAX;
+	}
+
+	if (threads <= 0) {
+		return;
+	}
+
+	switch_core_new_memory_pool(&rtp_reactor_globals.pool);
+	switch_mutex_init(&rtp_reactor_globals.mutex, SWITCH_MUTEX_NESTED, rtp_reactor_globals.pool);
+	switch_mutex_init(&rtp_mux_globals.mutex, SWITCH_MUTEX_NESTED, rtp_reactor_globals.pool);
+	rtp_mux_globals.table = rtp_mux_table_alloc(RTP_MUX_TABLE_MIN);
+	rtp_reactor_globals.running = 1;
+	rtp_reactor_globals.gso = 1;
+
+	switch_threadattr_create(&thd_attr, rtp_reactor_globals.pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+	switch_threadattr_priority_increase(thd_attr);
+
+	for (i = 0; i < (uint32_t) threads; i++) {
+		rtp_reactor_t *r = switch_core_alloc(rtp_reactor_globals.pool, sizeof(*r));
+		struct epoll_event ev = { 0 };
+
+		r->id = i;
+
+		if ((r->epfd = epoll_create1(EPOLL_CLOEXEC)) < 0 || (r->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Media reactor %u setup failed: %s\n", i, strerror(errno));
+			if (r->epfd >= 0) {
+				close(r->epfd);
+			}
+			break;
+		}
+
+		ev.events = EPOLLIN;
+		ev.data.u64 = RTP_IO_WAKE;
+		epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->evfd, &ev);
+
+		switch_mutex_init(&r->mutex, SWITCH_MUTEX_NESTED, rtp_reactor_globals.pool);
+		r->rxbuf = switch_core_alloc(rtp_reactor_globals.pool, RTP_REACTOR_BATCH * sizeof(rtp_msg_t));
+		r->txbuf = switch_core_alloc(rtp_reactor_globals.pool, RTP_IO_QUEUE_LEN);
+
+		rtp_reactor_globals.reactors[rtp_reactor_globals.count++] = r;
+		switch_thread_create(&r->thread, thd_attr, rtp_reactor_run, r, rtp_reactor_globals.pool);
+	}
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Started %u media reactor threads\n", rtp_reactor_globals.count);
+}
+
+static void rtp_reactor_stop(void)
+{
+	switch_status_t st;
+	uint32_t i;
+
+	if (!rtp_reactor_globals.running) {
+		return;
+	}
+
+	rtp_reactor_globals.running = 0;
+
+	for (i = 0; i < rtp_reactor_globals.count; i++) {
+		rtp_reactor_t *r = rtp_reactor_globals.reactors[i];
+
+		rtp_reactor_wake(r);
+		switch_thread_join(&st, r->thread);
+	}
+
+	/* legs still attached lock the reactors and touch their epoll sets when they detach */
+	for (i = 0; switch_atomic_read(&rtp_reactor_globals.attached) && i < 500; i++) {
+		switch_yield(10000);
+	}
+
+	if (switch_atomic_read(&rtp_reactor_globals.attached)) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "%u legs still on the media reactor, leaving it allocated\n",
+						  switch_atomic_read(&rtp_reactor_globals.attached));
+		return;
+	}
+
+	for (i = 0; i < rtp_reactor_globals.count; i++) {
+		rtp_reactor_t *r = rtp_reactor_globals.reactors[i];
+
+		close(r->evfd);
+		close(r->epfd);
+		switch_safe_free(r->ios);
+		switch_safe_free(r->gens);
+		switch_safe_free(r->free_slots);
+	}
+
+	rtp_reactor_globals.count = 0;
+	rtp_mux_globals.groups = NULL;
+	rtp_mux_globals.group_count = 0;
+	switch_safe_free(rtp_mux_globals.table);
+	while (rtp_mux_globals.retired) {
+		rtp_mux_table_t *next = rtp_mux_globals.retired->next;
+		free(rtp_mux_globals.retired);
+		rtp_mux_globals.retired = next;
+	}
+	switch_core_destroy_memory_pool(&rtp_reactor_globals.pool);
+}
+
+/* keep the reactors from being torn down under a leg, fails once they are stopping */
+static switch_bool_t rtp_reactor_hold(void)
+{
+	switch_atomic_inc(&rtp_reactor_globals.attached);
+
+	if (!rtp_reactor_globals.running || !rtp_reactor_globals.count) {
+		switch_atomic_dec(&rtp_reactor_globals.attached);
+		return SWITCH_FALSE;
+	}
+
+	return SWITCH_TRUE;
+}
+
+static rtp_io_t *rtp_io_new(switch_rtp_t *rtp_session, rtp_reactor_t *r, int fd)
+{
+	rtp_io_t *io = switch_core_alloc(rtp_session->pool, sizeof(*io));
+
+	io->reactor = r;
+	io->rtp_session = rtp_session;
+	io->fd = fd;
+
+	switch_buffer_create_spsc(rtp_session->pool, &io->rx, RTP_IO_QUEUE_LEN);
+	switch_buffer_create_spsc(rtp_session->pool, &io->tx, RTP_IO_QUEUE_LEN);
+	switch_mutex_init(&io->rx_mutex, SWITCH_MUTEX_NESTED, rtp_session->pool);
+	switch_mutex_init(&io->tx_mutex, SWITCH_MUTEX_NESTED, rtp_session->pool);
+	switch_mutex_init(&io->mutex, SWITCH_MUTEX_NESTED, rtp_session->pool);
+	switch_thread_cond_create(&io->cond, rtp_session->pool);
+
+	return io;
+}
+
+static rtp_reactor_t *rtp_reactor_next(void)
+{
+	rtp_reactor_t *r;
+
+	switch_mutex_lock(rtp_reactor_globals.mutex);
+	r = rtp_reactor_globals.reactors[rtp_reactor_globals.next++ % rtp_reactor_globals.count];
+	switch_mutex_unlock(rtp_reactor_globals.mutex);
+
+	return r;
+}
+
+/* give a socket to a reactor, with the reactor's mutex held */
+static switch_status_t rtp_reactor_add(rtp_reactor_t *r, rtp_io_t *io)
+{
+	struct epoll_event ev = { 0 };
+	uint32_t slot;
+
+	if (r->free_count) {
+		slot = r->free_slots[--r->free_count];
+	} else {
+		if (r->io_count == r->io_alloc) {
+			uint32_t x, alloc = r->io_alloc ? r->io_alloc * 2 : 256;
+
+			r->ios = realloc(r->ios, alloc * sizeof(*r->ios));
+			switch_assert(r->ios);
+			r->gens = realloc(r->gens, alloc * sizeof(*r->gens));
+			switch_assert(r->gens);
+			r->free_slots = realloc(r->free_slots, alloc * sizeof(*r->free_slots));
+			switch_assert(r->free_slots);
+
+			for (x = r->io_alloc; x < alloc; x++) {
+				r->ios[x] = NULL;
+				r->gens[x] = 0;
+			}
+
+			r->io_alloc = alloc;
+		}
+		slot = r->io_count++;
+	}
+
+	io->slot = slot;
+	io->gen = ++r->gens[slot];
+	r->ios[slot] = io;
+
+	ev.events = EPOLLIN | EPOLLRDHUP;
+	ev.data.u64 = ((uint64_t) io->gen << 32) | slot;
+
+	if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, io->fd, &ev) != 0) {
+		r->ios[slot] = NULL;
+		r->free_slots[r->free_count++] = slot;
+		return SWITCH_STATUS_FALSE;
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void rtp_io_attach(switch_rtp_t *rtp_session)
+{
+	rtp_reactor_t *r;
+	rtp_io_t *io;
+	int fd;
+
+	if ((fd = switch_socket_fd_get(rtp_session->sock_input)) < 0 || !rtp_reactor_hold()) {
+		return;
+	}
+
+	r = rtp_reactor_next();
+	io = rtp_io_new(rtp_session, r, fd);
+
+	switch_mutex_lock(r->mutex);
+	if (rtp_reactor_add(r, io) == SWITCH_STATUS_SUCCESS) {
+		rtp_session->rio = io;
+	} else {
+		switch_atomic_dec(&rtp_reactor_globals.attached);
+	}
+	switch_mutex_unlock(r->mutex);
+}
+
+static rtp_mux_group_t *rtp_mux_group_get(const char *host, switch_sockaddr_t *local_addr)
+{
+	rtp_mux_group_t *g;
+	uint32_t i;
+
+	switch_mutex_lock(rtp_reactor_globals.mutex);
+
+	for (g = rtp_mux_globals.groups; g; g = g->next) {
+		if (!strcmp(g->host, host)) {
+			goto end;
+		}
+	}
+
+	if (rtp_mux_globals.group_count > 255) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Too many addresses on the shared RTP port\n");
+		goto end;
+	}
+
+	g = switch_core_alloc(rtp_reactor_globals.pool, sizeof(*g));
+	g->id = (uint8_t) rtp_mux_globals.group_count;
+	g->host = switch_core_strdup(rtp_reactor_globals.pool, host);
+
+	/* one socket per reactor, the kernel spreads the far ends over them by address */
+	for (i = 0; i < rtp_reactor_globals.count; i++) {
+		rtp_reactor_t *r = rtp_reactor_globals.reactors[i];
+		int fd, on = 1, bufsize = 4 * 1024 * 1024;
+
+		if (switch_socket_create(&g->socks[i], switch_sockaddr_get_family(local_addr), SOCK_DGRAM, 0, rtp_reactor_globals.pool) != SWITCH_STATUS_SUCCESS) {
+			goto fail;
+		}
+
+		fd = switch_socket_fd_get(g->socks[i]);
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+		setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+		setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+
+		if (switch_socket_bind(g->socks[i], local_addr) != SWITCH_STATUS_SUCCESS) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_ERROR, "Cannot bind the shared RTP port %s:%d\n", host, rtp_mux_globals.port);
+			goto fail;
+		}
+
+		g->ios[i] = switch_core_alloc(rtp_reactor_globals.pool, sizeof(*g->ios[i]));
+		g->ios[i]->reactor = r;
+		g->ios[i]->fd = fd;
+		g->ios[i]->mux = g;
+
+		switch_mutex_lock(r->mutex);
+		if (rtp_reactor_add(r, g->ios[i]) != SWITCH_STATUS_SUCCESS) {
+			switch_mutex_unlock(r->mutex);
+			goto fail;
+		}
+		switch_mutex_unlock(r->mutex);
+	}
+
+	switch_socket_create_pollset(&g->pollfd, g->socks[0], SWITCH_POLLIN | SWITCH_POLLERR, rtp_reactor_globals.pool);
+
+	g->next = rtp_mux_globals.groups;
+	rtp_mux_globals.groups = g;
+	rtp_mux_globals.group_count++;
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_INFO, "Shared RTP port %s:%d open on %u sockets\n", host, rtp_mux_globals.port,
+					  rtp_reactor_globals.count);
+
+	goto end;
+
+ fail:
+
+	/* sockets already handed to a reactor stay there until shutdown, they just never see a leg */
+	for (i = 0; i < rtp_reactor_globals.count && g->socks[i]; i++) {
+		if (!g->ios[i] || !g->ios[i]->gen) {
+			switch_socket_close(g->socks[i]);
+		}
+	}
+	g = NULL;
+
+ end:
+
+	switch_mutex_unlock(rtp_reactor_globals.mutex);
+
+	return g;
+}
+
+static switch_bool_t rtp_mux_enabled(switch_port_t port)
+{
+	return rtp_mux_globals.port && rtp_reactor_globals.running && (!port || port == rtp_mux_globals.port);
+}
+
+/* bind a leg to the shared port on host instead of a socket of its own */
+static switch_status_t rtp_mux_attach(switch_rtp_t *rtp_session, const char *host)
+{
+	rtp_mux_group_t *g;
+	rtp_reactor_t *r;
+	rtp_io_t *io;
+	uint32_t i;
+
+	if (!rtp_reactor_hold()) {
+		return SWITCH_STATUS_FALSE;
+	}
+
+	if (!(g = rtp_mux_group_get(host, rtp_session->local_addr))) {
+		switch_atomic_dec(&rtp_reactor_globals.attached);
+		return SWITCH_STATUS_FALSE;
+	}
+
+	r = rtp_reactor_next();
+
+	for (i = 0; i < rtp_reactor_globals.count; i++) {
+		if (rtp_reactor_globals.reactors[i] == r) {
+			break;
+		}
+	}
+
+	io = rtp_io_new(rtp_session, r, g->ios[i]->fd);
+	io->mux = g;
+	io->slot = UINT32_MAX;
+
+	rtp_session->sock_input = g->socks[i];
+	rtp_session->read_pollfd = g->pollfd;
+	rtp_session->mux = g;
+	rtp_session->rio = io;
+	switch_atomic_inc(&rtp_mux_globals.legs);
+
+	switch_mutex_lock(rtp_mux_globals.mutex);
+	rtp_mux_latch_add(io);
+	switch_mutex_unlock(rtp_mux_globals.mutex);
+
+	rtp_mux_set_remote(rtp_session);
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+static void rtp_io_detach(switch_rtp_t *rtp_session)
+{
+	rtp_io_t *io, *pending, *keep = NULL;
+	rtp_reactor_t *r;
+
+	if (!(io = rtp_session->rio)) {
+		return;
+	}
+
+	r = io->reactor;
+
+	if (io->mux) {
+		switch_mutex_lock(rtp_mux_globals.mutex);
+		/* keeps a reactor that still holds the leg from a lookup from learning its ssrc again */
+		switch_atomic_set(&io->dead, 1);
+		rtp_mux_latch_del(io);
+		if (io->mux_key) {
+			rtp_mux_remove(io->mux_key, io);
+		}
+		if (io->mux_ssrc_key) {
+			rtp_mux_remove(io->mux_ssrc_key, io);
+		}
+		switch_mutex_unlock(rtp_mux_globals.mutex);
+		switch_atomic_dec(&rtp_mux_globals.legs);
+	}
+
+	/* senders check dead under tx_mutex, once it is set nobody queues on us or puts us back on the send list */
+	switch_mutex_lock(io->tx_mutex);
+
+	/* the reactor only runs with its mutex held, once we have it the leg is ours */
+	switch_mutex_lock(r->mutex);
+
+	if (!io->mux) {
+		epoll_ctl(r->epfd, EPOLL_CTL_DEL, io->fd, NULL);
+		r->ios[io->slot] = NULL;
+		r->gens[io->slot]++;
+		r->free_slots[r->free_count++] = io->slot;
+	}
+
+	if (switch_atomic_read(&io->tx_pending)) {
+		/* take ourselves off the send list, whatever we left queued goes with us */
+		pending = rtp_reactor_take(r);
+
+		while (pending) {
+			rtp_io_t *next = pending->next;
+
+			if (pending != io) {
+				pending->next = keep;
+				keep = pending;
+			}
+			pending = next;
+		}
+
+		while (keep) {
+			rtp_io_t *next = keep->next;
+			rtp_reactor_push(r, keep);
+			keep = next;
+		}
+	}
+
+	switch_atomic_set(&io->dead, 1);
+	rtp_session->rio = NULL;
+
+	switch_mutex_unlock(r->mutex);
+	switch_mutex_unlock(io->tx_mutex);
+
+	/* a reactor may still hold a shared port leg from a lookup, switch_rtp_destroy() waits for it before the pool goes */
+
+	switch_mutex_lock(io->mutex);
+	switch_thread_cond_signal(io->cond);
+	switch_mutex_unlock(io->mutex);
+
+	switch_atomic_dec(&rtp_reactor_globals.attached);
+}
+
+static void rtp_io_kick(rtp_io_t *io)
+{
+	switch_atomic_set(&io->kicked, 1);
+	switch_mutex_lock(io->mutex);
+	switch_thread_cond_signal(io->cond);
+	switch_mutex_unlock(io->mutex);
+}
+
+static switch_status_t rtp_io_poll(rtp_io_t *io, switch_interval_time_t timeout)
+{
+	switch_status_t status = SWITCH_STATUS_TIMEOUT;
+
+	if (switch_buffer_inuse(io->rx) || switch_atomic_read(&io->dead) || switch_atomic_read(&io->kicked)) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+
+	if (!timeout) {
+		return SWITCH_STATUS_TIMEOUT;
+	}
+
+	switch_mutex_lock(io->mutex);
+	switch_atomic_cas(&io->waiting, 1, 0);
+
+	if (!switch_buffer_inuse(io->rx) && !switch_atomic_read(&io->dead) && !switch_atomic_read(&io->kicked)) {
+		switch_thread_cond_timedwait(io->cond, io->mutex, timeout);
+	}
+
+	switch_atomic_cas(&io->waiting, 0, 1);
+	switch_mutex_unlock(io->mutex);
+
+	if (switch_buffer_inuse(io->rx) || switch_atomic_read(&io->dead) || switch_atomic_read(&io->kicked)) {
+		status = SWITCH_STATUS_SUCCESS;
+	}
+
+	return status;
+}
+
+static void rtp_io_resume(switch_rtp_t *rtp_session, rtp_io_t *io)
+{
+	rtp_reactor_t *r = io->reactor;
+	struct epoll_event ev = { 0 };
+
+	switch_mutex_lock(r->mutex);
+
+	if (rtp_session->rio == io && switch_atomic_read(&io->paused)) {
+		ev.events = EPOLLIN | EPOLLRDHUP;
+		ev.data.u64 = ((uint64_t) io->gen << 32) | io->slot;
+		epoll_ctl(r->epfd, EPOLL_CTL_MOD, io->fd, &ev);
+		switch_atomic_set(&io->paused, 0);
+	}
+
+	switch_mutex_unlock(r->mutex);
+}
+
+static switch_status_t rtp_io_recvfrom(switch_rtp_t *rtp_session, rtp_io_t *io, switch_size_t *bytes)
+{
+	rtp_io_hdr_t hdr;
+
+	/* a blocking socket would have waited for the packet, so do the same on the queue */
+	while (!switch_test_flag(rtp_session, SWITCH_RTP_FLAG_NOBLOCK) && !switch_buffer_inuse(io->rx) &&
+		   !switch_atomic_read(&io->dead) && !switch_atomic_read(&io->kicked) && switch_rtp_ready(rtp_session)) {
+		rtp_io_poll(io, 100000);
+	}
+
+	if (!rtp_io_get(io->rx, &hdr, &rtp_session->recv_msg, bytes)) {
+		/* a break on a shared port wakes us up instead of a packet to ourselves */
+		switch_atomic_set(&io->kicked, 0);
+		*bytes = 0;
+		return switch_atomic_read(&io->dead) ? SWITCH_STATUS_GENERR : SWITCH_STATUS_BREAK;
+	}
+
+	switch_sockaddr_set_raw(rtp_session->from_addr, &hdr.addr, hdr.salen);
+
+	if (switch_atomic_read(&io->paused) && switch_buffer_freespace(io->rx) > RTP_IO_QUEUE_LEN / 2) {
+		rtp_io_resume(rtp_session, io);
+	}
+
+	return SWITCH_STATUS_SUCCESS;
+}
+
+/* queue a packet for the reactor, or tell the caller to send it itself when the reactor is idle */
+static switch_status_t rtp_io_sendto(rtp_io_t *io, const void *buf, switch_size_t len)
+{
+	rtp_reactor_t *r = io->reactor;
+	rtp_io_hdr_t hdr = { 0 };
+	switch_status_t status = SWITCH_STATUS_FALSE;
+
+	switch_mutex_lock(io->tx_mutex);
+
+	/* rtp_sendto() read rio without a lock, a detach in between leaves us the socket */
+	if (switch_atomic_read(&io->dead)) {
+		goto end;
+	}
+
+	/* nothing of ours is waiting and the reactor is asleep: sending it here is cheaper than waking it */
+	if (!switch_atomic_read(&io->tx_pending) && switch_atomic_read(&r->sleeping)) {
+		goto end;
+	}
+
+	hdr.len = (uint32_t) len;
+	status = SWITCH_STATUS_SUCCESS;
+
+	if (!rtp_io_put(io->tx, &hdr, buf, (uint32_t) len)) {
+		/* sending around the queue would reorder the stream, so drop it like a full socket buffer would */
+		switch_atomic_inc(&r->tx_drops);
+		goto end;
+	}
+
+	if (switch_atomic_cas(&io->tx_pending, 1, 0) == 0) {
+		rtp_reactor_push(r, io);
 
-		if (!(packet[0] || packet[1] || packet[2] || packet[3]) && len >= 8) {
-			switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
-			packet += 4;
-			len -= 4;
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "DTMF payload offset by 4 bytes.\n");
+		if (switch_atomic_read(&r->sleeping)) {
+			rtp_reactor_wake(r);
 		}
+	}
 
-		if (!(packet[0] || packet[1] || packet[2] || packet[3])) {
-			switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Failed DTMF payload check.\n");
-			rtp_session->dtmf_data.last_digit = 0;
-			rtp_session->dtmf_data.in_digit_ts = 0;
-			rtp_session->dtmf_data.in_digit_sanity = 0;
-		}
+ end:
+	switch_mutex_unlock(io->tx_mutex);
 
-		end = packet[1] & 0x80 ? 1 : 0;
-		duration = (packet[2] << 8) + packet[3];
-		key = switch_rfc2833_to_char(packet[0]);
-		in_digit_seq = ntohs((uint16_t) rtp_session->recv_msg.header.seq);
-		ts = htonl(rtp_session->recv_msg.header.ts);
+	return status;
+}
 
-		if (in_digit_seq < rtp_session->dtmf_data.in_digit_seq) {
-			if (rtp_session->dtmf_data.in_digit_seq - in_digit_seq > 100) {
-				rtp_session->dtmf_data.in_digit_seq = 0;
-			}
-		}
-#ifdef DEBUG_2833
-		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "packet[%d]: %02x %02x %02x %02x\n", (int) len, (unsigned) packet[0], (unsigned)
-			   packet[1], (unsigned) packet[2], (unsigned) packet[3]);
 #endif
 
-		if (in_digit_seq > rtp_session->dtmf_data.in_digit_seq) {
-
-			rtp_session->dtmf_data.in_digit_seq = in_digit_seq;
-#ifdef DEBUG_2833
+SWITCH_DECLARE(void) switch_rtp_set_reactor_threads(int threads)
+{
+#ifdef RTP_REACTOR
+	rtp_reactor_globals.wanted = threads;
+#else
+	if (threads) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "The media reactor is not supported on this platform\n");
+	}
+#endif
+}
 
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "read: %c %u %u %u %u %d %d %s\n",
-				   key, in_digit_seq, rtp_session->dtmf_data.in_digit_seq,
-				   ts, duration, rtp_session->recv_msg.header.m, end, end && !rtp_session->dtmf_data.in_digit_ts ? "ignored" : "");
+SWITCH_DECLARE(void) switch_rtp_set_mux_port(switch_port_t port)
+{
+#ifdef RTP_REACTOR
+	rtp_mux_globals.port = port;
+#else
+	if (port) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Shared RTP ports are not supported on this platform\n");
+	}
 #endif
+}
 
-			if (!rtp_session->dtmf_data.in_digit_queued && (rtp_session->rtp_bugs & RTP_BUG_IGNORE_DTMF_DURATION) &&
-				rtp_session->dtmf_data.in_digit_ts) {
-				switch_dtmf_t dtmf = { key, switch_core_min_dtmf_duration(0), 0, SWITCH_DTMF_RTP };
-#ifdef DEBUG_2833
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Early Queuing digit %c:%d\n", dtmf.digit, dtmf.duration / 8);
+SWITCH_DECLARE(switch_port_t) switch_rtp_get_mux_port(void)
+{
+#ifdef RTP_REACTOR
+	return rtp_mux_enabled(0) ? rtp_mux_globals.port : 0;
+#else
+	return 0;
 #endif
-				switch_rtp_queue_rfc2833_in(rtp_session, &dtmf);
-				rtp_session->dtmf_data.in_digit_queued = 1;
-			}
+}
 
-			/* only set sanity if we do NOT ignore the packet */
-			if (rtp_session->dtmf_data.in_digit_ts) {
-				rtp_session->dtmf_data.in_digit_sanity = 2000;
-			}
+SWITCH_DECLARE(void) switch_rtp_reactor_stats(switch_stream_handle_t *stream, switch_bool_t reset)
+{
+#ifdef RTP_REACTOR
+	uint32_t i;
 
-			if (rtp_session->dtmf_data.last_duration > duration && 
-				rtp_session->dtmf_data.last_duration > 0xFC17 && ts == rtp_session->dtmf_data.in_digit_ts) {
-				rtp_session->dtmf_data.flip++;
-			}
+	if (!rtp_reactor_globals.count) {
+		stream->write_function(stream, "-ERR media reactor is not running\n");
+		return;
+	}
 
-			if (end) {
-				if (!rtp_session->dtmf_data.in_digit_ts && rtp_session->dtmf_data.last_in_digit_ts != ts) {
-#ifdef DEBUG_2833
-					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "start with end packet %d\n", ts);
-#endif
-					rtp_session->dtmf_data.last_in_digit_ts = ts;
-					rtp_session->dtmf_data.in_digit_ts = ts;
-					rtp_session->dtmf_data.first_digit = key;
-					rtp_session->dtmf_data.in_digit_sanity = 2000;
-				}
-				if (rtp_session->dtmf_data.in_digit_ts) {
-					switch_dtmf_t dtmf = { key, duration, 0, SWITCH_DTMF_RTP };
+	stream->write_function(stream, "reactor,sockets,rx_packets,rx_calls,rx_per_call,rx_drops,rx_pauses,tx_packets,tx_calls,tx_per_call,tx_gso,tx_errors,tx_drops,wakeups,mux_unknown,mux_ssrc_hits,mux_latched\n");
 
-					if (ts > rtp_session->dtmf_data.in_digit_ts) {
-						dtmf.duration += (ts - rtp_session->dtmf_data.in_digit_ts);
-					}
-					if (rtp_session->dtmf_data.flip) {
-						dtmf.duration += rtp_session->dtmf_data.flip * 0xFFFF;
-						rtp_session->dtmf_data.flip = 0;
-#ifdef DEBUG_2833
-						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "you're welcome!\n");
-#endif
-					}
-#ifdef DEBUG_2833
-					switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "done digit=%c ts=%u start_ts=%u dur=%u ddur=%u\n",
-						   dtmf.digit, ts, rtp_session->dtmf_data.in_digit_ts, duration, dtmf.duration);
-#endif
-						
-					if (!(rtp_session->rtp_bugs & RTP_BUG_IGNORE_DTMF_DURATION) && !rtp_session->dtmf_data.in_digit_queued) {
-#ifdef DEBUG_2833
-						switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "Queuing digit %c:%d\n", dtmf.digit, dtmf.duration / 8);
-#endif
-						switch_rtp_queue_rfc2833_in(rtp_session, &dtmf);
-					}
+	for (i = 0; i < rtp_reactor_globals.count; i++) {
+		rtp_reactor_t *r = rtp_reactor_globals.reactors[i];
 
-					rtp_session->dtmf_data.last_digit = rtp_session->dtmf_data.first_digit;
+		switch_mutex_lock(r->mutex);
+		stream->write_function(stream, "%u,%u,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%.2f,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT
+							   ",%" SWITCH_UINT64_T_FMT ",%.2f,%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%u,%" SWITCH_UINT64_T_FMT
+							   ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT ",%" SWITCH_UINT64_T_FMT "\n",
+							   r->id, r->io_count - r->free_count, r->rx_packets, r->rx_calls,
+							   r->rx_calls ? (double) r->rx_packets / r->rx_calls : 0, r->rx_drops, r->rx_pauses,
+							   r->tx_packets, r->tx_calls, r->tx_calls ? (double) r->tx_packets / r->tx_calls : 0,
+							   r->tx_gso, r->tx_errors, switch_atomic_read(&r->tx_drops), r->wakeups, r->mux_unknown, r->mux_ssrc_hits, r->mux_latched);
 
-					rtp_session->dtmf_data.in_digit_ts = 0;
-					rtp_session->dtmf_data.in_digit_sanity = 0;
-					rtp_session->dtmf_data.in_digit_queued = 0;
-					*do_cng = 1;
-				} else {
-					if (!switch_rtp_ready(rtp_session)) {
-						return RESULT_GOTO_END;
-					}
-					switch_cond_next();
-					return RESULT_GOTO_RECVFROM;
-				}
+		if (reset) {
+			r->rx_packets = r->rx_calls = r->rx_drops = r->rx_pauses = r->tx_packets = r->tx_calls = r->tx_gso = r->tx_errors = r->wakeups = 0;
+			r->mux_unknown = r->mux_ssrc_hits = r->mux_latched = 0;
+			switch_atomic_set(&r->tx_drops, 0);
+		}
+		switch_mutex_unlock(r->mutex);
+	}
 
-			} else if (!rtp_session->dtmf_data.in_digit_ts) {
-#ifdef DEBUG_2833
-				switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "start %d\n", ts);
+	if (rtp_mux_globals.port) {
+		switch_mutex_lock(rtp_mux_globals.mutex);
+		stream->write_function(stream, "\nmux_port,addresses,legs,table_size,table_used,table_tombs\n%d,%u,%u,%u,%u,%u\n",
+							   rtp_mux_globals.port, rtp_mux_globals.group_count, switch_atomic_read(&rtp_mux_globals.legs),
+							   rtp_mux_globals.table->mask + 1, rtp_mux_globals.table->used, rtp_mux_globals.table->tombs);
+		switch_mutex_unlock(rtp_mux_globals.mutex);
+	}
+#else
+	stream->write_function(stream, "-ERR the media reactor is not supported on this platform\n");
 #endif
-				rtp_session->dtmf_data.in_digit_ts = ts;
-				rtp_session->dtmf_data.last_in_digit_ts = ts;
-				rtp_session->dtmf_data.first_digit = key;
-				rtp_session->dtmf_data.in_digit_sanity = 2000;
-			}
+}
 
-			rtp_session->dtmf_data.last_duration = duration;
-		} else {
-#ifdef DEBUG_2833
-			switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_ERROR, "drop: %c %u %u %u %u %d %d\n",
-				   key, in_digit_seq, rtp_session->dtmf_data.in_digit_seq, ts, duration, rtp_session->recv_msg.header.m, end);
-#endif
-			switch_cond_next();
-			return RESULT_GOTO_RECVFROM;
-		}
+/* the leg's own socket, or its reactor queue */
+static switch_status_t rtp_recvfrom(switch_rtp_t *rtp_session, switch_size_t *bytes)
+{
+#ifdef RTP_REACTOR
+	rtp_io_t *io;
+
+	if ((io = rtp_session->rio)) {
+		return rtp_io_recvfrom(rtp_session, io, bytes);
 	}
 
-	if (bytes && rtp_session->dtmf_data.in_digit_ts) {
-		if (!switch_rtp_ready(rtp_session)) {
-			return RESULT_GOTO_END;
-		}
+	if (rtp_session->mux) {
+		/* off the shared port already, the socket belongs to everybody else */
+		*bytes = 0;
+		return SWITCH_STATUS_GENERR;
+	}
+#endif
 
-		if (!rtp_session->dtmf_data.in_interleaved && rtp_session->recv_msg.header.pt != rtp_session->recv_te) {
-			/* Drat, they are sending audio still as well as DTMF ok fine..... *sigh* */
-			rtp_session->dtmf_data.in_interleaved = 1;
-		}
-			
-		if (rtp_session->dtmf_data.in_interleaved || (rtp_session->rtp_bugs & RTP_BUG_IGNORE_DTMF_DURATION)) {
-			if (rtp_session->recv_msg.header.pt == rtp_session->recv_te) {
-				return RESULT_GOTO_RECVFROM;
-			}
-		} else {
-			*do_cng = 1;
-			return RESULT_GOTO_TIMERCHECK;
-		}
+	return switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, bytes);
+}
+
+static switch_status_t rtp_read_poll(switch_rtp_t *rtp_session, int *fdr, switch_interval_time_t timeout)
+{
+#ifdef RTP_REACTOR
+	rtp_io_t *io;
+
+	if ((io = rtp_session->rio)) {
+		return rtp_io_poll(io, timeout);
 	}
 
-	return RESULT_CONTINUE;
+	if (rtp_session->mux) {
+		return SWITCH_STATUS_BREAK;
+	}
+#endif
+
+	return switch_poll(rtp_session->read_pollfd, 1, fdr, timeout);
 }
 
-struct switch_rtcp_report_block {
-	uint32_t ssrc; /* The SSRC identifier of the source to which the information in this reception report block pertains. */
-	unsigned int fraction :8; /* The fraction of RTP data packets from source SSRC_n lost since the previous SR or RR packet was sent */
-	int lost :24; /* The total number of RTP data packets from source SSRC_n that have been lost since the beginning of reception */
-	uint32_t highest_sequence_number_received;
-	uint32_t jitter; /* An estimate of the statistical variance of the RTP data packet interarrival time, measured in timestamp units and expressed as an unsigned integer. */
-	uint32_t lsr; /* The middle 32 bits out of 64 in the NTP timestamp */
-	uint32_t dlsr; /* The delay, expressed in units of 1/65536 seconds, between receiving the last SR packet from source SSRC_n and sending this reception report block */
-};
+static switch_status_t rtp_sendto(switch_rtp_t *rtp_session, switch_sockaddr_t *addr, const void *buf, switch_size_t *len)
+{
+#ifdef RTP_REACTOR
+	rtp_io_t *io;
 
-static int global_init = 0;
-static int rtp_common_write(switch_rtp_t *rtp_session,
-							rtp_msg_t *send_msg, void *data, uint32_t datalen, switch_payload_t payload, uint32_t timestamp, switch_frame_flag_t *flags);
+	/* only media to the far end goes through the reactor, it sends on the input socket */
+	if ((io = rtp_session->rio) && addr == rtp_session->remote_addr && rtp_session->sock_output == rtp_session->sock_input &&
+		rtp_io_sendto(io, buf, *len) == SWITCH_STATUS_SUCCESS) {
+		return SWITCH_STATUS_SUCCESS;
+	}
+#endif
+
+	return switch_socket_sendto(rtp_session->sock_output, addr, 0, buf, len);
+}
 
 
 static switch_status_t do_stun_ping(switch_rtp_t *rtp_session)
@@ -572,7 +2152,7 @@ static switch_status_t ice_out(switch_rtp_t *rtp_session)
 	packet = switch_stun_packet_build_header(SWITCH_STUN_BINDING_REQUEST, NULL, buf);
 	switch_stun_packet_attribute_add_username(packet, rtp_session->ice_user, 32);
 	bytes = switch_stun_packet_length(packet);
-	switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, (void *) packet, &bytes);
+	rtp_sendto(rtp_session, rtp_session->remote_addr, (void *) packet, &bytes);
 	rtp_session->stuncount = rtp_session->default_stuncount;
 
  end:
@@ -659,7 +2239,7 @@ static void handle_ice(switch_rtp_t *rtp_session, void *data, switch_size_t len)
 		remote_ip = switch_get_addr(ipbuf, sizeof(ipbuf), rtp_session->from_addr);
 		switch_stun_packet_attribute_add_binded_address(rpacket, (char *) remote_ip, switch_sockaddr_get_port(rtp_session->from_addr));
 		bytes = switch_stun_packet_length(rpacket);
-		switch_socket_sendto(rtp_session->sock_output, rtp_session->from_addr, 0, (void *) rpacket, &bytes);
+		rtp_sendto(rtp_session, rtp_session->from_addr, (void *) rpacket, &bytes);
 	}
 
  end:
@@ -684,7 +2264,7 @@ static int zrtp_send_rtp_callback(const zrtp_stream_t *stream, char *rtp_packet,
 	switch_size_t len = rtp_packet_length;
 	zrtp_status_t status = zrtp_status_ok;
 
-	switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, rtp_packet, &len);
+	rtp_sendto(rtp_session, rtp_session->remote_addr, rtp_packet, &len);
 	return status;
 }
 
@@ -883,6 +2463,9 @@ SWITCH_DECLARE(void) switch_rtp_init(switch_memory_pool_t *pool)
 	srtp_init();
 #endif
 	switch_mutex_init(&port_lock, SWITCH_MUTEX_NESTED, pool);
+#ifdef RTP_REACTOR
+	rtp_reactor_start();
+#endif
 	global_init = 1;
 }
 
@@ -907,6 +2490,10 @@ SWITCH_DECLARE(void) switch_rtp_shutdown(void)
 		return;
 	}
 
+#ifdef RTP_REACTOR
+	rtp_reactor_stop();
+#endif
+
 	switch_mutex_lock(port_lock);
 
 	for (hi = switch_hash_first(NULL, alloc_hash); hi; hi = switch_hash_next(hi)) {
@@ -980,6 +2567,12 @@ SWITCH_DECLARE(void) switch_rtp_release_port(const char *ip, switch_port_t port)
 		return;
 	}
 
+#ifdef RTP_REACTOR
+	if (rtp_mux_enabled(port)) {
+		return;
+	}
+#endif
+
 	switch_mutex_lock(port_lock);
 	if ((alloc = switch_core_hash_find(alloc_hash, ip))) {
 		switch_core_port_allocator_free_port(alloc, port);
@@ -993,6 +2586,13 @@ SWITCH_DECLARE(switch_port_t) switch_rtp_request_port(const char *ip)
 	switch_port_t port = 0;
 	switch_core_port_allocator_t *alloc = NULL;
 
+#ifdef RTP_REACTOR
+	if (rtp_mux_enabled(0)) {
+		/* every leg shares the one port, the reactors sort the packets out */
+		return rtp_mux_globals.port;
+	}
+#endif
+
 	switch_mutex_lock(port_lock);
 	alloc = switch_core_hash_find(alloc_hash, ip);
 	if (!alloc) {
@@ -1072,6 +2672,14 @@ static switch_status_t enable_local_rtcp_socket(switch_rtp_t *rtp_session, const
 	switch_status_t status = SWITCH_STATUS_SUCCESS;
 	char bufa[30];
 
+	if (rtp_session->mux) {
+		/* port+1 is not ours on a shared port */
+		switch_core_session_t *session = switch_core_memory_pool_get_data(rtp_session->pool, "__session");
+		switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_WARNING, "RTCP is not available on the shared RTP port\n");
+		switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP);
+		return SWITCH_STATUS_FALSE;
+	}
+
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
 		if (switch_sockaddr_info_get(&rtp_session->rtcp_local_addr, host, SWITCH_UNSPEC, port+1, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
 			*err = "RTCP Local Address Error!";
@@ -1173,6 +2781,33 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 		switch_rtp_kill_socket(rtp_session);
 	}
 
+#ifdef RTP_REACTOR
+	if (rtp_mux_enabled(port)) {
+		rtp_io_detach(rtp_session);
+
+		if (!rtp_session->mux) {
+			old_sock = rtp_session->sock_input;
+		}
+
+		rtp_session->sock_input = NULL;
+		rtp_session->mux = NULL;
+
+		if (rtp_mux_attach(rtp_session, host) != SWITCH_STATUS_SUCCESS) {
+			*err = "Shared Port Error!";
+			goto done;
+		}
+
+		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
+			switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_NOBLOCK);
+		}
+
+		status = SWITCH_STATUS_SUCCESS;
+		*err = "Success";
+		switch_set_flag_locked(rtp_session, SWITCH_RTP_FLAG_IO);
+		goto done;
+	}
+#endif
+
 	if (switch_socket_create(&new_sock, switch_sockaddr_get_family(rtp_session->local_addr), SOCK_DGRAM, 0, rtp_session->pool) != SWITCH_STATUS_SUCCESS) {
 		*err = "Socket Error!";
 		goto done;
@@ -1214,6 +2849,15 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 
 #endif
 
+#ifdef RTP_REACTOR
+	rtp_io_detach(rtp_session);
+
+	if (rtp_session->mux) {
+		rtp_session->sock_input = NULL;
+		rtp_session->mux = NULL;
+	}
+#endif
+
 	old_sock = rtp_session->sock_input;
 	rtp_session->sock_input = new_sock;
 	new_sock = NULL;
@@ -1225,6 +2869,10 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 
 	switch_socket_create_pollset(&rtp_session->read_pollfd, rtp_session->sock_input, SWITCH_POLLIN | SWITCH_POLLERR, rtp_session->pool);
 
+#ifdef RTP_REACTOR
+	rtp_io_attach(rtp_session);
+#endif
+
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP)) {
 		if ((status = enable_local_rtcp_socket(rtp_session, err)) == SWITCH_STATUS_SUCCESS) {
 			*err = "Success";
@@ -1252,6 +2900,10 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_local_address(switch_rtp_t *rtp_s
 		READ_DEC(rtp_session);
 	}
 
+#ifdef RTP_REACTOR
+	rtp_mux_reap();
+#endif
+
 	return status;
 }
 
@@ -1286,6 +2938,17 @@ static void ping_socket(switch_rtp_t *rtp_session)
 {
 	uint32_t o = UINT_MAX;
 	switch_size_t len = sizeof(o);
+
+#ifdef RTP_REACTOR
+	if (rtp_session->mux) {
+		/* a packet to the shared port would not find us, wake the reader directly */
+		if (rtp_session->rio) {
+			rtp_io_kick(rtp_session->rio);
+		}
+		return;
+	}
+#endif
+
 	switch_socket_sendto(rtp_session->sock_input, rtp_session->local_addr, 0, (void *) &o, &len);
 
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_ENABLE_RTCP) && rtp_session->rtcp_sock_input) {
@@ -1394,8 +3057,16 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_set_remote_address(switch_rtp_t *rtp_
 		status = enable_remote_rtcp_socket(rtp_session, err);
 	}
 
+#ifdef RTP_REACTOR
+	rtp_mux_set_remote(rtp_session);
+#endif
+
 	switch_mutex_unlock(rtp_session->write_mutex);
 
+#ifdef RTP_REACTOR
+	rtp_mux_reap();
+#endif
+
 	return status;
 }
 
@@ -1886,13 +3557,14 @@ static void jb_callback(stfu_instance_t *i, void *udata)
 	stfu_n_report(i, &r);
 
 	switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG8, 
-					  "%s JB REPORT:\nlen: %u\nin: %u\nclean: %u\ngood: %u\nbad: %u\n",
+					  "%s JB REPORT:\nlen: %u\nin: %u\nclean: %u\ngood: %u\nbad: %u\njitter: %u\n",
 					  switch_core_session_get_name(session),
 					  r.qlen,
 					  r.packet_in_count,
 					  r.clean_count,
 					  r.consecutive_good_count,
-					  r.consecutive_bad_count
+					  r.consecutive_bad_count,
+					  r.jitter
 					  );
 
 }
@@ -2003,7 +3675,7 @@ SWITCH_DECLARE(switch_status_t) switch_rtp_activate_rtcp(switch_rtp_t *rtp_sessi
 {
 	const char *err = NULL;
 
-	if (!rtp_session->ms_per_packet) {
+	if (!rtp_session->ms_per_packet || rtp_session->mux) {
 		return SWITCH_STATUS_FALSE;
 	}
 	
@@ -2084,6 +3756,12 @@ SWITCH_DECLARE(void) switch_rtp_kill_socket(switch_rtp_t *rtp_session)
 	switch_mutex_lock(rtp_session->flag_mutex);
 	if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_IO)) {
 		switch_clear_flag(rtp_session, SWITCH_RTP_FLAG_IO);
+#ifdef RTP_REACTOR
+		if (rtp_session->mux) {
+			/* never shut the shared socket, just leave it */
+			rtp_io_detach(rtp_session);
+		} else
+#endif
 		if (rtp_session->sock_input) {
 			ping_socket(rtp_session);
 			switch_socket_shutdown(rtp_session->sock_input, SWITCH_SHUTDOWN_READWRITE);
@@ -2144,6 +3822,15 @@ SWITCH_DECLARE(void) switch_rtp_destroy(switch_rtp_t **rtp_session)
 
 	switch_rtp_kill_socket(*rtp_session);
 
+#ifdef RTP_REACTOR
+	rtp_io_detach(*rtp_session);
+
+	if (rtp_mux_globals.port && rtp_reactor_globals.count) {
+		/* the pool goes with the session, no reactor may still hold a leg of ours from a lookup */
+		rtp_reactor_quiesce();
+	}
+#endif
+
 	while (switch_queue_trypop((*rtp_session)->dtmf_data.dtmf_inqueue, &pop) == SWITCH_STATUS_SUCCESS) {
 		switch_safe_free(pop);
 	}
@@ -2158,7 +3845,9 @@ SWITCH_DECLARE(void) switch_rtp_destroy(switch_rtp_t **rtp_session)
 
 	sock = (*rtp_session)->sock_input;
 	(*rtp_session)->sock_input = NULL;
-	switch_socket_close(sock);
+	if (!(*rtp_session)->mux) {
+		switch_socket_close(sock);
+	}
 
 	if ((*rtp_session)->sock_output != sock) {
 		sock = (*rtp_session)->sock_output;
@@ -2521,7 +4210,7 @@ static void do_flush(switch_rtp_t *rtp_session)
 		do {
 			if (switch_rtp_ready(rtp_session)) {
 				bytes = sizeof(rtp_msg_t);
-				switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, &bytes);
+				rtp_recvfrom(rtp_session, &bytes);
 				if (bytes) {
 					int do_cng = 0;
 
@@ -2568,7 +4257,7 @@ static switch_status_t read_rtp_packet(switch_rtp_t *rtp_session, switch_size_t
 	switch_assert(bytes);
  more:
 	*bytes = sizeof(rtp_msg_t);
-	status = switch_socket_recvfrom(rtp_session->from_addr, rtp_session->sock_input, 0, (void *) &rtp_session->recv_msg, bytes);
+	status = rtp_recvfrom(rtp_session, bytes);
 	ts = ntohl(rtp_session->recv_msg.header.ts);
 
 	if (*bytes) {
@@ -2920,7 +4609,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 		if (switch_test_flag(rtp_session, SWITCH_RTP_FLAG_USE_TIMER)) {
 			if ((switch_test_flag(rtp_session, SWITCH_RTP_FLAG_AUTOFLUSH) || switch_test_flag(rtp_session, SWITCH_RTP_FLAG_STICKY_FLUSH)) &&
 				rtp_session->read_pollfd) {
-				if (switch_poll(rtp_session->read_pollfd, 1, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
+				if (rtp_read_poll(rtp_session, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
 					status = read_rtp_packet(rtp_session, &bytes, flags, SWITCH_FALSE);
 					/* switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Initial (%i) %d\n", status, bytes); */
 					if (status != SWITCH_STATUS_FALSE) {
@@ -2928,7 +4617,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 					}
 
 					if (bytes) {
-						if (switch_poll(rtp_session->read_pollfd, 1, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
+						if (rtp_read_poll(rtp_session, &fdr, 0) == SWITCH_STATUS_SUCCESS) {
 							/* switch_log_printf(SWITCH_CHANNEL_SESSION_LOG(session), SWITCH_LOG_DEBUG, "Trigger %d\n", rtp_session->hot_hits); */
 							rtp_session->hot_hits += rtp_session->samples_per_interval;
 						} else {
@@ -2986,7 +4675,7 @@ static int rtp_common_read(switch_rtp_t *rtp_session, switch_payload_t *payload_
 				pt = 0;
 			}
 
-			poll_status = switch_poll(rtp_session->read_pollfd, 1, &fdr, pt);
+			poll_status = rtp_read_poll(rtp_session, &fdr, pt);
 
 			if (rtp_session->dtmf_data.out_digit_dur > 0) {
 				return_cng_frame();
@@ -4022,7 +5711,7 @@ static int rtp_common_write(switch_rtp_t *rtp_session,
 		}
 
 
-		if (switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, (void *) send_msg, &bytes) != SWITCH_STATUS_SUCCESS) {
+		if (rtp_sendto(rtp_session, rtp_session->remote_addr, (void *) send_msg, &bytes) != SWITCH_STATUS_SUCCESS) {
 			rtp_session->seq--;
 			ret = -1;
 			goto end;
@@ -4232,7 +5921,7 @@ SWITCH_DECLARE(int) switch_rtp_write_frame(switch_rtp_t *rtp_session, switch_fra
 		  }
 		*/
 
-		if (switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, frame->packet, &bytes) != SWITCH_STATUS_SUCCESS) {
+		if (rtp_sendto(rtp_session, rtp_session->remote_addr, frame->packet, &bytes) != SWITCH_STATUS_SUCCESS) {
 			return -1;
 		}
 
@@ -4436,7 +6125,7 @@ SWITCH_DECLARE(int) switch_rtp_write_manual(switch_rtp_t *rtp_session,
 	}
 #endif
 
-	if (switch_socket_sendto(rtp_session->sock_output, rtp_session->remote_addr, 0, (void *) &rtp_session->write_msg, &bytes) != SWITCH_STATUS_SUCCESS) {
+	if (rtp_sendto(rtp_session, rtp_session->remote_addr, (void *) &rtp_session->write_msg, &bytes) != SWITCH_STATUS_SUCCESS) {
 		rtp_session->seq--;
 		ret = -1;
 		goto end;
@@ -31,6 +31,23 @@
  */
 
 #include <switch.h>
+/* 
+   Pending tasks live in a hierarchical timing wheel: 256 slots of SCHED_TICK_MS at the first level and 64 slots
+   per level above it, each level covering one full turn of the level below.  Tasks further out than the top level
+   sit in its last slot and are placed again when it cascades.  Slots are doubly linked and every task is also
+   indexed by id and by group so add and delete never walk the pending list.
+*/
+#define SCHED_TICK_MS 10
+#define SCHED_L0_BITS 8
+#define SCHED_LN_BITS 6
+#define SCHED_L0_SIZE (1 << SCHED_L0_BITS)
+#define SCHED_LN_SIZE (1 << SCHED_LN_BITS)
+#define SCHED_LEVELS 4
+#define SCHED_MAX_TICKS ((int64_t) 1 << (SCHED_L0_BITS + (SCHED_LEVELS - 1) * SCHED_LN_BITS))
+#define SCHED_WORKERS 4
+#define SCHED_ID_BUCKETS 1024
+
+typedef struct switch_scheduler_group switch_scheduler_group_t;
 
 struct switch_scheduler_task_container {
 	switch_scheduler_task_t task;
@@ -41,46 +58,290 @@ struct switch_scheduler_task_container {
 	switch_memory_pool_t *pool;
 	uint32_t flags;
 	char *desc;
+	/*! the tick the task is due on */
+	int64_t due;
+	/*! task.runtime in ms, kept so tasks added with ms precision keep it */
+	int64_t runtime_ms;
+	/*! the wheel slot holding the task, NULL while it runs */
+	struct switch_scheduler_task_container **slot;
 	struct switch_scheduler_task_container *next;
+	struct switch_scheduler_task_container *prev;
+	switch_scheduler_group_t *group;
+	struct switch_scheduler_task_container *group_next;
+	struct switch_scheduler_task_container *group_prev;
+	struct switch_scheduler_task_container *id_next;
 };
 typedef struct switch_scheduler_task_container switch_scheduler_task_container_t;
 
+struct switch_scheduler_group {
+	switch_scheduler_task_container_t *head;
+};
+
 static struct {
-	switch_scheduler_task_container_t *task_list;
+	switch_scheduler_task_container_t *wheel[SCHED_LEVELS][SCHED_L0_SIZE];
+	/*! the next tick to process */
+	int64_t tick;
+	switch_scheduler_task_container_t **ids;
+	uint32_t id_buckets;
+	uint32_t task_count;
+	switch_hash_t *groups;
+	switch_queue_t *run_queue;
+	switch_thread_t *workers[SCHED_WORKERS];
 	switch_mutex_t *task_mutex;
 	uint32_t task_id;
 	int task_thread_running;
 	switch_memory_pool_t *memory_pool;
 } globals;
 
-static void switch_scheduler_execute(switch_scheduler_task_container_t *tp)
+static int64_t sched_now_tick(void)
+{
+	return switch_micro_time_now() / (SCHED_TICK_MS * 1000);
+}
+
+static void sched_wheel_add(switch_scheduler_task_container_t *tp)
+{
+	int64_t due = tp->due, delta = due - globals.tick;
+	switch_scheduler_task_container_t **slot;
+
+	if (delta < 0) {
+		slot = &globals.wheel[0][globals.tick & (SCHED_L0_SIZE - 1)];
+	} else if (delta < SCHED_L0_SIZE) {
+		slot = &globals.wheel[0][due & (SCHED_L0_SIZE - 1)];
+	} else {
+		int level;
+
+		if (delta >= SCHED_MAX_TICKS) {
+			due = globals.tick + SCHED_MAX_TICKS - 1;
+			delta = SCHED_MAX_TICKS - 1;
+		}
+
+		for (level = 1; level < SCHED_LEVELS - 1; level++) {
+			if (delta < ((int64_t) 1 << (SCHED_L0_BITS + level * SCHED_LN_BITS))) {
+				break;
+			}
+		}
+
+		slot = &globals.wheel[level][(due >> (SCHED_L0_BITS + (level - 1) * SCHED_LN_BITS)) & (SCHED_LN_SIZE - 1)];
+	}
+
+	tp->slot = slot;
+	tp->prev = NULL;
+	if ((tp->next = *slot)) {
+		(*slot)->prev = tp;
+	}
+	*slot = tp;
+}
+
+static void sched_wheel_del(switch_scheduler_task_container_t *tp)
+{
+	if (!tp->slot) {
+		return;
+	}
+
+	if (tp->prev) {
+		tp->prev->next = tp->next;
+	} else {
+		*tp->slot = tp->next;
+	}
+	if (tp->next) {
+		tp->next->prev = tp->prev;
+	}
+
+	tp->slot = NULL;
+	tp->next = tp->prev = NULL;
+}
+
+/* move every task of a higher level slot down to where it belongs now, returns the slot index */
+static int sched_cascade(int level)
+{
+	int idx = (int) ((globals.tick >> (SCHED_L0_BITS + (level - 1) * SCHED_LN_BITS)) & (SCHED_LN_SIZE - 1));
+	switch_scheduler_task_container_t *tp = globals.wheel[level][idx], *next;
+
+	globals.wheel[level][idx] = NULL;
+
+	for (; tp; tp = next) {
+		next = tp->next;
+		sched_wheel_add(tp);
+	}
+
+	return idx;
+}
+
+static void sched_id_add(switch_scheduler_task_container_t *tp)
+{
+	uint32_t b;
+
+	if (globals.task_count >= globals.id_buckets * 2) {
+		uint32_t i, count = globals.id_buckets * 2;
+		switch_scheduler_task_container_t **ids, *xp, *next;
+
+		switch_zmalloc(ids, sizeof(*ids) * count);
+		for (i = 0; i < globals.id_buckets; i++) {
+			for (xp = globals.ids[i]; xp; xp = next) {
+				next = xp->id_next;
+				b = xp->task.task_id & (count - 1);
+				xp->id_next = ids[b];
+				ids[b] = xp;
+			}
+		}
+		free(globals.ids);
+		globals.ids = ids;
+		globals.id_buckets = count;
+	}
+
+	b = tp->task.task_id & (globals.id_buckets - 1);
+	tp->id_next = globals.ids[b];
+	globals.ids[b] = tp;
+	globals.task_count++;
+}
+
+static switch_scheduler_task_container_t *sched_id_find(uint32_t task_id)
+{
+	switch_scheduler_task_container_t *tp;
+
+	for (tp = globals.ids[task_id & (globals.id_buckets - 1)]; tp && tp->task.task_id != task_id; tp = tp->id_next);
+
+	return tp;
+}
+
+static void sched_id_del(switch_scheduler_task_container_t *tp)
+{
+	switch_scheduler_task_container_t **pp;
+
+	for (pp = &globals.ids[tp->task.task_id & (globals.id_buckets - 1)]; *pp; pp = &(*pp)->id_next) {
+		if (*pp == tp) {
+			*pp = tp->id_next;
+			globals.task_count--;
+			break;
+		}
+	}
+}
+
+static void sched_group_add(switch_scheduler_task_container_t *tp)
+{
+	switch_scheduler_group_t *group;
+
+	if (!(group = switch_core_hash_find(globals.groups, tp->task.group))) {
+		switch_zmalloc(group, sizeof(*group));
+		switch_core_hash_insert(globals.groups, tp->task.group, group);
+	}
+
+	tp->group = group;
+	tp->group_prev = NULL;
+	if ((tp->group_next = group->head)) {
+		group->head->group_prev = tp;
+	}
+	group->head = tp;
+}
+
+static void sched_group_del(switch_scheduler_task_container_t *tp)
+{
+	switch_scheduler_group_t *group = tp->group;
+
+	if (tp->group_prev) {
+		tp->group_prev->group_next = tp->group_next;
+	} else {
+		group->head = tp->group_next;
+	}
+	if (tp->group_next) {
+		tp->group_next->group_prev = tp->group_prev;
+	}
+
+	if (!group->head) {
+		switch_core_hash_delete(globals.groups, tp->task.group);
+		free(group);
+	}
+
+	tp->group = NULL;
+}
+
+/* unlink a task from every index, called with task_mutex held */
+static void sched_unlink(switch_scheduler_task_container_t *tp)
+{
+	sched_wheel_del(tp);
+	sched_id_del(tp);
+	sched_group_del(tp);
+}
+
+static void sched_free(switch_scheduler_task_container_t *tp)
+{
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleting task %u %s (%s)\n", tp->task.task_id, tp->desc, switch_str_nil(tp->task.group));
+
+	switch_safe_free(tp->task.group);
+	if (tp->task.cmd_arg && switch_test_flag(tp, SSHF_FREE_ARG)) {
+		free(tp->task.cmd_arg);
+	}
+	switch_safe_free(tp->desc);
+	free(tp);
+}
+
+static switch_event_t *sched_create_event(switch_scheduler_task_container_t *tp, switch_event_types_t type)
+{
+	switch_event_t *event = NULL;
+
+	if (switch_event_create(&event, type) == SWITCH_STATUS_SUCCESS) {
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-ID", "%u", tp->task.task_id);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Desc", tp->desc);
+		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Group", switch_str_nil(tp->task.group));
+		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-Runtime", "%" SWITCH_INT64_T_FMT, tp->task.runtime);
+	}
+
+	return event;
+}
+
+static void sched_fire_event(switch_scheduler_task_container_t *tp, switch_event_types_t type)
 {
 	switch_event_t *event;
+
+	if ((event = sched_create_event(tp, type))) {
+		switch_event_fire(&event);
+	}
+}
+
+static void switch_scheduler_execute(switch_scheduler_task_container_t *tp)
+{
 	//switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Executing task %u %s (%s)\n", tp->task.task_id, tp->desc, switch_str_nil(tp->task.group));
 
 	tp->func(&tp->task);
 
 	if (tp->task.runtime > tp->executed) {
 		tp->executed = 0;
-		if (switch_event_create(&event, SWITCH_EVENT_RE_SCHEDULE) == SWITCH_STATUS_SUCCESS) {
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-ID", "%u", tp->task.task_id);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Desc", tp->desc);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Group", switch_str_nil(tp->task.group));
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-Runtime", "%" SWITCH_INT64_T_FMT, tp->task.runtime);
-			switch_event_fire(&event);
-		}
+		sched_fire_event(tp, SWITCH_EVENT_RE_SCHEDULE);
 	} else {
-		if (switch_event_create(&event, SWITCH_EVENT_DEL_SCHEDULE) == SWITCH_STATUS_SUCCESS) {
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-ID", "%u", tp->task.task_id);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Desc", tp->desc);
-			switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Group", switch_str_nil(tp->task.group));
-			switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-Runtime", "%" SWITCH_INT64_T_FMT, tp->task.runtime);
-			switch_event_fire(&event);
-		}
+		sched_fire_event(tp, SWITCH_EVENT_DEL_SCHEDULE);
 		tp->destroyed = 1;
 	}
 }
 
+/* run a task that was taken off the wheel, then put it back or drop it */
+static void sched_run(switch_scheduler_task_container_t *tp)
+{
+	int destroyed;
+
+	/* deleted while it was waiting for a worker */
+	if (!tp->destroyed) {
+		switch_scheduler_execute(tp);
+	}
+
+	switch_mutex_lock(globals.task_mutex);
+	tp->in_thread = 0;
+	if (!(destroyed = tp->destroyed)) {
+		/* the task only sets whole seconds, keep the ms part if it left the second alone */
+		if (tp->task.runtime != tp->runtime_ms / 1000) {
+			tp->runtime_ms = (int64_t) tp->task.runtime * 1000;
+		}
+		tp->due = (tp->runtime_ms + SCHED_TICK_MS - 1) / SCHED_TICK_MS;
+		sched_wheel_add(tp);
+	} else {
+		sched_unlink(tp);
+	}
+	switch_mutex_unlock(globals.task_mutex);
+
+	if (destroyed) {
+		sched_free(tp);
+	}
+}
+
 static void *SWITCH_THREAD_FUNC task_own_thread(switch_thread_t *thread, void *obj)
 {
 	switch_scheduler_task_container_t *tp = (switch_scheduler_task_container_t *) obj;
@@ -89,73 +350,78 @@ static void *SWITCH_THREAD_FUNC task_own_thread(switch_thread_t *thread, void *o
 	pool = tp->pool;
 	tp->pool = NULL;
 
-	switch_scheduler_execute(tp);
+	sched_run(tp);
 	switch_core_destroy_memory_pool(&pool);
-	tp->in_thread = 0;
 
 	return NULL;
 }
 
-static int task_thread_loop(int done)
+static void *SWITCH_THREAD_FUNC task_worker_thread(switch_thread_t *thread, void *obj)
 {
-	switch_scheduler_task_container_t *tofree, *tp, *last = NULL;
+	void *pop;
 
+	while (switch_queue_pop(globals.run_queue, &pop) == SWITCH_STATUS_SUCCESS && pop) {
+		sched_run((switch_scheduler_task_container_t *) pop);
+	}
 
-	switch_mutex_lock(globals.task_mutex);
+	return NULL;
+}
 
-	for (tp = globals.task_list; tp; tp = tp->next) {
-		if (done) {
-			tp->destroyed = 1;
-		} else {
-			int64_t now = switch_epoch_time_now(NULL);
-			if (now >= tp->task.runtime && !tp->in_thread) {
-				int32_t diff = (int32_t) (now - tp->task.runtime);
-				if (diff > 1) {
-					switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Task was executed late by %d seconds %u %s (%s)\n",
-									  diff, tp->task.task_id, tp->desc, switch_str_nil(tp->task.group));
-				}
-				tp->executed = now;
-				if (switch_test_flag(tp, SSHF_OWN_THREAD)) {
-					switch_thread_t *thread;
-					switch_threadattr_t *thd_attr;
-					switch_core_new_memory_pool(&tp->pool);
-					switch_threadattr_create(&thd_attr, tp->pool);
-					switch_threadattr_detach_set(thd_attr, 1);
-					tp->in_thread = 1;
-					switch_thread_create(&thread, thd_attr, task_own_thread, tp, tp->pool);
-				} else {
-					switch_scheduler_execute(tp);
-				}
-			}
-		}
+/* hand a due task to its own thread or to the workers, called with task_mutex held */
+static void sched_dispatch(switch_scheduler_task_container_t *tp, int64_t now)
+{
+	int64_t late = (now - tp->due) * SCHED_TICK_MS;
+
+	if (late > 1000) {
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Task was executed late by %d seconds %u %s (%s)\n",
+						  (int) (late / 1000), tp->task.task_id, tp->desc, switch_str_nil(tp->task.group));
 	}
-	switch_mutex_unlock(globals.task_mutex);
+
+	tp->in_thread = 1;
+	tp->executed = switch_epoch_time_now(NULL);
+
+	if (switch_test_flag(tp, SSHF_OWN_THREAD)) {
+		switch_thread_t *thread;
+		switch_threadattr_t *thd_attr;
+		switch_core_new_memory_pool(&tp->pool);
+		switch_threadattr_create(&thd_attr, tp->pool);
+		switch_threadattr_detach_set(thd_attr, 1);
+		switch_thread_create(&thread, thd_attr, task_own_thread, tp, tp->pool);
+	} else {
+		switch_queue_push(globals.run_queue, tp);
+	}
+}
+
+/* advance the wheel up to now and dispatch everything that came due */
+static void task_thread_loop(void)
+{
+	int64_t now = sched_now_tick();
+	switch_scheduler_task_container_t *tp, *next;
+	int level, idx;
+
 	switch_mutex_lock(globals.task_mutex);
-	for (tp = globals.task_list; tp;) {
-		if (tp->destroyed && !tp->in_thread) {
-			tofree = tp;
-			tp = tp->next;
-			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Deleting task %u %s (%s)\n",
-							  tofree->task.task_id, tofree->desc, switch_str_nil(tofree->task.group));
-			if (last) {
-				last->next = tofree->next;
-			} else {
-				globals.task_list = tofree->next;
-			}
-			switch_safe_free(tofree->task.group);
-			if (tofree->task.cmd_arg && switch_test_flag(tofree, SSHF_FREE_ARG)) {
-				free(tofree->task.cmd_arg);
-			}
-			switch_safe_free(tofree->desc);
-			free(tofree);
-		} else {
-			last = tp;
-			tp = tp->next;
+
+	while (globals.tick <= now) {
+		idx = (int) (globals.tick & (SCHED_L0_SIZE - 1));
+
+		for (level = 1; !idx && level < SCHED_LEVELS; level++) {
+			idx = sched_cascade(level);
+		}
+
+		idx = (int) (globals.tick & (SCHED_L0_SIZE - 1));
+		tp = globals.wheel[0][idx];
+		globals.wheel[0][idx] = NULL;
+		globals.tick++;
+
+		for (; tp; tp = next) {
+			next = tp->next;
+			tp->slot = NULL;
+			tp->next = tp->prev = NULL;
+			sched_dispatch(tp, now);
 		}
 	}
-	switch_mutex_unlock(globals.task_mutex);
 
-	return done;
+	switch_mutex_unlock(globals.task_mutex);
 }
 
 static void *SWITCH_THREAD_FUNC switch_scheduler_task_thread(switch_thread_t *thread, void *obj)
@@ -165,123 +431,160 @@ static void *SWITCH_THREAD_FUNC switch_scheduler_task_thread(switch_thread_t *th
 
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Starting task thread\n");
 	while (globals.task_thread_running == 1) {
-		if (task_thread_loop(0)) {
-			break;
-		}
-		switch_yield(500000);
+		task_thread_loop();
+		switch_yield(SCHED_TICK_MS * 1000);
 	}
 
-	task_thread_loop(1);
-
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_NOTICE, "Task thread ending\n");
 	globals.task_thread_running = 0;
 
 	return NULL;
 }
 
-SWITCH_DECLARE(uint32_t) switch_scheduler_add_task(time_t task_runtime,
-												   switch_scheduler_func_t func,
-												   const char *desc, const char *group, uint32_t cmd_id, void *cmd_arg, switch_scheduler_flag_t flags)
+static uint32_t sched_add(int64_t task_runtime_ms, switch_scheduler_func_t func,
+						  const char *desc, const char *group, uint32_t cmd_id, void *cmd_arg, switch_scheduler_flag_t flags)
 {
-	switch_scheduler_task_container_t *container, *tp;
+	switch_scheduler_task_container_t *container;
 	switch_event_t *event;
+	uint32_t task_id;
 
-	switch_mutex_lock(globals.task_mutex);
 	switch_zmalloc(container, sizeof(*container));
 	switch_assert(func);
 	container->func = func;
 	container->task.created = switch_epoch_time_now(NULL);
-	container->task.runtime = task_runtime;
+	container->task.runtime = task_runtime_ms / 1000;
 	container->task.group = strdup(group ? group : "none");
 	container->task.cmd_id = cmd_id;
 	container->task.cmd_arg = cmd_arg;
 	container->flags = flags;
 	container->desc = strdup(desc ? desc : "none");
+	container->runtime_ms = task_runtime_ms;
+	container->due = (task_runtime_ms + SCHED_TICK_MS - 1) / SCHED_TICK_MS;
 
-	for (tp = globals.task_list; tp && tp->next; tp = tp->next);
-
-	if (tp) {
-		tp->next = container;
-	} else {
-		globals.task_list = container;
-	}
+	switch_mutex_lock(globals.task_mutex);
 
-	for (container->task.task_id = 0; !container->task.task_id; container->task.task_id = ++globals.task_id);
+	do {
+		container->task.task_id = ++globals.task_id;
+	} while (!container->task.task_id || sched_id_find(container->task.task_id));
 
-	switch_mutex_unlock(globals.task_mutex);
+	sched_id_add(container);
+	sched_group_add(container);
+	sched_wheel_add(container);
 
-	tp = container;
+	/* a task that is already due may run and be freed as soon as the lock is released */
+	task_id = container->task.task_id;
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Added task %u %s (%s) to run at %" SWITCH_INT64_T_FMT "\n",
-					  tp->task.task_id, tp->desc, switch_str_nil(tp->task.group), tp->task.runtime);
+					  task_id, container->desc, switch_str_nil(container->task.group), container->task.runtime);
+	event = sched_create_event(container, SWITCH_EVENT_ADD_SCHEDULE);
 
-	if (switch_event_create(&event, SWITCH_EVENT_ADD_SCHEDULE) == SWITCH_STATUS_SUCCESS) {
-		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-ID", "%u", tp->task.task_id);
-		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Desc", tp->desc);
-		switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Group", switch_str_nil(tp->task.group));
-		switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-Runtime", "%" SWITCH_INT64_T_FMT, tp->task.runtime);
+	switch_mutex_unlock(globals.task_mutex);
+
+	if (event) {
 		switch_event_fire(&event);
 	}
-	return container->task.task_id;
+
+	return task_id;
+}
+
+SWITCH_DECLARE(uint32_t) switch_scheduler_add_task(time_t task_runtime,
+												   switch_scheduler_func_t func,
+												   const char *desc, const char *group, uint32_t cmd_id, void *cmd_arg, switch_scheduler_flag_t flags)
+{
+	return sched_add((int64_t) task_runtime * 1000, func, desc, group, cmd_id, cmd_arg, flags);
+}
+
+SWITCH_DECLARE(uint32_t) switch_scheduler_add_task_ms(switch_time_t task_runtime_ms,
+													  switch_scheduler_func_t func,
+													  const char *desc, const char *group, uint32_t cmd_id, void *cmd_arg, switch_scheduler_flag_t flags)
+{
+	return sched_add(task_runtime_ms, func, desc, group, cmd_id, cmd_arg, flags);
+}
+
+/* drop a task that is not running, or mark a running one so sched_run drops it, called with task_mutex held */
+static int sched_del(switch_scheduler_task_container_t *tp)
+{
+	if (tp->destroyed) {
+		return 0;
+	}
+
+	tp->destroyed++;
+	sched_fire_event(tp, SWITCH_EVENT_DEL_SCHEDULE);
+
+	if (tp->in_thread) {
+		return 0;
+	}
+
+	sched_unlink(tp);
+
+	return 1;
 }
 
 SWITCH_DECLARE(uint32_t) switch_scheduler_del_task_id(uint32_t task_id)
 {
-	switch_scheduler_task_container_t *tp;
-	switch_event_t *event;
+	switch_scheduler_task_container_t *tp, *tofree = NULL;
 	uint32_t delcnt = 0;
 
 	switch_mutex_lock(globals.task_mutex);
-	for (tp = globals.task_list; tp; tp = tp->next) {
-		if (tp->task.task_id == task_id) {
-			if (switch_test_flag(tp, SSHF_NO_DEL)) {
-				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Attempt made to delete undeletable task #%u (group %s)\n",
-								  tp->task.task_id, tp->task.group);
-				break;
-			}
-			tp->destroyed++;
-			if (switch_event_create(&event, SWITCH_EVENT_DEL_SCHEDULE) == SWITCH_STATUS_SUCCESS) {
-				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-ID", "%u", tp->task.task_id);
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Desc", tp->desc);
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Group", switch_str_nil(tp->task.group));
-				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-Runtime", "%" SWITCH_INT64_T_FMT, tp->task.runtime);
-				switch_event_fire(&event);
+	if ((tp = sched_id_find(task_id)) && !tp->destroyed) {
+		if (switch_test_flag(tp, SSHF_NO_DEL)) {
+			switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Attempt made to delete undeletable task #%u (group %s)\n",
+							  tp->task.task_id, tp->task.group);
+		} else {
+			if (sched_del(tp)) {
+				tofree = tp;
 			}
 			delcnt++;
-			break;
 		}
 	}
 	switch_mutex_unlock(globals.task_mutex);
 
+	if (tofree) {
+		sched_free(tofree);
+	}
+
 	return delcnt;
 }
 
 SWITCH_DECLARE(uint32_t) switch_scheduler_del_task_group(const char *group)
 {
-	switch_scheduler_task_container_t *tp;
-	switch_event_t *event;
+	switch_scheduler_task_container_t *tp, *next, *tofree = NULL;
+	switch_scheduler_group_t *grp;
 	uint32_t delcnt = 0;
 
+	if (zstr(group)) {
+		return 0;
+	}
+
 	switch_mutex_lock(globals.task_mutex);
-	for (tp = globals.task_list; tp; tp = tp->next) {
-		if (!zstr(group) && !strcmp(tp->task.group, group)) {
+	if ((grp = switch_core_hash_find(globals.groups, group))) {
+		for (tp = grp->head; tp; tp = next) {
+			next = tp->group_next;
+
+			if (tp->destroyed) {
+				continue;
+			}
+
 			if (switch_test_flag(tp, SSHF_NO_DEL)) {
 				switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_WARNING, "Attempt made to delete undeletable task #%u (group %s)\n",
 								  tp->task.task_id, group);
 				continue;
 			}
-			if (switch_event_create(&event, SWITCH_EVENT_DEL_SCHEDULE) == SWITCH_STATUS_SUCCESS) {
-				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-ID", "%u", tp->task.task_id);
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Desc", tp->desc);
-				switch_event_add_header_string(event, SWITCH_STACK_BOTTOM, "Task-Group", switch_str_nil(tp->task.group));
-				switch_event_add_header(event, SWITCH_STACK_BOTTOM, "Task-Runtime", "%" SWITCH_INT64_T_FMT, tp->task.runtime);
-				switch_event_fire(&event);
+
+			/* the group goes away with its last task, next is NULL by then */
+			if (sched_del(tp)) {
+				tp->next = tofree;
+				tofree = tp;
 			}
-			tp->destroyed++;
 			delcnt++;
 		}
 	}
 	switch_mutex_unlock(globals.task_mutex);
 
+	for (tp = tofree; tp; tp = next) {
+		next = tp->next;
+		sched_free(tp);
+	}
+
 	return delcnt;
 }
 
@@ -291,22 +594,35 @@ SWITCH_DECLARE(void) switch_scheduler_task_thread_start(void)
 {
 
 	switch_threadattr_t *thd_attr;
+	int i;
 
 	switch_core_new_memory_pool(&globals.memory_pool);
 	switch_threadattr_create(&thd_attr, globals.memory_pool);
+	switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
 	switch_mutex_init(&globals.task_mutex, SWITCH_MUTEX_NESTED, globals.memory_pool);
+	switch_core_hash_init(&globals.groups, globals.memory_pool);
+	switch_queue_create(&globals.run_queue, SWITCH_CORE_QUEUE_LEN, globals.memory_pool);
+
+	globals.id_buckets = SCHED_ID_BUCKETS;
+	switch_zmalloc(globals.ids, sizeof(*globals.ids) * globals.id_buckets);
+	globals.tick = sched_now_tick();
+
+	for (i = 0; i < SCHED_WORKERS; i++) {
+		switch_thread_create(&globals.workers[i], thd_attr, task_worker_thread, NULL, globals.memory_pool);
+	}
 
-	switch_threadattr_detach_set(thd_attr, 1);
 	switch_thread_create(&task_thread_p, thd_attr, switch_scheduler_task_thread, NULL, globals.memory_pool);
 }
 
 SWITCH_DECLARE(void) switch_scheduler_task_thread_stop(void)
 {
+	switch_scheduler_task_container_t *tp, *next;
+	switch_status_t st;
+	uint32_t i;
+	int sanity = 0;
+
 	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Stopping Task Thread\n");
 	if (globals.task_thread_running == 1) {
-		int sanity = 0;
-		switch_status_t st;
-
 		globals.task_thread_running = -1;
 
 		switch_thread_join(&st, task_thread_p);
@@ -318,6 +634,31 @@ SWITCH_DECLARE(void) switch_scheduler_task_thread_stop(void)
 			}
 		}
 	}
+
+	for (i = 0; i < SCHED_WORKERS; i++) {
+		switch_queue_push(globals.run_queue, NULL);
+	}
+
+	for (i = 0; i < SCHED_WORKERS; i++) {
+		if (globals.workers[i]) {
+			switch_thread_join(&st, globals.workers[i]);
+			globals.workers[i] = NULL;
+		}
+	}
+
+	/* tasks still in their own thread keep their memory, everything else goes */
+	switch_mutex_lock(globals.task_mutex);
+	for (i = 0; i < globals.id_buckets; i++) {
+		for (tp = globals.ids[i]; tp; tp = next) {
+			next = tp->id_next;
+			tp->destroyed = 1;
+			if (!tp->in_thread) {
+				sched_unlink(tp);
+				sched_free(tp);
+			}
+		}
+	}
+	switch_mutex_unlock(globals.task_mutex);
 }
 
 /* For Emacs:
@@ -46,6 +46,14 @@
 #endif
 #endif
 
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#if defined(SYS_futex)
+#define TIMER_SHARD_FUTEX
+#endif
+#endif
+
 //#if defined(DARWIN)
 #define DISABLE_1MS_COND
 //#endif
@@ -91,6 +99,9 @@ static int COND = 1;
 
 static int MATRIX = 1;
 
+/* number of per-core tick threads, 0 keeps every timer on the global matrix */
+static int SHARDS = 0;
+
 #ifdef WIN32
 static CRITICAL_SECTION timer_section;
 static switch_time_t win32_tick_time_since_start = -1;
@@ -125,6 +136,14 @@ struct timer_private {
 	switch_size_t start;
 	uint32_t roll;
 	uint32_t ready;
+	struct timer_matrix *matrix;
+	struct timer_shard *shard;
+	/* shard wait list linkage, protected by the shard mutex */
+	struct timer_private *next;
+	uint8_t queued;
+	volatile switch_atomic_t wake;
+	/* set while the tick thread may still touch us after publishing wake */
+	volatile switch_atomic_t waking;
 };
 typedef struct timer_private timer_private_t;
 
@@ -135,11 +154,45 @@ struct timer_matrix {
 	switch_mutex_t *mutex;
 	switch_thread_cond_t *cond;
 	switch_thread_rwlock_t *rwlock;
+	timer_private_t *waiters;
 };
 typedef struct timer_matrix timer_matrix_t;
 
 static timer_matrix_t TIMER_MATRIX[MAX_ELEMENTS + 1];
 
+/*
+   A timer shard is a tick thread with its own matrix.  Timers are spread over the shards
+   at init and a waiting timer parks itself on the wait list of its interval, so each tick
+   only wakes the threads whose interval actually elapsed instead of broadcasting.
+*/
+struct timer_shard {
+	uint32_t id;
+	int cpu;
+	switch_thread_t *thread;
+	switch_mutex_t *mutex;
+#ifndef TIMER_SHARD_FUTEX
+	switch_thread_cond_t *cond;
+#endif
+	timer_matrix_t matrix[MAX_ELEMENTS + 1];
+	/* intervals with at least one timer, so a tick does not scan the whole matrix */
+	uint16_t active[MAX_ELEMENTS + 1];
+	uint32_t active_count;
+	uint32_t timer_count;
+	/* tick jitter, in microseconds past the ideal tick time, these and wakeups are protected by the shard mutex */
+	uint64_t ticks;
+	uint64_t jitter_total;
+	switch_time_t jitter_max;
+	uint64_t late_ticks;
+	uint64_t wakeups;
+};
+typedef struct timer_shard timer_shard_t;
+
+static struct {
+	timer_shard_t **shards;
+	uint32_t count;
+	uint32_t next;
+} SHARD_POOL;
+
 static void os_yield(void)
 {
 #if defined(WIN32)
@@ -352,6 +405,19 @@ SWITCH_DECLARE(void) switch_time_set_matrix(switch_bool_t enable)
 	switch_time_sync();
 }
 
+SWITCH_DECLARE(void) switch_time_set_timer_shards(int shards)
+{
+	if (shards < 0) {
+		shards = switch_core_cpu_count();
+	}
+
+	if (shards > 256) {
+		shards = 256;
+	}
+
+	SHARDS = shards;
+}
+
 SWITCH_DECLARE(void) switch_time_set_nanosleep(switch_bool_t enable)
 {
 #if defined(HAVE_CLOCK_NANOSLEEP)
@@ -505,6 +571,346 @@ SWITCH_DECLARE(void) switch_cond_yield(switch_interval_time_t t)
 
 }
 
+#ifdef TIMER_SHARD_FUTEX
+static void timer_shard_futex_wait(volatile switch_atomic_t *word, uint32_t val, switch_interval_time_t t)
+{
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000;
+	ts.tv_nsec = (t % 1000000) * 1000;
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+static void timer_shard_futex_wake(volatile switch_atomic_t *word)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+#endif
+
+static void timer_shard_attach(switch_timer_t *timer, timer_private_t *private_info)
+{
+	timer_shard_t *shard = NULL, *tmp;
+	uint32_t x, start;
+
+	switch_mutex_lock(globals.mutex);
+	start = SHARD_POOL.next++;
+	for (x = 0; x < SHARD_POOL.count; x++) {
+		tmp = SHARD_POOL.shards[(start + x) % SHARD_POOL.count];
+		if (!shard || tmp->timer_count < shard->timer_count) {
+			shard = tmp;
+		}
+	}
+	switch_mutex_unlock(globals.mutex);
+
+	switch_mutex_lock(shard->mutex);
+	if (!shard->matrix[timer->interval].count++) {
+		shard->active[shard->active_count++] = (uint16_t) timer->interval;
+	}
+	shard->timer_count++;
+	switch_mutex_unlock(shard->mutex);
+
+	private_info->shard = shard;
+	private_info->matrix = &shard->matrix[timer->interval];
+}
+
+static void timer_shard_detach(switch_timer_t *timer, timer_private_t *private_info)
+{
+	timer_shard_t *shard = private_info->shard;
+	timer_matrix_t *matrix = private_info->matrix;
+	uint32_t x;
+
+#ifdef TIMER_SHARD_FUTEX
+	/* the tick thread may be about to futex wake us, the memory has to stay until it did */
+	while (switch_atomic_read(&private_info->waking)) {
+		switch_cond_next();
+	}
+#endif
+
+	switch_mutex_lock(shard->mutex);
+	if (!--matrix->count) {
+		matrix->tick = 0;
+		for (x = 0; x < shard->active_count; x++) {
+			if (shard->active[x] == timer->interval) {
+				shard->active[x] = shard->active[--shard->active_count];
+				break;
+			}
+		}
+	}
+	shard->timer_count--;
+	switch_mutex_unlock(shard->mutex);
+}
+
+static void timer_shard_unlink(timer_matrix_t *matrix, timer_private_t *private_info)
+{
+	timer_private_t **pp;
+
+	for (pp = &matrix->waiters; *pp; pp = &(*pp)->next) {
+		if (*pp == private_info) {
+			*pp = private_info->next;
+			break;
+		}
+	}
+
+	private_info->queued = 0;
+}
+
+/* park on the shard wait list until the tick thread steps our interval */
+static void timer_shard_wait(switch_timer_t *timer, timer_private_t *private_info)
+{
+	timer_shard_t *shard = private_info->shard;
+	timer_matrix_t *matrix = private_info->matrix;
+
+	switch_mutex_lock(shard->mutex);
+
+	if (globals.RUNNING != 1 || matrix->tick >= private_info->reference) {
+		switch_mutex_unlock(shard->mutex);
+		return;
+	}
+
+	switch_atomic_set(&private_info->wake, 0);
+	private_info->queued = 1;
+	private_info->next = matrix->waiters;
+	matrix->waiters = private_info;
+
+#ifdef TIMER_SHARD_FUTEX
+	switch_mutex_unlock(shard->mutex);
+
+	while (!switch_atomic_read(&private_info->wake)) {
+		timer_shard_futex_wait(&private_info->wake, 0, 1000000);
+
+		if (!switch_atomic_read(&private_info->wake)) {
+			/* a stalled tick thread must not hang the caller, but once we are off the list a wakeup is already on its way */
+			switch_mutex_lock(shard->mutex);
+			if (private_info->queued) {
+				timer_shard_unlink(matrix, private_info);
+				switch_mutex_unlock(shard->mutex);
+				break;
+			}
+			switch_mutex_unlock(shard->mutex);
+		}
+	}
+#else
+	while (!switch_atomic_read(&private_info->wake)) {
+		if (switch_thread_cond_timedwait(shard->cond, shard->mutex, 1000000) == SWITCH_STATUS_TIMEOUT) {
+			if (private_info->queued) {
+				timer_shard_unlink(matrix, private_info);
+			}
+			break;
+		}
+	}
+
+	switch_mutex_unlock(shard->mutex);
+#endif
+}
+
+static void timer_shard_wake(timer_shard_t *shard, timer_matrix_t *matrix, timer_private_t **wake_list)
+{
+	timer_private_t *private_info, *np;
+
+	for (private_info = matrix->waiters; private_info; private_info = np) {
+		np = private_info->next;
+		private_info->queued = 0;
+#ifdef TIMER_SHARD_FUTEX
+		switch_atomic_set(&private_info->waking, 1);
+#endif
+		private_info->next = *wake_list;
+		*wake_list = private_info;
+		shard->wakeups++;
+	}
+
+	matrix->waiters = NULL;
+}
+
+/* must be called with the shard mutex held, releases it */
+static void timer_shard_release(timer_shard_t *shard, timer_private_t *wake_list)
+{
+	timer_private_t *private_info, *np;
+
+#ifdef TIMER_SHARD_FUTEX
+	switch_mutex_unlock(shard->mutex);
+
+	for (private_info = wake_list; private_info; private_info = np) {
+		np = private_info->next;
+		switch_atomic_set(&private_info->wake, 1);
+		timer_shard_futex_wake(&private_info->wake);
+		switch_atomic_set(&private_info->waking, 0);
+	}
+#else
+	for (private_info = wake_list; private_info; private_info = np) {
+		np = private_info->next;
+		switch_atomic_set(&private_info->wake, 1);
+	}
+
+	if (wake_list) {
+		switch_thread_cond_broadcast(shard->cond);
+	}
+
+	switch_mutex_unlock(shard->mutex);
+#endif
+}
+
+static void *SWITCH_THREAD_FUNC timer_shard_thread(switch_thread_t *thread, void *obj)
+{
+	timer_shard_t *shard = (timer_shard_t *) obj;
+	timer_private_t *wake_list;
+	timer_matrix_t *matrix;
+	switch_time_t ideal, ts, jitter;
+	uint32_t x, interval, step_ms, current_ms = 0;
+
+#ifdef HAVE_CPU_SET_MACROS
+	if (shard->cpu > -1) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(shard->cpu, &set);
+		sched_setaffinity(0, sizeof(set), &set);
+	}
+#endif
+
+	ideal = time_now(0);
+
+	while (globals.RUNNING == 1) {
+		ideal += runtime.microseconds_per_tick;
+
+		while ((ts = time_now(0)) + 100 < ideal && globals.RUNNING == 1) {
+			do_sleep(ideal - ts);
+		}
+
+		jitter = ts > ideal ? ts - ideal : 0;
+
+		if (jitter > 1000000) {
+			/* clock jumped or we were descheduled for ages, start over rather than replay every missed tick */
+			ideal = ts;
+			jitter = 0;
+		}
+
+		if (!(step_ms = runtime.microseconds_per_tick / 1000)) {
+			step_ms = 1;
+		}
+
+		current_ms += step_ms;
+		wake_list = NULL;
+
+		switch_mutex_lock(shard->mutex);
+
+		shard->ticks++;
+		shard->jitter_total += jitter;
+		if (jitter > shard->jitter_max) {
+			shard->jitter_max = jitter;
+		}
+		if (jitter >= runtime.microseconds_per_tick) {
+			shard->late_ticks++;
+		}
+
+		for (x = 0; x < shard->active_count; x++) {
+			interval = shard->active[x];
+
+			if ((current_ms % interval) != 0) {
+				continue;
+			}
+
+			matrix = &shard->matrix[interval];
+			matrix->tick++;
+			if (matrix->tick == MAX_TICK) {
+				matrix->tick = 0;
+				matrix->roll++;
+			}
+
+			timer_shard_wake(shard, matrix, &wake_list);
+		}
+		timer_shard_release(shard, wake_list);
+
+		if (current_ms >= MAX_ELEMENTS) {
+			current_ms = 0;
+		}
+	}
+
+	wake_list = NULL;
+	switch_mutex_lock(shard->mutex);
+	for (x = 0; x < shard->active_count; x++) {
+		timer_shard_wake(shard, &shard->matrix[shard->active[x]], &wake_list);
+	}
+	timer_shard_release(shard, wake_list);
+
+	return NULL;
+}
+
+static void timer_shards_start(void)
+{
+	switch_threadattr_t *thd_attr = NULL;
+	timer_shard_t **shards;
+	uint32_t x, count = (uint32_t) SHARDS;
+
+	if (!count) {
+		return;
+	}
+
+	shards = switch_core_alloc(module_pool, sizeof(*shards) * count);
+
+	for (x = 0; x < count; x++) {
+		shards[x] = switch_core_alloc(module_pool, sizeof(timer_shard_t));
+		shards[x]->id = x;
+		shards[x]->cpu = runtime.cpu_count > 1 ? (int) (x % runtime.cpu_count) : -1;
+		switch_mutex_init(&shards[x]->mutex, SWITCH_MUTEX_NESTED, module_pool);
+#ifndef TIMER_SHARD_FUTEX
+		switch_thread_cond_create(&shards[x]->cond, module_pool);
+#endif
+	}
+
+	for (x = 0; x < count; x++) {
+		switch_threadattr_create(&thd_attr, module_pool);
+		switch_threadattr_stacksize_set(thd_attr, SWITCH_THREAD_STACKSIZE);
+		switch_threadattr_priority_increase(thd_attr);
+		switch_thread_create(&shards[x]->thread, thd_attr, timer_shard_thread, shards[x], module_pool);
+	}
+
+	switch_mutex_lock(globals.mutex);
+	SHARD_POOL.shards = shards;
+	SHARD_POOL.count = count;
+	switch_mutex_unlock(globals.mutex);
+
+	switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_CONSOLE, "Started %u timer shard%s.\n", count, count == 1 ? "" : "s");
+}
+
+static void timer_shards_stop(void)
+{
+	switch_status_t st;
+	uint32_t x;
+
+	for (x = 0; x < SHARD_POOL.count; x++) {
+		switch_thread_join(&st, SHARD_POOL.shards[x]->thread);
+	}
+}
+
+SWITCH_DECLARE(void) switch_time_timer_shard_stats(switch_stream_handle_t *stream, switch_bool_t reset)
+{
+	timer_shard_t *shard;
+	uint32_t x;
+
+	if (!SHARD_POOL.count) {
+		stream->write_function(stream, "-ERR timer shards are disabled, set timer-shards in switch.conf.xml\n");
+		return;
+	}
+
+	stream->write_function(stream, "%-6s %-4s %-8s %-12s %-12s %-10s %-10s %-12s\n",
+						   "shard", "cpu", "timers", "ticks", "avg-jitter", "max-jitter", "late", "wakeups");
+
+	for (x = 0; x < SHARD_POOL.count; x++) {
+		shard = SHARD_POOL.shards[x];
+
+		switch_mutex_lock(shard->mutex);
+		stream->write_function(stream, "%-6u %-4d %-8u %-12" SWITCH_UINT64_T_FMT " %-12.1f %-10" SWITCH_TIME_T_FMT " %-10" SWITCH_UINT64_T_FMT " %-12" SWITCH_UINT64_T_FMT "\n",
+							   shard->id, shard->cpu, shard->timer_count, shard->ticks,
+							   shard->ticks ? (double) shard->jitter_total / shard->ticks : 0.0,
+							   shard->jitter_max, shard->late_ticks, shard->wakeups);
+
+		if (reset) {
+			shard->ticks = shard->jitter_total = shard->late_ticks = shard->wakeups = 0;
+			shard->jitter_max = 0;
+		}
+		switch_mutex_unlock(shard->mutex);
+	}
+}
+
 static switch_status_t timer_init(switch_timer_t *timer)
 {
 	timer_private_t *private_info;
@@ -522,17 +928,22 @@ static switch_status_t timer_init(switch_timer_t *timer)
 	}
 
 	if ((private_info = switch_core_alloc(timer->memory_pool, sizeof(*private_info)))) {
-		switch_mutex_lock(globals.mutex);
-		if (!TIMER_MATRIX[timer->interval].mutex) {
-			switch_mutex_init(&TIMER_MATRIX[timer->interval].mutex, SWITCH_MUTEX_NESTED, module_pool);
-			switch_thread_cond_create(&TIMER_MATRIX[timer->interval].cond, module_pool);
+		if (SHARD_POOL.count && MATRIX && timer->interval <= MAX_ELEMENTS) {
+			timer_shard_attach(timer, private_info);
+		} else {
+			switch_mutex_lock(globals.mutex);
+			if (!TIMER_MATRIX[timer->interval].mutex) {
+				switch_mutex_init(&TIMER_MATRIX[timer->interval].mutex, SWITCH_MUTEX_NESTED, module_pool);
+				switch_thread_cond_create(&TIMER_MATRIX[timer->interval].cond, module_pool);
+			}
+			TIMER_MATRIX[timer->interval].count++;
+			switch_mutex_unlock(globals.mutex);
+			private_info->matrix = &TIMER_MATRIX[timer->interval];
 		}
-		TIMER_MATRIX[timer->interval].count++;
-		switch_mutex_unlock(globals.mutex);
 		timer->private_info = private_info;
-		private_info->start = private_info->reference = TIMER_MATRIX[timer->interval].tick;
+		private_info->start = private_info->reference = private_info->matrix->tick;
 		private_info->start -= 2; /* switch_core_timer_init sets samplecount to samples, this makes first next() step once */
-		private_info->roll = TIMER_MATRIX[timer->interval].roll;
+		private_info->roll = private_info->matrix->roll;
 		private_info->ready = 1;
 
 		if ((timer->interval == 10 || timer->interval == 30) && runtime.microseconds_per_tick > 10000) {
@@ -559,9 +970,9 @@ static switch_status_t timer_init(switch_timer_t *timer)
 	return SWITCH_STATUS_MEMERR;
 }
 
-#define check_roll() if (private_info->roll < TIMER_MATRIX[timer->interval].roll) {	\
+#define check_roll() if (private_info->roll < private_info->matrix->roll) {	\
 		private_info->roll++;											\
-		private_info->reference = private_info->start = TIMER_MATRIX[timer->interval].tick;	\
+		private_info->reference = private_info->start = private_info->matrix->tick;	\
 		private_info->start--; /* Must have a diff */					\
 	}																	\
 
@@ -598,7 +1009,7 @@ static switch_status_t timer_sync(switch_timer_t *timer)
 	}
 
 	/* sync the clock */
-	private_info->reference = timer->tick = TIMER_MATRIX[timer->interval].tick;
+	private_info->reference = timer->tick = private_info->matrix->tick;
 
 	/* apply timestamp */
 	timer_step(timer);
@@ -616,11 +1027,11 @@ static switch_status_t timer_next(switch_timer_t *timer)
 #else
 	int cond_index = 1;
 #endif
-	int delta = (int) (private_info->reference - TIMER_MATRIX[timer->interval].tick);
+	int delta = (int) (private_info->reference - private_info->matrix->tick);
 
 	/* sync up timer if it's not been called for a while otherwise it will return instantly several times until it catches up */
 	if (delta < -1) {
-		private_info->reference = timer->tick = TIMER_MATRIX[timer->interval].tick;
+		private_info->reference = timer->tick = private_info->matrix->tick;
 	}
 	timer_step(timer);
 
@@ -629,6 +1040,14 @@ static switch_status_t timer_next(switch_timer_t *timer)
 		goto end;
 	}
 
+	if (private_info->shard) {
+		while (globals.RUNNING == 1 && private_info->ready && private_info->matrix->tick < private_info->reference) {
+			check_roll();
+			timer_shard_wait(timer, private_info);
+		}
+		goto end;
+	}
+
 	while (globals.RUNNING == 1 && private_info->ready && TIMER_MATRIX[timer->interval].tick < private_info->reference) {
 		check_roll();
 
@@ -663,7 +1082,7 @@ static switch_status_t timer_check(switch_timer_t *timer, switch_bool_t step)
 
 	check_roll();
 
-	timer->tick = TIMER_MATRIX[timer->interval].tick;
+	timer->tick = private_info->matrix->tick;
 
 	if (timer->tick < private_info->reference) {
 		timer->diff = private_info->reference - timer->tick;
@@ -684,7 +1103,9 @@ static switch_status_t timer_check(switch_timer_t *timer, switch_bool_t step)
 static switch_status_t timer_destroy(switch_timer_t *timer)
 {
 	timer_private_t *private_info = timer->private_info;
-	if (timer->interval < MAX_ELEMENTS) {
+	if (private_info && private_info->shard) {
+		timer_shard_detach(timer, private_info);
+	} else if (timer->interval < MAX_ELEMENTS) {
 		switch_mutex_lock(globals.mutex);
 		TIMER_MATRIX[timer->interval].count--;
 		if (TIMER_MATRIX[timer->interval].count == 0) {
@@ -848,6 +1269,8 @@ SWITCH_MODULE_RUNTIME_FUNCTION(softtimer_runtime)
 	globals.use_cond_yield = COND;
 	globals.RUNNING = 1;
 
+	timer_shards_start();
+
 	while (globals.RUNNING == 1) {
 
 #ifdef HAVE_TIMERFD_CREATE
@@ -1007,6 +1430,8 @@ SWITCH_MODULE_RUNTIME_FUNCTION(softtimer_runtime)
 	}
 
 	globals.use_cond_yield = 0;
+
+	timer_shards_stop();
 	
 	for (x = (runtime.microseconds_per_tick / 1000); x <= MAX_ELEMENTS; x += (runtime.microseconds_per_tick / 1000)) {
 		if (TIMER_MATRIX[x].mutex && switch_mutex_trylock(TIMER_MATRIX[x].mutex) == SWITCH_STATUS_SUCCESS) {
@@ -106,6 +106,8 @@ static switch_bool_t USE_UTF_8_ENCODING = SWITCH_TRUE;
 
 static int preprocess(const char *cwd, const char *file, int write_fd, int rlevel);
 
+struct xml_root_index;
+
 typedef struct switch_xml_root *switch_xml_root_t;
 struct switch_xml_root {		/* additional data for the root tag */
 	struct switch_xml xml;		/* is a super-struct built on top of switch_xml struct */
@@ -121,6 +123,7 @@ struct switch_xml_root {		/* additional data for the root tag */
 	char ***pi;					/* processing instructions */
 	short standalone;			/* non-zero if <?xml standalone="yes"?> */
 	char err[SWITCH_XML_ERRL];	/* error string */
+	struct xml_root_index *index;	/* lookup tables, only on the published root */
 };
 
 char *SWITCH_XML_NIL[] = { NULL };	/* empty, null terminated array of strings */
@@ -141,6 +144,9 @@ static switch_thread_rwlock_t *B_RWLOCK = NULL;
 static switch_mutex_t *XML_LOCK = NULL;
 static switch_mutex_t *CACHE_MUTEX = NULL;
 static switch_mutex_t *REFLOCK = NULL;
+/* readers of MAIN_XML_ROOT announce themselves in the counter of the current epoch */
+static volatile switch_atomic_t ROOT_EPOCH = 0;
+static volatile switch_atomic_t ROOT_READERS[2] = { 0 };
 static switch_mutex_t *FILE_LOCK = NULL;
 static switch_mutex_t *XML_GEN_LOCK = NULL;
 
@@ -1580,6 +1586,218 @@ SWITCH_DECLARE(switch_xml_t) switch_xml_parse_file(const char *file)
 	return xml;
 }
 
+/* users of one domain in the order find_user_in_tag() would meet them */
+typedef struct xml_domain_index {
+	switch_xml_t domain;
+	switch_hash_t *names;		/* id or number-alias -> ordinal + 1 */
+	switch_xml_t *users;
+	switch_xml_t *groups;
+	uint32_t count;
+	uint32_t size;
+	uint32_t typed;				/* first user with a type other than pointer, those match any name */
+	struct xml_domain_index *next;
+} xml_domain_index_t;
+
+struct xml_root_index {
+	switch_hash_t *nodes;		/* section/tag/name -> first such tag */
+	switch_hash_t *domains;		/* domain name -> xml_domain_index_t */
+	xml_domain_index_t *domain_list;
+	uint32_t node_count;
+	uint32_t user_count;
+};
+
+/* attribute values match case-insensitively and tag names case-sensitively, like switch_xml_find_child(), so only the tag keeps its case */
+static const char *xml_index_key(char *buf, switch_size_t len, const char *section, const char *tag_name, const char *value)
+{
+	switch_size_t i, tag_start = 0, tag_end = 0;
+
+	if (tag_name) {
+		switch_snprintf(buf, len, "%s/%s/%s", section, tag_name, value);
+		tag_start = strlen(section) + 1;
+		tag_end = tag_start + strlen(tag_name);
+	} else {
+		switch_copy_string(buf, section, len);
+	}
+
+	for (i = 0; buf[i]; i++) {
+		if (i < tag_start || i >= tag_end) {
+			buf[i] = (char) tolower((unsigned char) buf[i]);
+		}
+	}
+
+	return buf;
+}
+
+static void xml_index_add_name(xml_domain_index_t *di, const char *name, uint32_t ordinal)
+{
+	char key[512];
+
+	if (!zstr(name) && !switch_core_hash_find(di->names, xml_index_key(key, sizeof(key), name, NULL, NULL))) {
+		switch_core_hash_insert(di->names, key, (void *) (intptr_t) (ordinal + 1));
+	}
+}
+
+static void xml_index_add_users(xml_domain_index_t *di, switch_xml_t tag, switch_xml_t group)
+{
+	switch_xml_t user;
+
+	for (user = switch_xml_child(tag, "user"); user; user = user->next) {
+		const char *type = switch_xml_attr(user, "type");
+
+		if (di->count == di->size) {
+			di->size = di->size ? di->size * 2 : 64;
+			di->users = realloc(di->users, di->size * sizeof(switch_xml_t));
+			di->groups = realloc(di->groups, di->size * sizeof(switch_xml_t));
+			switch_assert(di->users && di->groups);
+		}
+
+		di->users[di->count] = user;
+		di->groups[di->count] = group;
+
+		xml_index_add_name(di, switch_xml_attr(user, "id"), di->count);
+		xml_index_add_name(di, switch_xml_attr(user, "number-alias"), di->count);
+
+		if (type && strcasecmp(type, "pointer") && di->typed == UINT32_MAX) {
+			di->typed = di->count;
+		}
+
+		di->count++;
+	}
+}
+
+static void xml_index_destroy(struct xml_root_index *index)
+{
+	xml_domain_index_t *di;
+
+	while ((di = index->domain_list)) {
+		index->domain_list = di->next;
+		switch_core_hash_destroy(&di->names);
+		switch_safe_free(di->users);
+		switch_safe_free(di->groups);
+		free(di);
+	}
+
+	switch_core_hash_destroy(&index->nodes);
+	switch_core_hash_destroy(&index->domains);
+	free(index);
+}
+
+/* the named children of every section and the users of every domain, so lookups in the published root skip the walk */
+static struct xml_root_index *xml_index_build(switch_xml_t root)
+{
+	struct xml_root_index *index;
+	switch_xml_t section, kind, tag;
+	char key[512];
+
+	switch_zmalloc(index, sizeof(*index));
+	switch_core_hash_init(&index->nodes, NULL);
+	switch_core_hash_init(&index->domains, NULL);
+
+	for (section = switch_xml_child(root, "section"); section; section = section->next) {
+		const char *sname = switch_xml_attr(section, "name");
+
+		/* only the first section of a name is ever searched */
+		if (!sname || switch_core_hash_find(index->nodes, xml_index_key(key, sizeof(key), sname, NULL, NULL))) {
+			continue;
+		}
+		switch_core_hash_insert(index->nodes, key, section);
+
+		for (kind = section->child; kind; kind = kind->sibling) {
+			for (tag = kind; tag; tag = tag->next) {
+				const char *name = switch_xml_attr(tag, "name");
+
+				if (name && !switch_core_hash_find(index->nodes, xml_index_key(key, sizeof(key), sname, tag->name, name))) {
+					switch_core_hash_insert(index->nodes, key, tag);
+					index->node_count++;
+				}
+			}
+		}
+
+		if (!strcasecmp(sname, "directory")) {
+			for (tag = switch_xml_child(section, "domain"); tag; tag = tag->next) {
+				const char *name = switch_xml_attr(tag, "name");
+				switch_xml_t groups, group;
+				xml_domain_index_t *di;
+
+				if (!name || switch_core_hash_find(index->domains, xml_index_key(key, sizeof(key), name, NULL, NULL))) {
+					continue;
+				}
+
+				switch_zmalloc(di, sizeof(*di));
+				di->domain = tag;
+				di->typed = UINT32_MAX;
+				switch_core_hash_init(&di->names, NULL);
+
+				if ((groups = switch_xml_child(tag, "groups"))) {
+					for (group = switch_xml_child(groups, "group"); group; group = group->next) {
+						xml_index_add_users(di, switch_xml_child(group, "users"), group);
+					}
+				}
+				xml_index_add_users(di, tag, NULL);
+
+				switch_core_hash_insert(index->domains, key, di);
+				di->next = index->domain_list;
+				index->domain_list = di;
+				index->user_count += di->count;
+			}
+		}
+	}
+
+	return index;
+}
+
+static struct xml_root_index *xml_index_of(switch_xml_t xml)
+{
+	return xml && !xml->parent && xml->is_switch_xml_root_t ? ((switch_xml_root_t) xml)->index : NULL;
+}
+
+/* SWITCH_TRUE when the index of xml could answer; *tag is what switch_xml_find_child() would have found */
+static switch_bool_t xml_index_find_node(switch_xml_t xml, const char *section, const char *tag_name, const char *key_name, const char *key_value,
+										 switch_xml_t *tag)
+{
+	struct xml_root_index *index = xml_index_of(xml);
+	char key[512];
+
+	if (!index || !section || !tag_name || !key_value || !key_name || strcasecmp(key_name, "name")) {
+		return SWITCH_FALSE;
+	}
+
+	*tag = switch_core_hash_find(index->nodes, xml_index_key(key, sizeof(key), section, tag_name, key_value));
+
+	return SWITCH_TRUE;
+}
+
+/* SWITCH_TRUE when domain is indexed in root; *user and *group are what the group walk in switch_xml_locate_user() would have found */
+static switch_bool_t xml_index_find_user(switch_xml_t root, switch_xml_t domain, const char *user_name, switch_xml_t *user, switch_xml_t *group)
+{
+	struct xml_root_index *index = xml_index_of(root);
+	const char *name = switch_xml_attr(domain, "name");
+	xml_domain_index_t *di;
+	uint32_t ordinal;
+	char key[512];
+
+	if (!index || !name || !(di = switch_core_hash_find(index->domains, xml_index_key(key, sizeof(key), name, NULL, NULL))) || di->domain != domain) {
+		return SWITCH_FALSE;
+	}
+
+	ordinal = (uint32_t) (intptr_t) switch_core_hash_find(di->names, xml_index_key(key, sizeof(key), user_name, NULL, NULL));
+	ordinal = ordinal ? ordinal - 1 : UINT32_MAX;
+
+	if (di->typed < ordinal) {
+		ordinal = di->typed;
+	}
+
+	if (ordinal == UINT32_MAX) {
+		*user = NULL;
+		*group = NULL;
+	} else {
+		*user = di->users[ordinal];
+		*group = di->groups[ordinal];
+	}
+
+	return SWITCH_TRUE;
+}
+
 SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 												  const char *tag_name,
 												  const char *key_name,
@@ -1637,7 +1855,14 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate(const char *section,
 			}
 		}
 
-		if ((conf = switch_xml_find_child(xml, "section", "name", section)) && (tag = switch_xml_find_child(conf, tag_name, key_name, key_value))) {
+		if (!xml_index_find_node(xml, section, tag_name, key_name, key_value, &tag)) {
+			tag = NULL;
+			if ((conf = switch_xml_find_child(xml, "section", "name", section))) {
+				tag = switch_xml_find_child(conf, tag_name, key_name, key_value);
+			}
+		}
+
+		if (tag) {
 			if (clone) {
 				char *x = switch_xml_toxml(tag, SWITCH_FALSE);
 				switch_assert(x);
@@ -1975,6 +2200,17 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user(const char *key,
 
 	status = SWITCH_STATUS_FALSE;
 
+	if (!ip && user_name && !strcasecmp(key, "id") && !switch_event_get_header(params, "user_type") &&
+		xml_index_find_user(*root, *domain, user_name, user, &group)) {
+		if (*user) {
+			if (ingroup) {
+				*ingroup = group;
+			}
+			status = SWITCH_STATUS_SUCCESS;
+		}
+		goto end;
+	}
+
 	if ((groups = switch_xml_child(*domain, "groups"))) {
 		for (group = switch_xml_child(groups, "group"); group; group = group->next) {
 			if ((users = switch_xml_child(group, "users"))) {
@@ -2010,12 +2246,24 @@ SWITCH_DECLARE(switch_status_t) switch_xml_locate_user(const char *key,
 SWITCH_DECLARE(switch_xml_t) switch_xml_root(void)
 {
 	switch_xml_t xml;
+	uint32_t epoch;
+
+	/* switch_xml_set_root() waits for this counter before dropping the root we may be about to ref,
+	   it only covers us if the epoch did not move on between reading it and registering */
+	for (;;) {
+		epoch = switch_atomic_read(&ROOT_EPOCH);
+		switch_atomic_inc(&ROOT_READERS[epoch & 1]);
+		if (switch_atomic_read(&ROOT_EPOCH) == epoch) {
+			break;
+		}
+		switch_atomic_dec(&ROOT_READERS[epoch & 1]);
+	}
+
+	if ((xml = MAIN_XML_ROOT)) {
+		switch_atomic_inc((switch_atomic_t *) &xml->refs);
+	}
+	switch_atomic_dec(&ROOT_READERS[epoch & 1]);
 
-	switch_mutex_lock(REFLOCK);
-	xml = MAIN_XML_ROOT;
-	xml->refs++;
-	switch_mutex_unlock(REFLOCK);
-	
 	return xml;
 }
 
@@ -2056,25 +2304,42 @@ SWITCH_DECLARE(void) switch_xml_free_in_thread(switch_xml_t xml, int stacksize)
 
 static char not_so_threadsafe_error_buffer[256] = "";
 
+/* wait until every switch_xml_root() that may have seen the previous MAIN_XML_ROOT has taken its ref */
+static void xml_root_synchronize(void)
+{
+	uint32_t epoch = switch_atomic_read(&ROOT_EPOCH) & 1;
+
+	switch_atomic_inc(&ROOT_EPOCH);
+
+	while (switch_atomic_read(&ROOT_READERS[epoch])) {
+		switch_cond_next();
+	}
+}
+
 SWITCH_DECLARE(switch_status_t) switch_xml_set_root(switch_xml_t new_main)
 {
 	switch_xml_t old_root = NULL;
-	
+	switch_time_t start = switch_time_now();
+	struct xml_root_index *index;
+
+	/* only serializes publishers, readers never take it */
 	switch_mutex_lock(REFLOCK);
 
+	switch_set_flag(new_main, SWITCH_XML_ROOT);
+	switch_atomic_inc((switch_atomic_t *) &new_main->refs);
+
+	if (!new_main->parent && new_main->is_switch_xml_root_t && !((switch_xml_root_t) new_main)->index) {
+		index = ((switch_xml_root_t) new_main)->index = xml_index_build(new_main);
+		switch_log_printf(SWITCH_CHANNEL_LOG, SWITCH_LOG_DEBUG, "Indexed %u named tags and %u users in %" SWITCH_TIME_T_FMT "us\n",
+						  index->node_count, index->user_count, switch_time_now() - start);
+	}
+
 	old_root = MAIN_XML_ROOT;
-	MAIN_XML_ROOT = new_main;
-	switch_set_flag(MAIN_XML_ROOT, SWITCH_XML_ROOT);
-	MAIN_XML_ROOT->refs++;
-			
-	if (old_root) {
-		if (old_root->refs) {
-			old_root->refs--;
-		}
+	switch_atomic_casptr((volatile void **) &MAIN_XML_ROOT, new_main, old_root);
 
-		if (!old_root->refs) {
-			switch_xml_free(old_root);
-		}
+	if (old_root) {
+		xml_root_synchronize();
+		switch_xml_free(old_root);
 	}
 
 	switch_mutex_unlock(REFLOCK);
@@ -2205,7 +2470,8 @@ SWITCH_DECLARE(switch_status_t) switch_xml_destroy(void)
 
 	if (MAIN_XML_ROOT) {
 		switch_xml_t xml = MAIN_XML_ROOT;
-		MAIN_XML_ROOT = NULL;
+		switch_atomic_casptr((volatile void **) &MAIN_XML_ROOT, NULL, xml);
+		xml_root_synchronize();
 		switch_xml_free(xml);
 		status = SWITCH_STATUS_SUCCESS;
 	}
@@ -2561,14 +2827,9 @@ SWITCH_DECLARE(void) switch_xml_free(switch_xml_t xml)
 		return;
 	}
 
+	/* a published root holds a ref of its own from switch_xml_set_root(), so this never goes below zero */
 	if (switch_test_flag(xml, SWITCH_XML_ROOT)) {
-		switch_mutex_lock(REFLOCK);
-
-		if (xml->refs) {
-			xml->refs--;
-			refs = xml->refs;
-		}
-		switch_mutex_unlock(REFLOCK);
+		refs = switch_atomic_dec((switch_atomic_t *) &xml->refs);
 	}
 
 	if (refs) {
@@ -2588,6 +2849,11 @@ SWITCH_DECLARE(void) switch_xml_free(switch_xml_t xml)
 	/*switch_xml_free(xml->ordered); */
 
 	if (!xml->parent) {			/* free root tag allocations */
+		if (xml->is_switch_xml_root_t && root->index) {
+			xml_index_destroy(root->index);
+			root->index = NULL;
+		}
+
 #if (_MSC_VER >= 1400)			// VC8+
 		__analysis_assume(sizeof(root->ent) > 44);	/* tail recursion confuses code analysis */
 #endif